@@ -1,11 +1,13 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gst/gst.h>
 #include "loader.h"
 #include "layout.h"
 #include "lipsync.h"
 #include "markertype.h"
+#include "workers.h"
 
 GST_DEBUG_CATEGORY(tvg_analyzer_debug);
 #define GST_CAT_DEFAULT tvg_analyzer_debug
@@ -15,34 +17,103 @@ typedef struct {
   GArray *markers; /* marker_t, detected markers */
   int num_frames;
   GArray *lipsync_markers; /* lipsync_marker_t, detected beeps */
-  GArray *frame_data; /* char*, detected marker states in frames */
-  GArray *frame_times; /* GstClockTime */
+  framestore_t *frames; /* Marker states, color of the most changing pixel and time of the frames */
   int mc_x, mc_y; /* Coordinates for most changing pixel */
-  GArray *frame_colors; /* char*, detected marker color for most changing pixel */
   GArray *warnings;
   int rgb6_marker_index; /* Index of the RGB6 marker */
   int samplerate; /* Audio samplerate */
+  GstClockTime duration; /* Length of the video, or GST_CLOCK_TIME_NONE */
+  videoinfo_t *videoinfo; /* Detected marker types and video structure */
 } main_state_t;
 
-/* First pass through the input video:
- * - Count number of frames
- * - Detect the location of markers in video
- */
-bool first_pass(main_state_t *main_state, GError **error)
+/* Command line options */
+static gboolean single_pass_mode = FALSE;
+static gint num_threads = 1;
+static gint converge_frames = 600;
+static gint scan_interval = 1;
+static gint segment_workers = 1;
+
+static GOptionEntry option_entries[] = {
+  {"single-pass", '1', 0, G_OPTION_ARG_NONE, &single_pass_mode,
+   "Decode the video only once, unless the marker layout does not converge. "
+   "The color of the frames before the layout converged is not known and is "
+   "written as #------ in frames.txt", NULL},
+  {"threads", 't', 0, G_OPTION_ARG_INT, &num_threads,
+   "Threads for layout detection, 0 for the number of CPU cores (default 1)", "N"},
+  {"converge-frames", 'c', 0, G_OPTION_ARG_INT, &converge_frames,
+   "Stop layout detection once the layout has stayed the same for N frames, "
+   "0 to process the whole video (default 600)", "N"},
+  {"scan-interval", 's', 0, G_OPTION_ARG_INT, &scan_interval,
+   "Detect the layout from every Nth frame only, not in single pass mode. "
+   "N must be odd, even values are rounded up (default 1)", "N"},
+  {"segment-workers", 'j', 0, G_OPTION_ARG_INT, &segment_workers,
+   "Read the markers in N parallel time segments, 0 for the number of CPU cores (default 1)", "N"},
+  {NULL}
+};
+
+/* Limit for the memory used by the color history in single pass mode */
+#define HISTORY_MAX_BYTES (256 * 1024 * 1024)
+
+/* The layout is checked every CONVERGE_INTERVAL frames and it is final
+ * once it has stayed the same for converge_frames frames. The header and
+ * locator frames alone are not enough, because neighbouring markers only
+ * differ in the content frames. */
+#define CONVERGE_INTERVAL 30
+
+/* Layout seen at the previous check */
+typedef struct {
+  GArray *markers;
+  int stable_since;
+} converge_t;
+
+/* Start and end times of the streams, used to detect gaps */
+typedef struct {
+  GstClockTime video_start_time, audio_start_time;
+  GstClockTime video_end_time, audio_end_time;
+} timing_t;
+
+/* Check if the layout has converged. The markers are compared with
+ * layout_same_markers(), so the pixels that make up the marker areas
+ * have to stay the same too. */
+static bool check_converged(converge_t *converge, layout_t *layout_state, int num_frames)
+{
+  GArray *current;
+  
+  if (converge_frames <= 0 || num_frames % CONVERGE_INTERVAL != 0)
+    return false;
+  
+  current = layout_fetch(layout_state);
+  if (converge->markers == NULL || !layout_same_markers(converge->markers, current))
+  {
+    converge->stable_since = num_frames;
+  }
+  
+  if (converge->markers != NULL)
+    g_array_free(converge->markers, TRUE);
+  converge->markers = current;
+  
+  return current->len > 0 && num_frames - converge->stable_since >= converge_frames;
+}
+
+/* Open the input video and print the information about its format */
+static loader_t *open_input(main_state_t *main_state, int *width, int *height,
+                            int *stride, GError **error)
 {
-  int width, height, stride;
-  layout_t *layout_state;
   loader_t *loader_state;
   float framerate;
   
   *error = NULL;
   loader_state = loader_open(main_state->filename, error);
   if (*error != NULL)
-    return false;
+  {
+    loader_close(loader_state);
+    return NULL;
+  }
   
-  loader_get_resolution(loader_state, &width, &height, &stride);
+  loader_get_resolution(loader_state, width, height, stride);
   main_state->samplerate = loader_get_samplerate(loader_state);
   framerate = loader_get_framerate(loader_state);
+  main_state->duration = loader_get_duration(loader_state);
   
   printf("{\n");
   printf("    \"file\":           \"%s\",\n", main_state->filename); 
@@ -52,7 +123,7 @@ bool first_pass(main_state_t *main_state, GError **error)
   printf("    \"muxer\":          \"%s\",\n", loader_get_mux(loader_state));
   printf("    \"video_encoder\":  \"%s\",\n", loader_get_video_encoder(loader_state));
   printf("    \"audio_encoder\":  \"%s\",\n", loader_get_audio_encoder(loader_state));
-  printf("    \"resolution\":     [%d,%d],\n", width, height);
+  printf("    \"resolution\":     [%d,%d],\n", *width, *height);
   
   if (framerate != 0)
     printf("    \"framerate\":    %8.2f,\n", framerate);
@@ -61,12 +132,123 @@ bool first_pass(main_state_t *main_state, GError **error)
   
   printf("    \"audio_rate\":   %8d,\n", main_state->samplerate);
   
+  return loader_state;
+}
+
+static void timing_init(timing_t *timing)
+{
+  timing->video_start_time = GST_CLOCK_TIME_NONE;
+  timing->audio_start_time = GST_CLOCK_TIME_NONE;
+  timing->video_end_time = 0;
+  timing->audio_end_time = 0;
+}
+
+/* Warn about gaps between video frames */
+static void check_video_time(main_state_t *main_state, timing_t *timing,
+                             GstBuffer *video_buf, GstClockTime video_time, int num_frames)
+{
+  if (!GST_CLOCK_TIME_IS_VALID(timing->video_start_time))
+  {
+    /* First frame */
+    timing->video_start_time = video_time;
+  }
+  else
+  {
+    GstClockTimeDiff delta = GST_CLOCK_DIFF(timing->video_end_time, video_time);
+    if (delta < -GST_MSECOND || delta > GST_MSECOND)
+    {
+      gchar* m = g_strdup_printf(
+             "Gap in video times (frame %d, offset = %0.3f s)",
+             num_frames, (float)delta / GST_SECOND);
+      g_array_append_val(main_state->warnings, m);
+    }
+  }
+  
+  timing->video_end_time = video_time + video_buf->duration;
+}
+
+/* Warn about gaps between audio buffers */
+static void check_audio_time(main_state_t *main_state, timing_t *timing,
+                             GstBuffer *audio_buf, GstClockTime audio_time)
+{
+  if (!GST_CLOCK_TIME_IS_VALID(timing->audio_start_time))
+  {
+    timing->audio_start_time = audio_time;
+  }
+  else
+  {
+    GstClockTimeDiff delta = GST_CLOCK_DIFF(timing->audio_end_time, audio_time);
+    if (delta < -GST_MSECOND || delta > GST_MSECOND)
+    {
+      gchar* m = g_strdup_printf(
+             "Gap in audio times (at %0.3f s, offset = %0.3f s)",
+             (float)timing->audio_end_time / GST_SECOND, (float)delta / GST_SECOND);
+      g_array_append_val(main_state->warnings, m);
+    }
+  }
+  
+  timing->audio_end_time = audio_time + audio_buf->duration;
+}
+
+/* Print the stream lengths and check that the streams start together */
+static void print_timing(main_state_t *main_state, timing_t *timing, int num_frames)
+{
+  main_state->num_frames = num_frames;
+  printf("    \"total_frames\": %8d,\n", num_frames);
+  printf("    \"video_length\": %8.3f,\n", (float)timing->video_end_time / GST_SECOND);
+  printf("    \"audio_length\": %8.3f,\n", (float)timing->audio_end_time / GST_SECOND);
+  
+  if (GST_CLOCK_TIME_IS_VALID(timing->video_start_time) &&
+      GST_CLOCK_TIME_IS_VALID(timing->audio_start_time))
+  {
+    if (abs(timing->video_start_time - timing->audio_start_time) > GST_MSECOND)
+    {
+      gchar* m = g_strdup_printf(
+        "Audio and video start at different times (audio = %0.3f s, video = %0.3f s)",
+        (float)timing->audio_start_time / GST_SECOND, (float)timing->video_start_time / GST_SECOND);
+      g_array_append_val(main_state->warnings, m);
+    }
+  }
+}
+
+static void print_layout(main_state_t *main_state)
+{
+  printf("    \"markers_found\":%8d,\n", main_state->markers->len);
+  printf("    \"most_changing_pixel\": [%4d,%4d],\n", main_state->mc_x, main_state->mc_y);
+}
+
+/* Release the samples of an iteration that stops on an error */
+static void drop_samples(GstSample *audio_sample, GstSample *video_sample)
+{
+  if (audio_sample != NULL)
+    gst_sample_unref(audio_sample);
+  if (video_sample != NULL)
+    gst_sample_unref(video_sample);
+}
+
+/* First pass through the input video:
+ * - Count number of frames
+ * - Detect the location of markers in video, until the layout converges
+ */
+bool first_pass(main_state_t *main_state, GError **error)
+{
+  int width, height, stride;
+  layout_t *layout_state;
+  loader_t *loader_state;
+  timing_t timing;
+  converge_t converge = {NULL, 0};
+  bool converged = false;
+  
+  loader_state = open_input(main_state, &width, &height, &stride, error);
+  if (loader_state == NULL)
+    return false;
+  
   layout_state = layout_create(width, height);
+  layout_set_threads(layout_state, num_threads);
+  timing_init(&timing);
   
   int num_frames = 0;
   GstSample *audio_sample, *video_sample;
-  GstClockTime video_start_time = GST_CLOCK_TIME_NONE, audio_start_time = GST_CLOCK_TIME_NONE;
-  GstClockTime video_end_time = 0, audio_end_time = 0;
   while (loader_get_buffer(loader_state, &audio_sample, &video_sample, error))
   {
     if (video_sample != NULL)
@@ -86,32 +268,29 @@ bool first_pass(main_state_t *main_state, GError **error)
         fflush(stdout);
       }
       
+      if (!converged && (num_frames - 1) % scan_interval == 0)
       {
-        GstMapInfo mapinfo;
-        gst_buffer_map(video_buf, &mapinfo, GST_MAP_READ);
-        layout_process(layout_state, mapinfo.data, stride);
-        gst_buffer_unmap(video_buf, &mapinfo);
-      }
-      
-      if (!GST_CLOCK_TIME_IS_VALID(video_start_time))
-      {
-        /* First frame */
-        video_start_time = video_time;
-      }
-      else
-      {
-        GstClockTimeDiff delta = GST_CLOCK_DIFF(video_end_time, video_time);
-        if (delta < -GST_MSECOND || delta > GST_MSECOND)
+        GstVideoFrame vframe;
+        frame_t frame;
+        if (!loader_map_frame(video_sample, &vframe, &frame, error))
         {
-          gchar* m = g_strdup_printf(
-                 "Gap in video times (frame %d, offset = %0.3f s)",
-                 num_frames, (float)delta / GST_SECOND);
-          g_array_append_val(main_state->warnings, m);
+          drop_samples(audio_sample, video_sample);
+          break;
         }
+        
+        layout_process(layout_state, &frame);
+        gst_video_frame_unmap(&vframe);
       }
       
-      video_end_time = video_time + video_buf->duration;
+      check_video_time(main_state, &timing, video_buf, video_time, num_frames);
       gst_sample_unref(video_sample);
+      
+      if (!converged && check_converged(&converge, layout_state, num_frames))
+      {
+        /* The rest of the video is only needed for the frame count */
+        GST_INFO("Layout converged at frame %d", num_frames);
+        converged = true;
+      }
     }
     
     if (audio_sample != NULL)
@@ -121,54 +300,248 @@ bool first_pass(main_state_t *main_state, GError **error)
                                                             GST_FORMAT_TIME,
                                                             GST_BUFFER_PTS(audio_buf));
       
+      check_audio_time(main_state, &timing, audio_buf, audio_time);
+      gst_sample_unref(audio_sample);
+    }
+    
+    if (*error != NULL)
+      break;
+  }
+  
+  if (*error != NULL)
+  {
+    if (converge.markers != NULL)
+      g_array_free(converge.markers, TRUE);
+    layout_free(layout_state);
+    loader_close(loader_state);
+    return false;
+  }
+  
+  print_timing(main_state, &timing, num_frames);
+  
+  if (converge.markers != NULL)
+    g_array_free(converge.markers, TRUE);
+  
+  main_state->markers = layout_fetch(layout_state);
+  layout_most_changing_pixel(layout_state, &main_state->mc_x, &main_state->mc_y);
+  print_layout(main_state);
+  
+  loader_close(loader_state);
+  layout_free(layout_state);
+  return true;
+}
+
+/* Read the marker states and the color of the most changing pixel */
+static void read_frame(main_state_t *main_state, framestore_t *frames,
+                       const frame_t *frame, GstClockTime time)
+{
+  uint8_t *codes = g_alloca(main_state->markers->len);
+  uint32_t color;
+  
+  layout_read_markers(main_state->markers, frame, codes);
+  color = layout_sample_color(frame, main_state->mc_x, main_state->mc_y);
+  framestore_append(frames, codes, color, time);
+}
+
+/* Take the layout detected so far into use, if it is known to cover
+ * all the frames seen so far. The marker states of those frames come
+ * from the color history. The color of the most changing pixel is
+ * not known for them. */
+static bool use_layout(main_state_t *main_state, layout_t *layout_state, GArray *markers,
+                       GArray *frame_times)
+{
+  framestore_t *frames = layout_history_markers(layout_state, markers, frame_times);
+  
+  if (frames == NULL)
+    return false;
+  
+  main_state->markers = markers;
+  main_state->frames = frames;
+  layout_most_changing_pixel(layout_state, &main_state->mc_x, &main_state->mc_y);
+  
+  return true;
+}
+
+/* Single pass through the input video, for when decoding the video
+ * twice would take too long:
+ * - Count number of frames
+ * - Detect the location of markers, until the layout converges
+ * - Read the states of video markers
+ * - Detect audio markers
+ * If the layout does not converge before the color history fills up,
+ * the rest of the pass only detects the layout and *need_second_pass
+ * is set.
+ */
+bool single_pass(main_state_t *main_state, bool *need_second_pass, GError **error)
+{
+  int width, height, stride;
+  layout_t *layout_state;
+  loader_t *loader_state;
+  lipsync_t *lipsync_state;
+  timing_t timing;
+  converge_t converge = {NULL, 0};
+  GArray *markers;
+  GArray *frame_times; /* GstClockTime, of the frames before the layout is known */
+  bool converged = false;
+  bool layout_final = false;
+  
+  *need_second_pass = false;
+  loader_state = open_input(main_state, &width, &height, &stride, error);
+  if (loader_state == NULL)
+    return false;
+  
+  layout_state = layout_create(width, height);
+  layout_set_threads(layout_state, num_threads);
+  layout_record_history(layout_state, HISTORY_MAX_BYTES);
+  lipsync_state = lipsync_create(main_state->samplerate);
+  timing_init(&timing);
+  
+  frame_times = g_array_new(false, false, sizeof(GstClockTime));
+  
+  int num_frames = 0;
+  GstSample *audio_sample, *video_sample;
+  while (loader_get_buffer(loader_state, &audio_sample, &video_sample, error))
+  {
+    if (video_sample != NULL)
+    {
+      num_frames++;
+      
+      GstBuffer *video_buf = gst_sample_get_buffer(video_sample);
+      GstClockTime video_time = gst_segment_to_running_time(gst_sample_get_segment(video_sample),
+                                                            GST_FORMAT_TIME,
+                                                            GST_BUFFER_PTS(video_buf));
       
-      if (!GST_CLOCK_TIME_IS_VALID(audio_start_time))
+      if (isatty(1))
       {
-        audio_start_time = audio_time;
+        printf("[%5d]  \r", num_frames);
+        fflush(stdout);
       }
-      else
+      
       {
-        GstClockTimeDiff delta = GST_CLOCK_DIFF(audio_end_time, audio_time);
-        if (delta < -GST_MSECOND || delta > GST_MSECOND)
+        GstVideoFrame vframe;
+        frame_t frame;
+        if (!loader_map_frame(video_sample, &vframe, &frame, error))
+        {
+          drop_samples(audio_sample, video_sample);
+          break;
+        }
+        
+        if (converged)
         {
-          gchar* m = g_strdup_printf(
-                 "Gap in audio times (at %0.3f s, offset = %0.3f s)",
-                 (float)audio_end_time / GST_SECOND, (float)delta / GST_SECOND);
-          g_array_append_val(main_state->warnings, m);
+          read_frame(main_state, main_state->frames, &frame, video_time);
+        }
+        else if (!layout_final)
+        {
+          layout_process(layout_state, &frame);
+        }
+        
+        gst_video_frame_unmap(&vframe);
+      }
+      
+      if (!converged && !*need_second_pass)
+        g_array_append_val(frame_times, video_time);
+      
+      check_video_time(main_state, &timing, video_buf, video_time, num_frames);
+      gst_sample_unref(video_sample);
+      
+      if (!converged && !layout_final &&
+          check_converged(&converge, layout_state, num_frames))
+      {
+        GST_INFO("Layout converged at frame %d", num_frames);
+        
+        if (*need_second_pass)
+        {
+          /* The rest of the video is only needed for the frame count */
+          layout_final = true;
+        }
+        else if (use_layout(main_state, layout_state, converge.markers, frame_times))
+        {
+          converged = true;
+          converge.markers = NULL;
+          layout_free(layout_state);
+          layout_state = NULL;
         }
       }
       
-      audio_end_time = audio_time + audio_buf->duration;
-      gst_buffer_unref(audio_buf);
+      if (!converged && !*need_second_pass && !layout_history_complete(layout_state))
+      {
+        /* Continue as the first pass of two */
+        GST_INFO("Layout did not converge, falling back to two passes");
+        *need_second_pass = true;
+      }
+    }
+    
+    if (audio_sample != NULL)
+    {
+      GstBuffer *audio_buf = gst_sample_get_buffer(audio_sample);
+      GstClockTime audio_time = gst_segment_to_running_time(gst_sample_get_segment(audio_sample),
+                                                            GST_FORMAT_TIME,
+                                                            GST_BUFFER_PTS(audio_buf));
+      
+      check_audio_time(main_state, &timing, audio_buf, audio_time);
+      
+      if (!*need_second_pass)
+      {
+        GstMapInfo mapinfo;
+        gst_buffer_map(audio_buf, &mapinfo, GST_MAP_READ);
+        
+        lipsync_process(lipsync_state, audio_time, main_state->samplerate,
+                        (const int16_t*)mapinfo.data, mapinfo.size / 2);
+        
+        gst_buffer_unmap(audio_buf, &mapinfo);
+      }
+      gst_sample_unref(audio_sample);
     }
     
     if (*error != NULL)
-      return false;
+      break;
   }
   
-  main_state->num_frames = num_frames;
-  printf("    \"total_frames\": %8d,\n", num_frames);
-  printf("    \"video_length\": %8.3f,\n", (float)video_end_time / GST_SECOND);
-  printf("    \"audio_length\": %8.3f,\n", (float)audio_end_time / GST_SECOND);
+  if (*error != NULL)
+  {
+    if (converge.markers != NULL)
+      g_array_free(converge.markers, TRUE);
+    if (main_state->frames != NULL)
+    {
+      framestore_free(main_state->frames);
+      main_state->frames = NULL;
+    }
+    g_array_free(frame_times, TRUE);
+    lipsync_free(lipsync_state);
+    loader_close(loader_state);
+    if (layout_state != NULL)
+      layout_free(layout_state);
+    return false;
+  }
+  
+  print_timing(main_state, &timing, num_frames);
   
-  if (GST_CLOCK_TIME_IS_VALID(video_start_time) && GST_CLOCK_TIME_IS_VALID(audio_start_time))
+  if (converge.markers != NULL)
+    g_array_free(converge.markers, TRUE);
+  
+  if (!converged)
   {
-    if (abs(video_start_time - audio_start_time) > GST_MSECOND)
+    /* Short video, or no converge: use the layout of the whole video */
+    markers = layout_fetch(layout_state);
+    if (*need_second_pass || !use_layout(main_state, layout_state, markers, frame_times))
     {
-      gchar* m = g_strdup_printf(
-        "Audio and video start at different times (audio = %0.3f s, video = %0.3f s)",
-        (float)audio_start_time / GST_SECOND, (float)video_start_time / GST_SECOND);
-      g_array_append_val(main_state->warnings, m);
+      *need_second_pass = true;
+      main_state->markers = markers;
+      layout_most_changing_pixel(layout_state, &main_state->mc_x, &main_state->mc_y);
     }
   }
   
-  main_state->markers = layout_fetch(layout_state);
-  layout_most_changing_pixel(layout_state, &main_state->mc_x, &main_state->mc_y);
-  printf("    \"markers_found\":%8d,\n", main_state->markers->len);
-  printf("    \"most_changing_pixel\": [%4d,%4d],\n", main_state->mc_x, main_state->mc_y);
+  print_layout(main_state);
+  
+  /* Otherwise the second pass collects the frame data again */
+  if (!*need_second_pass)
+    main_state->lipsync_markers = lipsync_fetch(lipsync_state);
   
+  g_array_free(frame_times, TRUE);
+  lipsync_free(lipsync_state);
   loader_close(loader_state);
-  layout_free(layout_state);
+  if (layout_state != NULL)
+    layout_free(layout_state);
   return true;
 }
 
@@ -185,14 +558,15 @@ bool second_pass(main_state_t *main_state, GError **error)
   *error = NULL;
   loader_state = loader_open(main_state->filename, error);
   if (*error != NULL)
+  {
+    loader_close(loader_state);
     return false;
+  }
   
   loader_get_resolution(loader_state, &width, &height, &stride);
   
   lipsync_state = lipsync_create(main_state->samplerate);
-  main_state->frame_data = g_array_new(false, false, sizeof(char*));
-  main_state->frame_times = g_array_new(false, false, sizeof(GstClockTime));
-  main_state->frame_colors = g_array_new(false, false, sizeof(char*));
+  main_state->frames = framestore_create(main_state->markers->len);
   
   int num_frames = 0;
   GstSample *audio_sample, *video_sample;
@@ -214,19 +588,19 @@ bool second_pass(main_state_t *main_state, GError **error)
                                                             GST_BUFFER_PTS(video_buf));
       
       {
-        GstMapInfo mapinfo;
-        gst_buffer_map(video_buf, &mapinfo, GST_MAP_READ);
-        
-        char *states = layout_read_markers(main_state->markers, mapinfo.data, stride);
-        char *color = layout_sample_color(mapinfo.data, stride, main_state->mc_x, main_state->mc_y);
-        g_array_append_val(main_state->frame_data, states);
-        g_array_append_val(main_state->frame_times, video_time);
-        g_array_append_val(main_state->frame_colors, color);
+        GstVideoFrame vframe;
+        frame_t frame;
+        if (!loader_map_frame(video_sample, &vframe, &frame, error))
+        {
+          drop_samples(audio_sample, video_sample);
+          break;
+        }
         
-        gst_buffer_unmap(video_buf, &mapinfo);
+        read_frame(main_state, main_state->frames, &frame, video_time);
+        gst_video_frame_unmap(&vframe);
       }
       
-      gst_buffer_unref(video_buf);
+      gst_sample_unref(video_sample);
     }
     
     if (audio_sample != NULL)
@@ -245,11 +619,20 @@ bool second_pass(main_state_t *main_state, GError **error)
         
         gst_buffer_unmap(audio_buf, &mapinfo);
       }
-      gst_buffer_unref(audio_buf);
+      gst_sample_unref(audio_sample);
     }
     
     if (*error != NULL)
-      return false;
+      break;
+  }
+  
+  if (*error != NULL)
+  {
+    framestore_free(main_state->frames);
+    main_state->frames = NULL;
+    lipsync_free(lipsync_state);
+    loader_close(loader_state);
+    return false;
   }
   
   main_state->lipsync_markers = lipsync_fetch(lipsync_state);
@@ -258,10 +641,309 @@ bool second_pass(main_state_t *main_state, GError **error)
   return true;
 }
 
+/* The parallel second pass splits the video into time segments that are
+ * decoded by separate pipelines. Each frame and beep belongs to the segment
+ * that contains its time, the overlaps are only decoded to get the
+ * decoder and the lipsync detector into the same state as in a
+ * sequential pass. */
+#define SEGMENT_MIN_LENGTH (10 * GST_SECOND)
+#define SEGMENTS_PER_WORKER 4
+#define SEGMENT_OVERLAP GST_SECOND
+
+typedef struct {
+  GstClockTime start;
+  GstClockTime end; /* GST_CLOCK_TIME_NONE for the last segment */
+  framestore_t *frames;
+  GArray *lipsync_markers;
+  GError *error;
+} segment_t;
+
+/* Work-stealing queue of segments. Each worker starts with a contiguous
+ * range of segments and takes them from the front. A worker that runs out
+ * takes the last segment of the longest remaining range. */
+typedef struct {
+  main_state_t *main_state;
+  segment_t *segments;
+  int num_segments;
+  int segments_done;
+  GMutex lock;
+  int *next; /* Per worker, first segment not taken yet */
+  int *end;  /* Per worker, end of the range */
+} segment_queue_t;
+
+static bool segment_contains(const segment_t *segment, GstClockTime time)
+{
+  return time >= segment->start &&
+         (segment->end == GST_CLOCK_TIME_NONE || time < segment->end);
+}
+
+/* Read the markers and beeps of one segment */
+static void analyze_segment(main_state_t *main_state, segment_t *segment)
+{
+  GstClockTime decode_start = 0;
+  GstClockTime decode_end = GST_CLOCK_TIME_NONE;
+  loader_t *loader_state;
+  lipsync_t *lipsync_state;
+  bool video_done = false;
+  bool audio_done = (main_state->samplerate == 0);
+  bool audio_started = false;
+  GArray *beeps;
+  size_t i;
+  
+  if (segment->start > SEGMENT_OVERLAP)
+    decode_start = segment->start - SEGMENT_OVERLAP;
+  if (segment->end != GST_CLOCK_TIME_NONE)
+    decode_end = segment->end + SEGMENT_OVERLAP;
+  
+  loader_state = loader_open_at(main_state->filename, decode_start, &segment->error);
+  if (segment->error != NULL)
+  {
+    /* The pipeline may have prerolled already */
+    loader_close(loader_state);
+    return;
+  }
+  
+  lipsync_state = lipsync_create(main_state->samplerate);
+  segment->frames = framestore_create(main_state->markers->len);
+  segment->lipsync_markers = g_array_new(false, false, sizeof(lipsync_marker_t));
+  
+  GstSample *audio_sample, *video_sample;
+  while ((!video_done || !audio_done) &&
+         loader_get_buffer(loader_state, &audio_sample, &video_sample, &segment->error))
+  {
+    if (video_sample != NULL)
+    {
+      GstClockTime video_time = loader_get_time(loader_state, video_sample);
+      
+      if (segment_contains(segment, video_time))
+      {
+        GstVideoFrame vframe;
+        frame_t frame;
+        if (!loader_map_frame(video_sample, &vframe, &frame, &segment->error))
+        {
+          /* Stop the segment, the frames would not line up any more */
+          drop_samples(audio_sample, video_sample);
+          break;
+        }
+        
+        read_frame(main_state, segment->frames, &frame, video_time);
+        gst_video_frame_unmap(&vframe);
+      }
+      
+      video_done = (video_time != GST_CLOCK_TIME_NONE && video_time >= decode_end);
+      gst_sample_unref(video_sample);
+    }
+    
+    if (audio_sample != NULL)
+    {
+      GstBuffer *audio_buf = gst_sample_get_buffer(audio_sample);
+      GstClockTime audio_time = loader_get_time(loader_state, audio_sample);
+      
+      if (!audio_started)
+      {
+        /* Count the samples as if the detection had started from the
+         * beginning of the file */
+        GstClockTime audio_start = loader_get_audio_start(loader_state);
+        GstClockTime offset = (audio_time > audio_start) ? audio_time - audio_start : 0;
+        lipsync_set_sample_index(lipsync_state,
+                                 gst_util_uint64_scale_round(offset, main_state->samplerate,
+                                                             GST_SECOND));
+        audio_started = true;
+      }
+      
+      {
+        GstMapInfo mapinfo;
+        gst_buffer_map(audio_buf, &mapinfo, GST_MAP_READ);
+        
+        lipsync_process(lipsync_state, audio_time, main_state->samplerate,
+                        (const int16_t*)mapinfo.data, mapinfo.size / 2);
+        
+        gst_buffer_unmap(audio_buf, &mapinfo);
+      }
+      
+      audio_done = (audio_time != GST_CLOCK_TIME_NONE && audio_time >= decode_end);
+      gst_sample_unref(audio_sample);
+    }
+    
+    if (segment->error != NULL)
+      break;
+  }
+  
+  beeps = lipsync_fetch(lipsync_state);
+  for (i = 0; i < beeps->len; i++)
+  {
+    lipsync_marker_t *beep = &g_array_index(beeps, lipsync_marker_t, i);
+    if (segment_contains(segment, beep->start_time))
+      g_array_append_val(segment->lipsync_markers, *beep);
+  }
+  g_array_unref(beeps);
+  
+  GST_INFO("Segment %" GST_TIME_FORMAT " - %" GST_TIME_FORMAT ": %d frames, %d beeps",
+           GST_TIME_ARGS(segment->start), GST_TIME_ARGS(segment->end),
+           (int)framestore_length(segment->frames), segment->lipsync_markers->len);
+  
+  lipsync_free(lipsync_state);
+  loader_close(loader_state);
+}
+
+/* Take the next segment for the worker, or -1 if all have been taken */
+static int take_segment(segment_queue_t *queue, int worker, int count)
+{
+  int index = -1;
+  int victim = -1;
+  int i;
+  
+  g_mutex_lock(&queue->lock);
+  if (queue->next[worker] < queue->end[worker])
+  {
+    index = queue->next[worker]++;
+  }
+  else
+  {
+    for (i = 0; i < count; i++)
+    {
+      if (queue->next[i] < queue->end[i] &&
+          (victim < 0 || queue->end[i] - queue->next[i] > queue->end[victim] - queue->next[victim]))
+      {
+        victim = i;
+      }
+    }
+    
+    if (victim >= 0)
+      index = --queue->end[victim];
+  }
+  g_mutex_unlock(&queue->lock);
+  
+  return index;
+}
+
+static void segment_worker(void *data, int worker, int count)
+{
+  segment_queue_t *queue = (segment_queue_t*)data;
+  int index;
+  
+  while ((index = take_segment(queue, worker, count)) >= 0)
+  {
+    analyze_segment(queue->main_state, &queue->segments[index]);
+    
+    g_mutex_lock(&queue->lock);
+    queue->segments_done++;
+    if (isatty(1))
+    {
+      printf("[%3d/%3d segments]  \r", queue->segments_done, queue->num_segments);
+      fflush(stdout);
+    }
+    g_mutex_unlock(&queue->lock);
+  }
+}
+
+/* Second pass split into time segments that are analyzed in parallel.
+ * The results are the same as from second_pass(). On failure nothing is
+ * stored in main_state. */
+bool parallel_second_pass(main_state_t *main_state, GError **error)
+{
+  segment_queue_t queue = {0};
+  workers_t *workers;
+  int num_segments;
+  int num_workers;
+  int i;
+  
+  *error = NULL;
+  num_segments = MIN(segment_workers * SEGMENTS_PER_WORKER,
+                     (int)(main_state->duration / SEGMENT_MIN_LENGTH));
+  
+  /* A short video has fewer segments than there are workers */
+  num_workers = MIN(segment_workers, num_segments);
+  
+  queue.main_state = main_state;
+  queue.num_segments = num_segments;
+  queue.segments = g_malloc0(num_segments * sizeof(segment_t));
+  queue.next = g_malloc(num_workers * sizeof(int));
+  queue.end = g_malloc(num_workers * sizeof(int));
+  g_mutex_init(&queue.lock);
+  
+  for (i = 0; i < num_segments; i++)
+  {
+    queue.segments[i].start = gst_util_uint64_scale(main_state->duration, i, num_segments);
+    queue.segments[i].end = gst_util_uint64_scale(main_state->duration, i + 1, num_segments);
+  }
+  queue.segments[0].start = 0;
+  queue.segments[num_segments - 1].end = GST_CLOCK_TIME_NONE;
+  
+  for (i = 0; i < num_workers; i++)
+  {
+    queue.next[i] = num_segments * i / num_workers;
+    queue.end[i] = num_segments * (i + 1) / num_workers;
+  }
+  
+  GST_INFO("Analyzing %d segments with %d workers", num_segments, num_workers);
+  workers = workers_create(num_workers);
+  workers_run(workers, segment_worker, &queue);
+  workers_free(workers);
+  
+  /* Concatenate the segments in order */
+  main_state->frames = framestore_create(main_state->markers->len);
+  main_state->lipsync_markers = g_array_new(false, false, sizeof(lipsync_marker_t));
+  
+  for (i = 0; i < num_segments; i++)
+  {
+    segment_t *segment = &queue.segments[i];
+    
+    if (segment->error != NULL && *error == NULL)
+      *error = segment->error;
+    else if (segment->error != NULL)
+      g_error_free(segment->error);
+    
+    if (segment->frames == NULL)
+      continue;
+    
+    framestore_append_store(main_state->frames, segment->frames);
+    g_array_append_vals(main_state->lipsync_markers, segment->lipsync_markers->data,
+                        segment->lipsync_markers->len);
+    
+    framestore_free(segment->frames);
+    g_array_free(segment->lipsync_markers, TRUE);
+  }
+  
+  if (*error != NULL)
+  {
+    framestore_free(main_state->frames);
+    main_state->frames = NULL;
+    g_array_free(main_state->lipsync_markers, TRUE);
+    main_state->lipsync_markers = NULL;
+  }
+  
+  g_mutex_clear(&queue.lock);
+  g_free(queue.segments);
+  g_free(queue.next);
+  g_free(queue.end);
+  
+  return *error == NULL;
+}
+
+/* Run the second pass in parallel if it is enabled and the video is long
+ * enough to split. If a segment fails, e.g. because the file cannot be
+ * seeked, the whole pass is done sequentially instead. */
+static bool run_second_pass(main_state_t *main_state, GError **error)
+{
+  if (segment_workers > 1 && main_state->duration != GST_CLOCK_TIME_NONE &&
+      main_state->duration >= 2 * SEGMENT_MIN_LENGTH)
+  {
+    if (parallel_second_pass(main_state, error))
+      return true;
+    
+    GST_WARNING("Parallel second pass failed, analyzing sequentially: %s", (*error)->message);
+    g_error_free(*error);
+    *error = NULL;
+  }
+  
+  return second_pass(main_state, error);
+}
+
 /* Print the collected information about markers */
 static void print_marker_info(main_state_t *main_state)
 {
-  videoinfo_t *videoinfo = markertype_analyze(main_state->frame_data);
+  videoinfo_t *videoinfo = markertype_analyze(main_state->frames);
   size_t i;
   
   printf("    \"markers\": [\n");
@@ -305,34 +987,61 @@ static void print_marker_info(main_state_t *main_state)
   printf("      \"trailer_frames\":%8d\n", videoinfo->num_trailer_frames);
   printf("    },\n");
   
-  markertype_free(videoinfo);
+  main_state->videoinfo = videoinfo;
 }
 
-/* Calculate statistics about lipsync markers */
+/* Calculate statistics about lipsync markers.
+ * Coded beeps carry the number of their frame counted from the first
+ * content frame, so each is paired with its frame through a lookup table
+ * and lost beeps do not affect the others. Plain beeps are paired with
+ * the lipsync frames in order. */
 static void print_lipsync_info(main_state_t *main_state)
 {
   size_t beep_index = 0;
   size_t frame_index = 0;
   int video_markers = 0;
+  int matched_markers = 0;
   float min_lipsync = 0;
   float max_lipsync = 0;
-  for (frame_index = 0; frame_index < main_state->frame_data->len; frame_index++)
+  GHashTable *coded_beeps = g_hash_table_new(g_direct_hash, g_direct_equal);
+  int content_start = main_state->videoinfo->num_header_frames
+                      + main_state->videoinfo->num_locator_frames;
+  
+  for (beep_index = 0; beep_index < main_state->lipsync_markers->len; beep_index++)
   {
-    char c = g_array_index(main_state->frame_data, char*, frame_index)
-              [main_state->rgb6_marker_index];
-    if (c == 'k')
+    lipsync_marker_t *beep = &g_array_index(main_state->lipsync_markers,
+                                            lipsync_marker_t, beep_index);
+    if (beep->code >= 0)
+      g_hash_table_insert(coded_beeps, GINT_TO_POINTER(beep->code), beep);
+  }
+  beep_index = 0;
+  
+  for (frame_index = 0; frame_index < framestore_length(main_state->frames); frame_index++)
+  {
+    if (main_state->rgb6_marker_index >= 0 &&
+        framestore_get_code(main_state->frames, frame_index,
+                            main_state->rgb6_marker_index) == TVG_COLOR_BLACK)
     {
-      if (beep_index < main_state->lipsync_markers->len)
+      lipsync_marker_t *beep = NULL;
+      
+      if (g_hash_table_size(coded_beeps) > 0)
+      {
+        int code = ((int)frame_index - content_start) & ((1 << TVG_LIPSYNC_CODE_BITS) - 1);
+        beep = g_hash_table_lookup(coded_beeps, GINT_TO_POINTER(code));
+      }
+      else if (beep_index < main_state->lipsync_markers->len)
+      {
+        beep = &g_array_index(main_state->lipsync_markers, lipsync_marker_t, beep_index++);
+      }
+      
+      if (beep != NULL)
       {
         /* Lipsync frame, compare to matching lipsync beep */
-        GstClockTimeDiff frame_time = g_array_index(main_state->frame_times,
-                                                    GstClockTime, frame_index);
-        lipsync_marker_t beep = g_array_index(main_state->lipsync_markers,
-                                              lipsync_marker_t, beep_index++);
+        GstClockTimeDiff frame_time = framestore_get_time(main_state->frames, frame_index);
         
-        float delta = (float)((GstClockTimeDiff)beep.start_time - frame_time) / GST_SECOND;
+        float delta = (float)((GstClockTimeDiff)beep->start_time - frame_time) / GST_SECOND;
         
-        if (video_markers == 0)
+        if (matched_markers == 0)
         {
           min_lipsync = delta;
           max_lipsync = delta;
@@ -342,6 +1051,8 @@ static void print_lipsync_info(main_state_t *main_state)
           if (delta < min_lipsync) min_lipsync = delta;
           if (delta > max_lipsync) max_lipsync = delta;
         }
+        
+        matched_markers++;
       }
       
       video_markers++;
@@ -350,9 +1061,13 @@ static void print_lipsync_info(main_state_t *main_state)
   
   printf("    \"lipsync\": {\n");
   printf("      \"audio_markers\":    %8d,\n", main_state->lipsync_markers->len);
-  printf("      \"video_markers\":    %8d", video_markers);
+  printf("      \"coded_markers\":    %8d,\n", g_hash_table_size(coded_beeps));
+  printf("      \"video_markers\":    %8d,\n", video_markers);
+  printf("      \"matched_markers\":  %8d", matched_markers);
+  
+  g_hash_table_destroy(coded_beeps);
   
-  if (main_state->lipsync_markers->len > 0 && video_markers > 0)
+  if (matched_markers > 0)
   {
     printf(",\n");
     printf("      \"audio_delay_min_ms\": %6.1f,\n", 1000 * min_lipsync);
@@ -364,6 +1079,9 @@ static void print_lipsync_info(main_state_t *main_state)
 static void save_details(main_state_t *main_state)
 {
   size_t frame_index, lipsync_index = 0;
+  size_t num_frames = framestore_length(main_state->frames);
+  char *frame_data;
+  char frame_color[8];
   FILE *f;
   
   f = fopen("frames.txt", "w");
@@ -371,20 +1089,28 @@ static void save_details(main_state_t *main_state)
   if (!f)
     return;
   
-  for (frame_index = 0; frame_index <= main_state->frame_data->len; frame_index++)
+  frame_data = g_malloc(main_state->markers->len + 1);
+  
+  for (frame_index = 0; frame_index <= num_frames; frame_index++)
   {
     GstClockTime frame_time = 0;
-    char *frame_data = NULL;
-    char *frame_color = NULL;
     
     /* On the last iteration, process all the beeps that come after the last video frame */
-    bool last = (frame_index == main_state->frame_data->len);
+    bool last = (frame_index == num_frames);
     
     if (!last)
     {
-      frame_time = g_array_index(main_state->frame_times, GstClockTime, frame_index);
-      frame_data = g_array_index(main_state->frame_data, char*, frame_index);
-      frame_color = g_array_index(main_state->frame_colors, char*, frame_index);
+      uint32_t color = framestore_get_color(main_state->frames, frame_index);
+      
+      frame_time = framestore_get_time(main_state->frames, frame_index);
+      framestore_format_codes(main_state->frames, frame_index, frame_data);
+      
+      /* Frames read from the color history in single pass mode */
+      if (color == FRAMESTORE_NO_COLOR)
+        strcpy(frame_color, "#------");
+      else
+        snprintf(frame_color, sizeof(frame_color), "#%02x%02x%02x",
+                 (color >> 16) & 0xff, (color >> 8) & 0xff, color & 0xff);
     }
     
     while (lipsync_index < main_state->lipsync_markers->len)
@@ -395,10 +1121,17 @@ static void save_details(main_state_t *main_state)
       
       if (last || beep_start <= frame_time)
       {
-        fprintf(f, "AUDIO: %8d %5d\n",
-                (int)(beep_start / GST_USECOND),
-                (int)(beep_length / GST_USECOND)
-              );
+        if (beep.code >= 0)
+          fprintf(f, "AUDIO: %8d %5d %8d\n",
+                  (int)(beep_start / GST_USECOND),
+                  (int)(beep_length / GST_USECOND),
+                  beep.code
+                );
+        else
+          fprintf(f, "AUDIO: %8d %5d\n",
+                  (int)(beep_start / GST_USECOND),
+                  (int)(beep_length / GST_USECOND)
+                );
         lipsync_index++;
       }
       else
@@ -413,6 +1146,7 @@ static void save_details(main_state_t *main_state)
     }
   }
   
+  g_free(frame_data);
   fclose(f);
   
   printf("    \"frame_data\": \"frames.txt\",\n");
@@ -423,31 +1157,67 @@ int main(int argc, char *argv[])
   size_t i;
   
   /* Initialize gstreamer. Will handle any gst-specific commandline options. */
-  gst_init(&argc, &argv);
+  {
+    GOptionContext *context = g_option_context_new("<video file>");
+    GError *error = NULL;
+    
+    g_option_context_add_main_entries(context, option_entries, NULL);
+    g_option_context_add_group(context, gst_init_get_option_group());
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      return 1;
+    }
+    g_option_context_free(context);
+    
+    if (num_threads <= 0)
+      num_threads = g_get_num_processors();
+    if (scan_interval <= 0)
+      scan_interval = 1;
+    if (segment_workers <= 0)
+      segment_workers = g_get_num_processors();
+    
+    /* With an even interval the frame ID markers of the low bits would
+     * have the same state on every scanned frame */
+    if (scan_interval % 2 == 0)
+      scan_interval++;
+  }
   GST_DEBUG_CATEGORY_INIT (tvg_analyzer_debug, "tvg_analyzer", 0, "OF TVG Video Analyzer");
   
   /* There should be only one remaining argument. */
   if (argc != 2)
   {
-    fprintf(stderr, "Usage: %s [gst options] <video file>\n", argv[0]);
+    fprintf(stderr, "Usage: %s [options] <video file>\n", argv[0]);
+    fprintf(stderr, "Run %s --help for the options.\n", argv[0]);
     return 1;
   }
   
   {
     main_state_t main_state = {0};
     GError *error = NULL;
+    bool need_second_pass = true;
     
     main_state.filename = argv[1];
     main_state.warnings = g_array_new(false, false, sizeof(char*));
     
-    if (!first_pass(&main_state, &error))
+    if (single_pass_mode)
+    {
+      if (!single_pass(&main_state, &need_second_pass, &error))
+      {
+        fprintf(stderr, "%s\n", error->message);
+        g_error_free(error);
+        return 2;
+      }
+    }
+    else if (!first_pass(&main_state, &error))
     {
       fprintf(stderr, "%s\n", error->message);
       g_error_free(error);
       return 2;
     }
     
-    if (!second_pass(&main_state, &error))
+    if (need_second_pass && !run_second_pass(&main_state, &error))
     {
       fprintf(stderr, "%s\n", error->message);
       g_error_free(error);
@@ -457,6 +1227,7 @@ int main(int argc, char *argv[])
     print_marker_info(&main_state);
     print_lipsync_info(&main_state);
     save_details(&main_state);
+    markertype_free(main_state.videoinfo);
     
     printf("    \"warnings\": [\n");
     for (i = 0; i < main_state.warnings->len; i++)
@@ -0,0 +1,176 @@
+#include "frame.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FRAME_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+void frame_set_matrix(frame_t *frame, double kr, double kb, bool full_range)
+{
+  double kg = 1.0 - kr - kb;
+  double y_scale = full_range ? 1.0 : 255.0 / 219.0;
+  double c_scale = full_range ? 1.0 : 255.0 / 224.0;
+  
+  frame->y_offset = full_range ? 0 : 16;
+  frame->y_scale = (int)(y_scale * 65536 + 0.5);
+  frame->rv = (int)(2 * (1 - kr) * c_scale * 65536 + 0.5);
+  frame->gu = (int)(-2 * kb * (1 - kb) / kg * c_scale * 65536 - 0.5);
+  frame->gv = (int)(-2 * kr * (1 - kr) / kg * c_scale * 65536 - 0.5);
+  frame->bu = (int)(2 * (1 - kb) * c_scale * 65536 + 0.5);
+}
+
+static inline uint8_t clamp_component(int value)
+{
+  value = (value + 32768) >> 16;
+  return (value < 0) ? 0 : (value > 255) ? 255 : value;
+}
+
+/* Convert one pixel. This is the reference for the SIMD code. */
+static inline void yuv_to_rgb(const frame_t *frame, int y, int u, int v, uint8_t *rgb)
+{
+  int luma = (y - frame->y_offset) * frame->y_scale;
+  u -= 128;
+  v -= 128;
+  rgb[0] = clamp_component(luma + v * frame->rv);
+  rgb[1] = clamp_component(luma + u * frame->gu + v * frame->gv);
+  rgb[2] = clamp_component(luma + u * frame->bu);
+}
+
+/* Chroma samples for row y, and the distance between the samples */
+static void chroma_rows(const frame_t *frame, int y, const uint8_t **u, const uint8_t **v,
+                        int *step)
+{
+  *u = frame->data[1] + (y / 2) * frame->stride[1];
+  
+  if (frame->format == FRAME_I420)
+  {
+    *v = frame->data[2] + (y / 2) * frame->stride[2];
+    *step = 1;
+  }
+  else
+  {
+    *v = *u + 1;
+    *step = 2;
+  }
+}
+
+void frame_get_rgb(const frame_t *frame, int x, int y, uint8_t rgb[3])
+{
+  if (frame->format == FRAME_RGBX)
+  {
+    memcpy(rgb, frame->data[0] + y * frame->stride[0] + x * 4, 3);
+  }
+  else
+  {
+    const uint8_t *u, *v;
+    int step;
+    chroma_rows(frame, y, &u, &v, &step);
+    yuv_to_rgb(frame, frame->data[0][y * frame->stride[0] + x],
+               u[(x / 2) * step], v[(x / 2) * step], rgb);
+  }
+}
+
+/* Convert pixels x0 <= x < x1 of a row */
+static void convert_scalar(const frame_t *frame, const uint8_t *luma, const uint8_t *u,
+                           const uint8_t *v, int step, int x0, int x1, uint8_t *dest)
+{
+  int x;
+  for (x = x0; x < x1; x++)
+  {
+    yuv_to_rgb(frame, luma[x], u[(x / 2) * step], v[(x / 2) * step], dest + x * 4);
+    dest[x * 4 + 3] = 0;
+  }
+}
+
+#ifdef FRAME_HAVE_X86
+
+/* Convert 8 pixels from x on, x is even. Same arithmetic as yuv_to_rgb(). */
+__attribute__((target("avx2")))
+static inline void avx2_convert(const frame_t *frame, const uint8_t *luma, const uint8_t *u,
+                                const uint8_t *v, int step, int x, uint8_t *dest)
+{
+  const __m256i round = _mm256_set1_epi32(32768);
+  const __m256i max = _mm256_set1_epi32(255);
+  __m256i y = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(luma + x)));
+  __m256i cu, cv;
+  __m256i l, r, g, b;
+  
+  if (step == 1)
+  {
+    /* Each chroma sample goes to two lanes */
+    const __m256i pairs = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    int u4, v4;
+    memcpy(&u4, u + x / 2, 4);
+    memcpy(&v4, v + x / 2, 4);
+    cu = _mm256_permutevar8x32_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi32_si128(u4)), pairs);
+    cv = _mm256_permutevar8x32_epi32(_mm256_cvtepu8_epi32(_mm_cvtsi32_si128(v4)), pairs);
+  }
+  else
+  {
+    /* Interleaved U and V */
+    __m256i uv = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(u + x)));
+    cu = _mm256_permutevar8x32_epi32(uv, _mm256_setr_epi32(0, 0, 2, 2, 4, 4, 6, 6));
+    cv = _mm256_permutevar8x32_epi32(uv, _mm256_setr_epi32(1, 1, 3, 3, 5, 5, 7, 7));
+  }
+  
+  cu = _mm256_sub_epi32(cu, _mm256_set1_epi32(128));
+  cv = _mm256_sub_epi32(cv, _mm256_set1_epi32(128));
+  l = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(y, _mm256_set1_epi32(frame->y_offset)),
+                                          _mm256_set1_epi32(frame->y_scale)), round);
+  r = _mm256_add_epi32(l, _mm256_mullo_epi32(cv, _mm256_set1_epi32(frame->rv)));
+  g = _mm256_add_epi32(l, _mm256_add_epi32(_mm256_mullo_epi32(cu, _mm256_set1_epi32(frame->gu)),
+                                           _mm256_mullo_epi32(cv, _mm256_set1_epi32(frame->gv))));
+  b = _mm256_add_epi32(l, _mm256_mullo_epi32(cu, _mm256_set1_epi32(frame->bu)));
+  
+  r = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(r, 16), _mm256_setzero_si256()), max);
+  g = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(g, 16), _mm256_setzero_si256()), max);
+  b = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(b, 16), _mm256_setzero_si256()), max);
+  
+  _mm256_storeu_si256((__m256i*)(dest + x * 4),
+                      _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8),
+                                                         _mm256_slli_epi32(b, 16))));
+}
+
+__attribute__((target("avx2")))
+static int convert_avx2(const frame_t *frame, const uint8_t *luma, const uint8_t *u,
+                        const uint8_t *v, int step, uint8_t *dest)
+{
+  int x;
+  
+  for (x = 0; x + 8 <= frame->width; x += 8)
+  {
+    avx2_convert(frame, luma, u, v, step, x, dest);
+  }
+  
+  return x;
+}
+
+#endif
+
+void frame_to_rgbx(const frame_t *frame, int y, int count, uint8_t *dest, int dest_stride)
+{
+  int row;
+  
+  for (row = y; row < y + count; row++, dest += dest_stride)
+  {
+    if (frame->format == FRAME_RGBX)
+    {
+      memcpy(dest, frame->data[0] + row * frame->stride[0], frame->width * 4);
+    }
+    else
+    {
+      const uint8_t *luma = frame->data[0] + row * frame->stride[0];
+      const uint8_t *u, *v;
+      int step, x = 0;
+      chroma_rows(frame, row, &u, &v, &step);
+      
+#ifdef FRAME_HAVE_X86
+      if (__builtin_cpu_supports("avx2"))
+        x = convert_avx2(frame, luma, u, v, step, dest);
+#endif
+      
+      convert_scalar(frame, luma, u, v, step, x, frame->width, dest);
+    }
+  }
+}
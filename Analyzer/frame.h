@@ -0,0 +1,43 @@
+/* Decoded video frames, either in RGBx or in the native YUV format of
+ * the decoder. The analysis converts only the pixels it looks at to RGB,
+ * so a YUV video does not have to go through videoconvert. */
+
+#ifndef _TVG_FRAME_H_
+#define _TVG_FRAME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+  FRAME_RGBX, /* Packed R, G, B, unused */
+  FRAME_I420, /* Y plane, U and V planes at half resolution */
+  FRAME_NV12  /* Y plane, interleaved UV plane at half resolution */
+} frame_format_t;
+
+typedef struct {
+  frame_format_t format;
+  int width;
+  int height;
+  const uint8_t *data[3];
+  int stride[3];
+  
+  /* YUV to RGB conversion in 16.16 fixed point:
+   * R = (Y - y_offset) * y_scale + (V - 128) * rv, and so on */
+  int y_offset;
+  int y_scale;
+  int rv, gu, gv, bu;
+} frame_t;
+
+/* Set the conversion of a YUV frame from the luma coefficients of red
+ * and blue, e.g. 0.299 and 0.114 for BT.601. Limited range video has
+ * luma in 16-235 and chroma in 16-240. */
+void frame_set_matrix(frame_t *frame, double kr, double kb, bool full_range);
+
+/* Color of a single pixel */
+void frame_get_rgb(const frame_t *frame, int x, int y, uint8_t rgb[3]);
+
+/* Convert count rows starting at y to RGBx. Each pixel gets the
+ * chroma sample it is co-sited with, without interpolation. */
+void frame_to_rgbx(const frame_t *frame, int y, int count, uint8_t *dest, int dest_stride);
+
+#endif
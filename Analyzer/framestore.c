@@ -0,0 +1,156 @@
+#include "framestore.h"
+#include <string.h>
+
+/* Number of frames in each chunk */
+#define CHUNK_FRAMES 4096
+
+/* Columns of one chunk of frames. The packed codes of each frame take
+ * row_bytes bytes, followed by one byte of padding at the end of the
+ * chunk so that a code can always be read with a 16-bit load. */
+typedef struct {
+  int64_t times[CHUNK_FRAMES];
+  uint32_t colors[CHUNK_FRAMES];
+  uint8_t codes[];
+} chunk_t;
+
+struct _framestore_t
+{
+  int num_markers;
+  size_t row_bytes;
+  size_t length;
+  GPtrArray *chunks;
+};
+
+framestore_t *framestore_create(int num_markers)
+{
+  framestore_t *store = g_malloc0(sizeof(framestore_t));
+  
+  store->num_markers = num_markers;
+  store->row_bytes = (num_markers * 3 + 7) / 8;
+  store->chunks = g_ptr_array_new_with_free_func(g_free);
+  
+  return store;
+}
+
+void framestore_free(framestore_t *store)
+{
+  g_ptr_array_free(store->chunks, TRUE); store->chunks = NULL;
+  g_free(store);
+}
+
+size_t framestore_length(const framestore_t *store)
+{
+  return store->length;
+}
+
+int framestore_num_markers(const framestore_t *store)
+{
+  return store->num_markers;
+}
+
+static chunk_t *frame_chunk(const framestore_t *store, size_t frame)
+{
+  return g_ptr_array_index(store->chunks, frame / CHUNK_FRAMES);
+}
+
+static uint8_t *frame_row(const framestore_t *store, size_t frame)
+{
+  return frame_chunk(store, frame)->codes + (frame % CHUNK_FRAMES) * store->row_bytes;
+}
+
+/* Add a frame and return its cleared row of codes */
+static uint8_t *add_frame(framestore_t *store, uint32_t color, GstClockTime time)
+{
+  size_t frame = store->length;
+  chunk_t *chunk;
+  
+  if (frame % CHUNK_FRAMES == 0)
+  {
+    chunk = g_malloc0(sizeof(chunk_t) + CHUNK_FRAMES * store->row_bytes + 1);
+    g_ptr_array_add(store->chunks, chunk);
+  }
+  
+  chunk = frame_chunk(store, frame);
+  chunk->times[frame % CHUNK_FRAMES] = (int64_t)time;
+  chunk->colors[frame % CHUNK_FRAMES] = color;
+  store->length++;
+  
+  return frame_row(store, frame);
+}
+
+void framestore_append(framestore_t *store, const uint8_t *codes, uint32_t color,
+                       GstClockTime time)
+{
+  uint8_t *row = add_frame(store, color, time);
+  int i;
+  
+  for (i = 0; i < store->num_markers; i++)
+  {
+    int bit = i * 3;
+    int value = (codes[i] & 7) << (bit % 8);
+    
+    row[bit / 8] |= value & 0xff;
+    if (value > 0xff)
+      row[bit / 8 + 1] |= value >> 8;
+  }
+}
+
+void framestore_append_store(framestore_t *store, const framestore_t *other)
+{
+  size_t i;
+  
+  g_assert(store->num_markers == other->num_markers);
+  
+  for (i = 0; i < other->length; i++)
+  {
+    uint8_t *row = add_frame(store, framestore_get_color(other, i),
+                             framestore_get_time(other, i));
+    memcpy(row, frame_row(other, i), store->row_bytes);
+  }
+}
+
+uint8_t framestore_get_code(const framestore_t *store, size_t frame, int marker)
+{
+  const uint8_t *row = frame_row(store, frame);
+  int bit = marker * 3;
+  int value = row[bit / 8] | (row[bit / 8 + 1] << 8);
+  
+  return (value >> (bit % 8)) & 7;
+}
+
+bool framestore_all_codes(const framestore_t *store, size_t frame, uint8_t code)
+{
+  int i;
+  
+  for (i = 0; i < store->num_markers; i++)
+  {
+    if (framestore_get_code(store, frame, i) != code)
+      return false;
+  }
+  
+  return true;
+}
+
+bool framestore_same_codes(const framestore_t *store, size_t a, size_t b)
+{
+  return memcmp(frame_row(store, a), frame_row(store, b), store->row_bytes) == 0;
+}
+
+uint32_t framestore_get_color(const framestore_t *store, size_t frame)
+{
+  return frame_chunk(store, frame)->colors[frame % CHUNK_FRAMES];
+}
+
+GstClockTime framestore_get_time(const framestore_t *store, size_t frame)
+{
+  return (GstClockTime)frame_chunk(store, frame)->times[frame % CHUNK_FRAMES];
+}
+
+void framestore_format_codes(const framestore_t *store, size_t frame, char *buffer)
+{
+  int i;
+  
+  for (i = 0; i < store->num_markers; i++)
+    buffer[i] = TVG_COLOR_CHARS[framestore_get_code(store, frame, i)];
+  buffer[store->num_markers] = '\0';
+}
@@ -0,0 +1,74 @@
+/* Storage for the per-frame results of the marker readout.
+ * The marker states are packed as 3-bit color codes, and stored together
+ * with the color of the most changing pixel and the time of each frame in
+ * separate columns. The columns are allocated in chunks of frames that
+ * are released together, so that long videos do not need an allocation
+ * per frame. */
+
+#ifndef _TVG_FRAMESTORE_H_
+#define _TVG_FRAMESTORE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <glib.h>
+#include <gst/gst.h>
+
+/* Color codes of the marker states: bit 0 is red, bit 1 green, bit 2 blue */
+#define TVG_COLOR_BLACK   0
+#define TVG_COLOR_RED     1
+#define TVG_COLOR_GREEN   2
+#define TVG_COLOR_YELLOW  3
+#define TVG_COLOR_BLUE    4
+#define TVG_COLOR_MAGENTA 5
+#define TVG_COLOR_CYAN    6
+#define TVG_COLOR_WHITE   7
+
+/* Characters of the color codes in the frame details */
+#define TVG_COLOR_CHARS "krgybmcw"
+
+/* Sampled color of the frames where it is not known */
+#define FRAMESTORE_NO_COLOR 0xffffffff
+
+typedef struct _framestore_t framestore_t;
+
+/* Create an empty store for frames with the given number of markers */
+framestore_t *framestore_create(int num_markers);
+
+/* Release the store and all the frames in it */
+void framestore_free(framestore_t *store);
+
+/* Number of frames in the store */
+size_t framestore_length(const framestore_t *store);
+
+/* Number of markers in each frame */
+int framestore_num_markers(const framestore_t *store);
+
+/* Add a frame. codes has a TVG_COLOR_* code for each marker and color
+ * is 0xRRGGBB or FRAMESTORE_NO_COLOR. */
+void framestore_append(framestore_t *store, const uint8_t *codes, uint32_t color,
+                       GstClockTime time);
+
+/* Add all the frames of another store with the same number of markers */
+void framestore_append_store(framestore_t *store, const framestore_t *other);
+
+/* Get the color code of one marker in a frame */
+uint8_t framestore_get_code(const framestore_t *store, size_t frame, int marker);
+
+/* Check if all the markers of a frame have the given color code */
+bool framestore_all_codes(const framestore_t *store, size_t frame, uint8_t code);
+
+/* Check if two frames have the same marker states */
+bool framestore_same_codes(const framestore_t *store, size_t a, size_t b);
+
+/* Get the sampled color of a frame */
+uint32_t framestore_get_color(const framestore_t *store, size_t frame);
+
+/* Get the time of a frame */
+GstClockTime framestore_get_time(const framestore_t *store, size_t frame);
+
+/* Write the marker states of a frame as TVG_COLOR_CHARS characters.
+ * The buffer must have room for num_markers + 1 characters. */
+void framestore_format_codes(const framestore_t *store, size_t frame, char *buffer);
+
+#endif
@@ -1,6 +1,7 @@
 #include "layout.h"
+#include "layout_kernels.h"
+#include "workers.h"
 #include <stdbool.h>
-#include <zlib.h>
 #include <glib.h>
 #include <gst/gst.h>
 #include <string.h>
@@ -9,220 +10,560 @@
 GST_DEBUG_CATEGORY_EXTERN(tvg_analyzer_debug);
 #define GST_CAT_DEFAULT tvg_analyzer_debug
 
+/* The state of the marker candidate pixels is kept in tiles, so that
+ * it can be released once a whole tile has been ruled out. In TVG
+ * videos that happens to most tiles on the first content frames. */
+#define TILE_WIDTH 64
+#define TILE_HEIGHT 16
+#define TILE_PIXELS (TILE_WIDTH * TILE_HEIGHT)
+
+typedef enum {
+  TILE_DEAD,    /* No marker candidates left, no state */
+  TILE_UNIFORM, /* All pixels have had the same color on every frame */
+  TILE_DENSE    /* State of each pixel */
+} tile_state_t;
+
+typedef struct {
+  tile_state_t state;
+  
+  /* Marker candidate state, see layout_kernels.h. For uniform tiles
+   * these point to the shared values below, otherwise to arrays of
+   * TILE_PIXELS entries in rows of TILE_WIDTH. */
+  uint8_t *flags;
+  uint32_t *crcs;
+  uint32_t *colors;
+  
+  uint8_t uniform_flags;
+  uint32_t uniform_crc;
+  uint32_t uniform_color;
+  
+  /* The uniform color changed on the current frame */
+  bool uniform_changed;
+} tile_t;
+
 struct _layout_t
 {
   int width;
   int height;
+  int tiles_x;
+  int tiles_y;
+  tile_t *tiles;
   
-  /* Pixel mask of the pixels that are good so far. */
-  uint8_t *good_mask;
+  /* Color on the previous frame, and sum of total pixel color changes.
+   * These are needed for all pixels, 8 bytes per pixel. A frame can add
+   * up to 765 to the sum, so a 16-bit sum would saturate after about a
+   * hundred frames on the marker pixels and tie the most changing pixel.
+   * The color stays in 32 bits so the kernels load it aligned with the
+   * RGBx pixels. */
+  uint32_t *pixel_prevcolor;
+  uint32_t *pixel_changesum;
   
-  /* Pixel mask of the pixels that are black/white. */
-  uint8_t *blackwhite;
+  /* Number of frames processed */
+  int num_frames;
   
-  /* Minimum and maximum values of each color component. */
-  uint8_t *min_values;
-  uint8_t *max_values;
+  /* Row processing function, and its output of changed pixels */
+  layout_kernel_t kernel;
+  uint8_t *changed;
   
-  /* Pixel color checksums to detect connected areas. */
-  uint32_t *pixel_crcs;
+  /* Rows of a YUV frame converted to RGBx, one row of tiles per worker */
+  uint8_t *rgbx_rows;
   
-  /* Pixel color after the previous large change. */
-  uint32_t *pixel_colors;
+  /* The frame is split into bands of tile rows, one for each worker.
+   * Color changes are collected per band and recorded in band order,
+   * so the history does not depend on the number of workers. */
+  workers_t *workers;
+  GArray **band_changes;
   
-  /* Sum of total pixel color changes */
-  uint32_t *pixel_prevcolor;
-  uint32_t *pixel_changesum;
+  /* Color changes of the marker candidate pixels, history_event_t */
+  GArray *history;
+  size_t history_max;
+  bool history_complete;
 };
 
+/* A pixel changed to a new saturated color on a frame */
+typedef struct {
+  uint32_t pixel;
+  uint32_t frame_color; /* frame << 3 | color */
+} history_event_t;
+
+static tile_t *tile_at(layout_t *layout, int x, int y)
+{
+  return &layout->tiles[(y / TILE_HEIGHT) * layout->tiles_x + x / TILE_WIDTH];
+}
+
+/* Give each pixel of a uniform tile its own copy of the state */
+static void expand_tile(tile_t *tile)
+{
+  uint8_t *block = g_malloc(TILE_PIXELS * (2 * sizeof(uint32_t) + 1));
+  int i;
+  
+  tile->crcs = (uint32_t*)block;
+  tile->colors = tile->crcs + TILE_PIXELS;
+  tile->flags = (uint8_t*)(tile->colors + TILE_PIXELS);
+  
+  for (i = 0; i < TILE_PIXELS; i++)
+  {
+    tile->crcs[i] = tile->uniform_crc;
+    tile->colors[i] = tile->uniform_color;
+  }
+  memset(tile->flags, tile->uniform_flags, TILE_PIXELS);
+  
+  tile->state = TILE_DENSE;
+}
+
+static void free_tile(tile_t *tile)
+{
+  if (tile->state == TILE_DENSE)
+    g_free(tile->crcs);
+  
+  tile->flags = NULL;
+  tile->crcs = tile->colors = NULL;
+  tile->state = TILE_DEAD;
+}
+
+/* State of a pixel. Returns false if it has been ruled out. */
+static bool pixel_state(layout_t *layout, int x, int y, uint8_t *flags, uint32_t *crc)
+{
+  tile_t *tile = tile_at(layout, x, y);
+  int i = 0;
+  
+  if (tile->state == TILE_DEAD)
+    return false;
+  
+  if (tile->state == TILE_DENSE)
+    i = (y % TILE_HEIGHT) * TILE_WIDTH + x % TILE_WIDTH;
+  
+  *flags = tile->flags[i];
+  *crc = tile->crcs[i];
+  return (*flags & LAYOUT_GOOD) != 0;
+}
+
+static bool pixel_is_good(layout_t *layout, int index_pixel)
+{
+  uint8_t flags;
+  uint32_t crc;
+  return pixel_state(layout, index_pixel % layout->width, index_pixel / layout->width,
+                     &flags, &crc);
+}
+
 layout_t *layout_create(int width, int height)
 {
   layout_t *layout = g_malloc0(sizeof(layout_t));
+  bool uniform_tiles;
+  int i;
   
   layout->width = width;
   layout->height = height;
+  layout->tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+  layout->tiles_y = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+  layout->tiles = g_malloc0(layout->tiles_x * layout->tiles_y * sizeof(tile_t));
   
-  layout->good_mask = g_malloc(width * height);
-  layout->blackwhite = g_malloc(width * height);
-  layout->min_values = g_malloc(width * height * 4);
-  layout->max_values = g_malloc(width * height * 4);
-  layout->pixel_crcs = g_malloc(width * height * 4);
-  layout->pixel_colors = g_malloc(width * height * 4);
   layout->pixel_prevcolor = g_malloc(width * height * 4);
   layout->pixel_changesum = g_malloc(width * height * 4);
-  
-  memset(layout->good_mask, 1, width * height);
-  memset(layout->blackwhite, 1, width * height);
-  memset(layout->min_values, 255, width * height * 4);
-  memset(layout->max_values, 0, width * height * 4);
-  memset(layout->pixel_crcs, 1, width * height * 4);
-  memset(layout->pixel_colors, 0, width * height * 4);
   memset(layout->pixel_prevcolor, 0, width * height * 4);
   memset(layout->pixel_changesum, 0, width * height * 4);
   
+  {
+    const char *name;
+    layout->kernel = layout_kernel_select(&name);
+    GST_INFO("Using %s layout kernel", name);
+  }
+  
+  /* Uniform tiles are processed as a single pixel, which would hide
+   * the per-pixel debug messages. */
+  uniform_tiles = (gst_debug_category_get_threshold(tvg_analyzer_debug) < GST_LEVEL_DEBUG);
+  
+  /* All pixels start out as good and black */
+  for (i = 0; i < layout->tiles_x * layout->tiles_y; i++)
+  {
+    tile_t *tile = &layout->tiles[i];
+    tile->state = TILE_UNIFORM;
+    tile->flags = &tile->uniform_flags;
+    tile->crcs = &tile->uniform_crc;
+    tile->colors = &tile->uniform_color;
+    tile->uniform_flags = LAYOUT_GOOD;
+    tile->uniform_crc = 0x01010101;
+    tile->uniform_color = 0;
+    
+    if (!uniform_tiles)
+      expand_tile(tile);
+  }
+  
+  layout_set_threads(layout, 1);
+  
   return layout;
 }
 
+static void free_workers(layout_t *layout)
+{
+  int i;
+  
+  if (layout->workers == NULL)
+    return;
+  
+  for (i = 0; i < workers_count(layout->workers); i++)
+    g_array_free(layout->band_changes[i], TRUE);
+  g_free(layout->band_changes); layout->band_changes = NULL;
+  g_free(layout->changed); layout->changed = NULL;
+  g_free(layout->rgbx_rows); layout->rgbx_rows = NULL;
+  workers_free(layout->workers); layout->workers = NULL;
+}
+
+void layout_set_threads(layout_t *layout, int threads)
+{
+  int i;
+  
+  free_workers(layout);
+  
+  /* A band is at least one row of tiles */
+  threads = CLAMP(threads, 1, layout->tiles_y);
+  
+  layout->workers = workers_create(threads);
+  layout->changed = g_malloc(layout->width * threads);
+  layout->rgbx_rows = g_malloc(TILE_HEIGHT * layout->width * 4 * threads);
+  layout->band_changes = g_malloc(threads * sizeof(GArray*));
+  for (i = 0; i < threads; i++)
+    layout->band_changes[i] = g_array_new(FALSE, FALSE, sizeof(history_event_t));
+}
+
+/* Tile rows of a band */
+static void band_rows(layout_t *layout, int index, int count, int *first, int *last)
+{
+  *first = layout->tiles_y * index / count;
+  *last = layout->tiles_y * (index + 1) / count;
+}
+
 void layout_free(layout_t *layout)
 {
-  g_free(layout->good_mask);  layout->good_mask = NULL;
-  g_free(layout->blackwhite);  layout->blackwhite = NULL;
-  g_free(layout->min_values); layout->min_values = NULL;
-  g_free(layout->max_values); layout->max_values = NULL;
-  g_free(layout->pixel_crcs); layout->pixel_crcs = NULL;
+  int i;
+  
+  for (i = 0; i < layout->tiles_x * layout->tiles_y; i++)
+    free_tile(&layout->tiles[i]);
+  g_free(layout->tiles); layout->tiles = NULL;
   g_free(layout->pixel_prevcolor); layout->pixel_prevcolor = NULL;
   g_free(layout->pixel_changesum); layout->pixel_changesum = NULL;
+  free_workers(layout);
+  if (layout->history)
+    g_array_free(layout->history, TRUE);
   g_free(layout);
 }
 
-void layout_process(layout_t *layout, const uint8_t *frame, int stride)
+void layout_record_history(layout_t *layout, size_t max_bytes)
 {
-  int x, y, c;
-  for (y = 0; y < layout->height; y++)
+  layout->history = g_array_new(FALSE, FALSE, sizeof(history_event_t));
+  layout->history_max = max_bytes / sizeof(history_event_t);
+  layout->history_complete = (layout->num_frames == 0);
+}
+
+bool layout_history_complete(layout_t *layout)
+{
+  return layout->history != NULL && layout->history_complete;
+}
+
+/* Drop the history of pixels that have been ruled out. If that does not
+ * free up enough space, give up on the history. */
+static void prune_history(layout_t *layout)
+{
+  size_t i, count = 0;
+  
+  for (i = 0; i < layout->history->len; i++)
   {
-    for (x = 0; x < layout->width; x++)
+    history_event_t event = g_array_index(layout->history, history_event_t, i);
+    if (pixel_is_good(layout, event.pixel))
+      g_array_index(layout->history, history_event_t, count++) = event;
+  }
+  g_array_set_size(layout->history, count);
+  
+  if (count > layout->history_max / 2)
+  {
+    GST_INFO("Color history is full after %d frames", layout->num_frames);
+    layout->history_complete = false;
+    g_array_free(layout->history, TRUE);
+    layout->history = NULL;
+  }
+}
+
+static void record_change(layout_t *layout, int index_pixel, uint8_t color)
+{
+  history_event_t event = {index_pixel, (layout->num_frames << 3) | color};
+  
+  if (!layout->history_complete)
+    return;
+  
+  if (layout->history->len >= layout->history_max)
+  {
+    prune_history(layout);
+    if (!layout->history_complete)
+      return;
+  }
+  
+  g_array_append_val(layout->history, event);
+}
+
+typedef struct {
+  layout_t *layout;
+  const frame_t *frame;
+} process_job_t;
+
+/* RGBx pixels of a row of tiles, the first row is y0 */
+typedef struct {
+  layout_t *layout;
+  const uint8_t *pixels;
+  int stride;
+  int y0;
+} tile_row_t;
+
+static const uint8_t *row_pixels(const tile_row_t *rows, int x, int y)
+{
+  return rows->pixels + (y - rows->y0) * rows->stride + x * 4;
+}
+
+/* Check if all pixels of the tile area have the same color */
+static bool same_colors(const tile_row_t *rows, int x0, int y0, int width, int height)
+{
+  const uint8_t *first = row_pixels(rows, x0, y0);
+  int x, y;
+  
+  for (y = y0; y < y0 + height; y++)
+  {
+    const uint8_t *row = row_pixels(rows, x0, y);
+    for (x = 0; x < width; x++)
     {
-      /* Don't recheck pixels that have already been ruled out. */
-      int index_pixel = y * layout->width + x;
-      if (layout->good_mask[index_pixel])
-      {
-        int min = 255;
-        int max = 0;
-        for (c = 0; c < 3; c++)
-        {
-          int index_frame = y * stride + x * 4 + c;
-          int index_color = index_pixel * 4 + c;
-          uint8_t value = frame[index_frame];
-          
-          if (value < layout->min_values[index_color])
-            layout->min_values[index_color] = value;
-          if (value > layout->max_values[index_color])
-            layout->max_values[index_color] = value;
-          
-          if (value < min)
-            min = value;
-          if (value > max)
-            max = value;
-        }
-        
-        {
-          int r = frame[y * stride + x * 4 + 0];
-          int g = frame[y * stride + x * 4 + 1];
-          int b = frame[y * stride + x * 4 + 2];
-          uint8_t color = 0;
-          if (r > TVG_COLOR_THRESHOLD) color |= 1;
-          if (g > TVG_COLOR_THRESHOLD) color |= 2;
-          if (b > TVG_COLOR_THRESHOLD) color |= 4;
-          
-          if (min > 5 && max < 250)
-          {
-            GST_DEBUG("Marking %d,%d as non-saturated: color #%02x%02x%02x\n",
-                      x, y, r, g, b);
-            
-            /* This pixel wasn't fully saturated. */
-            layout->good_mask[index_pixel] = 0;
-          }
-          
-          /* Update CRC32 of the pixel in order to detect joined areas.
-           * Uses only the saturated pixel value in order to be tolerant of
-           * lossy compression. */
-          {
-            layout->pixel_crcs[index_pixel] = crc32(layout->pixel_crcs[index_pixel],
-                                                    &color, 1);
-            
-            if (color != 0 && color != 7)
-            {
-              layout->blackwhite[index_pixel] = 0;
-            }
-          }
-          
-          /* Check if the pixel value has changed */
-          {
-            int old_value = layout->pixel_colors[index_pixel];
-            int new_value = (color << 24) | (r << 16) | (g << 8) | b;
-            
-            if ((old_value >> 24) != (new_value >> 24))
-            {
-              /* Ok, large change, update value */
-              layout->pixel_colors[index_pixel] = new_value;
-            }
-            else
-            {
-              /* There shouldn't be much change in the value */
-              int delta_r = abs(r - ((old_value >> 16) & 0xFF));
-              int delta_g = abs(g - ((old_value >>  8) & 0xFF));
-              int delta_b = abs(b - ((old_value >>  0) & 0xFF));
-              if (delta_r + delta_g + delta_b > 32)
-              {
-                GST_DEBUG("Marking %d,%d as slowly changing: old %08x, new %08x\n",
-                      x, y, old_value, new_value);
-                
-                layout->good_mask[index_pixel] = 0;
-              }
-            }
-          }
-        }
-      }
-      
-      /* Keep track of the most changing pixel (for use by camera fps) */
+      if (row[x * 4 + 0] != first[0] || row[x * 4 + 1] != first[1] ||
+          row[x * 4 + 2] != first[2])
+        return false;
+    }
+  }
+  
+  return true;
+}
+
+/* Update the state of a uniform tile, if the frame keeps it uniform */
+static void process_uniform(const tile_row_t *rows, tile_t *tile, int tx, int ty,
+                            uint8_t *changed)
+{
+  layout_t *layout = rows->layout;
+  int x0 = tx * TILE_WIDTH;
+  int y0 = ty * TILE_HEIGHT;
+  layout_row_t row;
+  
+  tile->uniform_changed = false;
+  
+  if (!same_colors(rows, x0, y0, MIN(TILE_WIDTH, layout->width - x0),
+                   MIN(TILE_HEIGHT, layout->height - y0)))
+  {
+    expand_tile(tile);
+    return;
+  }
+  
+  /* Every pixel would get the same update */
+  row.x = x0;
+  row.y = y0;
+  row.width = 1;
+  row.first_frame = (layout->num_frames == 0);
+  row.flags = tile->flags;
+  row.pixel_crcs = tile->crcs;
+  row.pixel_colors = tile->colors;
+  row.pixel_prevcolor = layout->pixel_prevcolor + y0 * layout->width + x0;
+  row.changed = changed;
+  layout_kernel_uniform(&row, row_pixels(rows, x0, y0));
+  tile->uniform_changed = changed[0];
+}
+
+/* Release the tile once all its pixels have been ruled out */
+static void release_tile(layout_t *layout, tile_t *tile, int tx, int ty)
+{
+  int width = MIN(TILE_WIDTH, layout->width - tx * TILE_WIDTH);
+  int height = MIN(TILE_HEIGHT, layout->height - ty * TILE_HEIGHT);
+  int x, y;
+  
+  if (tile->state == TILE_DENSE)
+  {
+    for (y = 0; y < height; y++)
+    {
+      for (x = 0; x < width; x++)
       {
-        int r = frame[y * stride + x * 4 + 0];
-        int g = frame[y * stride + x * 4 + 1];
-        int b = frame[y * stride + x * 4 + 2];
-        uint32_t newcolor = (r << 16) | (g << 8) | b;
-        uint32_t oldcolor = layout->pixel_prevcolor[index_pixel];
-        int oldr = (oldcolor >> 16) & 0xFF;
-        int oldg = (oldcolor >> 8) & 0xFF;
-        int oldb = (oldcolor >> 0) & 0xFF;
-        int change = abs(r-oldr) + abs(g-oldg) + abs(b-oldb);
-        
-        layout->pixel_changesum[index_pixel] += change;
-        layout->pixel_prevcolor[index_pixel] = newcolor;
+        if (tile->flags[y * TILE_WIDTH + x] & LAYOUT_GOOD)
+          return;
       }
     }
+    free_tile(tile);
+  }
+  else if (tile->state == TILE_UNIFORM && !(tile->uniform_flags & LAYOUT_GOOD))
+  {
+    free_tile(tile);
   }
 }
 
-/* Zero out the CRC for any pixels that fail the saturation/change checks. */
-static void filter_crcs(layout_t *layout)
+static void record_changes(GArray *changes, int index_row, int width,
+                           const uint8_t *changed, const uint32_t *colors)
 {
-  int x, y;
+  int x;
   
-  for (y = 0; y < layout->height; y++)
+  for (x = 0; x < width; x++)
   {
-    for (x = 0; x < layout->width; x++)
+    if (changed == NULL || changed[x])
     {
-      int index_pixel = y * layout->width + x;
-      
-      /* If some pixel happens by luck to have 0 CRC, rewrite it so that we can
-       * use 0 as our special value. */
-      if (layout->pixel_crcs[index_pixel] == 0)
-        layout->pixel_crcs[index_pixel] = 1;
-      
-      if (layout->good_mask[index_pixel] == 0)
+      /* The frame number is added when the change is recorded */
+      history_event_t change = {index_row + x, (changed ? colors[x] : colors[0]) >> 24};
+      g_array_append_val(changes, change);
+    }
+  }
+}
+
+/* Process one pixel row of a row of tiles. The pixels of consecutive
+ * tiles without per-pixel state are processed together. */
+static void process_row(const tile_row_t *rows, int ty, int y,
+                        uint8_t *changed, GArray *changes)
+{
+  layout_t *layout = rows->layout;
+  tile_t *tiles = layout->tiles + ty * layout->tiles_x;
+  int index_row = y * layout->width;
+  int tx = 0;
+  layout_row_t row;
+  
+  row.y = y;
+  row.first_frame = (layout->num_frames == 0);
+  row.changed = changed;
+  
+  while (tx < layout->tiles_x)
+  {
+    int x0 = tx * TILE_WIDTH;
+    int end = tx + 1;
+    
+    if (tiles[tx].state == TILE_DENSE)
+    {
+      int index_tile = (y % TILE_HEIGHT) * TILE_WIDTH;
+      row.flags = tiles[tx].flags + index_tile;
+      row.pixel_crcs = tiles[tx].crcs + index_tile;
+      row.pixel_colors = tiles[tx].colors + index_tile;
+    }
+    else
+    {
+      /* Only the change sums */
+      while (end < layout->tiles_x && tiles[end].state != TILE_DENSE)
+        end++;
+      row.flags = NULL;
+    }
+    
+    row.x = x0;
+    row.width = MIN(end * TILE_WIDTH, layout->width) - x0;
+    row.pixel_prevcolor = layout->pixel_prevcolor + index_row + x0;
+    row.pixel_changesum = layout->pixel_changesum + index_row + x0;
+    layout->kernel(&row, row_pixels(rows, x0, y));
+    
+    if (layout->history_complete)
+    {
+      if (row.flags != NULL)
       {
-        /* Not saturated */
-        layout->pixel_crcs[index_pixel] = 0;
-        continue;
+        record_changes(changes, index_row + x0, row.width, row.changed, row.pixel_colors);
       }
-      
-      /* Rule out constant valued pixels */
+      else
       {
-        uint8_t min1 = layout->min_values[index_pixel * 4 + 0];
-        uint8_t max1 = layout->max_values[index_pixel * 4 + 0];
-        uint8_t min2 = layout->min_values[index_pixel * 4 + 1];
-        uint8_t max2 = layout->max_values[index_pixel * 4 + 1];
-        uint8_t min3 = layout->min_values[index_pixel * 4 + 2];
-        uint8_t max3 = layout->max_values[index_pixel * 4 + 2];
-        
-        if (min1 == max1 || min2 == max2 || min3 == max3)
+        for (; tx < end; tx++)
         {
-          /* Pixel value in atleast one color channel has not changed. */
-          layout->pixel_crcs[index_pixel] = 0;
+          if (tiles[tx].state == TILE_UNIFORM && tiles[tx].uniform_changed)
+          {
+            record_changes(changes, index_row + tx * TILE_WIDTH,
+                           MIN(TILE_WIDTH, layout->width - tx * TILE_WIDTH),
+                           NULL, tiles[tx].colors);
+          }
         }
       }
     }
+    
+    tx = end;
+  }
+}
+
+static void process_band(void *data, int index, int count)
+{
+  process_job_t *job = data;
+  layout_t *layout = job->layout;
+  GArray *changes = layout->band_changes[index];
+  uint8_t *changed = layout->changed + index * layout->width;
+  int tx, ty, y, first, last;
+  
+  band_rows(layout, index, count, &first, &last);
+  g_array_set_size(changes, 0);
+  
+  for (ty = first; ty < last; ty++)
+  {
+    tile_t *tiles = layout->tiles + ty * layout->tiles_x;
+    int y0 = ty * TILE_HEIGHT;
+    int height = MIN(TILE_HEIGHT, layout->height - y0);
+    tile_row_t rows = {layout, NULL, 0, y0};
+    
+    if (job->frame->format == FRAME_RGBX)
+    {
+      rows.stride = job->frame->stride[0];
+      rows.pixels = job->frame->data[0] + y0 * rows.stride;
+    }
+    else
+    {
+      /* Convert the YUV rows while they are in cache */
+      uint8_t *buffer = layout->rgbx_rows + index * TILE_HEIGHT * layout->width * 4;
+      rows.stride = layout->width * 4;
+      rows.pixels = buffer;
+      frame_to_rgbx(job->frame, y0, height, buffer, rows.stride);
+    }
+    
+    for (tx = 0; tx < layout->tiles_x; tx++)
+    {
+      if (tiles[tx].state == TILE_UNIFORM)
+        process_uniform(&rows, &tiles[tx], tx, ty, changed);
+    }
+    
+    for (y = y0; y < y0 + height; y++)
+    {
+      process_row(&rows, ty, y, changed, changes);
+    }
+    
+    for (tx = 0; tx < layout->tiles_x; tx++)
+    {
+      release_tile(layout, &tiles[tx], tx, ty);
+    }
+  }
+}
+
+void layout_process(layout_t *layout, const frame_t *frame)
+{
+  process_job_t job = {layout, frame};
+  int i;
+  size_t j;
+  
+  workers_run(layout->workers, process_band, &job);
+  
+  for (i = 0; i < workers_count(layout->workers) && layout->history_complete; i++)
+  {
+    GArray *changes = layout->band_changes[i];
+    for (j = 0; j < changes->len; j++)
+    {
+      history_event_t *change = &g_array_index(changes, history_event_t, j);
+      record_change(layout, change->pixel, change->frame_color);
+    }
   }
+  
+  layout->num_frames++;
+}
+
+/* CRC of a pixel for finding connected areas, 0 if the pixel is not
+ * part of a marker: it is not saturated, changes slowly or is constant
+ * valued in atleast one color channel. */
+static uint32_t marker_crc(layout_t *layout, int x, int y)
+{
+  uint8_t flags;
+  uint32_t crc;
+  
+  if (!pixel_state(layout, x, y, &flags, &crc))
+    return 0;
+  
+  if ((flags & LAYOUT_VARIED) != LAYOUT_VARIED)
+    return 0;
+  
+  /* If some pixel happens by luck to have 0 CRC, rewrite it so that we can
+   * use 0 as our special value. */
+  return (crc != 0) ? crc : 1;
 }
 
 /* Find connected areas and collect information about them. */
@@ -238,8 +579,16 @@ static void find_markers(layout_t *layout, GArray *dest)
     for (x = 0; x < layout->width; x++)
     {
       int index_pixel = y * layout->width + x;
-      int current = layout->pixel_crcs[index_pixel];
+      int current;
+      
+      if (tile_at(layout, x, y)->state == TILE_DEAD)
+      {
+        /* No candidates in the rest of the tile */
+        x = MIN(x - x % TILE_WIDTH + TILE_WIDTH, layout->width) - 1;
+        continue;
+      }
       
+      current = marker_crc(layout, x, y);
       if (current != 0)
       {
         int west = 0;
@@ -248,10 +597,10 @@ static void find_markers(layout_t *layout, GArray *dest)
         int south = 0;
         int label = 0;
         
-        if (y > 0) north = layout->pixel_crcs[index_pixel - layout->width];        
-        if (x > 0) west = layout->pixel_crcs[index_pixel - 1];
-        if (y < layout->height - 1) south = layout->pixel_crcs[index_pixel + layout->width];        
-        if (x < layout->width - 1)  east = layout->pixel_crcs[index_pixel + 1];
+        if (y > 0) north = marker_crc(layout, x, y - 1);
+        if (x > 0) west = marker_crc(layout, x - 1, y);
+        if (y < layout->height - 1) south = marker_crc(layout, x, y + 1);
+        if (x < layout->width - 1)  east = marker_crc(layout, x + 1, y);
         
         if (west == current)
           label = labels[index_pixel - 1];
@@ -278,8 +627,11 @@ static void find_markers(layout_t *layout, GArray *dest)
           {         
             /* Assign new label */
             label = next_label++;
-            marker_t marker = {x, y, x, y, false, 0};
-            marker.is_rgb = !layout->blackwhite[index_pixel];
+            marker_t marker = {x, y, x, y, false, 0, 0};
+            uint8_t flags;
+            uint32_t crc;
+            pixel_state(layout, x, y, &flags, &crc);
+            marker.is_rgb = (flags & LAYOUT_COLORED) != 0;
             marker.crc = current;
             g_array_append_val(dest, marker);
           }
@@ -296,6 +648,7 @@ static void find_markers(layout_t *layout, GArray *dest)
           if (marker->y1 > y) marker->y1 = y;
           if (marker->x2 < x) marker->x2 = x;
           if (marker->y2 < y) marker->y2 = y;          
+          marker->pixels++;
         }
       }
     }
@@ -314,6 +667,7 @@ static void find_markers(layout_t *layout, GArray *dest)
       if (m2->y1 < m1->y1) m1->y1 = m2->y1;
       if (m2->x2 > m1->x2) m1->x2 = m2->x2;
       if (m2->y2 > m1->y2) m1->y2 = m2->y2;
+      m1->pixels += m2->pixels;
       
       g_array_remove_index(dest, i - 1);
     }
@@ -334,36 +688,162 @@ static void find_markers(layout_t *layout, GArray *dest)
 GArray* layout_fetch(layout_t *layout)
 {
   GArray* result = g_array_new(FALSE, FALSE, sizeof(marker_t));
+  int i, tracked = 0;
+  
+  for (i = 0; i < layout->tiles_x * layout->tiles_y; i++)
+  {
+    if (layout->tiles[i].state != TILE_DEAD)
+      tracked++;
+  }
+  GST_INFO("%d of %d tiles have marker candidates", tracked,
+           layout->tiles_x * layout->tiles_y);
   
-  filter_crcs(layout);
   find_markers(layout, result);
   
   return result;
 }
 
-void layout_most_changing_pixel(layout_t *layout, int *x, int *y)
+bool layout_same_markers(GArray *a, GArray *b)
 {
-  uint32_t largest = 0;
-  int py, px;
+  size_t i;
   
-  *x = *y = 0;
+  if (a->len != b->len)
+    return false;
+  
+  for (i = 0; i < a->len; i++)
+  {
+    marker_t *m1 = &g_array_index(a, marker_t, i);
+    marker_t *m2 = &g_array_index(b, marker_t, i);
+    
+    if (m1->x1 != m2->x1 || m1->y1 != m2->y1 || m1->x2 != m2->x2 ||
+        m1->y2 != m2->y2 || m1->is_rgb != m2->is_rgb || m1->pixels != m2->pixels)
+      return false;
+  }
+  
+  return true;
+}
+
+framestore_t *layout_history_markers(layout_t *layout, GArray *markers,
+                                     GArray *frame_times)
+{
+  framestore_t *result;
+  uint32_t *centers;
+  uint8_t *codes;
+  size_t i, event_index = 0;
+  int frame;
+  
+  if (!layout_history_complete(layout))
+    return NULL;
+  
+  /* The history of a pixel is complete if it has never been ruled out */
+  centers = g_malloc(markers->len * sizeof(uint32_t));
+  for (i = 0; i < markers->len; i++)
+  {
+    marker_t *marker = &g_array_index(markers, marker_t, i);
+    int x = (marker->x1 + marker->x2) / 2;
+    int y = (marker->y1 + marker->y2) / 2;
+    
+    centers[i] = y * layout->width + x;
+    if (!pixel_is_good(layout, centers[i]))
+    {
+      GST_INFO("No color history for marker %d", (int)i);
+      g_free(centers);
+      return NULL;
+    }
+  }
+  
+  /* All pixels start out black, then the events are in frame order */
+  result = framestore_create(markers->len);
+  codes = g_malloc0(markers->len);
   
-  for (py = 5; py < layout->height - 5; py++)
+  for (frame = 0; frame < layout->num_frames; frame++)
+  {
+    for (; event_index < layout->history->len; event_index++)
+    {
+      history_event_t *event = &g_array_index(layout->history, history_event_t, event_index);
+      if ((int)(event->frame_color >> 3) != frame)
+        break;
+      
+      for (i = 0; i < markers->len; i++)
+      {
+        if (centers[i] == event->pixel)
+          codes[i] = event->frame_color & 7;
+      }
+    }
+    
+    framestore_append(result, codes, FRAMESTORE_NO_COLOR,
+                      g_array_index(frame_times, GstClockTime, frame));
+  }
+  
+  g_free(codes);
+  g_free(centers);
+  return result;
+}
+
+/* Most changing pixel of each band */
+typedef struct {
+  layout_t *layout;
+  uint32_t *largest;
+  int *x;
+  int *y;
+} changing_job_t;
+
+static void changing_band(void *data, int index, int count)
+{
+  changing_job_t *job = data;
+  layout_t *layout = job->layout;
+  int py, px, first, last;
+  
+  band_rows(layout, index, count, &first, &last);
+  first = MAX(first * TILE_HEIGHT, 5);
+  last = MIN(last * TILE_HEIGHT, layout->height - 5);
+  
+  job->x[index] = job->y[index] = -1;
+  job->largest[index] = 0;
+  
+  for (py = first; py < last; py++)
   {
     for (px = 5; px < layout->width - 5; px++)
     {
       int index_pixel = py * layout->width + px;
-      if (layout->pixel_changesum[index_pixel] >= largest)
+      if (layout->pixel_changesum[index_pixel] >= job->largest[index])
       {
-        *x = px;
-        *y = py;
-        largest = layout->pixel_changesum[index_pixel];
+        job->x[index] = px;
+        job->y[index] = py;
+        job->largest[index] = layout->pixel_changesum[index_pixel];
       }
     }
   }
 }
 
-char* layout_sample_color(const uint8_t *frame, int stride, int x, int y)
+void layout_most_changing_pixel(layout_t *layout, int *x, int *y)
+{
+  int count = workers_count(layout->workers);
+  changing_job_t job = {layout, g_malloc(count * sizeof(uint32_t)),
+                        g_malloc(count * sizeof(int)), g_malloc(count * sizeof(int))};
+  uint32_t largest = 0;
+  int i;
+  
+  workers_run(layout->workers, changing_band, &job);
+  
+  /* The last pixel with the largest change wins, as in a single scan */
+  *x = *y = 0;
+  for (i = 0; i < count; i++)
+  {
+    if (job.x[i] >= 0 && job.largest[i] >= largest)
+    {
+      *x = job.x[i];
+      *y = job.y[i];
+      largest = job.largest[i];
+    }
+  }
+  
+  g_free(job.largest);
+  g_free(job.x);
+  g_free(job.y);
+}
+
+uint32_t layout_sample_color(const frame_t *frame, int x, int y)
 {
   int r = 0, g = 0, b = 0;
   int count = 0;
@@ -373,9 +853,11 @@ char* layout_sample_color(const uint8_t *frame, int stride, int x, int y)
   {
     for (px = x - 2; px <= x + 2; px++)
     {
-      r += frame[py * stride + px * 4 + 0];
-      g += frame[py * stride + px * 4 + 1];
-      b += frame[py * stride + px * 4 + 2];
+      uint8_t rgb[3];
+      frame_get_rgb(frame, px, py, rgb);
+      r += rgb[0];
+      g += rgb[1];
+      b += rgb[2];
       count++;
     }
   }
@@ -384,13 +866,11 @@ char* layout_sample_color(const uint8_t *frame, int stride, int x, int y)
   g /= count;
   b /= count;
   
-  return g_strdup_printf("#%02x%02x%02x", r, g, b);
+  return (r << 16) | (g << 8) | b;
 }
 
-char* layout_read_markers(GArray* markers, const uint8_t *frame, int stride)
+void layout_read_markers(GArray* markers, const frame_t *frame, uint8_t *codes)
 {
-  char *result = g_malloc0(markers->len + 1);
-  const char lookup[] = "krgybmcw";
   size_t i;
   
   for (i = 0; i < markers->len; i++)
@@ -398,14 +878,14 @@ char* layout_read_markers(GArray* markers, const uint8_t *frame, int stride)
     marker_t *marker = &g_array_index(markers, marker_t, i);
     int x = (marker->x1 + marker->x2) / 2;
     int y = (marker->y1 + marker->y2) / 2;
-    uint8_t color = 0;
+    uint8_t color = TVG_COLOR_BLACK;
+    uint8_t rgb[3];
     
-    if (frame[y * stride + x * 4 + 0] > TVG_COLOR_THRESHOLD) color |= 1;
-    if (frame[y * stride + x * 4 + 1] > TVG_COLOR_THRESHOLD) color |= 2;
-    if (frame[y * stride + x * 4 + 2] > TVG_COLOR_THRESHOLD) color |= 4;
+    frame_get_rgb(frame, x, y, rgb);
+    if (rgb[0] > TVG_COLOR_THRESHOLD) color |= TVG_COLOR_RED;
+    if (rgb[1] > TVG_COLOR_THRESHOLD) color |= TVG_COLOR_GREEN;
+    if (rgb[2] > TVG_COLOR_THRESHOLD) color |= TVG_COLOR_BLUE;
     
-    result[i] = lookup[color];
+    codes[i] = color;
   }
-  
-  return result;
 }
@@ -13,6 +13,8 @@
 #include <stddef.h>
 #include <glib.h>
 #include <stdbool.h>
+#include "frame.h"
+#include "framestore.h"
 
 #define TVG_COLOR_THRESHOLD 200
 
@@ -25,6 +27,7 @@ typedef struct _marker_t {
   int y2;
   bool is_rgb;
   uint32_t crc;
+  int pixels; /* Number of marker candidate pixels in the area */
 } marker_t;
 
 /* Create a new context for the layout detector */
@@ -33,21 +36,46 @@ layout_t *layout_create(int width, int height);
 /* Release all resources associated with the context */
 void layout_free(layout_t *layout);
 
-/* Feed a new video frame to the layout detector (assumes RGB32 format) */
-void layout_process(layout_t *layout, const uint8_t *frame, int stride);
+/* Split the processing into bands of rows handled by this many threads.
+ * The results do not depend on the number of threads. */
+void layout_set_threads(layout_t *layout, int threads);
+
+/* Feed a new video frame to the layout detector. YUV frames are
+ * converted to RGB one row of tiles at a time. */
+void layout_process(layout_t *layout, const frame_t *frame);
 
 /* Fetch a list of the detected marker locations
- * Returns array of marker_t structures. */
+ * Returns array of marker_t structures. The state is not modified, so
+ * this can be called again after processing more frames. */
 GArray* layout_fetch(layout_t *layout);
 
+/* Check if two marker lists have the same marker areas, made up of
+ * the same number of pixels */
+bool layout_same_markers(GArray *a, GArray *b);
+
+/* Start recording the color changes of the pixels that can still be
+ * part of a marker, so that the marker states of the frames processed
+ * so far can be read once the layout is known. Uses at most max_bytes
+ * of memory; if that is not enough, the history is dropped. */
+void layout_record_history(layout_t *layout, size_t max_bytes);
+
+/* Check if the history covers all frames processed so far */
+bool layout_history_complete(layout_t *layout);
+
+/* Read the marker states of all the processed frames from the history.
+ * Returns a new frame store with the given frame times and no sampled
+ * colors, or NULL if the history does not cover the center of every marker. */
+framestore_t *layout_history_markers(layout_t *layout, GArray *markers,
+                                     GArray *frame_times);
+
 /* Fetch coordinates of the most changing pixel in the video */
 void layout_most_changing_pixel(layout_t *layout, int *x, int *y);
 
-/* Sample color value around a given pixel */
-char* layout_sample_color(const uint8_t *frame, int stride, int x, int y);
+/* Sample color value around a given pixel, as 0xRRGGBB */
+uint32_t layout_sample_color(const frame_t *frame, int x, int y);
 
 /* Collect the current marker states in the video frame.
- * Returns a string of 'wrgbcmyk' characters, one for each marker. */
-char* layout_read_markers(GArray* markers, const uint8_t *frame, int stride);
+ * Stores a TVG_COLOR_* code for each marker to codes. */
+void layout_read_markers(GArray* markers, const frame_t *frame, uint8_t *codes);
 
 #endif
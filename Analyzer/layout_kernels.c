@@ -0,0 +1,536 @@
+#include "layout_kernels.h"
+#include "layout.h"
+#include <zlib.h>
+#include <glib.h>
+#include <gst/gst.h>
+#include <string.h>
+#include <stdlib.h>
+
+GST_DEBUG_CATEGORY_EXTERN(tvg_analyzer_debug);
+#define GST_CAT_DEFAULT tvg_analyzer_debug
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LAYOUT_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Update the candidate state of a good pixel. This is the reference
+ * for the other kernels. Reads the previous color, so it has to run
+ * before track_change(). */
+static inline void process_good(const layout_row_t *row, const uint8_t *pixels, int x)
+{
+  int r = pixels[x * 4 + 0];
+  int g = pixels[x * 4 + 1];
+  int b = pixels[x * 4 + 2];
+  int min = MIN(MIN(r, g), b);
+  int max = MAX(MAX(r, g), b);
+  uint8_t flags = row->flags[x];
+  uint8_t color = 0;
+
+  /* A channel is constant as long as it has the value of the previous
+   * frame, the pixel has been good on all of them. */
+  if (!row->first_frame)
+  {
+    uint32_t prev = row->pixel_prevcolor[x];
+    if (r != (int)((prev >> 16) & 0xFF)) flags |= LAYOUT_VARIED_R;
+    if (g != (int)((prev >>  8) & 0xFF)) flags |= LAYOUT_VARIED_G;
+    if (b != (int)((prev >>  0) & 0xFF)) flags |= LAYOUT_VARIED_B;
+  }
+
+  if (r > TVG_COLOR_THRESHOLD) color |= 1;
+  if (g > TVG_COLOR_THRESHOLD) color |= 2;
+  if (b > TVG_COLOR_THRESHOLD) color |= 4;
+
+  if (min > 5 && max < 250)
+  {
+    GST_DEBUG("Marking %d,%d as non-saturated: color #%02x%02x%02x\n",
+              row->x + x, row->y, r, g, b);
+
+    /* This pixel wasn't fully saturated. */
+    flags &= ~LAYOUT_GOOD;
+  }
+
+  /* Update CRC32 of the pixel in order to detect joined areas.
+   * Uses only the saturated pixel value in order to be tolerant of
+   * lossy compression. */
+  row->pixel_crcs[x] = crc32(row->pixel_crcs[x], &color, 1);
+
+  if (color != 0 && color != 7)
+  {
+    flags |= LAYOUT_COLORED;
+  }
+
+  /* Check if the pixel value has changed */
+  {
+    int old_value = row->pixel_colors[x];
+    int new_value = (color << 24) | (r << 16) | (g << 8) | b;
+
+    if ((old_value >> 24) != (new_value >> 24))
+    {
+      /* Ok, large change, update value */
+      row->pixel_colors[x] = new_value;
+      row->changed[x] = 1;
+    }
+    else
+    {
+      /* There shouldn't be much change in the value */
+      int delta_r = abs(r - ((old_value >> 16) & 0xFF));
+      int delta_g = abs(g - ((old_value >>  8) & 0xFF));
+      int delta_b = abs(b - ((old_value >>  0) & 0xFF));
+      if (delta_r + delta_g + delta_b > 32)
+      {
+        GST_DEBUG("Marking %d,%d as slowly changing: old %08x, new %08x\n",
+              row->x + x, row->y, old_value, new_value);
+
+        flags &= ~LAYOUT_GOOD;
+      }
+    }
+  }
+
+  row->flags[x] = flags;
+}
+
+/* Keep track of the most changing pixel (for use by camera fps) */
+static inline void track_change(const layout_row_t *row, const uint8_t *pixels, int x)
+{
+  int r = pixels[x * 4 + 0];
+  int g = pixels[x * 4 + 1];
+  int b = pixels[x * 4 + 2];
+  uint32_t newcolor = (r << 16) | (g << 8) | b;
+  uint32_t oldcolor = row->pixel_prevcolor[x];
+  int oldr = (oldcolor >> 16) & 0xFF;
+  int oldg = (oldcolor >> 8) & 0xFF;
+  int oldb = (oldcolor >> 0) & 0xFF;
+  int change = abs(r-oldr) + abs(g-oldg) + abs(b-oldb);
+
+  row->pixel_changesum[x] += change;
+  row->pixel_prevcolor[x] = newcolor;
+}
+
+static inline void process_pixel(const layout_row_t *row, const uint8_t *pixels, int x)
+{
+  if (row->flags != NULL)
+  {
+    row->changed[x] = 0;
+
+    /* Don't recheck pixels that have already been ruled out. */
+    if (row->flags[x] & LAYOUT_GOOD)
+      process_good(row, pixels, x);
+  }
+
+  track_change(row, pixels, x);
+}
+
+void layout_kernel_scalar(const layout_row_t *row, const uint8_t *pixels)
+{
+  int x;
+  for (x = 0; x < row->width; x++)
+  {
+    process_pixel(row, pixels, x);
+  }
+}
+
+void layout_kernel_uniform(const layout_row_t *row, const uint8_t *pixels)
+{
+  row->changed[0] = 0;
+  if (row->flags[0] & LAYOUT_GOOD)
+    process_good(row, pixels, 0);
+}
+
+#ifdef LAYOUT_HAVE_X86
+
+/* Same as zlib's crc32() for a single byte, for the SIMD kernels */
+static uint32_t crc_table[256];
+
+static void init_crc_table(void)
+{
+  uint32_t i, k;
+  for (i = 0; i < 256; i++)
+  {
+    uint32_t c = i;
+    for (k = 0; k < 8; k++)
+      c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : (c >> 1);
+    crc_table[i] = c;
+  }
+}
+
+static inline uint32_t crc_byte(uint32_t crc, uint8_t value)
+{
+  crc = ~crc;
+  crc = crc_table[(crc ^ value) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+/* The SIMD kernels work on 32-bit lanes, one pixel per lane. The flags
+ * of a group of pixels are widened to the lanes, updated and packed back
+ * so that the byte arrays are written once for the whole iteration. */
+
+__attribute__((target("sse2")))
+static inline __m128i sse2_blend(__m128i mask, __m128i a, __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/* Sum of absolute differences of the three low bytes */
+__attribute__((target("sse2")))
+static inline __m128i sse2_sad3(__m128i a, __m128i b)
+{
+  const __m128i byte = _mm_set1_epi32(0xFF);
+  __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+  return _mm_add_epi32(_mm_add_epi32(_mm_and_si128(d, byte),
+                                     _mm_and_si128(_mm_srli_epi32(d, 8), byte)),
+                       _mm_and_si128(_mm_srli_epi32(d, 16), byte));
+}
+
+/* Flag of the lanes where the mask is set */
+__attribute__((target("sse2")))
+static inline __m128i sse2_flag(__m128i mask, int flag)
+{
+  return _mm_and_si128(mask, _mm_set1_epi32(flag));
+}
+
+/* Pixels in 0x00RRGGBB order */
+__attribute__((target("sse2")))
+static inline __m128i sse2_rgb(const uint8_t *pixels, int x, __m128i *r, __m128i *g, __m128i *b)
+{
+  const __m128i byte = _mm_set1_epi32(0xFF);
+  __m128i px = _mm_loadu_si128((const __m128i*)(pixels + x * 4));
+  *r = _mm_and_si128(px, byte);
+  *g = _mm_and_si128(_mm_srli_epi32(px, 8), byte);
+  *b = _mm_and_si128(_mm_srli_epi32(px, 16), byte);
+  return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(*r, 16), _mm_slli_epi32(*g, 8)), *b);
+}
+
+/* Change sum of 4 pixels. Returns the previous colors. */
+__attribute__((target("sse2")))
+static inline __m128i sse2_track(const layout_row_t *row, int x, __m128i rgb)
+{
+  __m128i *prevp = (__m128i*)(row->pixel_prevcolor + x);
+  __m128i *sum = (__m128i*)(row->pixel_changesum + x);
+  __m128i prev = _mm_loadu_si128(prevp);
+  _mm_storeu_si128(sum, _mm_add_epi32(_mm_loadu_si128(sum), sse2_sad3(rgb, prev)));
+  _mm_storeu_si128(prevp, rgb);
+  return prev;
+}
+
+/* Process 4 pixels. flags has the flags of each pixel in its lane. */
+__attribute__((target("sse2")))
+static inline void sse2_step(const layout_row_t *row, const uint8_t *pixels, int x,
+                             __m128i *flags, __m128i *changed)
+{
+  const __m128i threshold = _mm_set1_epi32(TVG_COLOR_THRESHOLD);
+  __m128i good = _mm_cmpeq_epi32(sse2_flag(*flags, LAYOUT_GOOD), _mm_set1_epi32(LAYOUT_GOOD));
+  __m128i r, g, b;
+  __m128i rgb = sse2_rgb(pixels, x, &r, &g, &b);
+  __m128i prev = sse2_track(row, x, rgb);
+
+  *changed = _mm_setzero_si128();
+  if (_mm_movemask_epi8(good) == 0)
+    return;
+
+  /* Channels that differ from the previous frame */
+  if (!row->first_frame)
+  {
+    __m128i diff = _mm_xor_si128(rgb, prev);
+    __m128i zero = _mm_setzero_si128();
+    __m128i varied = _mm_or_si128(
+        _mm_or_si128(
+          sse2_flag(_mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(diff, _mm_set1_epi32(0xFF0000)), zero), good),
+                    LAYOUT_VARIED_R),
+          sse2_flag(_mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(diff, _mm_set1_epi32(0xFF00)), zero), good),
+                    LAYOUT_VARIED_G)),
+        sse2_flag(_mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(diff, _mm_set1_epi32(0xFF)), zero), good),
+                  LAYOUT_VARIED_B));
+    *flags = _mm_or_si128(*flags, varied);
+  }
+
+  {
+    /* The values fit in the low 16 bits of each lane */
+    __m128i min = _mm_min_epi16(_mm_min_epi16(r, g), b);
+    __m128i max = _mm_max_epi16(_mm_max_epi16(r, g), b);
+    __m128i unsaturated = _mm_and_si128(_mm_cmpgt_epi32(min, _mm_set1_epi32(5)),
+                                        _mm_cmplt_epi32(max, _mm_set1_epi32(250)));
+    __m128i color = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi32(r, threshold), _mm_set1_epi32(1)),
+                     _mm_and_si128(_mm_cmpgt_epi32(g, threshold), _mm_set1_epi32(2))),
+        _mm_and_si128(_mm_cmpgt_epi32(b, threshold), _mm_set1_epi32(4)));
+    __m128i gray = _mm_or_si128(_mm_cmpeq_epi32(color, _mm_setzero_si128()),
+                                _mm_cmpeq_epi32(color, _mm_set1_epi32(7)));
+    __m128i *colorp = (__m128i*)(row->pixel_colors + x);
+    __m128i old = _mm_loadu_si128(colorp);
+    __m128i big = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_srli_epi32(old, 24), color), good);
+    __m128i slow = _mm_cmpgt_epi32(sse2_sad3(_mm_and_si128(old, _mm_set1_epi32(0x00FFFFFF)), rgb),
+                                   _mm_set1_epi32(32));
+    __m128i ruled = _mm_and_si128(good, _mm_or_si128(unsaturated, _mm_andnot_si128(big, slow)));
+
+    _mm_storeu_si128(colorp, sse2_blend(big, _mm_or_si128(_mm_slli_epi32(color, 24), rgb), old));
+
+    *flags = _mm_or_si128(*flags, sse2_flag(_mm_andnot_si128(gray, good), LAYOUT_COLORED));
+    *flags = _mm_andnot_si128(sse2_flag(ruled, LAYOUT_GOOD), *flags);
+    *changed = big;
+
+    /* No gather in SSE2, so the CRCs are updated one by one */
+    {
+      uint32_t colors[4];
+      int mask = _mm_movemask_ps(_mm_castsi128_ps(good));
+      int i;
+      _mm_storeu_si128((__m128i*)colors, color);
+      for (i = 0; i < 4; i++)
+      {
+        if (mask & (1 << i))
+          row->pixel_crcs[x + i] = crc_byte(row->pixel_crcs[x + i], colors[i]);
+      }
+    }
+  }
+}
+
+/* Pack four groups of 4 lanes into 16 bytes */
+__attribute__((target("sse2")))
+static inline __m128i sse2_pack(const __m128i m[4])
+{
+  return _mm_packs_epi16(_mm_packs_epi32(m[0], m[1]), _mm_packs_epi32(m[2], m[3]));
+}
+
+__attribute__((target("sse2")))
+static void layout_kernel_sse2(const layout_row_t *row, const uint8_t *pixels)
+{
+  int x = 0;
+
+  if (row->flags == NULL)
+  {
+    for (; x + 4 <= row->width; x += 4)
+    {
+      __m128i r, g, b;
+      sse2_track(row, x, sse2_rgb(pixels, x, &r, &g, &b));
+    }
+  }
+  else
+  {
+    for (; x + 16 <= row->width; x += 16)
+    {
+      __m128i flag_bytes = _mm_loadu_si128((const __m128i*)(row->flags + x));
+      __m128i zero = _mm_setzero_si128();
+      __m128i flags16[2], flags[4], changed[4];
+      int i;
+
+      flags16[0] = _mm_unpacklo_epi8(flag_bytes, zero);
+      flags16[1] = _mm_unpackhi_epi8(flag_bytes, zero);
+      flags[0] = _mm_unpacklo_epi16(flags16[0], zero);
+      flags[1] = _mm_unpackhi_epi16(flags16[0], zero);
+      flags[2] = _mm_unpacklo_epi16(flags16[1], zero);
+      flags[3] = _mm_unpackhi_epi16(flags16[1], zero);
+
+      for (i = 0; i < 4; i++)
+      {
+        sse2_step(row, pixels, x + i * 4, &flags[i], &changed[i]);
+      }
+
+      _mm_storeu_si128((__m128i*)(row->flags + x), sse2_pack(flags));
+      _mm_storeu_si128((__m128i*)(row->changed + x),
+                       _mm_and_si128(sse2_pack(changed), _mm_set1_epi8(1)));
+    }
+  }
+
+  for (; x < row->width; x++)
+  {
+    process_pixel(row, pixels, x);
+  }
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_blend(__m256i mask, __m256i a, __m256i b)
+{
+  return _mm256_blendv_epi8(b, a, mask);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_sad3(__m256i a, __m256i b)
+{
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+  return _mm256_add_epi32(_mm256_add_epi32(_mm256_and_si256(d, byte),
+                                           _mm256_and_si256(_mm256_srli_epi32(d, 8), byte)),
+                          _mm256_and_si256(_mm256_srli_epi32(d, 16), byte));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_flag(__m256i mask, int flag)
+{
+  return _mm256_and_si256(mask, _mm256_set1_epi32(flag));
+}
+
+/* Flag of the lanes where the masked bits of a and b differ */
+__attribute__((target("avx2")))
+static inline __m256i avx2_differ(__m256i diff, int bits, __m256i good, int flag)
+{
+  __m256i same = _mm256_cmpeq_epi32(_mm256_and_si256(diff, _mm256_set1_epi32(bits)),
+                                    _mm256_setzero_si256());
+  return avx2_flag(_mm256_andnot_si256(same, good), flag);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_rgb(const uint8_t *pixels, int x, __m256i *r, __m256i *g, __m256i *b)
+{
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  __m256i px = _mm256_loadu_si256((const __m256i*)(pixels + x * 4));
+  *r = _mm256_and_si256(px, byte);
+  *g = _mm256_and_si256(_mm256_srli_epi32(px, 8), byte);
+  *b = _mm256_and_si256(_mm256_srli_epi32(px, 16), byte);
+  return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(*r, 16),
+                                         _mm256_slli_epi32(*g, 8)), *b);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_track(const layout_row_t *row, int x, __m256i rgb)
+{
+  __m256i *prevp = (__m256i*)(row->pixel_prevcolor + x);
+  __m256i *sum = (__m256i*)(row->pixel_changesum + x);
+  __m256i prev = _mm256_loadu_si256(prevp);
+  _mm256_storeu_si256(sum, _mm256_add_epi32(_mm256_loadu_si256(sum), avx2_sad3(rgb, prev)));
+  _mm256_storeu_si256(prevp, rgb);
+  return prev;
+}
+
+/* Process 8 pixels, see sse2_step() */
+__attribute__((target("avx2")))
+static inline void avx2_step(const layout_row_t *row, const uint8_t *pixels, int x,
+                             __m256i *flags, __m256i *changed)
+{
+  const __m256i byte = _mm256_set1_epi32(0xFF);
+  const __m256i threshold = _mm256_set1_epi32(TVG_COLOR_THRESHOLD);
+  __m256i good = _mm256_cmpeq_epi32(avx2_flag(*flags, LAYOUT_GOOD), _mm256_set1_epi32(LAYOUT_GOOD));
+  __m256i r, g, b;
+  __m256i rgb = avx2_rgb(pixels, x, &r, &g, &b);
+  __m256i prev = avx2_track(row, x, rgb);
+
+  *changed = _mm256_setzero_si256();
+  if (_mm256_testz_si256(good, good))
+    return;
+
+  if (!row->first_frame)
+  {
+    __m256i diff = _mm256_xor_si256(rgb, prev);
+    *flags = _mm256_or_si256(*flags,
+        _mm256_or_si256(_mm256_or_si256(avx2_differ(diff, 0xFF0000, good, LAYOUT_VARIED_R),
+                                        avx2_differ(diff, 0xFF00, good, LAYOUT_VARIED_G)),
+                        avx2_differ(diff, 0xFF, good, LAYOUT_VARIED_B)));
+  }
+
+  {
+    __m256i min = _mm256_min_epi32(_mm256_min_epi32(r, g), b);
+    __m256i max = _mm256_max_epi32(_mm256_max_epi32(r, g), b);
+    __m256i unsaturated = _mm256_andnot_si256(_mm256_cmpgt_epi32(max, _mm256_set1_epi32(249)),
+                                              _mm256_cmpgt_epi32(min, _mm256_set1_epi32(5)));
+    __m256i color = _mm256_or_si256(
+        _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi32(r, threshold), _mm256_set1_epi32(1)),
+                        _mm256_and_si256(_mm256_cmpgt_epi32(g, threshold), _mm256_set1_epi32(2))),
+        _mm256_and_si256(_mm256_cmpgt_epi32(b, threshold), _mm256_set1_epi32(4)));
+    __m256i gray = _mm256_or_si256(_mm256_cmpeq_epi32(color, _mm256_setzero_si256()),
+                                   _mm256_cmpeq_epi32(color, _mm256_set1_epi32(7)));
+    __m256i *colorp = (__m256i*)(row->pixel_colors + x);
+    __m256i old = _mm256_loadu_si256(colorp);
+    __m256i big = _mm256_andnot_si256(_mm256_cmpeq_epi32(_mm256_srli_epi32(old, 24), color), good);
+    __m256i slow = _mm256_cmpgt_epi32(
+        avx2_sad3(_mm256_and_si256(old, _mm256_set1_epi32(0x00FFFFFF)), rgb),
+        _mm256_set1_epi32(32));
+    __m256i ruled = _mm256_and_si256(good, _mm256_or_si256(unsaturated, _mm256_andnot_si256(big, slow)));
+
+    _mm256_storeu_si256(colorp, avx2_blend(big, _mm256_or_si256(_mm256_slli_epi32(color, 24), rgb), old));
+
+    *flags = _mm256_or_si256(*flags, avx2_flag(_mm256_andnot_si256(gray, good), LAYOUT_COLORED));
+    *flags = _mm256_andnot_si256(avx2_flag(ruled, LAYOUT_GOOD), *flags);
+    *changed = big;
+
+    /* CRC of one byte: ~table[(~crc ^ color) & 0xFF] ^ (~crc >> 8) */
+    {
+      __m256i *crcp = (__m256i*)(row->pixel_crcs + x);
+      __m256i crc = _mm256_xor_si256(_mm256_loadu_si256(crcp), _mm256_set1_epi32(-1));
+      __m256i index = _mm256_and_si256(_mm256_xor_si256(crc, color), byte);
+      __m256i entry = _mm256_i32gather_epi32((const int*)crc_table, index, 4);
+      __m256i result = _mm256_xor_si256(_mm256_xor_si256(entry, _mm256_srli_epi32(crc, 8)),
+                                        _mm256_set1_epi32(-1));
+      _mm256_storeu_si256(crcp, avx2_blend(good, result, _mm256_loadu_si256(crcp)));
+    }
+  }
+}
+
+/* Pack four groups of 8 lanes into 32 bytes in pixel order */
+__attribute__((target("avx2")))
+static inline __m256i avx2_pack(const __m256i m[4])
+{
+  __m256i packed = _mm256_packs_epi16(_mm256_packs_epi32(m[0], m[1]),
+                                      _mm256_packs_epi32(m[2], m[3]));
+  return _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+}
+
+__attribute__((target("avx2")))
+static void layout_kernel_avx2(const layout_row_t *row, const uint8_t *pixels)
+{
+  int x = 0;
+
+  if (row->flags == NULL)
+  {
+    for (; x + 8 <= row->width; x += 8)
+    {
+      __m256i r, g, b;
+      avx2_track(row, x, avx2_rgb(pixels, x, &r, &g, &b));
+    }
+  }
+  else
+  {
+    for (; x + 32 <= row->width; x += 32)
+    {
+      __m256i flags[4], changed[4];
+      int i;
+
+      for (i = 0; i < 4; i++)
+      {
+        flags[i] = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(row->flags + x + i * 8)));
+        avx2_step(row, pixels, x + i * 8, &flags[i], &changed[i]);
+      }
+
+      _mm256_storeu_si256((__m256i*)(row->flags + x), avx2_pack(flags));
+      _mm256_storeu_si256((__m256i*)(row->changed + x),
+                          _mm256_and_si256(avx2_pack(changed), _mm256_set1_epi8(1)));
+    }
+  }
+
+  for (; x < row->width; x++)
+  {
+    process_pixel(row, pixels, x);
+  }
+}
+
+#endif
+
+layout_kernel_t layout_kernel_select(const char **name)
+{
+  const char *request = g_getenv("TVG_LAYOUT_KERNEL");
+
+  /* The per-pixel debug messages are only in the scalar kernel */
+  if (gst_debug_category_get_threshold(tvg_analyzer_debug) >= GST_LEVEL_DEBUG)
+    request = "scalar";
+
+#ifdef LAYOUT_HAVE_X86
+  init_crc_table();
+  __builtin_cpu_init();
+
+  if ((request == NULL || strcmp(request, "avx2") == 0) && __builtin_cpu_supports("avx2"))
+  {
+    *name = "avx2";
+    return layout_kernel_avx2;
+  }
+
+  if ((request == NULL || strcmp(request, "avx2") == 0 || strcmp(request, "sse2") == 0)
+      && __builtin_cpu_supports("sse2"))
+  {
+    *name = "sse2";
+    return layout_kernel_sse2;
+  }
+#else
+  (void)request;
+#endif
+
+  *name = "scalar";
+  return layout_kernel_scalar;
+}
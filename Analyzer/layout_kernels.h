@@ -0,0 +1,51 @@
+/* Per-row processing kernels of the layout detector.
+ * The scalar kernel is the reference, the SIMD kernels produce exactly
+ * the same state. The kernel is chosen at runtime based on the CPU, or
+ * by setting TVG_LAYOUT_KERNEL to scalar, sse2 or avx2. */
+
+#ifndef _TVG_LAYOUT_KERNELS_H_
+#define _TVG_LAYOUT_KERNELS_H_
+
+#include <stdint.h>
+
+/* Marker candidate state of a pixel */
+#define LAYOUT_GOOD     0x01 /* Saturated and changing quickly so far */
+#define LAYOUT_COLORED  0x02 /* Has had a color other than black or white */
+#define LAYOUT_VARIED_R 0x04 /* Red channel has not been constant */
+#define LAYOUT_VARIED_G 0x08
+#define LAYOUT_VARIED_B 0x10
+#define LAYOUT_VARIED   (LAYOUT_VARIED_R | LAYOUT_VARIED_G | LAYOUT_VARIED_B)
+
+/* Layout detector state of one row of pixels, see layout.c */
+typedef struct {
+  int x;
+  int y;
+  int width;
+  int first_frame;
+
+  /* Candidate state, NULL if only the change sums are updated */
+  uint8_t *flags;
+  uint32_t *pixel_crcs;
+  uint32_t *pixel_colors;
+
+  /* Needed for all pixels */
+  uint32_t *pixel_prevcolor;
+  uint32_t *pixel_changesum;
+
+  /* Output: 1 for good pixels that changed to another saturated color */
+  uint8_t *changed;
+} layout_row_t;
+
+/* Update the state with one row of RGB32 pixels */
+typedef void (*layout_kernel_t)(const layout_row_t *row, const uint8_t *pixels);
+
+void layout_kernel_scalar(const layout_row_t *row, const uint8_t *pixels);
+
+/* Update the candidate state of the first pixel only, without the change
+ * sum. Used for areas where all pixels have the same state and color. */
+void layout_kernel_uniform(const layout_row_t *row, const uint8_t *pixels);
+
+/* Pick the fastest kernel supported by the CPU */
+layout_kernel_t layout_kernel_select(const char **name);
+
+#endif
@@ -16,6 +16,13 @@ struct _lipsync_t
   bool beep_is_on;
   lipsync_marker_t current_marker;
   float max_value_during_beep;
+  
+  /* Samples after the end of the beep, for decoding the frame number */
+  bool code_pending;
+  lipsync_marker_t pending_marker;
+  int16_t *code_samples;
+  int code_length;
+  int code_received;
 };
 
 lipsync_t *lipsync_create(int samplerate)
@@ -27,19 +34,53 @@ lipsync_t *lipsync_create(int samplerate)
   lipsync->past_samples = g_malloc0(sizeof(int16_t) * TVG_LIPSYNC_BUFFER_LENGTH);
   lipsync->detected_markers = g_array_new(false, false, sizeof(lipsync_marker_t));
   
+  if (samplerate >= TVG_LIPSYNC_CODE_MIN_SAMPLERATE)
+  {
+    lipsync->code_length = TVG_LIPSYNC_CODE_SYMBOLS * (samplerate * TVG_LIPSYNC_CODE_SYMBOL_MS / 1000);
+    lipsync->code_samples = g_malloc0(sizeof(int16_t) * lipsync->code_length);
+  }
+  
   return lipsync;
 }
 
+void lipsync_set_sample_index(lipsync_t *lipsync, int sample_index)
+{
+  lipsync->sample_index = sample_index;
+}
+
 void lipsync_free(lipsync_t *lipsync)
 {
   g_free(lipsync->past_samples); lipsync->past_samples = NULL;
+  g_free(lipsync->code_samples); lipsync->code_samples = NULL;
   g_array_unref(lipsync->detected_markers); lipsync->detected_markers = NULL;
   g_free(lipsync);
 }
 
+/* The phase only depends on the index modulo the samplerate, which also
+ * keeps index * freq from overflowing on long recordings. */
 static float complex dft_term(lipsync_t *lipsync, int index, int16_t sample, int freq)
 {
-  return sample * cexpf(-I * 2 * M_PI * index * freq / lipsync->samplerate);
+  return sample * cexpf(-I * 2 * M_PI * (index % lipsync->samplerate) * freq / lipsync->samplerate);
+}
+
+/* Recalculate the sums from the samples in the buffer. This drops the
+ * rounding errors collected by the rolling updates, so that the detector
+ * state only depends on the recent samples and not on where the
+ * detection started. */
+static void recalculate_dft(lipsync_t *lipsync)
+{
+  int index;
+  
+  lipsync->freq_1_dft = 0;
+  lipsync->freq_2_dft = 0;
+  
+  for (index = MAX(0, lipsync->sample_index - TVG_LIPSYNC_BUFFER_LENGTH);
+       index < lipsync->sample_index; index++)
+  {
+    int16_t sample = lipsync->past_samples[index % TVG_LIPSYNC_BUFFER_LENGTH];
+    lipsync->freq_1_dft += dft_term(lipsync, index, sample, TVG_LIPSYNC_FREQ1);
+    lipsync->freq_2_dft += dft_term(lipsync, index, sample, TVG_LIPSYNC_FREQ2);
+  }
 }
 
 static void add_sample(lipsync_t *lipsync, int16_t sample)
@@ -55,8 +96,116 @@ static void add_sample(lipsync_t *lipsync, int16_t sample)
   lipsync->past_samples[i] = sample;
   lipsync->sample_index++;
   
-  lipsync->freq_1_dft += dft_term(lipsync, index, sample, TVG_LIPSYNC_FREQ1);
-  lipsync->freq_2_dft += dft_term(lipsync, index, sample, TVG_LIPSYNC_FREQ2);
+  if (lipsync->sample_index % TVG_LIPSYNC_BUFFER_LENGTH == 0)
+  {
+    recalculate_dft(lipsync);
+  }
+  else
+  {
+    lipsync->freq_1_dft += dft_term(lipsync, index, sample, TVG_LIPSYNC_FREQ1);
+    lipsync->freq_2_dft += dft_term(lipsync, index, sample, TVG_LIPSYNC_FREQ2);
+  }
+}
+
+/* Magnitude of one frequency component in the samples (Goertzel algorithm) */
+static float goertzel(const int16_t *data, int count, int freq, int samplerate)
+{
+  float coeff = 2 * cosf(2 * M_PI * freq / samplerate);
+  float s1 = 0, s2 = 0;
+  int i;
+  
+  for (i = 0; i < count; i++)
+  {
+    float s0 = data[i] + coeff * s1 - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+  
+  return sqrtf(s1 * s1 + s2 * s2 - coeff * s1 * s2);
+}
+
+/* Decode the frame number from the samples after the beep.
+ * Only the middle half of each symbol is used, so that small errors in
+ * the detected beep end do not matter. Returns -1 if the samples do not
+ * contain a valid code, e.g. because the beeps are not coded. */
+static int decode_code(lipsync_t *lipsync)
+{
+  static const int freqs[4] = TVG_LIPSYNC_CODE_FREQS;
+  int symbol_len = lipsync->code_length / TVG_LIPSYNC_CODE_SYMBOLS;
+  int symbols[TVG_LIPSYNC_CODE_SYMBOLS];
+  int checksum = 0, value = 0;
+  int i, j;
+  
+  if (lipsync->code_received < lipsync->code_length)
+    return -1;
+  
+  for (i = 0; i < TVG_LIPSYNC_CODE_SYMBOLS; i++)
+  {
+    const int16_t *data = lipsync->code_samples + i * symbol_len + symbol_len / 4;
+    int count = symbol_len / 2;
+    float best = 0, second = 0;
+    
+    for (j = 0; j < 4; j++)
+    {
+      float magnitude = goertzel(data, count, freqs[j], lipsync->samplerate);
+      
+      if (magnitude > best)
+      {
+        second = best;
+        best = magnitude;
+        symbols[i] = j;
+      }
+      else if (magnitude > second)
+      {
+        second = magnitude;
+      }
+    }
+    
+    /* Tone amplitude is 2 * magnitude / count */
+    if (2 * best / count < TVG_LIPSYNC_THRESHOLD || best < TVG_LIPSYNC_CODE_MARGIN * second)
+      return -1;
+  }
+  
+  for (i = 0; i < TVG_LIPSYNC_CODE_DATA_SYMBOLS; i++)
+  {
+    value = (value << 2) | symbols[i];
+    checksum += symbols[i];
+  }
+  
+  if (symbols[TVG_LIPSYNC_CODE_DATA_SYMBOLS] != ((checksum >> 2) & 3) ||
+      symbols[TVG_LIPSYNC_CODE_DATA_SYMBOLS + 1] != (checksum & 3))
+    return -1;
+  
+  return value;
+}
+
+/* Store the marker that has been waiting for its code */
+static void finish_pending(lipsync_t *lipsync)
+{
+  if (lipsync->code_pending)
+  {
+    lipsync->pending_marker.code = decode_code(lipsync);
+    g_array_append_val(lipsync->detected_markers, lipsync->pending_marker);
+    lipsync->code_pending = false;
+  }
+}
+
+/* Start collecting the code samples after the beep. The code starts at the
+ * end of the beep, which is in the past because of the filter delay, so
+ * the first samples are taken from the filter buffer. */
+static void start_pending(lipsync_t *lipsync, const lipsync_marker_t *marker)
+{
+  int index = MAX(marker->end_sample, lipsync->sample_index - TVG_LIPSYNC_BUFFER_LENGTH);
+  
+  lipsync->pending_marker = *marker;
+  lipsync->code_pending = true;
+  lipsync->code_received = 0;
+  
+  for (; index < lipsync->sample_index && lipsync->code_received < lipsync->code_length; index++)
+  {
+    lipsync->code_samples[lipsync->code_received++] =
+      lipsync->past_samples[index % TVG_LIPSYNC_BUFFER_LENGTH];
+  }
 }
 
 void lipsync_process(lipsync_t *lipsync, GstClockTime buf_start_time, int samplerate, const int16_t *data, size_t num_samples)
@@ -71,6 +220,13 @@ void lipsync_process(lipsync_t *lipsync, GstClockTime buf_start_time, int sample
   {
     add_sample(lipsync, data[i]);
     
+    if (lipsync->code_pending)
+    {
+      lipsync->code_samples[lipsync->code_received++] = data[i];
+      if (lipsync->code_received == lipsync->code_length)
+        finish_pending(lipsync);
+    }
+    
     float value = cabs(lipsync->freq_1_dft) * cabs(lipsync->freq_2_dft);
     value = sqrtf(value) / TVG_LIPSYNC_BUFFER_LENGTH;
     
@@ -109,7 +265,14 @@ void lipsync_process(lipsync_t *lipsync, GstClockTime buf_start_time, int sample
          * or time drift in the audio stream. */
         lipsync->current_marker.start_time = buf_start_time + (float)(lipsync->current_marker.start_sample - buf_start_sample) * GST_SECOND / samplerate;
         
-        g_array_append_val(lipsync->detected_markers, lipsync->current_marker);
+        /* A new beep during the code means that the beeps are not coded */
+        finish_pending(lipsync);
+        
+        lipsync->current_marker.code = -1;
+        if (lipsync->code_length > 0)
+          start_pending(lipsync, &lipsync->current_marker);
+        else
+          g_array_append_val(lipsync->detected_markers, lipsync->current_marker);
       }
     }
   }
@@ -117,5 +280,6 @@ void lipsync_process(lipsync_t *lipsync, GstClockTime buf_start_time, int sample
 
 GArray *lipsync_fetch(lipsync_t *lipsync)
 {
+  finish_pending(lipsync);
   return g_array_ref(lipsync->detected_markers);
 }
@@ -3,6 +3,10 @@
  * a rolling window value of the DFT. The thresholds are hardcoded
  * to 1/4 the dynamic range. This should be fine for TVG generated
  * videos.
+ *
+ * Coded beeps are followed by the frame number of the lipsync frame, sent
+ * as 4-FSK symbols. These are decoded with the Goertzel algorithm from the
+ * samples after the end of the beep.
  */
 
 #ifndef _TVG_LIPSYNC_DETECTOR_H_
@@ -18,17 +22,37 @@
 #define TVG_LIPSYNC_HYSTERESIS 100
 #define TVG_LIPSYNC_BUFFER_LENGTH 500
 
+/* Coded beep format, must match gstoftvg_beeps.cc */
+#define TVG_LIPSYNC_CODE_BITS 24
+#define TVG_LIPSYNC_CODE_DATA_SYMBOLS (TVG_LIPSYNC_CODE_BITS / 2)
+#define TVG_LIPSYNC_CODE_SYMBOLS (TVG_LIPSYNC_CODE_DATA_SYMBOLS + 2)
+#define TVG_LIPSYNC_CODE_SYMBOL_MS 10
+#define TVG_LIPSYNC_CODE_MIN_SAMPLERATE 16000
+#define TVG_LIPSYNC_CODE_FREQS {2400, 3000, 3600, 4200}
+
+/* The strongest tone of a symbol must be this many times stronger
+ * than the second strongest. */
+#define TVG_LIPSYNC_CODE_MARGIN 3
+
 typedef struct _lipsync_t lipsync_t;
 
 typedef struct {
   GstClockTime start_time;
   int start_sample;
   int end_sample;
+  int code; /* Frame number sent after the beep, modulo 2^TVG_LIPSYNC_CODE_BITS, or -1 */
 } lipsync_marker_t;
 
 /* Create a new context for lipsync detector */
 lipsync_t *lipsync_create(int samplerate);
 
+/* Continue the sample count of a detection that started from an earlier
+ * point of the stream. Must be called before the first lipsync_process().
+ * If the detection starts outside a beep, the detected beeps are the same
+ * as in a detection from the start of the stream after the first
+ * 2 * TVG_LIPSYNC_BUFFER_LENGTH samples. */
+void lipsync_set_sample_index(lipsync_t *lipsync, int sample_index);
+
 /* Release all resources associated with the context */
 void lipsync_free(lipsync_t *lipsync);
 
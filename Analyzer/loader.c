@@ -8,6 +8,36 @@
 GST_DEBUG_CATEGORY_EXTERN(tvg_analyzer_debug);
 #define GST_CAT_DEFAULT tvg_analyzer_debug
 
+/* Number of samples queued for each stream, in addition to the few
+ * samples that the appsink itself holds. */
+#define LOADER_QUEUE_LENGTH 8
+
+/* Samples of one appsink, pulled by a consumer thread */
+typedef struct {
+  loader_t *loader;
+  const gchar *name;
+  GstElement *sink;
+  GThread *thread;
+  
+  /* Segment and running time of the first sample of the file. Samples
+   * keep their running times from before seeking, see loader_get_time(). */
+  GstSegment segment;
+  GstClockTime start_time;
+  
+  /* Ring buffer of pulled samples, protected by the loader lock */
+  GstSample *samples[LOADER_QUEUE_LENGTH];
+  int head;
+  int count;
+  bool done;
+  
+  /* Sample accounting, pulled == delivered + discarded after close */
+  guint64 pulled;
+  guint64 delivered;
+  guint64 discarded;
+  gsize queued_bytes;
+  gsize peak_bytes;
+} stream_t;
+
 struct _loader_t
 {
   GstElement *pipeline;
@@ -18,8 +48,15 @@ struct _loader_t
   GstElement *videosink;
   GstElement *audiosink;
   GstBus *bus;
-  gint available_audio_buffers;
-  gint available_video_buffers;
+  
+  /* Protects everything below, cond is signaled on any change */
+  GMutex lock;
+  GCond cond;
+  GstState current;
+  bool stopping;
+  GError *error;
+  stream_t audio;
+  stream_t video;
 };
 
 /* Connects the decodebin to the sinks once the pads are available. */
@@ -113,52 +150,196 @@ static void decodebin_no_more_pads(GstElement *decodebin, gpointer data)
   }
 }
 
-/* Keeps track of the number of available audio/video buffers */
-GstFlowReturn new_sample_cb(GstAppSink *appsink, loader_t *state)
+/* Handles the bus messages in the thread that posts them. Nothing pops
+ * the bus, so all messages are dropped after looking at them. */
+static GstBusSyncReply bus_sync_handler(GstBus *bus, GstMessage *msg, gpointer data)
 {
-  if (GST_ELEMENT(appsink) == state->videosink)
+  loader_t *state = (loader_t*)data;
+  
+  if (msg->type == GST_MESSAGE_ERROR)
   {
-    g_atomic_int_inc(&state->available_video_buffers);
+    gchar *debug = NULL;
+    GError *err;
+    
+    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(state->pipeline), GST_DEBUG_GRAPH_SHOW_ALL,
+                              "error");
+    
+    gst_message_parse_error(msg, &err, &debug);
+    
+    g_mutex_lock(&state->lock);
+    if (state->error == NULL)
+    {
+      state->error = g_error_new(err->domain, err->code, "Error from %s: %s\n%s",
+                                 GST_OBJECT_NAME(msg->src), err->message,
+                                 debug ? debug : "(no debug info)");
+    }
+    g_cond_broadcast(&state->cond);
+    g_mutex_unlock(&state->lock);
+    
+    g_error_free(err);
+    g_free(debug);
   }
-  else if (GST_ELEMENT(appsink) == state->audiosink)
+  else if (msg->type == GST_MESSAGE_STATE_CHANGED &&
+           GST_MESSAGE_SRC(msg) == GST_OBJECT(state->pipeline))
   {
-    g_atomic_int_inc(&state->available_audio_buffers);
+    GstState newstate;
+    gst_message_parse_state_changed(msg, NULL, &newstate, NULL);
+    
+    g_mutex_lock(&state->lock);
+    state->current = newstate;
+    g_cond_broadcast(&state->cond);
+    g_mutex_unlock(&state->lock);
   }
   
-  /* Notify any waiting threads */
-  gst_bus_post(state->bus,
-               gst_message_new_application(GST_OBJECT(appsink),
-                                           gst_structure_new_empty("new-sample"))
-  );
-  
-  return GST_FLOW_OK;
+  return GST_BUS_DROP;
 }
 
-/* Returns true if there was an error */
-static bool handle_bus_errors(loader_t *state, GstMessage *msg, GError **error)
+/* Consumer thread: pulls samples from the appsink into the ring buffer,
+ * until end-of-stream or until the pipeline is stopped. */
+static gpointer stream_thread(gpointer data)
 {
-  if (msg->type == GST_MESSAGE_ERROR)
+  stream_t *stream = (stream_t*)data;
+  loader_t *state = stream->loader;
+  GstSample *sample;
+  
+  while ((sample = gst_app_sink_try_pull_sample(GST_APP_SINK(stream->sink),
+                                                GST_CLOCK_TIME_NONE)) != NULL)
   {
-    GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(state->pipeline), GST_DEBUG_GRAPH_SHOW_ALL,
-                              "error");
+    gsize size = gst_buffer_get_size(gst_sample_get_buffer(sample));
     
-    gchar *debug = NULL;
-    GError *err;
-    gst_message_parse_error(msg, &err, &debug);
-    *error = g_error_new(err->domain, err->code, "Error from %s: %s\n%s",
-                          GST_OBJECT_NAME(msg->src), err->message,
-                          debug ? debug : "(no debug info)");
-    g_error_free(err);
-    g_free(debug);
-    return true;
+    g_mutex_lock(&state->lock);
+    stream->pulled++;
+    
+    while (stream->count == LOADER_QUEUE_LENGTH && !state->stopping)
+      g_cond_wait(&state->cond, &state->lock);
+    
+    if (state->stopping)
+    {
+      stream->discarded++;
+      g_mutex_unlock(&state->lock);
+      gst_sample_unref(sample);
+      break;
+    }
+    
+    stream->samples[(stream->head + stream->count) % LOADER_QUEUE_LENGTH] = sample;
+    stream->count++;
+    stream->queued_bytes += size;
+    stream->peak_bytes = MAX(stream->peak_bytes, stream->queued_bytes);
+    g_cond_broadcast(&state->cond);
+    g_mutex_unlock(&state->lock);
   }
-  else
+  
+  g_mutex_lock(&state->lock);
+  stream->done = true;
+  g_cond_broadcast(&state->cond);
+  g_mutex_unlock(&state->lock);
+  
+  return NULL;
+}
+
+/* Take the segment and the start time of the stream from the preroll
+ * sample of the appsink, or mark the stream done if the file does not
+ * have it. The pipeline must be prerolled. */
+static void stream_init(loader_t *state, stream_t *stream, const gchar *name,
+                        GstElement *sink)
+{
+  GstSample *preroll = NULL;
+  
+  stream->loader = state;
+  stream->name = name;
+  stream->sink = sink;
+  stream->done = (sink == NULL);
+  stream->start_time = GST_CLOCK_TIME_NONE;
+  gst_segment_init(&stream->segment, GST_FORMAT_TIME);
+  
+  if (sink != NULL)
+    preroll = gst_app_sink_try_pull_preroll(GST_APP_SINK(sink), 0);
+  
+  if (preroll != NULL)
   {
-    return false;
+    gst_segment_copy_into(gst_sample_get_segment(preroll), &stream->segment);
+    stream->start_time = gst_segment_to_running_time(&stream->segment, GST_FORMAT_TIME,
+                                                     GST_BUFFER_PTS(gst_sample_get_buffer(preroll)));
+    gst_sample_unref(preroll);
+  }
+}
+
+/* Start the consumer thread of the appsink */
+static void stream_start(stream_t *stream)
+{
+  if (stream->sink != NULL)
+    stream->thread = g_thread_new(stream->name, stream_thread, stream);
+}
+
+/* Take the oldest queued sample, must be called with the lock held */
+static GstSample *stream_pop(stream_t *stream)
+{
+  GstSample *sample;
+  
+  if (stream->count == 0)
+    return NULL;
+  
+  sample = stream->samples[stream->head];
+  stream->samples[stream->head] = NULL;
+  stream->head = (stream->head + 1) % LOADER_QUEUE_LENGTH;
+  stream->count--;
+  stream->queued_bytes -= gst_buffer_get_size(gst_sample_get_buffer(sample));
+  return sample;
+}
+
+/* Join the consumer thread and release the samples still queued.
+ * The pipeline must already be stopped. */
+static void stream_stop(stream_t *stream)
+{
+  GstSample *sample;
+  
+  if (stream->thread != NULL)
+  {
+    g_thread_join(stream->thread);
+    stream->thread = NULL;
+  }
+  
+  while ((sample = stream_pop(stream)) != NULL)
+  {
+    stream->discarded++;
+    gst_sample_unref(sample);
+  }
+  
+  GST_INFO("%s stream: %" G_GUINT64_FORMAT " samples pulled, %" G_GUINT64_FORMAT
+           " delivered, %" G_GUINT64_FORMAT " discarded, peak queue %" G_GSIZE_FORMAT
+           " bytes", stream->name, stream->pulled, stream->delivered,
+           stream->discarded, stream->peak_bytes);
+}
+
+/* Wait until the pipeline has reached the state. Dumps the pipeline
+ * graph every second, to help debugging a stuck pipeline. */
+static bool wait_for_state(loader_t *state, GstState target, const gchar *dot_name,
+                           GError **error)
+{
+  g_mutex_lock(&state->lock);
+  while (state->current != target && state->error == NULL)
+  {
+    gint64 end_time = g_get_monotonic_time() + G_TIME_SPAN_SECOND;
+    if (!g_cond_wait_until(&state->cond, &state->lock, end_time))
+    {
+      GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(state->pipeline), GST_DEBUG_GRAPH_SHOW_ALL,
+                                dot_name);
+    }
   }
+  
+  if (state->error != NULL)
+    *error = g_error_copy(state->error);
+  g_mutex_unlock(&state->lock);
+  
+  return *error == NULL;
 }
 
 loader_t *loader_open(const gchar *filename, GError **error)
+{
+  return loader_open_at(filename, 0, error);
+}
+
+loader_t *loader_open_at(const gchar *filename, GstClockTime start, GError **error)
 {
   *error = NULL;
   loader_t *state = g_malloc0(sizeof(loader_t));
@@ -173,16 +354,18 @@ loader_t *loader_open(const gchar *filename, GError **error)
   state->bus = gst_pipeline_get_bus(GST_PIPELINE(state->pipeline));
   
   g_object_set(G_OBJECT(state->filesrc), "location", filename, NULL);
-  g_object_set(G_OBJECT(state->videosink), "max-buffers", 10, NULL);
-  g_object_set(G_OBJECT(state->videosink), "emit-signals", TRUE, NULL);
+  g_object_set(G_OBJECT(state->videosink), "max-buffers", 2, NULL);
   g_object_set(G_OBJECT(state->videosink), "sync", FALSE, NULL);
-  g_object_set(G_OBJECT(state->videosink), "caps",
-               gst_caps_new_simple("video/x-raw",
-                                   "format", G_TYPE_STRING, "RGBx",
-                                   NULL), NULL
-  );
-  g_object_set(G_OBJECT(state->audiosink), "max-buffers", 10, NULL);
-  g_object_set(G_OBJECT(state->audiosink), "emit-signals", TRUE, NULL);
+  
+  /* The analysis works directly on the usual decoder output formats,
+   * so that videoconvert only has to convert the less common ones. */
+  {
+    GstCaps *caps = gst_caps_from_string("video/x-raw, format=(string){ I420, NV12, RGBx }");
+    g_object_set(G_OBJECT(state->videosink), "caps", caps, NULL);
+    gst_caps_unref(caps);
+  }
+  
+  g_object_set(G_OBJECT(state->audiosink), "max-buffers", 2, NULL);
   g_object_set(G_OBJECT(state->audiosink), "sync", FALSE, NULL);
   g_object_set(G_OBJECT(state->audiosink), "caps",
                gst_caps_new_simple("audio/x-raw",
@@ -191,9 +374,6 @@ loader_t *loader_open(const gchar *filename, GError **error)
                                    NULL), NULL
   );
   
-  g_signal_connect(state->videosink, "new-sample", G_CALLBACK(new_sample_cb), state);
-  g_signal_connect(state->audiosink, "new-sample", G_CALLBACK(new_sample_cb), state);
-  
   /* Add and connect elements */
   gst_bin_add_many(GST_BIN(state->pipeline), state->filesrc, state->decodebin,
                    state->videoconvert, state->videosink,
@@ -204,38 +384,57 @@ loader_t *loader_open(const gchar *filename, GError **error)
   g_signal_connect(state->decodebin, "pad-added", G_CALLBACK(decodebin_pad_added), state);
   g_signal_connect(state->decodebin, "no-more-pads", G_CALLBACK(decodebin_no_more_pads), state);
   
-  /* Try to start the pipeline and check for errors */
-  gst_element_set_state(state->pipeline, GST_STATE_PLAYING);
+  g_mutex_init(&state->lock);
+  g_cond_init(&state->cond);
+  gst_bus_set_sync_handler(state->bus, bus_sync_handler, state, NULL);
+  
+  /* Preroll the pipeline and check for errors. The unused sinks have
+   * been removed once the pipeline is prerolled. */
+  gst_element_set_state(state->pipeline, GST_STATE_PAUSED);
+  if (!wait_for_state(state, GST_STATE_PAUSED, "loader_open_wait", error))
+    return state;
+  
+  stream_init(state, &state->audio, "audio", state->audiosink);
+  stream_init(state, &state->video, "video", state->videosink);
   
-  bool state_changed = false;
-  while (!state_changed ||
-         (state->audiosink != NULL && g_atomic_int_get(&state->available_audio_buffers) == 0) ||
-         (state->videosink != NULL && g_atomic_int_get(&state->available_video_buffers) == 0))
+  if (start > 0)
   {
-    GstMessage *msg = gst_bus_timed_pop(state->bus, GST_SECOND);
-    if (msg != NULL)
+    /* The seek position is in stream time, the start in running time */
+    const GstSegment *segment = (state->videosink != NULL) ? &state->video.segment
+                                                           : &state->audio.segment;
+    guint64 position = gst_segment_position_from_running_time(segment, GST_FORMAT_TIME, start);
+    
+    GST_INFO("Seeking to %" GST_TIME_FORMAT, GST_TIME_ARGS(start));
+    if (!gst_element_seek_simple(state->pipeline, GST_FORMAT_TIME,
+                                 GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT |
+                                 GST_SEEK_FLAG_SNAP_BEFORE, position))
     {
-      if (handle_bus_errors(state, msg, error))
-      {
-        break;
-      }
-      else if (msg->type == GST_MESSAGE_STATE_CHANGED)
-      {
-        GstState newstate;
-        gst_message_parse_state_changed(msg, NULL, &newstate, NULL);
-        if (newstate == GST_STATE_PLAYING)
-        {
-          state_changed = true;
-        }
-      }
-      gst_message_unref(msg);
+      g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FAILED,
+                  "Could not seek to %" GST_TIME_FORMAT, GST_TIME_ARGS(start));
+      return state;
     }
-    else
+  }
+  
+  gst_element_set_state(state->pipeline, GST_STATE_PLAYING);
+  if (!wait_for_state(state, GST_STATE_PLAYING, "loader_open_wait", error))
+    return state;
+  
+  stream_start(&state->audio);
+  stream_start(&state->video);
+  
+  /* Wait for the first samples, so that the stream formats are known */
+  g_mutex_lock(&state->lock);
+  while ((state->audio.count == 0 && !state->audio.done) ||
+         (state->video.count == 0 && !state->video.done))
+  {
+    if (state->error != NULL)
     {
-      GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(state->pipeline), GST_DEBUG_GRAPH_SHOW_ALL,
-                            "loader_open_wait");
+      *error = g_error_copy(state->error);
+      break;
     }
+    g_cond_wait(&state->cond, &state->lock);
   }
+  g_mutex_unlock(&state->lock);
   
   GST_DEBUG_BIN_TO_DOT_FILE(GST_BIN(state->pipeline), GST_DEBUG_GRAPH_SHOW_ALL,
                             "loader_open_done");
@@ -245,8 +444,24 @@ loader_t *loader_open(const gchar *filename, GError **error)
 
 void loader_close(loader_t *state)
 {
+  /* Stopping the pipeline wakes up the consumers blocked in the appsinks */
+  g_mutex_lock(&state->lock);
+  state->stopping = true;
+  g_cond_broadcast(&state->cond);
+  g_mutex_unlock(&state->lock);
+  
   gst_element_set_state(state->pipeline, GST_STATE_NULL);
+  stream_stop(&state->audio);
+  stream_stop(&state->video);
+  
+  gst_bus_set_sync_handler(state->bus, NULL, NULL, NULL);
+  gst_object_unref(state->bus); state->bus = NULL;
   gst_object_unref(state->pipeline); state->pipeline = NULL;
+  
+  if (state->error != NULL)
+    g_error_free(state->error);
+  g_mutex_clear(&state->lock);
+  g_cond_clear(&state->cond);
   g_free(state);
 }
 
@@ -469,6 +684,16 @@ float loader_get_framerate(loader_t *state)
   }
 }
 
+/* Log the timestamp of a delivered sample */
+static void log_sample(const gchar *name, GstSample *sample)
+{
+  GstBuffer *buf = gst_sample_get_buffer(sample);
+  GstClockTime time = gst_segment_to_running_time(gst_sample_get_segment(sample),
+                                                  GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+  GST_INFO("Got %s buffer: %" GST_TIME_FORMAT " duration %" GST_TIME_FORMAT,
+           name, GST_TIME_ARGS(time), GST_TIME_ARGS(GST_BUFFER_DURATION(buf)));
+}
+
 bool loader_get_buffer(loader_t *state, GstSample **audio_sample,
                        GstSample **video_sample, GError **error)
 {
@@ -476,53 +701,111 @@ bool loader_get_buffer(loader_t *state, GstSample **audio_sample,
   *video_sample = NULL;
   *error = NULL;
   
-  do
+  g_mutex_lock(&state->lock);
+  while (state->error == NULL && state->audio.count == 0 && state->video.count == 0)
   {
-    if ((state->videosink == NULL || gst_app_sink_is_eos(GST_APP_SINK(state->videosink))) &&
-        (state->audiosink == NULL || gst_app_sink_is_eos(GST_APP_SINK(state->audiosink))))
+    if (state->audio.done && state->video.done)
     {
-      /* End of stream and appsinks are empty */
+      /* End of stream and the queues are empty */
+      g_mutex_unlock(&state->lock);
       return false;
     }
     
-    GstMessage *msg = gst_bus_timed_pop(state->bus, GST_SECOND);
-    if (msg != NULL)
-    {
-      handle_bus_errors(state, msg, error);
-      gst_message_unref(msg);
-    }
+    g_cond_wait(&state->cond, &state->lock);
+  }
+  
+  if (state->error != NULL)
+  {
+    *error = g_error_copy(state->error);
+  }
+  else
+  {
+    *audio_sample = stream_pop(&state->audio);
+    *video_sample = stream_pop(&state->video);
+    state->audio.delivered += (*audio_sample != NULL);
+    state->video.delivered += (*video_sample != NULL);
     
-    if (g_atomic_int_get(&state->available_audio_buffers))
+    /* Wake up the consumers waiting for space */
+    g_cond_broadcast(&state->cond);
+  }
+  g_mutex_unlock(&state->lock);
+  
+  if (*audio_sample != NULL)
+    log_sample("audio", *audio_sample);
+  if (*video_sample != NULL)
+    log_sample("video", *video_sample);
+  
+  return true;
+}
+
+GstClockTime loader_get_duration(loader_t *state)
+{
+  gint64 duration;
+  
+  if (!gst_element_query_duration(state->pipeline, GST_FORMAT_TIME, &duration))
+    return GST_CLOCK_TIME_NONE;
+  
+  return duration;
+}
+
+GstClockTime loader_get_time(loader_t *state, GstSample *sample)
+{
+  GstStructure *str = gst_caps_get_structure(gst_sample_get_caps(sample), 0);
+  stream_t *stream = g_str_has_prefix(gst_structure_get_name(str), "audio/") ?
+                     &state->audio : &state->video;
+  
+  return gst_segment_to_running_time(&stream->segment, GST_FORMAT_TIME,
+                                     GST_BUFFER_PTS(gst_sample_get_buffer(sample)));
+}
+
+GstClockTime loader_get_audio_start(loader_t *state)
+{
+  return state->audio.start_time;
+}
+
+bool loader_map_frame(GstSample *sample, GstVideoFrame *vframe, frame_t *frame,
+                      GError **error)
+{
+  GstVideoInfo info;
+  gdouble kr, kb;
+  guint i;
+  
+  gst_video_info_init(&info);
+  if (!gst_video_info_from_caps(&info, gst_sample_get_caps(sample)) ||
+      !gst_video_frame_map(vframe, &info, gst_sample_get_buffer(sample), GST_MAP_READ))
+  {
+    g_set_error(error, GST_STREAM_ERROR, GST_STREAM_ERROR_FORMAT,
+                "Could not map video frame");
+    return false;
+  }
+  
+  memset(frame, 0, sizeof(*frame));
+  switch (GST_VIDEO_FRAME_FORMAT(vframe))
+  {
+    case GST_VIDEO_FORMAT_I420: frame->format = FRAME_I420; break;
+    case GST_VIDEO_FORMAT_NV12: frame->format = FRAME_NV12; break;
+    default:                    frame->format = FRAME_RGBX; break;
+  }
+  
+  frame->width = GST_VIDEO_FRAME_WIDTH(vframe);
+  frame->height = GST_VIDEO_FRAME_HEIGHT(vframe);
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES(vframe); i++)
+  {
+    frame->data[i] = GST_VIDEO_FRAME_PLANE_DATA(vframe, i);
+    frame->stride[i] = GST_VIDEO_FRAME_PLANE_STRIDE(vframe, i);
+  }
+  
+  if (frame->format != FRAME_RGBX)
+  {
+    if (!gst_video_color_matrix_get_Kr_Kb(info.colorimetry.matrix, &kr, &kb))
     {
-      g_atomic_int_dec_and_test(&state->available_audio_buffers);
-      GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK(state->audiosink));
-      if (sample)
-      {
-        *audio_sample = sample;
-        
-        GstClockTime time = gst_segment_to_running_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, GST_BUFFER_PTS(gst_sample_get_buffer(sample)));
-        GST_INFO("Got audio buffer: %" GST_TIME_FORMAT " duration %" GST_TIME_FORMAT,
-                 GST_TIME_ARGS(time),
-                 GST_TIME_ARGS(GST_BUFFER_DURATION(gst_sample_get_buffer(sample))));
-      }
+      /* Unknown matrix, assume BT.601 */
+      kr = 0.299;
+      kb = 0.114;
     }
     
-    if (g_atomic_int_get(&state->available_video_buffers))
-    {
-      g_atomic_int_dec_and_test(&state->available_video_buffers);
-      GstSample *sample = gst_app_sink_pull_sample(GST_APP_SINK(state->videosink));
-      if (sample)
-      {
-        *video_sample = sample;
-        
-        GstClockTime time = gst_segment_to_running_time(gst_sample_get_segment(sample), GST_FORMAT_TIME, GST_BUFFER_PTS(gst_sample_get_buffer(sample)));
-        GST_INFO("Got video buffer: %" GST_TIME_FORMAT " duration %" GST_TIME_FORMAT,
-                 GST_TIME_ARGS(time),
-                 GST_TIME_ARGS(GST_BUFFER_DURATION(gst_sample_get_buffer(sample))));
-      }
-    }
-  } while (*audio_sample == NULL && *video_sample == NULL && *error == NULL);
+    frame_set_matrix(frame, kr, kb, info.colorimetry.range == GST_VIDEO_COLOR_RANGE_0_255);
+  }
   
   return true;
 }
-
@@ -5,13 +5,19 @@
 #define _TVG_LOADER_H_
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 #include <stdbool.h>
+#include "frame.h"
 
 typedef struct _loader_t loader_t;
 
 /* Load the given video file and setup a pipeline to parse it. */
 loader_t *loader_open(const gchar *filename, GError **error);
 
+/* Same as loader_open(), but start from the key frame at or before the
+ * given running time. */
+loader_t *loader_open_at(const gchar *filename, GstClockTime start, GError **error);
+
 /* Release all resources associated to the state. */
 void loader_close(loader_t *state);
 
@@ -42,10 +48,27 @@ int loader_get_samplerate(loader_t *state);
 /* Get framerate of video, or 0 for variable fps */
 float loader_get_framerate(loader_t *state);
 
-/* Retrieve video/audio buffers. Atleast one of the returned pointers
- * is non-NULL after the call, *except* on end-of-stream when it returns false. */
+/* Get duration of the file, or GST_CLOCK_TIME_NONE if not known */
+GstClockTime loader_get_duration(loader_t *state);
+
+/* Retrieve video/audio samples, the caller owns the returned references.
+ * Blocks until a sample is available. Atleast one of the returned pointers
+ * is non-NULL after the call, *except* on end-of-stream when it returns false,
+ * or on a pipeline error when *error is set. */
 bool loader_get_buffer(loader_t *state, GstSample **audio_sample,
                        GstSample **video_sample, GError **error);
 
+/* Get the running time of a sample. After loader_open_at() the times
+ * are the same as when decoding from the start of the file. */
+GstClockTime loader_get_time(loader_t *state, GstSample *sample);
+
+/* Get the running time of the first audio sample of the file */
+GstClockTime loader_get_audio_start(loader_t *state);
+
+/* Map a video sample for reading. The frame stays valid until
+ * gst_video_frame_unmap(vframe) is called. */
+bool loader_map_frame(GstSample *sample, GstVideoFrame *vframe, frame_t *frame,
+                      GError **error);
+
 
 #endif
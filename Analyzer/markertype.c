@@ -1,16 +1,13 @@
 #include "markertype.h"
-#include <string.h>
 #include <stdbool.h>
 
 /* Count the number of header (all white) frames in the video data. */
-static void count_header_frames(videoinfo_t *videoinfo, GArray *frame_data)
+static void count_header_frames(videoinfo_t *videoinfo, const framestore_t *frames)
 {
   size_t i;
-  for (i = 0; i < frame_data->len; i++)
+  for (i = 0; i < framestore_length(frames); i++)
   {
-    char *frame = g_array_index(frame_data, char*, i);
-    
-    if ((int)strspn(frame, "w") != videoinfo->num_markers)
+    if (!framestore_all_codes(frames, i, TVG_COLOR_WHITE))
       break;
     
     videoinfo->num_header_frames++;
@@ -18,23 +15,19 @@ static void count_header_frames(videoinfo_t *videoinfo, GArray *frame_data)
 }
 
 /* Count the number of locator (marks in black) frames in the video data. */
-static void count_locator_frames(videoinfo_t *videoinfo, GArray *frame_data)
+static void count_locator_frames(videoinfo_t *videoinfo, const framestore_t *frames)
 {
   size_t i;
   for (i = videoinfo->num_header_frames;
-       i < frame_data->len; i++)
+       i < framestore_length(frames); i++)
   {
-    char *frame = g_array_index(frame_data, char*, i);
-
     /* Locator frames are a bit difficult to identify as they have both
      * black and white markers. We detect them by requiring that all locator
      * frames are identical. */
-    if (i == frame_data->len - 1)
+    if (i == framestore_length(frames) - 1)
       break;
     
-    char *next = g_array_index(frame_data, char*, i+1);
-    
-    if (strcmp(frame, next) != 0)
+    if (!framestore_same_codes(frames, i, i + 1))
     {
       /* If there have already been locator frames, count also this last one. */
       if (videoinfo->num_locator_frames > 0)
@@ -48,15 +41,13 @@ static void count_locator_frames(videoinfo_t *videoinfo, GArray *frame_data)
 }
 
 /* Count the number of content (non-white) frames in the video data. */
-static void count_content_frames(videoinfo_t *videoinfo, GArray *frame_data)
+static void count_content_frames(videoinfo_t *videoinfo, const framestore_t *frames)
 {
   size_t i;
   for (i = videoinfo->num_header_frames
-           + videoinfo->num_locator_frames; i < frame_data->len; i++)
+           + videoinfo->num_locator_frames; i < framestore_length(frames); i++)
   {
-    char *frame = g_array_index(frame_data, char*, i);
-    
-    if ((int)strspn(frame, "w") == videoinfo->num_markers)
+    if (framestore_all_codes(frames, i, TVG_COLOR_WHITE))
       break;
     
     videoinfo->num_content_frames++;
@@ -64,26 +55,24 @@ static void count_content_frames(videoinfo_t *videoinfo, GArray *frame_data)
 }
 
 /* Count the number of trailer (white) frames in the video data. */
-static void count_trailer_frames(videoinfo_t *videoinfo, GArray *frame_data)
+static void count_trailer_frames(videoinfo_t *videoinfo, const framestore_t *frames)
 {
   size_t i;
   for (i = videoinfo->num_header_frames
            + videoinfo->num_locator_frames
-           + videoinfo->num_content_frames; i < frame_data->len; i++)
+           + videoinfo->num_content_frames; i < framestore_length(frames); i++)
   {
-    char *frame = g_array_index(frame_data, char*, i);
-    
-    if ((int)strspn(frame, "w") != videoinfo->num_markers)
+    if (!framestore_all_codes(frames, i, TVG_COLOR_WHITE))
       break;
     
     videoinfo->num_trailer_frames++;
   }
 }
 
-#define GET_FRAME() g_array_index(frame_data, char*, framenum++)[marker_index]
+#define GET_FRAME() framestore_get_code(frames, framenum++, marker_index)
 
 /* Determine if this marker is a BW sync/frameid mark */
-static bool detect_bw_mark(videoinfo_t *videoinfo, GArray *frame_data,
+static bool detect_bw_mark(videoinfo_t *videoinfo, const framestore_t *frames,
                            int marker_index, markerinfo_t *markerinfo)
 {
   int framenum = 0, i;
@@ -91,20 +80,20 @@ static bool detect_bw_mark(videoinfo_t *videoinfo, GArray *frame_data,
   /* Should be white for whole header duration */
   for (i = 0; i < videoinfo->num_header_frames; i++)
   {
-    char c = GET_FRAME();
-    if (c != 'w')
+    uint8_t c = GET_FRAME();
+    if (c != TVG_COLOR_WHITE)
       return false;
   }
   
   /* First locator frame tells us if this is a frameid or a sync mark */
   if (videoinfo->num_locator_frames > 0)
   {
-    char c = GET_FRAME();
+    uint8_t c = GET_FRAME();
     i = 1;
     
-    if (c == 'w')
+    if (c == TVG_COLOR_WHITE)
       markerinfo->type = TVG_MARKER_SYNCMARK;
-    else if (c == 'k')
+    else if (c == TVG_COLOR_BLACK)
       markerinfo->type = TVG_MARKER_FRAMEID;
     else
       return false;
@@ -119,8 +108,8 @@ static bool detect_bw_mark(videoinfo_t *videoinfo, GArray *frame_data,
   /* Verify rest of locator frames */
   for (; i < videoinfo->num_locator_frames; i++)
   {
-    char c = GET_FRAME();
-    char expected = (markerinfo->type == TVG_MARKER_SYNCMARK) ? 'w' : 'k';
+    uint8_t c = GET_FRAME();
+    uint8_t expected = (markerinfo->type == TVG_MARKER_SYNCMARK) ? TVG_COLOR_WHITE : TVG_COLOR_BLACK;
     if (c != expected)
       return false;
   }
@@ -129,13 +118,13 @@ static bool detect_bw_mark(videoinfo_t *videoinfo, GArray *frame_data,
   markerinfo->interval = 0;
   for (i = 0; i < videoinfo->num_content_frames; i++)
   {
-    char c = GET_FRAME();
-    if (c == 'w')
+    uint8_t c = GET_FRAME();
+    if (c == TVG_COLOR_WHITE)
     {
       markerinfo->interval = i++;
       break;
     }
-    else if (c != 'k')
+    else if (c != TVG_COLOR_BLACK)
     {
       return false;
     }
@@ -144,13 +133,13 @@ static bool detect_bw_mark(videoinfo_t *videoinfo, GArray *frame_data,
   /* Verify rest of content frames */
   for (; i < videoinfo->num_content_frames; i++)
   {
-    char c = GET_FRAME();
-    char expected;
+    uint8_t c = GET_FRAME();
+    uint8_t expected;
     
     if (markerinfo->interval > 0)
-      expected = (i % (markerinfo->interval * 2) < markerinfo->interval) ? 'k' : 'w';
+      expected = (i % (markerinfo->interval * 2) < markerinfo->interval) ? TVG_COLOR_BLACK : TVG_COLOR_WHITE;
     else
-      expected = 'k';
+      expected = TVG_COLOR_BLACK;
       
     if (c != expected)
       return false;
@@ -159,8 +148,8 @@ static bool detect_bw_mark(videoinfo_t *videoinfo, GArray *frame_data,
   /* Verify trailer frames */
   for (i = 0; i < videoinfo->num_trailer_frames; i++)
   {
-    char c = GET_FRAME();
-    if (c != 'w')
+    uint8_t c = GET_FRAME();
+    if (c != TVG_COLOR_WHITE)
       return false;
   }
   
@@ -168,7 +157,7 @@ static bool detect_bw_mark(videoinfo_t *videoinfo, GArray *frame_data,
 }
 
 /* Determine if this marker is a RGB6 marker */
-static bool detect_rgb6_mark(videoinfo_t *videoinfo, GArray *frame_data,
+static bool detect_rgb6_mark(videoinfo_t *videoinfo, const framestore_t *frames,
                              int marker_index, markerinfo_t *markerinfo)
 {
   int framenum = 0, i;
@@ -176,29 +165,33 @@ static bool detect_rgb6_mark(videoinfo_t *videoinfo, GArray *frame_data,
   /* Should be white for whole header duration */
   for (i = 0; i < videoinfo->num_header_frames; i++)
   {
-    char c = GET_FRAME();
-    if (c != 'w')
+    uint8_t c = GET_FRAME();
+    if (c != TVG_COLOR_WHITE)
       return false;
   }
   
   /* Should be white for locator frames also */
   for (i = 0; i < videoinfo->num_locator_frames; i++)
   {
-    char c = GET_FRAME();
-    if (c != 'w')
+    uint8_t c = GET_FRAME();
+    if (c != TVG_COLOR_WHITE)
       return false;
   }
   
   /* Should follow the RGB6 sequence for the content frames
    * Up to one frame at a time may be replaced by black lipsync marker. */
   {
+    static const uint8_t rgb6_sequence[6] = {
+      TVG_COLOR_RED, TVG_COLOR_YELLOW, TVG_COLOR_GREEN,
+      TVG_COLOR_CYAN, TVG_COLOR_BLUE, TVG_COLOR_MAGENTA
+    };
     bool was_black = false;
     for (i = 0; i < videoinfo->num_content_frames; i++)
     {
-      char c = GET_FRAME();
-      char expected = "rygcbm"[i % 6];
+      uint8_t c = GET_FRAME();
+      uint8_t expected = rgb6_sequence[i % 6];
       
-      if (c == 'k' && !was_black)
+      if (c == TVG_COLOR_BLACK && !was_black)
         was_black = true;
       else if (c == expected)
         was_black = false;
@@ -210,8 +203,8 @@ static bool detect_rgb6_mark(videoinfo_t *videoinfo, GArray *frame_data,
   /* Trailer should be white */
   for (i = 0; i < videoinfo->num_trailer_frames; i++)
   {
-    char c = GET_FRAME();
-    if (c != 'w')
+    uint8_t c = GET_FRAME();
+    if (c != TVG_COLOR_WHITE)
       return false;
   }
   
@@ -221,28 +214,28 @@ static bool detect_rgb6_mark(videoinfo_t *videoinfo, GArray *frame_data,
   return true;
 }
 
-videoinfo_t *markertype_analyze(GArray *frame_data)
+videoinfo_t *markertype_analyze(const framestore_t *frames)
 {  
   int i;
   videoinfo_t *videoinfo = g_malloc0(sizeof(videoinfo_t));
  
-  if (frame_data->len > 0)
+  if (framestore_length(frames) > 0)
   {
-    videoinfo->num_markers = strlen(g_array_index(frame_data, char*, 0));
+    videoinfo->num_markers = framestore_num_markers(frames);
   }
   
   videoinfo->markerinfo = g_malloc0(sizeof(markerinfo_t) * videoinfo->num_markers);
   
-  count_header_frames(videoinfo, frame_data);
-  count_locator_frames(videoinfo, frame_data);
-  count_content_frames(videoinfo, frame_data);
-  count_trailer_frames(videoinfo, frame_data);
+  count_header_frames(videoinfo, frames);
+  count_locator_frames(videoinfo, frames);
+  count_content_frames(videoinfo, frames);
+  count_trailer_frames(videoinfo, frames);
   
   for (i = 0; i < videoinfo->num_markers; i++)
   {
     markerinfo_t *markerinfo = &videoinfo->markerinfo[i];
-    if (!detect_bw_mark(videoinfo, frame_data, i, markerinfo) &&
-        !detect_rgb6_mark(videoinfo, frame_data, i, markerinfo))
+    if (!detect_bw_mark(videoinfo, frames, i, markerinfo) &&
+        !detect_rgb6_mark(videoinfo, frames, i, markerinfo))
     {
       markerinfo->type = TVG_MARKER_UNKNOWN;
     }
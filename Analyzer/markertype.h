@@ -4,6 +4,7 @@
 #define _TVG_MARKERTYPE_H_
 
 #include <glib.h>
+#include "framestore.h"
 
 typedef enum {
   TVG_MARKER_UNKNOWN = 0,
@@ -26,9 +27,8 @@ typedef struct {
   int num_markers;
 } videoinfo_t;
 
-/* Detect the type of each marker in the frame data.
- * frame_data: Array of char* entries with marker colors. */
-videoinfo_t *markertype_analyze(GArray *frame_data);
+/* Detect the type of each marker from the marker states of the frames */
+videoinfo_t *markertype_analyze(const framestore_t *frames);
 
 /* Release the allocated arrays */
 void markertype_free(videoinfo_t *videoinfo);
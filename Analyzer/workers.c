@@ -0,0 +1,132 @@
+#include "workers.h"
+#include <glib.h>
+#include <stdbool.h>
+
+struct _workers_t
+{
+  int count;
+  GThread **threads;
+  
+  GMutex lock;
+  GCond start_cond;
+  GCond done_cond;
+  
+  /* Current job, a new generation starts each run */
+  workers_func_t func;
+  void *data;
+  int generation;
+  int pending;
+  bool quit;
+};
+
+typedef struct {
+  workers_t *workers;
+  int index;
+} worker_arg_t;
+
+static gpointer worker_thread(gpointer arg)
+{
+  worker_arg_t *worker = arg;
+  workers_t *workers = worker->workers;
+  int index = worker->index;
+  int seen = 0;
+  
+  g_free(worker);
+  
+  g_mutex_lock(&workers->lock);
+  for (;;)
+  {
+    workers_func_t func;
+    void *data;
+    
+    while (workers->generation == seen && !workers->quit)
+      g_cond_wait(&workers->start_cond, &workers->lock);
+    
+    if (workers->quit)
+      break;
+    
+    seen = workers->generation;
+    func = workers->func;
+    data = workers->data;
+    g_mutex_unlock(&workers->lock);
+    
+    func(data, index, workers->count);
+    
+    g_mutex_lock(&workers->lock);
+    if (--workers->pending == 0)
+      g_cond_signal(&workers->done_cond);
+  }
+  g_mutex_unlock(&workers->lock);
+  
+  return NULL;
+}
+
+workers_t *workers_create(int count)
+{
+  workers_t *workers = g_malloc0(sizeof(workers_t));
+  int i;
+  
+  workers->count = (count < 1) ? 1 : count;
+  g_mutex_init(&workers->lock);
+  g_cond_init(&workers->start_cond);
+  g_cond_init(&workers->done_cond);
+  
+  workers->threads = g_malloc0(workers->count * sizeof(GThread*));
+  for (i = 1; i < workers->count; i++)
+  {
+    worker_arg_t *arg = g_malloc(sizeof(worker_arg_t));
+    arg->workers = workers;
+    arg->index = i;
+    workers->threads[i] = g_thread_new("tvg_worker", worker_thread, arg);
+  }
+  
+  return workers;
+}
+
+void workers_free(workers_t *workers)
+{
+  int i;
+  
+  g_mutex_lock(&workers->lock);
+  workers->quit = true;
+  g_cond_broadcast(&workers->start_cond);
+  g_mutex_unlock(&workers->lock);
+  
+  for (i = 1; i < workers->count; i++)
+    g_thread_join(workers->threads[i]);
+  
+  g_free(workers->threads);
+  g_cond_clear(&workers->done_cond);
+  g_cond_clear(&workers->start_cond);
+  g_mutex_clear(&workers->lock);
+  g_free(workers);
+}
+
+int workers_count(workers_t *workers)
+{
+  return workers->count;
+}
+
+void workers_run(workers_t *workers, workers_func_t func, void *data)
+{
+  if (workers->count > 1)
+  {
+    g_mutex_lock(&workers->lock);
+    workers->func = func;
+    workers->data = data;
+    workers->pending = workers->count - 1;
+    workers->generation++;
+    g_cond_broadcast(&workers->start_cond);
+    g_mutex_unlock(&workers->lock);
+  }
+  
+  func(data, 0, workers->count);
+  
+  if (workers->count > 1)
+  {
+    g_mutex_lock(&workers->lock);
+    while (workers->pending > 0)
+      g_cond_wait(&workers->done_cond, &workers->lock);
+    g_mutex_unlock(&workers->lock);
+  }
+}
@@ -0,0 +1,25 @@
+/* Persistent pool of worker threads that run the same function in
+ * parallel, for splitting a frame into bands. The calling thread takes
+ * part as worker 0, so a pool of one worker starts no threads. */
+
+#ifndef _TVG_WORKERS_H_
+#define _TVG_WORKERS_H_
+
+typedef struct _workers_t workers_t;
+
+/* Called on each worker with its index, 0 <= index < count */
+typedef void (*workers_func_t)(void *data, int index, int count);
+
+/* Start a pool of count workers */
+workers_t *workers_create(int count);
+
+/* Stop the threads and release the pool */
+void workers_free(workers_t *workers);
+
+/* Number of workers in the pool */
+int workers_count(workers_t *workers);
+
+/* Run the function on all the workers and wait until they are done */
+void workers_run(workers_t *workers, workers_func_t func, void *data);
+
+#endif
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <gst/gst.h>
+#include "jobspec.h"
+#include "generator.h"
+
+#ifdef G_OS_WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+GST_DEBUG_CATEGORY(tvg_generate_debug);
+#define GST_CAT_DEFAULT tvg_generate_debug
+
+static generator_t *g_generator = NULL;
+
+/* Ctrl-C finishes the output file, second Ctrl-C aborts */
+static void interrupt_handler(int signum)
+{
+  static volatile sig_atomic_t interrupted = 0;
+
+  if (interrupted || g_generator == NULL)
+  {
+    _exit(130);
+  }
+
+  interrupted = 1;
+  generator_request_stop(g_generator);
+}
+
+/* Peak resident memory of the process in bytes */
+static guint64 get_peak_memory(void)
+{
+#ifdef G_OS_WIN32
+  PROCESS_MEMORY_COUNTERS pmc;
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+    return pmc.PeakWorkingSetSize;
+  return 0;
+#else
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return (guint64)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+/* Append a structure as a JSON object. Only the value types used in
+ * the statistics structures are supported. */
+static void structure_to_json(GString *json, const GstStructure *s);
+
+static gboolean field_to_json(GQuark field, const GValue *value, gpointer data)
+{
+  GString *json = (GString*)data;
+
+  if (json->str[json->len - 1] != '{')
+    g_string_append(json, ", ");
+  g_string_append_printf(json, "\"%s\": ", g_quark_to_string(field));
+
+  if (GST_VALUE_HOLDS_STRUCTURE(value))
+    structure_to_json(json, gst_value_get_structure(value));
+  else if (G_VALUE_HOLDS_UINT64(value))
+    g_string_append_printf(json, "%" G_GUINT64_FORMAT, g_value_get_uint64(value));
+  else if (G_VALUE_HOLDS_INT64(value))
+    g_string_append_printf(json, "%" G_GINT64_FORMAT, g_value_get_int64(value));
+  else if (G_VALUE_HOLDS_INT(value))
+    g_string_append_printf(json, "%d", g_value_get_int(value));
+  else if (G_VALUE_HOLDS_DOUBLE(value))
+    g_string_append_printf(json, "%f", g_value_get_double(value));
+  else if (G_VALUE_HOLDS_STRING(value))
+    g_string_append_printf(json, "\"%s\"", g_value_get_string(value));
+  else
+    g_string_append(json, "null");
+
+  return TRUE;
+}
+
+static void structure_to_json(GString *json, const GstStructure *s)
+{
+  g_string_append_c(json, '{');
+  gst_structure_foreach(s, field_to_json, json);
+  g_string_append_c(json, '}');
+}
+
+/* Write the throughput statistics for tests/benchmark.py */
+static bool write_stats_file(const gchar *filename, GstStructure *stats,
+                             guint64 frames, double wall_time, guint64 peak_memory)
+{
+  GString *json = g_string_new(NULL);
+  GError *error = NULL;
+  bool status;
+
+  gst_structure_set(stats,
+                    "wall-time", G_TYPE_DOUBLE, wall_time,
+                    "fps", G_TYPE_DOUBLE, (wall_time > 0) ? frames / wall_time : 0.0,
+                    "peak-memory", G_TYPE_UINT64, peak_memory,
+                    NULL);
+
+  structure_to_json(json, stats);
+  g_string_append_c(json, '\n');
+
+  status = g_file_set_contents(filename, json->str, json->len, &error);
+  if (!status)
+  {
+    fprintf(stderr, "Could not write statistics: %s\n", error->message);
+    g_error_free(error);
+  }
+
+  g_string_free(json, TRUE);
+  return status;
+}
+
+static void print_usage(const char *progname)
+{
+  fprintf(stderr, "Usage: %s [KEY=VALUE | file.tvg] ...\n", progname);
+  fprintf(stderr, "\n");
+  fprintf(stderr, "Generates a test video. The settings are applied in the given order,\n");
+  fprintf(stderr, "so later ones override earlier ones.\n");
+  fprintf(stderr, "\n");
+  jobspec_print_help(stderr);
+}
+
+int main(int argc, char *argv[])
+{
+  jobspec_t job;
+  GError *error = NULL;
+  gint64 start_time, end_time;
+  double wall_time;
+  guint64 frames;
+  bool status;
+  int i;
+
+  gst_init(&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT(tvg_generate_debug, "tvg_generate", 0, "Test video generator");
+
+  jobspec_init(&job);
+
+  for (i = 1; i < argc; i++)
+  {
+    bool ok;
+
+    if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
+    {
+      print_usage(argv[0]);
+      jobspec_clear(&job);
+      return 0;
+    }
+
+    if (strchr(argv[i], '=') != NULL)
+    {
+      ok = jobspec_set_from_string(&job, argv[i], &error);
+    }
+    else
+    {
+      ok = jobspec_load(&job, argv[i], &error);
+      if (ok)
+        printf("Loaded parameters from %s\n", argv[i]);
+    }
+
+    if (!ok)
+    {
+      fprintf(stderr, "%s\n", error->message);
+      g_error_free(error);
+      jobspec_clear(&job);
+      return 1;
+    }
+  }
+
+  if (!jobspec_validate(&job, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    jobspec_clear(&job);
+    return 1;
+  }
+
+  g_generator = generator_create(&job, &error);
+  if (g_generator == NULL)
+  {
+    fprintf(stderr, "Could not create the pipeline: %s\n", error->message);
+    g_error_free(error);
+    jobspec_clear(&job);
+    return 2;
+  }
+
+  signal(SIGINT, interrupt_handler);
+
+  printf("Starting test video generator..\n");
+  start_time = g_get_monotonic_time();
+  status = generator_run(g_generator, &error);
+  end_time = g_get_monotonic_time();
+
+  signal(SIGINT, SIG_DFL);
+
+  frames = generator_get_frame_count(g_generator);
+  wall_time = (end_time - start_time) / 1e6;
+
+  if (job.stats_file[0] != '\0')
+  {
+    GstStructure *stats = generator_get_stats(g_generator);
+    write_stats_file(job.stats_file, stats, frames, wall_time, get_peak_memory());
+    gst_structure_free(stats);
+  }
+
+  generator_free(g_generator);
+  g_generator = NULL;
+
+  printf("Processed %" G_GUINT64_FORMAT " frames in %.1f s (%.1f fps), "
+         "peak memory %.1f MB\n",
+         frames, wall_time, (wall_time > 0) ? frames / wall_time : 0.0,
+         get_peak_memory() / (1024.0 * 1024.0));
+
+  if (!status)
+  {
+    fprintf(stderr, "Error: %s\n", error ? error->message : "unknown error");
+    if (error) g_error_free(error);
+    jobspec_clear(&job);
+    return 2;
+  }
+
+  printf("Done! Output written to %s\n", job.output);
+  jobspec_clear(&job);
+  return 0;
+}
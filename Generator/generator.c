@@ -0,0 +1,984 @@
+#include "generator.h"
+#include <gst/video/video.h>
+#include <gst/pbutils/pbutils.h>
+#include <string.h>
+#include <stdio.h>
+
+GST_DEBUG_CATEGORY_EXTERN(tvg_generate_debug);
+#define GST_CAT_DEFAULT tvg_generate_debug
+
+/* How long to wait for the end-of-stream after a stop request */
+#define GENERATOR_STOP_TIMEOUT (10 * GST_SECOND)
+
+/* Queues that carry only compressed or audio data are limited by time */
+#define GENERATOR_QUEUE_TIME (10 * GST_SECOND)
+
+/* Raw video queues never hold more than this much video */
+#define GENERATOR_MAX_RAW_QUEUE_TIME GST_SECOND
+
+/* Time limit for finding out whether the input has audio */
+#define GENERATOR_DISCOVER_TIMEOUT (10 * GST_SECOND)
+
+/* Elements whose processing time is measured */
+#define GENERATOR_MAX_TIMERS 4
+
+/* Time from a buffer entering an element to the element pushing a buffer
+ * out. Each timed element runs its chain function in a single streaming
+ * thread, so one timestamp per element is enough. */
+typedef struct
+{
+  const gchar *name;
+  GstClockTime last_in;
+  guint64 total;
+  guint64 count;
+} element_timer_t;
+
+struct _generator_t
+{
+  GstElement *pipeline;
+  GstElement *oftvg;
+
+  /* Raw video before and after the oftvg element */
+  GstElement *video_queue_in;
+  GstElement *video_queue_mid;
+
+  /* Compressed video and the audio queues */
+  GstElement *video_queue_out;
+  GstElement *audio_queue_in;
+  GstElement *audio_queue_mid;
+  GstElement *audio_queue_out;
+
+  guint64 memory_budget; /* bytes */
+  gint encoder_threads;
+
+  /* Processing time of the main elements, measured with pad probes */
+  element_timer_t timers[GENERATOR_MAX_TIMERS];
+  int num_timers;
+
+  /* Read-ahead file source, NULL if the input is read on demand */
+  GstElement *input_src;
+
+  /* Latest render statistics posted by oftvg */
+  GstStructure *oftvg_stats;
+  GstStructure *decoder_info;
+
+  /* Counted in the streaming thread, read from the main thread */
+  GMutex frame_lock;
+  guint64 frame_count;
+
+  volatile gint stop_requested;
+};
+
+/* Create an element and add it to the pipeline */
+static GstElement *add_element(generator_t *gen, const gchar *factory,
+                               const gchar *name, GError **error)
+{
+  GstElement *element = gst_element_factory_make(factory, name);
+
+  if (element == NULL)
+  {
+    g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_MISSING_PLUGIN,
+                "Could not create element '%s', check your GStreamer installation",
+                factory);
+    return NULL;
+  }
+
+  gst_bin_add(GST_BIN(gen->pipeline), element);
+  return element;
+}
+
+/* Create a bin from a gst-launch style description given in the job spec,
+ * e.g. "x264enc speed-preset=4", and add it to the pipeline. */
+static GstElement *add_description(generator_t *gen, const gchar *key,
+                                   const gchar *description, GError **error)
+{
+  GError *parse_error = NULL;
+  GstElement *bin;
+
+  bin = gst_parse_bin_from_description_full(description, TRUE, NULL,
+                                            GST_PARSE_FLAG_FATAL_ERRORS,
+                                            &parse_error);
+  if (bin == NULL)
+  {
+    g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+                "%s: could not parse '%s': %s", key, description,
+                parse_error->message);
+    g_error_free(parse_error);
+    return NULL;
+  }
+
+  gst_bin_add(GST_BIN(gen->pipeline), bin);
+  return bin;
+}
+
+/* Set the number of threads on an encoder, using whichever
+ * property name the element happens to use. */
+static void set_thread_count(GstElement *element, gint threads)
+{
+  static const gchar *properties[] = {"threads", "max-threads", "n-threads"};
+  GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+  gchar *value = g_strdup_printf("%d", threads);
+  size_t i;
+
+  for (i = 0; i < G_N_ELEMENTS(properties); i++)
+  {
+    if (g_object_class_find_property(klass, properties[i]) != NULL)
+    {
+      GST_INFO("Setting %s %s=%s", GST_ELEMENT_NAME(element), properties[i], value);
+      gst_util_set_object_arg(G_OBJECT(element), properties[i], value);
+      break;
+    }
+  }
+
+  g_free(value);
+}
+
+static bool element_is_video_codec(GstElement *element, const gchar *type)
+{
+  GstElementFactory *factory = gst_element_get_factory(element);
+  const gchar *klass;
+
+  if (factory == NULL)
+    return false;
+
+  klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+  return klass != NULL && strstr(klass, type) != NULL && strstr(klass, "Video") != NULL;
+}
+
+/* Apply the encoder thread count to all encoders inside the bin */
+static void configure_encoders(generator_t *gen, GstElement *bin)
+{
+  GstIterator *it = gst_bin_iterate_recurse(GST_BIN(bin));
+  GValue item = G_VALUE_INIT;
+
+  while (gst_iterator_next(it, &item) == GST_ITERATOR_OK)
+  {
+    GstElement *element = GST_ELEMENT(g_value_get_object(&item));
+    if (element_is_video_codec(element, "Encoder"))
+    {
+      set_thread_count(element, gen->encoder_threads);
+    }
+    g_value_reset(&item);
+  }
+  g_value_unset(&item);
+  gst_iterator_free(it);
+}
+
+/* Once the video format is known, size the raw video queues so that
+ * they fit in the memory budget. Three quarters of the budget goes to
+ * the two raw video queues and the rest to the compressed video. */
+static void size_video_queues(generator_t *gen, GstCaps *caps)
+{
+  GstVideoInfo info;
+  guint64 frame_size, per_queue;
+  guint frames, max_frames;
+  gdouble fps;
+
+  if (!gst_video_info_from_caps(&info, caps))
+  {
+    GST_WARNING("Could not parse video caps, keeping queue sizes");
+    return;
+  }
+
+  frame_size = GST_VIDEO_INFO_SIZE(&info);
+  per_queue = gen->memory_budget * 3 / 8;
+  frames = (guint)(per_queue / MAX(frame_size, 1));
+
+  /* Variable framerate streams are treated as 30 fps */
+  fps = 30.0;
+  if (GST_VIDEO_INFO_FPS_N(&info) > 0 && GST_VIDEO_INFO_FPS_D(&info) > 0)
+  {
+    fps = (gdouble)GST_VIDEO_INFO_FPS_N(&info) / GST_VIDEO_INFO_FPS_D(&info);
+  }
+
+  /* More than a second of buffered raw video does not help throughput */
+  max_frames = (guint)(fps * GENERATOR_MAX_RAW_QUEUE_TIME / GST_SECOND + 0.5);
+  frames = CLAMP(frames, 2, MAX(max_frames, 2));
+
+  GST_INFO("Video %dx%d @ %.2f fps, %" G_GUINT64_FORMAT " bytes/frame: "
+           "queueing %u frames before and after oftvg",
+           GST_VIDEO_INFO_WIDTH(&info), GST_VIDEO_INFO_HEIGHT(&info), fps,
+           frame_size, frames);
+
+  g_object_set(gen->video_queue_in, "max-size-buffers", frames, NULL);
+  g_object_set(gen->video_queue_mid, "max-size-buffers", frames, NULL);
+}
+
+static GstPadProbeReturn video_caps_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  generator_t *gen = (generator_t*)data;
+  GstEvent *event = GST_PAD_PROBE_INFO_EVENT(info);
+
+  if (GST_EVENT_TYPE(event) == GST_EVENT_CAPS)
+  {
+    GstCaps *caps;
+    gst_event_parse_caps(event, &caps);
+    size_video_queues(gen, caps);
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn frame_count_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  generator_t *gen = (generator_t*)data;
+  g_mutex_lock(&gen->frame_lock);
+  gen->frame_count++;
+  g_mutex_unlock(&gen->frame_lock);
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn timer_in_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  element_timer_t *timer = (element_timer_t*)data;
+  timer->last_in = gst_util_get_timestamp();
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn timer_out_probe(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  element_timer_t *timer = (element_timer_t*)data;
+
+  if (GST_CLOCK_TIME_IS_VALID(timer->last_in))
+  {
+    timer->total += gst_util_get_timestamp() - timer->last_in;
+    timer->count++;
+    timer->last_in = GST_CLOCK_TIME_NONE;
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* Measure the processing time of an element between the given pads */
+static void add_timer(generator_t *gen, GstElement *element,
+                      const gchar *sinkpad, const gchar *srcpad)
+{
+  element_timer_t *timer;
+  GstPad *pad;
+
+  if (element == NULL || gen->num_timers >= GENERATOR_MAX_TIMERS)
+    return;
+
+  timer = &gen->timers[gen->num_timers++];
+  timer->name = GST_ELEMENT_NAME(element);
+  timer->last_in = GST_CLOCK_TIME_NONE;
+
+  pad = gst_element_get_static_pad(element, sinkpad);
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, timer_in_probe, timer, NULL);
+  gst_object_unref(pad);
+
+  pad = gst_element_get_static_pad(element, srcpad);
+  gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, timer_out_probe, timer, NULL);
+  gst_object_unref(pad);
+}
+
+/* Initial queue limits, before the stream format is known */
+static void setup_queues(generator_t *gen)
+{
+  g_object_set(gen->video_queue_in, "max-size-buffers", 2,
+               "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+  g_object_set(gen->video_queue_mid, "max-size-buffers", 2,
+               "max-size-bytes", 0, "max-size-time", (guint64)0, NULL);
+  g_object_set(gen->video_queue_out, "max-size-buffers", 0,
+               "max-size-bytes", (guint)MIN(gen->memory_budget / 4, G_MAXUINT),
+               "max-size-time", (guint64)GENERATOR_QUEUE_TIME, NULL);
+
+  if (gen->audio_queue_in)
+    g_object_set(gen->audio_queue_in, "max-size-buffers", 0,
+                 "max-size-bytes", 0, "max-size-time", (guint64)GENERATOR_QUEUE_TIME, NULL);
+  g_object_set(gen->audio_queue_mid, "max-size-buffers", 0,
+               "max-size-bytes", 0, "max-size-time", (guint64)GST_SECOND, NULL);
+  g_object_set(gen->audio_queue_out, "max-size-buffers", 0,
+               "max-size-bytes", 0, "max-size-time", (guint64)GENERATOR_QUEUE_TIME, NULL);
+
+  {
+    GstPad *pad = gst_element_get_static_pad(gen->video_queue_in, "sink");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+                      video_caps_probe, gen, NULL);
+    gst_object_unref(pad);
+  }
+}
+
+static bool link_pads(GstElement *src, const gchar *srcpad,
+                      GstElement *sink, const gchar *sinkpad, GError **error)
+{
+  if (!gst_element_link_pads(src, srcpad, sink, sinkpad))
+  {
+    g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_NEGOTIATION,
+                "Could not link %s to %s", GST_ELEMENT_NAME(src), GST_ELEMENT_NAME(sink));
+    return false;
+  }
+  return true;
+}
+
+/* Link a chain of elements, skipping NULL entries */
+static bool link_chain(GstElement **chain, size_t count, GError **error)
+{
+  GstElement *prev = NULL;
+  size_t i;
+
+  for (i = 0; i < count; i++)
+  {
+    if (chain[i] == NULL)
+      continue;
+
+    if (prev != NULL && !link_pads(prev, NULL, chain[i], NULL, error))
+      return false;
+
+    prev = chain[i];
+  }
+
+  return true;
+}
+
+/* Synthetic input for benchmarks: raw video and audio test signals
+ * in place of the file source and decoder. */
+static bool build_testsrc(generator_t *gen, gint width, gint height, gint fps_n, gint fps_d,
+                          GstElement **video, GstElement **audio, GError **error)
+{
+  GstElement *videosrc, *capsfilter, *audiosrc;
+  GstCaps *caps;
+
+  if ((videosrc = add_element(gen, "videotestsrc", "videotestsrc", error)) == NULL ||
+      (capsfilter = add_element(gen, "capsfilter", "testsrc_caps", error)) == NULL ||
+      (audiosrc = add_element(gen, "audiotestsrc", "audiotestsrc", error)) == NULL)
+  {
+    return false;
+  }
+
+  caps = gst_caps_new_simple("video/x-raw",
+                             "format", G_TYPE_STRING, "I420",
+                             "width", G_TYPE_INT, width,
+                             "height", G_TYPE_INT, height,
+                             "framerate", GST_TYPE_FRACTION, fps_n, fps_d,
+                             NULL);
+  g_object_set(capsfilter, "caps", caps, NULL);
+  gst_caps_unref(caps);
+
+  /* A static pattern keeps the source cheap compared to the oftvg element */
+  gst_util_set_object_arg(G_OBJECT(videosrc), "pattern", "black");
+
+  if (!link_pads(videosrc, "src", capsfilter, "sink", error))
+    return false;
+
+  *video = capsfilter;
+  *audio = audiosrc;
+  return true;
+}
+
+/* Check whether the input file has the selected audio stream. If it can't be
+ * determined, assume that it has, because the dummy audio of
+ * autoaudio_decodebin works in either case. */
+static bool input_has_audio(const gchar *filename, gint audio_track)
+{
+  GstDiscoverer *discoverer;
+  GstDiscovererInfo *info;
+  GList *streams;
+  gchar *uri;
+  bool result = true;
+
+  if (audio_track < 0)
+    return false;
+
+  gst_pb_utils_init();
+  uri = gst_filename_to_uri(filename, NULL);
+  discoverer = gst_discoverer_new(GENERATOR_DISCOVER_TIMEOUT, NULL);
+  if (uri == NULL || discoverer == NULL)
+  {
+    g_free(uri);
+    if (discoverer) g_object_unref(discoverer);
+    return true;
+  }
+
+  info = gst_discoverer_discover_uri(discoverer, uri, NULL);
+  if (info != NULL && gst_discoverer_info_get_result(info) == GST_DISCOVERER_OK)
+  {
+    streams = gst_discoverer_info_get_audio_streams(info);
+    result = ((gint)g_list_length(streams) > audio_track);
+    gst_discoverer_stream_info_list_free(streams);
+  }
+
+  GST_DEBUG("Input %s audio", result ? "has" : "has no");
+
+  if (info) gst_discoverer_info_unref(info);
+  g_object_unref(discoverer);
+  g_free(uri);
+  return result;
+}
+
+static bool build_pipeline(generator_t *gen, const jobspec_t *job, GError **error)
+{
+  GstElement *video_src, *audio_src, *preprocess = NULL, *videoconvert = NULL;
+  GstElement *encoder = NULL, *audioconvert_in = NULL, *volume = NULL, *audioconvert_out = NULL;
+  GstElement *videoscale = NULL, *output_filter = NULL;
+  GstElement *audioencoder = NULL, *mux = NULL, *filesink = NULL;
+  GstElement *video_sink = NULL, *audio_sink = NULL;
+  const gchar *video_pad = "src", *audio_pad = "src";
+  gint width, height, fps_n, fps_d;
+  bool null_output = jobspec_output_is_null(job);
+  bool output_caps = job->output_caps[0] != '\0';
+  bool generate_audio = false;
+
+#define ADD(var, factory, name) \
+  if ((var = add_element(gen, factory, name, error)) == NULL) return false;
+
+  /* The job has been validated, so the test source spec is valid */
+  if (jobspec_parse_testsrc(job->input, &width, &height, &fps_n, &fps_d, NULL))
+  {
+    if (!build_testsrc(gen, width, height, fps_n, fps_d, &video_src, &audio_src, error))
+      return false;
+  }
+  else if (jobspec_input_is_raw(job))
+  {
+    /* Uncompressed input needs no decoder, and has no audio */
+    ADD(video_src, "oftvg_rawsrc", "rawsrc");
+    g_object_set(video_src, "location", job->input, NULL);
+    if (job->raw_caps[0] != '\0')
+    {
+      GstCaps *caps = gst_caps_from_string(job->raw_caps);
+      if (caps == NULL)
+      {
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+                    "RAW_CAPS: could not parse '%s'", job->raw_caps);
+        return false;
+      }
+      g_object_set(video_src, "raw-caps", caps, NULL);
+      gst_caps_unref(caps);
+    }
+
+    audio_src = NULL;
+    generate_audio = true;
+  }
+  else
+  {
+    GstElement *filesrc;
+    if (job->input_readahead > 0)
+    {
+      ADD(filesrc, "oftvg_filesrc", "filesrc");
+      g_object_set(filesrc, "readahead", (guint64)job->input_readahead * 1024 * 1024, NULL);
+      gen->input_src = filesrc;
+    }
+    else
+    {
+      ADD(filesrc, "filesrc", "filesrc");
+    }
+    ADD(video_src, "autoaudio_decodebin", "decode");
+    audio_src = video_src;
+    video_pad = "video";
+    audio_pad = "audio";
+
+    g_object_set(filesrc, "location", job->input, NULL);
+    g_object_set(video_src,
+                 "decoder-threads", job->decoder_threads,
+                 "thread-type", job->decoder_thread_type,
+                 "output-buffers", job->decoder_buffers,
+                 "video-track", job->video_track,
+                 "audio-track", job->audio_track,
+                 "use-decodebin3", job->use_decodebin3,
+                 NULL);
+    if (!link_pads(filesrc, "src", video_src, "sink", error)) return false;
+
+    /* Without input audio, oftvg generates the audio track itself */
+    generate_audio = !input_has_audio(job->input, job->audio_track);
+    if (generate_audio)
+    {
+      g_object_set(video_src, "dummy-audio", FALSE, NULL);
+      audio_src = NULL;
+    }
+  }
+
+  ADD(gen->video_queue_in, "queue", "video_queue_in");
+  ADD(gen->oftvg, "oftvg", "oftvg");
+  ADD(gen->video_queue_mid, "queue", "video_queue_mid");
+  ADD(gen->video_queue_out, "queue", "video_queue_out");
+  if (!generate_audio)
+  {
+    ADD(audioconvert_in, "audioconvert", "audioconvert_in");
+    ADD(volume, "volume", "volume");
+    ADD(gen->audio_queue_in, "queue", "audio_queue_in");
+  }
+  ADD(gen->audio_queue_mid, "queue", "audio_queue_mid");
+  ADD(gen->audio_queue_out, "queue", "audio_queue_out");
+
+  if (null_output)
+  {
+    ADD(video_sink, "fakesink", "video_sink");
+    ADD(audio_sink, "fakesink", "audio_sink");
+    g_object_set(video_sink, "sync", FALSE, NULL);
+    g_object_set(audio_sink, "sync", FALSE, NULL);
+  }
+  else
+  {
+    ADD(audioconvert_out, "audioconvert", "audioconvert_out");
+    ADD(filesink, "filesink", "filesink");
+  }
+
+  /* With FUSED_CONVERT, oftvg converts to the format of the encoder */
+  if (!job->fused_convert && (!null_output || output_caps))
+  {
+    ADD(videoconvert, "videoconvert", "videoconvert");
+  }
+  if (!job->fused_convert && output_caps)
+  {
+    ADD(videoscale, "videoscale", "videoscale");
+  }
+  if (output_caps)
+  {
+    GstCaps *caps;
+
+    ADD(output_filter, "capsfilter", "output_caps");
+    caps = gst_caps_from_string(job->output_caps);
+    if (caps == NULL)
+    {
+      g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+                  "OUTPUT_CAPS: could not parse '%s'", job->output_caps);
+      return false;
+    }
+    g_object_set(output_filter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+  }
+#undef ADD
+
+  if (job->preprocess[0] != '\0')
+  {
+    preprocess = add_description(gen, "PREPROCESS", job->preprocess, error);
+    if (preprocess == NULL) return false;
+  }
+
+  if (!null_output)
+  {
+    encoder = add_description(gen, "COMPRESSION", job->compression, error);
+    if (encoder == NULL) return false;
+
+    audioencoder = add_description(gen, "AUDIOCOMPRESSION", job->audiocompression, error);
+    if (audioencoder == NULL) return false;
+
+    /* The muxer needs request pads, so it can't be wrapped in a bin */
+    {
+      GError *parse_error = NULL;
+      mux = gst_parse_launch_full(job->container, NULL, GST_PARSE_FLAG_FATAL_ERRORS,
+                                  &parse_error);
+      if (mux == NULL)
+      {
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+                    "CONTAINER: could not parse '%s': %s", job->container,
+                    parse_error->message);
+        g_error_free(parse_error);
+        return false;
+      }
+
+      if (GST_IS_BIN(mux))
+      {
+        g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+                    "CONTAINER: '%s' should be a single muxer element", job->container);
+        gst_object_unref(mux);
+        return false;
+      }
+
+      gst_bin_add(GST_BIN(gen->pipeline), mux);
+    }
+
+    g_object_set(filesink, "location", job->output, NULL);
+    configure_encoders(gen, encoder);
+  }
+
+  if (volume)
+    g_object_set(volume, "volume", 0.5, NULL);
+  g_object_set(gen->oftvg,
+               "location", job->layout,
+               "num-buffers", job->num_buffers,
+               "lipsync", job->lipsync,
+               "coded-beeps", job->coded_lipsync,
+               "only-calibration", job->only_calibration,
+               "rgb6-calibration", job->rgb6_calibration,
+               "pre-white-duration", job->pre_white_duration,
+               "pre-marks-duration", job->pre_marks_duration,
+               "post-white-duration", job->post_white_duration,
+               "progress-interval", job->progress_interval,
+               "generate-audio", generate_audio,
+               "convert", job->fused_convert,
+               "convert-threads", job->convert_threads,
+               NULL);
+
+  setup_queues(gen);
+
+  /* Video: decode ! [preprocess] ! queue ! oftvg ! queue ! [videoscale]
+   *        ! videoconvert ! [capsfilter] ! encoder ! queue ! mux
+   * With OUTPUT=null the encoded part is replaced by a fakesink.
+   * With FUSED_CONVERT, oftvg does the scaling and conversion and the
+   * capsfilter comes right after it. */
+  {
+    GstElement *chain[] = {gen->oftvg, job->fused_convert ? output_filter : NULL,
+                           gen->video_queue_mid, videoscale, videoconvert,
+                           job->fused_convert ? NULL : output_filter, encoder,
+                           gen->video_queue_out, mux, filesink, video_sink};
+
+    if (!link_pads(video_src, video_pad, preprocess ? preprocess : gen->video_queue_in,
+                   "sink", error)) return false;
+    if (preprocess && !link_pads(preprocess, "src", gen->video_queue_in, "sink", error))
+      return false;
+    if (!link_pads(gen->video_queue_in, "src", gen->oftvg, "sink", error)) return false;
+    if (!link_chain(chain, G_N_ELEMENTS(chain), error)) return false;
+  }
+
+  /* Audio: decode ! audioconvert ! volume ! queue ! oftvg ! queue
+   *        ! audioconvert ! encoder ! queue ! mux
+   * With generated audio, the part before oftvg is left out. */
+  {
+    GstElement *chain_in[] = {audioconvert_in, volume, gen->audio_queue_in};
+    GstElement *chain_out[] = {gen->audio_queue_mid, audioconvert_out, audioencoder,
+                               gen->audio_queue_out, mux, audio_sink};
+
+    if (!generate_audio)
+    {
+      if (!link_pads(audio_src, audio_pad, audioconvert_in, "sink", error)) return false;
+      if (!link_chain(chain_in, G_N_ELEMENTS(chain_in), error)) return false;
+      if (!link_pads(gen->audio_queue_in, "src", gen->oftvg, "asink", error)) return false;
+    }
+    if (!link_pads(gen->oftvg, "asrc", gen->audio_queue_mid, "sink", error)) return false;
+    if (!link_chain(chain_out, G_N_ELEMENTS(chain_out), error)) return false;
+  }
+
+  {
+    GstPad *pad = gst_element_get_static_pad(gen->oftvg, "src");
+    gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_BUFFER, frame_count_probe, gen, NULL);
+    gst_object_unref(pad);
+  }
+
+  add_timer(gen, gen->oftvg, "sink", "src");
+  add_timer(gen, videoscale, "sink", "src");
+  add_timer(gen, videoconvert, "sink", "src");
+  add_timer(gen, encoder, "sink", "src");
+
+  return true;
+}
+
+generator_t *generator_create(const jobspec_t *job, GError **error)
+{
+  generator_t *gen = g_new0(generator_t, 1);
+
+  g_mutex_init(&gen->frame_lock);
+  gen->memory_budget = (guint64)job->memory_budget * 1024 * 1024;
+  gen->encoder_threads = job->encoder_threads;
+
+  if (gen->encoder_threads == 0)
+    gen->encoder_threads = g_get_num_processors();
+
+  gen->pipeline = gst_pipeline_new("tvg_generate");
+
+  if (!build_pipeline(gen, job, error))
+  {
+    generator_free(gen);
+    return NULL;
+  }
+
+  return gen;
+}
+
+void generator_free(generator_t *gen)
+{
+  if (gen->pipeline != NULL)
+  {
+    gst_element_set_state(gen->pipeline, GST_STATE_NULL);
+    gst_object_unref(gen->pipeline);
+  }
+
+  if (gen->oftvg_stats != NULL)
+    gst_structure_free(gen->oftvg_stats);
+  if (gen->decoder_info != NULL)
+    gst_structure_free(gen->decoder_info);
+
+  g_mutex_clear(&gen->frame_lock);
+  g_free(gen);
+}
+
+void generator_request_stop(generator_t *gen)
+{
+  g_atomic_int_set(&gen->stop_requested, 1);
+}
+
+guint64 generator_get_frame_count(generator_t *gen)
+{
+  guint64 count;
+
+  g_mutex_lock(&gen->frame_lock);
+  count = gen->frame_count;
+  g_mutex_unlock(&gen->frame_lock);
+
+  return count;
+}
+
+GstStructure *generator_get_stats(generator_t *gen)
+{
+  GstStructure *result = gst_structure_new("tvg-stats",
+      "frames", G_TYPE_UINT64, generator_get_frame_count(gen), NULL);
+  GstStructure *elements = gst_structure_new_empty("elements");
+  int i;
+
+  /* Average processing time per buffer in nanoseconds */
+  for (i = 0; i < gen->num_timers; i++)
+  {
+    const element_timer_t *timer = &gen->timers[i];
+    gst_structure_set(elements, timer->name, G_TYPE_UINT64,
+                      timer->count ? timer->total / timer->count : 0, NULL);
+  }
+  gst_structure_set(result, "elements", GST_TYPE_STRUCTURE, elements, NULL);
+  gst_structure_free(elements);
+
+  if (gen->oftvg_stats != NULL)
+  {
+    gst_structure_set(result, "oftvg", GST_TYPE_STRUCTURE, gen->oftvg_stats, NULL);
+  }
+
+  if (gen->decoder_info != NULL)
+  {
+    gst_structure_set(result, "decoder", GST_TYPE_STRUCTURE, gen->decoder_info, NULL);
+  }
+
+  if (gen->input_src != NULL)
+  {
+    GstStructure *input = NULL;
+    g_object_get(gen->input_src, "stats", &input, NULL);
+    gst_structure_set(result, "input", GST_TYPE_STRUCTURE, input, NULL);
+    gst_structure_free(input);
+  }
+
+  return result;
+}
+
+/* Print the video decoder chosen by autoaudio_decodebin */
+static void print_decoder(const GstStructure *s)
+{
+  const gchar *thread_type = gst_structure_get_string(s, "thread-type");
+  gint threads = -1;
+
+  gst_structure_get_int(s, "threads", &threads);
+
+  printf("Video decoder: %s", gst_structure_get_string(s, "factory"));
+  if (threads > 0)
+    printf(", %d threads", threads);
+  else if (threads == 0)
+    printf(", automatic thread count");
+  if (thread_type != NULL && thread_type[0] != '\0')
+    printf(", thread type %s", thread_type);
+  printf("\n");
+}
+
+/* Print how well the read-ahead kept up with the pipeline */
+static void print_input_stats(GstElement *input_src)
+{
+  GstStructure *s = NULL;
+  guint64 bytes = 0, stalls = 0, stall_time = 0;
+  gdouble throughput = 0;
+
+  g_object_get(input_src, "stats", &s, NULL);
+  gst_structure_get_uint64(s, "bytes-read", &bytes);
+  gst_structure_get_uint64(s, "stalls", &stalls);
+  gst_structure_get_uint64(s, "stall-time", &stall_time);
+  gst_structure_get_double(s, "throughput", &throughput);
+  gst_structure_free(s);
+
+  printf("Input: %.1f MB read at %.1f MB/s, waited %" G_GUINT64_FORMAT " times for %.1f s\n",
+         bytes / 1048576.0, throughput / 1048576.0, stalls, (double)stall_time / GST_SECOND);
+}
+
+/* Print the progress messages posted by the oftvg element */
+static void print_progress(const GstStructure *s)
+{
+  const gchar *state = gst_structure_get_string(s, "state");
+  guint64 frame = 0, eta = GST_CLOCK_TIME_NONE;
+  gint64 total_frames = -1;
+  gdouble fps = 0, percent = -1;
+
+  gst_structure_get_uint64(s, "frame", &frame);
+  gst_structure_get_uint64(s, "eta", &eta);
+  gst_structure_get_int64(s, "total-frames", &total_frames);
+  gst_structure_get_double(s, "fps", &fps);
+  gst_structure_get_double(s, "percent", &percent);
+
+  if (total_frames >= 0)
+  {
+    printf("Progress: %5.1f%% %-20s frame %" G_GUINT64_FORMAT "/%" G_GINT64_FORMAT
+           ", %5.1f fps, ETA %d s\n", percent, state, frame, total_frames, fps,
+           GST_CLOCK_TIME_IS_VALID(eta) ? (int)(eta / GST_SECOND) : -1);
+  }
+  else
+  {
+    printf("Progress: %-20s frame %" G_GUINT64_FORMAT ", %5.1f fps\n",
+           state, frame, fps);
+  }
+  fflush(stdout);
+}
+
+/* Print the render time summary posted by the oftvg element at EOS */
+static gboolean print_segment_stats(GQuark field, const GValue *value, gpointer data)
+{
+  const GstStructure *segment;
+  guint64 frames = 0, p50 = 0, p99 = 0, max = 0, fill = 0;
+
+  if (!GST_VALUE_HOLDS_STRUCTURE(value))
+    return TRUE;
+
+  segment = gst_value_get_structure(value);
+  gst_structure_get_uint64(segment, "frames", &frames);
+  gst_structure_get_uint64(segment, "total-p50", &p50);
+  gst_structure_get_uint64(segment, "total-p99", &p99);
+  gst_structure_get_uint64(segment, "total-max", &max);
+  gst_structure_get_uint64(segment, "fill-p50", &fill);
+
+  printf("  %-22s %6" G_GUINT64_FORMAT " frames, render p50 %.3f ms, p99 %.3f ms, "
+         "max %.3f ms (fill p50 %.3f ms)\n", g_quark_to_string(field), frames,
+         p50 / 1e6, p99 / 1e6, max / 1e6, fill / 1e6);
+  return TRUE;
+}
+
+static void print_stats(const GstStructure *s)
+{
+  guint64 layout = 0;
+  gst_structure_get_uint64(s, "layout-compile", &layout);
+  printf("Render times in oftvg (layout compiled in %.1f ms):\n", layout / 1e6);
+  gst_structure_foreach(s, print_segment_stats, NULL);
+}
+
+/* Convert an error message from the bus to a GError */
+static void take_bus_error(GstMessage *msg, GError **error)
+{
+  GError *bus_error = NULL;
+  gchar *debug = NULL;
+
+  gst_message_parse_error(msg, &bus_error, &debug);
+  GST_ERROR("Error from %s: %s (%s)", GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)),
+            bus_error->message, debug ? debug : "no details");
+
+  g_set_error(error, bus_error->domain, bus_error->code, "%s: %s",
+              GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)), bus_error->message);
+  g_error_free(bus_error);
+  g_free(debug);
+}
+
+bool generator_run(generator_t *gen, GError **error)
+{
+  GstBus *bus = gst_element_get_bus(gen->pipeline);
+  gint64 stop_deadline = 0;
+  bool done = false;
+  bool status = false;
+
+  if (gst_element_set_state(gen->pipeline, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+  {
+    /* The reason is usually posted on the bus */
+    GstMessage *msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+    if (msg != NULL)
+    {
+      take_bus_error(msg, error);
+      gst_message_unref(msg);
+    }
+    else
+    {
+      g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_STATE_CHANGE,
+                  "Could not start the pipeline");
+    }
+    done = true;
+  }
+
+  while (!done)
+  {
+    GstMessage *msg = gst_bus_timed_pop_filtered(bus, 100 * GST_MSECOND,
+        (GstMessageType)(GST_MESSAGE_ERROR | GST_MESSAGE_WARNING |
+                         GST_MESSAGE_EOS | GST_MESSAGE_STATE_CHANGED |
+                         GST_MESSAGE_ELEMENT));
+
+    if (g_atomic_int_get(&gen->stop_requested) && stop_deadline == 0)
+    {
+      /* Finish writing the file instead of just aborting */
+      g_printerr("Stopping, finalizing the output file..\n");
+      gst_element_send_event(gen->pipeline, gst_event_new_eos());
+      stop_deadline = g_get_monotonic_time() + GENERATOR_STOP_TIMEOUT / GST_USECOND;
+    }
+
+    if (stop_deadline != 0 && g_get_monotonic_time() > stop_deadline)
+    {
+      g_set_error(error, GST_CORE_ERROR, GST_CORE_ERROR_FAILED,
+                  "Pipeline did not stop within %d seconds",
+                  (int)(GENERATOR_STOP_TIMEOUT / GST_SECOND));
+      done = true;
+    }
+
+    if (msg == NULL)
+      continue;
+
+    switch (GST_MESSAGE_TYPE(msg))
+    {
+      case GST_MESSAGE_EOS:
+        done = true;
+        status = true;
+        break;
+
+      case GST_MESSAGE_ERROR:
+        take_bus_error(msg, error);
+        GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(GST_BIN(gen->pipeline),
+                                          GST_DEBUG_GRAPH_SHOW_ALL, "tvg_generate.error");
+        done = true;
+        break;
+
+      case GST_MESSAGE_WARNING:
+      {
+        GError *warning = NULL;
+        gst_message_parse_warning(msg, &warning, NULL);
+        g_printerr("Warning from %s: %s\n", GST_OBJECT_NAME(GST_MESSAGE_SRC(msg)),
+                   warning->message);
+        g_error_free(warning);
+        break;
+      }
+
+      case GST_MESSAGE_STATE_CHANGED:
+        if (GST_MESSAGE_SRC(msg) == GST_OBJECT(gen->pipeline))
+        {
+          GstState oldstate, newstate;
+          gchar *name;
+          gst_message_parse_state_changed(msg, &oldstate, &newstate, NULL);
+          name = g_strdup_printf("tvg_generate.%s_%s",
+                                 gst_element_state_get_name(oldstate),
+                                 gst_element_state_get_name(newstate));
+          GST_DEBUG_BIN_TO_DOT_FILE_WITH_TS(GST_BIN(gen->pipeline),
+                                            GST_DEBUG_GRAPH_SHOW_ALL, name);
+          g_free(name);
+        }
+        break;
+
+      case GST_MESSAGE_ELEMENT:
+        if (gst_message_has_name(msg, "oftvg-progress"))
+        {
+          print_progress(gst_message_get_structure(msg));
+        }
+        else if (gst_message_has_name(msg, "oftvg-stats"))
+        {
+          print_stats(gst_message_get_structure(msg));
+
+          if (gen->oftvg_stats != NULL)
+            gst_structure_free(gen->oftvg_stats);
+          gen->oftvg_stats = gst_structure_copy(gst_message_get_structure(msg));
+        }
+        else if (gst_message_has_name(msg, "oftvg-decoder"))
+        {
+          print_decoder(gst_message_get_structure(msg));
+
+          if (gen->decoder_info != NULL)
+            gst_structure_free(gen->decoder_info);
+          gen->decoder_info = gst_structure_copy(gst_message_get_structure(msg));
+        }
+        break;
+
+      default:
+        break;
+    }
+
+    gst_message_unref(msg);
+  }
+
+  if (gen->input_src != NULL)
+    print_input_stats(gen->input_src);
+
+  gst_element_set_state(gen->pipeline, GST_STATE_NULL);
+  gst_object_unref(bus);
+  return status;
+}
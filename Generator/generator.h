@@ -0,0 +1,37 @@
+/* Builds and runs the GStreamer pipeline that produces the test video.
+ * The pipeline is equivalent to the one that Run_TVG.sh used to pass to
+ * gst-launch, but the queues are sized based on the actual video format
+ * and the thread counts of the codecs are configurable. */
+
+#ifndef _TVG_GENERATOR_H_
+#define _TVG_GENERATOR_H_
+
+#include <gst/gst.h>
+#include <stdbool.h>
+#include "jobspec.h"
+
+typedef struct _generator_t generator_t;
+
+/* Create the pipeline for the job. The job must have been validated. */
+generator_t *generator_create(const jobspec_t *job, GError **error);
+
+/* Release all resources associated to the generator. */
+void generator_free(generator_t *gen);
+
+/* Run the pipeline until end-of-stream or error. */
+bool generator_run(generator_t *gen, GError **error);
+
+/* Ask the pipeline to finish early, so that the output file is still
+ * properly finalized. Only sets a flag, so it is safe to call from a
+ * signal handler. */
+void generator_request_stop(generator_t *gen);
+
+/* Number of video frames that have passed through the oftvg element. */
+guint64 generator_get_frame_count(generator_t *gen);
+
+/* Throughput statistics of the last run: frame count, average processing
+ * time of the main elements and the render statistics of oftvg.
+ * Free with gst_structure_free(). */
+GstStructure *generator_get_stats(generator_t *gen);
+
+#endif
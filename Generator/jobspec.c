@@ -0,0 +1,331 @@
+#include "jobspec.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+GQuark tvg_jobspec_error_quark(void)
+{
+  return g_quark_from_static_string("tvg-jobspec-error-quark");
+}
+
+void jobspec_init(jobspec_t *job)
+{
+#define JOB_STR(up,name,desc,def) job->name = g_strdup(def);
+#define JOB_INT(up,name,desc,def,min,max) job->name = def;
+#define JOB_BOOL(up,name,desc,def) job->name = def;
+JOBSPEC_FIELDS
+#undef JOB_STR
+#undef JOB_INT
+#undef JOB_BOOL
+}
+
+void jobspec_clear(jobspec_t *job)
+{
+#define JOB_STR(up,name,desc,def) g_free(job->name); job->name = NULL;
+#define JOB_INT(up,name,desc,def,min,max)
+#define JOB_BOOL(up,name,desc,def)
+JOBSPEC_FIELDS
+#undef JOB_STR
+#undef JOB_INT
+#undef JOB_BOOL
+}
+
+static bool parse_int(const gchar *key, const gchar *value, gint min, gint max,
+                      gint *result, GError **error)
+{
+  gchar *end;
+  gint64 v;
+
+  errno = 0;
+  v = g_ascii_strtoll(value, &end, 10);
+  if (end == value || *end != '\0' || errno != 0)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "%s: '%s' is not an integer", key, value);
+    return false;
+  }
+
+  if (v < min || v > max)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "%s: %" G_GINT64_FORMAT " is out of range [%d, %d]",
+                key, v, min, max);
+    return false;
+  }
+
+  *result = (gint)v;
+  return true;
+}
+
+static bool parse_bool(const gchar *key, const gchar *value,
+                       gboolean *result, GError **error)
+{
+  if (g_ascii_strcasecmp(value, "true") == 0 ||
+      g_ascii_strcasecmp(value, "yes") == 0 ||
+      strcmp(value, "1") == 0)
+  {
+    *result = TRUE;
+    return true;
+  }
+
+  if (g_ascii_strcasecmp(value, "false") == 0 ||
+      g_ascii_strcasecmp(value, "no") == 0 ||
+      strcmp(value, "0") == 0)
+  {
+    *result = FALSE;
+    return true;
+  }
+
+  g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+              "%s: '%s' is not a boolean (true/false)", key, value);
+  return false;
+}
+
+bool jobspec_set(jobspec_t *job, const gchar *key, const gchar *value, GError **error)
+{
+#define JOB_STR(up,name,desc,def) \
+  if (g_ascii_strcasecmp(key, #up) == 0) \
+  { g_free(job->name); job->name = g_strdup(value); return true; }
+#define JOB_INT(up,name,desc,def,min,max) \
+  if (g_ascii_strcasecmp(key, #up) == 0) \
+  { return parse_int(#up, value, min, max, &job->name, error); }
+#define JOB_BOOL(up,name,desc,def) \
+  if (g_ascii_strcasecmp(key, #up) == 0) \
+  { return parse_bool(#up, value, &job->name, error); }
+JOBSPEC_FIELDS
+#undef JOB_STR
+#undef JOB_INT
+#undef JOB_BOOL
+
+  g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_UNKNOWN_KEY,
+              "Unknown setting: %s", key);
+  return false;
+}
+
+bool jobspec_set_from_string(jobspec_t *job, const gchar *setting, GError **error)
+{
+  const gchar *eq = strchr(setting, '=');
+  gchar *key, *value;
+  bool status;
+
+  if (eq == NULL)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "Expected KEY=VALUE, got '%s'", setting);
+    return false;
+  }
+
+  key = g_strstrip(g_strndup(setting, eq - setting));
+  value = g_strstrip(g_strdup(eq + 1));
+
+  /* Allow quoting the value, as was done in Run_TVG.sh */
+  {
+    size_t len = strlen(value);
+    if (len >= 2 && value[0] == '"' && value[len - 1] == '"')
+    {
+      memmove(value, value + 1, len - 2);
+      value[len - 2] = '\0';
+    }
+  }
+
+  /* PREPROCESS used to be appended to a gst-launch line, so the
+   * old configurations start it with '!'. */
+  if (g_ascii_strcasecmp(key, "PREPROCESS") == 0)
+  {
+    gchar *p = value;
+    while (*p == '!' || g_ascii_isspace(*p)) p++;
+    memmove(value, p, strlen(p) + 1);
+  }
+
+  status = jobspec_set(job, key, value, error);
+  g_free(key);
+  g_free(value);
+  return status;
+}
+
+bool jobspec_load(jobspec_t *job, const gchar *filename, GError **error)
+{
+  gchar *contents;
+  gchar **lines;
+  int i;
+  bool status = true;
+
+  if (!g_file_get_contents(filename, &contents, NULL, error))
+    return false;
+
+  lines = g_strsplit(contents, "\n", -1);
+  g_free(contents);
+
+  for (i = 0; lines[i] != NULL; i++)
+  {
+    gchar *line = g_strstrip(lines[i]);
+    GError *line_error = NULL;
+
+    /* Comments: '#' from the shell script, '::' and REM from batch files */
+    if (line[0] == '\0' || line[0] == '#' || g_str_has_prefix(line, "::") ||
+        g_ascii_strncasecmp(line, "REM ", 4) == 0 ||
+        g_ascii_strcasecmp(line, "@echo off") == 0)
+    {
+      continue;
+    }
+
+    if (g_ascii_strncasecmp(line, "SET ", 4) == 0)
+    {
+      line += 4;
+    }
+
+    if (!jobspec_set_from_string(job, line, &line_error))
+    {
+      if (g_error_matches(line_error, TVG_JOBSPEC_ERROR,
+                          TVG_JOBSPEC_ERROR_UNKNOWN_KEY))
+      {
+        /* Older .tvg files contain settings that are no longer used. */
+        g_printerr("%s:%d: Warning: %s\n", filename, i + 1, line_error->message);
+        g_error_free(line_error);
+        continue;
+      }
+
+      g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                  "%s:%d: %s", filename, i + 1, line_error->message);
+      g_error_free(line_error);
+      status = false;
+      break;
+    }
+  }
+
+  g_strfreev(lines);
+  return status;
+}
+
+#define TESTSRC_PREFIX "testsrc:"
+
+bool jobspec_parse_testsrc(const gchar *input, gint *width, gint *height,
+                           gint *fps_n, gint *fps_d, GError **error)
+{
+  const gchar *spec;
+
+  if (!g_str_has_prefix(input, TESTSRC_PREFIX))
+    return false;
+
+  spec = input + strlen(TESTSRC_PREFIX);
+  *fps_d = 1;
+
+  if (sscanf(spec, "%dx%d@%d/%d", width, height, fps_n, fps_d) < 3 ||
+      *width <= 0 || *height <= 0 || *fps_n <= 0 || *fps_d <= 0)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "INPUT: '%s' should be of the form %sWIDTHxHEIGHT@FPS",
+                input, TESTSRC_PREFIX);
+    return false;
+  }
+
+  return true;
+}
+
+bool jobspec_input_is_raw(const jobspec_t *job)
+{
+  gchar *lower;
+  bool result;
+
+  if (job->raw_caps[0] != '\0')
+    return true;
+
+  lower = g_ascii_strdown(job->input, -1);
+  result = g_str_has_suffix(lower, ".y4m");
+  g_free(lower);
+  return result;
+}
+
+bool jobspec_output_is_null(const jobspec_t *job)
+{
+  return g_ascii_strcasecmp(job->output, "null") == 0;
+}
+
+bool jobspec_validate(const jobspec_t *job, GError **error)
+{
+  GError *testsrc_error = NULL;
+  gint width, height, fps_n, fps_d;
+  bool testsrc = jobspec_parse_testsrc(job->input, &width, &height,
+                                       &fps_n, &fps_d, &testsrc_error);
+
+  if (testsrc_error != NULL)
+  {
+    g_propagate_error(error, testsrc_error);
+    return false;
+  }
+
+  if (testsrc && job->num_buffers < 0)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "NUM_BUFFERS: must be given for a synthetic input");
+    return false;
+  }
+
+  if (!testsrc && !g_file_test(job->input, G_FILE_TEST_IS_REGULAR))
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "INPUT: file '%s' does not exist", job->input);
+    return false;
+  }
+
+  if (!g_file_test(job->layout, G_FILE_TEST_IS_REGULAR))
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "LAYOUT: file '%s' does not exist", job->layout);
+    return false;
+  }
+
+  if (job->output[0] == '\0')
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "OUTPUT: no file name given");
+    return false;
+  }
+
+  if (strcmp(job->input, job->output) == 0)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "OUTPUT: would overwrite the input file '%s'", job->input);
+    return false;
+  }
+
+  if (!jobspec_output_is_null(job) &&
+      (job->compression[0] == '\0' || job->container[0] == '\0' ||
+       job->audiocompression[0] == '\0'))
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "COMPRESSION, AUDIOCOMPRESSION and CONTAINER must be set");
+    return false;
+  }
+
+  if (job->lipsync == 0)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "LIPSYNC: use -1 to disable the lipsync markers");
+    return false;
+  }
+
+  if (job->num_buffers == 0)
+  {
+    g_set_error(error, TVG_JOBSPEC_ERROR, TVG_JOBSPEC_ERROR_INVALID,
+                "NUM_BUFFERS: use -1 to process the whole video");
+    return false;
+  }
+
+  return true;
+}
+
+void jobspec_print_help(FILE *f)
+{
+  fprintf(f, "Settings (default value in brackets):\n");
+#define JOB_STR(up,name,desc,def) \
+  fprintf(f, "  %-20s %s [%s]\n", #up, desc, def);
+#define JOB_INT(up,name,desc,def,min,max) \
+  fprintf(f, "  %-20s %s [%d]\n", #up, desc, def);
+#define JOB_BOOL(up,name,desc,def) \
+  fprintf(f, "  %-20s %s [%s]\n", #up, desc, (def) ? "true" : "false");
+JOBSPEC_FIELDS
+#undef JOB_STR
+#undef JOB_INT
+#undef JOB_BOOL
+}
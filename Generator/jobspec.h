@@ -0,0 +1,106 @@
+/* Parsing and validation of the test video generation job description.
+ * A job spec is a set of KEY=VALUE settings, read from the command line and
+ * from .tvg files. The .tvg files use the same "SET KEY=VALUE" syntax as the
+ * Run_TVG.bat configuration, so existing files keep working. */
+
+#ifndef _TVG_JOBSPEC_H_
+#define _TVG_JOBSPEC_H_
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+/* List of settings understood by the generator.
+ * Each entry contains:
+ * - uppercase key as used in the .tvg files
+ * - field name in jobspec_t
+ * - description of the setting
+ * - default value
+ * - for integers, the allowed range
+ */
+#define JOBSPEC_FIELDS \
+  JOB_STR(INPUT,               input,               "Input video file, or testsrc:WIDTHxHEIGHT@FPS", "big_buck_bunny_1080p_h264.mp4") \
+  JOB_STR(LAYOUT,              layout,              "Layout bitmap file", "layout.bmp") \
+  JOB_STR(OUTPUT,              output,              "Output video file, or null to discard the output", "output.mov") \
+  JOB_STR(COMPRESSION,         compression,         "Video encoder and its parameters", "x264enc speed-preset=4") \
+  JOB_STR(CONTAINER,           container,           "Container muxer element", "qtmux") \
+  JOB_STR(AUDIOCOMPRESSION,    audiocompression,    "Audio encoder and its parameters", "avenc_aac compliance=-2") \
+  JOB_STR(RAW_CAPS,            raw_caps,            "Format of a headerless raw video input, e.g. video/x-raw,format=I420,width=1920,height=1080,framerate=30/1", "") \
+  JOB_INT(INPUT_READAHEAD,     input_readahead,     "Input file read-ahead in MB, 0 to read on demand", 32, 0, 65536) \
+  JOB_INT(VIDEO_TRACK,         video_track,         "Index of the input video stream to use", 0, 0, G_MAXINT) \
+  JOB_INT(AUDIO_TRACK,         audio_track,         "Index of the input audio stream to use, -1 for none", 0, -1, G_MAXINT) \
+  JOB_BOOL(USE_DECODEBIN3,     use_decodebin3,      "Drop the unused input streams before decoding, with decodebin3", false) \
+  JOB_STR(PREPROCESS,          preprocess,          "Optional video preprocessing elements", "") \
+  JOB_STR(OUTPUT_CAPS,         output_caps,         "Format and size of the output video, e.g. video/x-raw,width=1280,height=720", "") \
+  JOB_BOOL(FUSED_CONVERT,      fused_convert,       "Scale and convert in the oftvg element instead of separate elements", false) \
+  JOB_INT(CONVERT_THREADS,     convert_threads,     "Threads for the fused conversion, 0 for number of CPU cores", 0, 0, 1024) \
+  JOB_INT(NUM_BUFFERS,         num_buffers,         "Number of frames to process, -1 for all", -1, -1, G_MAXINT) \
+  JOB_INT(LIPSYNC,             lipsync,             "Interval of lipsync markers in ms, -1 to disable", -1, -1, G_MAXINT) \
+  JOB_BOOL(CODED_LIPSYNC,      coded_lipsync,       "Follow each lipsync beep with the frame number", false) \
+  JOB_BOOL(ONLY_CALIBRATION,   only_calibration,    "Only generate the calibration sequences", false) \
+  JOB_BOOL(RGB6_CALIBRATION,   rgb6_calibration,    "Calibration white only in the marker area", false) \
+  JOB_INT(PRE_WHITE_DURATION,  pre_white_duration,  "Precalibration white screen duration in ms", 4000, 0, G_MAXINT) \
+  JOB_INT(PRE_MARKS_DURATION,  pre_marks_duration,  "Precalibration marks duration in ms", 1000, 0, G_MAXINT) \
+  JOB_INT(POST_WHITE_DURATION, post_white_duration, "Postcalibration white screen duration in ms", 5000, 0, G_MAXINT) \
+  JOB_INT(PROGRESS_INTERVAL,   progress_interval,   "Interval of progress reports in ms, 0 to disable", 1000, 0, G_MAXINT) \
+  JOB_INT(MEMORY_BUDGET,       memory_budget,       "Memory available for queued frames in MB", 256, 16, 65536) \
+  JOB_INT(ENCODER_THREADS,     encoder_threads,     "Encoder threads, 0 for number of CPU cores", 0, 0, 1024) \
+  JOB_INT(DECODER_THREADS,     decoder_threads,     "Decoder threads, 0 for number of CPU cores, -1 for decoder default", 0, -1, 1024) \
+  JOB_STR(DECODER_THREAD_TYPE, decoder_thread_type, "Decoder threading: frame, slice or frame+slice, empty for default", "") \
+  JOB_INT(DECODER_BUFFERS,     decoder_buffers,     "Minimum decoder output buffers, 0 for default", 0, 0, 1024) \
+  JOB_STR(STATS_FILE,          stats_file,          "Write throughput statistics as JSON to this file", "")
+
+typedef struct {
+#define JOB_STR(up,name,desc,def) gchar *name;
+#define JOB_INT(up,name,desc,def,min,max) gint name;
+#define JOB_BOOL(up,name,desc,def) gboolean name;
+JOBSPEC_FIELDS
+#undef JOB_STR
+#undef JOB_INT
+#undef JOB_BOOL
+} jobspec_t;
+
+#define TVG_JOBSPEC_ERROR (tvg_jobspec_error_quark())
+GQuark tvg_jobspec_error_quark(void);
+
+typedef enum {
+  TVG_JOBSPEC_ERROR_INVALID,     /* Bad value or an unusable combination */
+  TVG_JOBSPEC_ERROR_UNKNOWN_KEY  /* Setting name is not recognized */
+} tvg_jobspec_error_t;
+
+/* Initialize all settings to their default values */
+void jobspec_init(jobspec_t *job);
+
+/* Release the memory held by the settings */
+void jobspec_clear(jobspec_t *job);
+
+/* Set a single setting. Fails if the key is unknown or the value
+ * is out of range. */
+bool jobspec_set(jobspec_t *job, const gchar *key, const gchar *value, GError **error);
+
+/* Parse a "KEY=VALUE" string and apply it */
+bool jobspec_set_from_string(jobspec_t *job, const gchar *setting, GError **error);
+
+/* Apply all the settings from a .tvg file */
+bool jobspec_load(jobspec_t *job, const gchar *filename, GError **error);
+
+/* Check that the settings make up a runnable job */
+bool jobspec_validate(const jobspec_t *job, GError **error);
+
+/* Parse a synthetic input of the form "testsrc:1920x1080@30" or
+ * "testsrc:1920x1080@30000/1001". Returns false if the input is a file
+ * name; sets an error only if it looks like a test source but is invalid. */
+bool jobspec_parse_testsrc(const gchar *input, gint *width, gint *height,
+                           gint *fps_n, gint *fps_d, GError **error);
+
+/* True if the input is uncompressed video that is read without a
+ * decoder: a .y4m file, or any file when RAW_CAPS is given */
+bool jobspec_input_is_raw(const jobspec_t *job);
+
+/* True if the output is discarded instead of encoded (OUTPUT=null) */
+bool jobspec_output_is_null(const jobspec_t *job);
+
+/* Print the list of known settings and their defaults */
+void jobspec_print_help(FILE *f);
+
+#endif
@@ -1,4 +1,6 @@
 #include "autoaudio_decodebin.hh"
+#include <gst/video/video.h>
+#include <string.h>
 
 /* Debug category to use */
 GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
@@ -29,18 +31,50 @@ GST_STATIC_PAD_TEMPLATE (
   GST_STATIC_CAPS ("audio/x-raw")
 );
 
+/* Identifier numbers for properties */
+enum
+{
+  PROP_0,
+  PROP_DUMMY_AUDIO,
+  PROP_DECODER_THREADS,
+  PROP_THREAD_TYPE,
+  PROP_OUTPUT_BUFFERS,
+  PROP_VIDEO_TRACK,
+  PROP_AUDIO_TRACK,
+  PROP_USE_DECODEBIN3
+};
+
 /* Definition of the GObject subtype. We inherit from GstBin. */
 static void gst_autoaudio_decodebin_class_init(GstAutoAudioDecodeBinClass* klass);
 static void gst_autoaudio_decodebin_init(GstAutoAudioDecodeBin* filter);
 G_DEFINE_TYPE (GstAutoAudioDecodeBin, gst_autoaudio_decodebin, GST_TYPE_BIN);
 
+/* GObject function overrides */
+static void gst_autoaudio_decodebin_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_autoaudio_decodebin_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_autoaudio_decodebin_finalize(GObject *object);
+
 /* GstElement function overrides */
 static void gst_element_state_changed(GstElement *element, GstState oldstate,
                                       GstState newstate, GstState pending);
 
+/* GstBin function overrides */
+static void gst_autoaudio_decodebin_handle_message(GstBin *bin, GstMessage *message);
+
 /* Callbacks from the real decodebin */
 static void decodebin_pad_added(GstElement *decodebin, GstPad *pad, gpointer data);
 static void decodebin_no_more_pads(GstElement *decodebin, gpointer data);
+static void decodebin_element_added(GstBin *decodebin, GstElement *element, gpointer data);
+
+/* Create the real decodebin, replacing the previous one */
+static void create_decodebin(GstAutoAudioDecodeBin *filter);
+
+/* Dummy sources for the pads that have no stream */
+static void add_dummy_audio(GstAutoAudioDecodeBin *filter);
+static void add_dummy_video(GstAutoAudioDecodeBin *filter);
+
+/* Callback from allocation queries on the decoder source pad */
+static GstPadProbeReturn decoder_query_probe_callback(GstPad *pad, GstPadProbeInfo *info, gpointer data);
 
 /* Callback from end-of-stream on sink pad */
 static GstPadProbeReturn sink_pad_probe_callback(GstPad *pad, GstPadProbeInfo *info, gpointer data);
@@ -48,6 +82,73 @@ static GstPadProbeReturn sink_pad_probe_callback(GstPad *pad, GstPadProbeInfo *i
 /* Initializer for the class type */
 static void gst_autoaudio_decodebin_class_init (GstAutoAudioDecodeBinClass* klass)
 {
+  /* GObject method overrides */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    
+    gobject_class->set_property = gst_autoaudio_decodebin_set_property;
+    gobject_class->get_property = gst_autoaudio_decodebin_get_property;
+    gobject_class->finalize     = gst_autoaudio_decodebin_finalize;
+    
+    g_object_class_install_property(gobject_class, PROP_DUMMY_AUDIO,
+      g_param_spec_boolean("dummy-audio", "dummy-audio",
+                           "Generate silence on the audio pad if the input has no audio. "
+                           "Disable when the audio is generated downstream instead.",
+                           TRUE, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_DECODER_THREADS,
+      g_param_spec_int("decoder-threads", "decoder-threads",
+                       "Threads for the video decoder, 0 for the number of CPU cores, "
+                       "-1 to keep the decoder default",
+                       -1, 1024, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_THREAD_TYPE,
+      g_param_spec_string("thread-type", "thread-type",
+                          "Threading method for decoders that support several, "
+                          "e.g. \"frame\", \"slice\" or \"frame+slice\". "
+                          "Empty to keep the decoder default.",
+                          "", (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_OUTPUT_BUFFERS,
+      g_param_spec_int("output-buffers", "output-buffers",
+                       "Minimum number of buffers in the decoder output pool, so that "
+                       "frame threads are not starved. 0 to keep the negotiated size.",
+                       0, 1024, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_VIDEO_TRACK,
+      g_param_spec_int("video-track", "video-track",
+                       "Index of the video stream to decode, counting only video streams. "
+                       "-1 to decode no video.",
+                       -1, G_MAXINT, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_AUDIO_TRACK,
+      g_param_spec_int("audio-track", "audio-track",
+                       "Index of the audio stream to decode, counting only audio streams. "
+                       "-1 to decode no audio.",
+                       -1, G_MAXINT, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_USE_DECODEBIN3,
+      g_param_spec_boolean("use-decodebin3", "use-decodebin3",
+                           "Decode with decodebin3, which drops the unselected streams before "
+                           "decoding. Off by default, because decodebin3 is experimental in "
+                           "older GStreamer versions. Can only be changed in NULL state.",
+                           FALSE, (GParamFlags)(G_PARAM_READWRITE))
+    );
+  }
+  
+  /* GstBin method overrides */
+  {
+    GstBinClass *bin_class = GST_BIN_CLASS(klass);
+    
+    bin_class->handle_message = GST_DEBUG_FUNCPTR(gst_autoaudio_decodebin_handle_message);
+  }
+  
   /* Element metadata */
   {
     GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
@@ -72,24 +173,30 @@ static void gst_autoaudio_decodebin_class_init (GstAutoAudioDecodeBinClass* klas
 /* Initializer for class instances */
 static void gst_autoaudio_decodebin_init (GstAutoAudioDecodeBin* filter)
 {
-  GstPad *pad;
-  
-  /* Dummy video / audio are added in decodebin_no_more_pads() if needed */
+  /* Dummy video / audio are added in decodebin_no_more_pads() or
+   * select_streams() if needed */
   filter->dummyvideo = NULL;
   filter->dummyaudio = NULL;
+  filter->dummy_audio = TRUE;
+  filter->decoder_threads = 0;
+  filter->thread_type = g_strdup("");
+  filter->output_buffers = 0;
+  filter->video_track = 0;
+  filter->audio_track = 0;
+  filter->video_selected = FALSE;
+  filter->audio_selected = FALSE;
+  filter->video_pads = 0;
+  filter->audio_pads = 0;
+  filter->use_decodebin3 = FALSE;
+  filter->decodebin = NULL;
   
-  /* Create the main decodebin */
-  filter->decodebin = gst_element_factory_make("decodebin", "decodebin0");
-  gst_bin_add(GST_BIN(filter), filter->decodebin);
-  
-  /* Ghost the sink pad */
-  pad = gst_element_get_static_pad(GST_ELEMENT(filter->decodebin), "sink");
-  gst_element_add_pad(GST_ELEMENT(filter), gst_ghost_pad_new("sink", pad));
-  gst_object_unref(GST_OBJECT(pad));
-  
-  /* Ghost the source pads */
+  /* Ghost the pads, the sink pad gets its target in create_decodebin() */
   {
     GstPadTemplate *tmpl;
+    tmpl = gst_static_pad_template_get(&sink_template);
+    gst_element_add_pad(GST_ELEMENT(filter),
+                        gst_ghost_pad_new_no_target_from_template("sink", tmpl));
+    g_object_unref(tmpl);
     tmpl = gst_static_pad_template_get(&video_src_template);
     gst_element_add_pad(GST_ELEMENT(filter),
                         gst_ghost_pad_new_no_target_from_template("video", tmpl));
@@ -99,10 +206,151 @@ static void gst_autoaudio_decodebin_init (GstAutoAudioDecodeBin* filter)
                         gst_ghost_pad_new_no_target_from_template("audio", tmpl));
     g_object_unref(tmpl);
   }
-    
+  
+  create_decodebin(filter);
+}
+
+static void create_decodebin(GstAutoAudioDecodeBin *filter)
+{
+  GstPad *ghost = gst_element_get_static_pad(GST_ELEMENT(filter), "sink");
+  GstPad *pad;
+  
+  if (filter->decodebin != NULL)
+  {
+    gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), NULL);
+    gst_element_set_state(filter->decodebin, GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(filter), filter->decodebin);
+    filter->decodebin = NULL;
+  }
+  
+  /* decodebin3 lets us pick the streams from the stream collection, so
+   * that the other streams are dropped after the demuxer instead of being
+   * decoded and discarded. */
+#if GST_CHECK_VERSION(1,10,0)
+  if (filter->use_decodebin3)
+  {
+    filter->decodebin = gst_element_factory_make("decodebin3", "decodebin0");
+    if (filter->decodebin == NULL)
+      GST_INFO("decodebin3 not available, unused streams are selected by pad");
+  }
+#endif
+  filter->stream_selection = (filter->decodebin != NULL);
+  if (filter->decodebin == NULL)
+    filter->decodebin = gst_element_factory_make("decodebin", "decodebin0");
+  gst_bin_add(GST_BIN(filter), filter->decodebin);
+  
+  pad = gst_element_get_static_pad(filter->decodebin, "sink");
+  gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), pad);
+  gst_object_unref(GST_OBJECT(pad));
+  gst_object_unref(GST_OBJECT(ghost));
+  
   /* Connect the signals from the decodebin */
   g_signal_connect(filter->decodebin, "pad-added", G_CALLBACK(decodebin_pad_added), filter);
   g_signal_connect(filter->decodebin, "no-more-pads", G_CALLBACK(decodebin_no_more_pads), filter);
+  g_signal_connect(filter->decodebin, "element-added", G_CALLBACK(decodebin_element_added), filter);
+}
+
+static void gst_autoaudio_decodebin_finalize(GObject *object)
+{
+  GstAutoAudioDecodeBin *filter = GST_AUTOAUDIO_DECODEBIN(object);
+  
+  g_free(filter->thread_type);
+  filter->thread_type = NULL;
+  
+  G_OBJECT_CLASS(gst_autoaudio_decodebin_parent_class)->finalize(object);
+}
+
+static void gst_autoaudio_decodebin_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstAutoAudioDecodeBin *filter = GST_AUTOAUDIO_DECODEBIN(object);
+  
+  switch (prop_id)
+  {
+    case PROP_DUMMY_AUDIO:
+      filter->dummy_audio = g_value_get_boolean(value);
+      break;
+    
+    case PROP_DECODER_THREADS:
+      filter->decoder_threads = g_value_get_int(value);
+      break;
+    
+    case PROP_THREAD_TYPE:
+      g_free(filter->thread_type);
+      filter->thread_type = g_value_dup_string(value);
+      if (filter->thread_type == NULL)
+        filter->thread_type = g_strdup("");
+      break;
+    
+    case PROP_OUTPUT_BUFFERS:
+      filter->output_buffers = g_value_get_int(value);
+      break;
+    
+    case PROP_VIDEO_TRACK:
+      filter->video_track = g_value_get_int(value);
+      break;
+    
+    case PROP_AUDIO_TRACK:
+      filter->audio_track = g_value_get_int(value);
+      break;
+    
+    case PROP_USE_DECODEBIN3:
+      if (GST_STATE(filter) != GST_STATE_NULL)
+      {
+        GST_WARNING_OBJECT(filter, "use-decodebin3 can only be changed in NULL state");
+        break;
+      }
+      
+      if (filter->use_decodebin3 != g_value_get_boolean(value))
+      {
+        filter->use_decodebin3 = g_value_get_boolean(value);
+        create_decodebin(filter);
+      }
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gst_autoaudio_decodebin_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstAutoAudioDecodeBin *filter = GST_AUTOAUDIO_DECODEBIN(object);
+  
+  switch (prop_id)
+  {
+    case PROP_DUMMY_AUDIO:
+      g_value_set_boolean(value, filter->dummy_audio);
+      break;
+    
+    case PROP_DECODER_THREADS:
+      g_value_set_int(value, filter->decoder_threads);
+      break;
+    
+    case PROP_THREAD_TYPE:
+      g_value_set_string(value, filter->thread_type);
+      break;
+    
+    case PROP_OUTPUT_BUFFERS:
+      g_value_set_int(value, filter->output_buffers);
+      break;
+    
+    case PROP_VIDEO_TRACK:
+      g_value_set_int(value, filter->video_track);
+      break;
+    
+    case PROP_AUDIO_TRACK:
+      g_value_set_int(value, filter->audio_track);
+      break;
+    
+    case PROP_USE_DECODEBIN3:
+      g_value_set_boolean(value, filter->use_decodebin3);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static void gst_element_state_changed(GstElement *element, GstState oldstate,
@@ -111,6 +359,10 @@ static void gst_element_state_changed(GstElement *element, GstState oldstate,
   if (newstate == GST_STATE_READY || newstate == GST_STATE_NULL)
   {
     GstAutoAudioDecodeBin *filter = (GstAutoAudioDecodeBin*)element;
+    filter->video_selected = FALSE;
+    filter->audio_selected = FALSE;
+    filter->video_pads = 0;
+    filter->audio_pads = 0;
     if (filter->dummyaudio != NULL)
     {
       gst_element_set_state(filter->dummyaudio, GST_STATE_NULL);
@@ -126,6 +378,80 @@ static void gst_element_state_changed(GstElement *element, GstState oldstate,
   }
 }
 
+#if GST_CHECK_VERSION(1,10,0)
+/* Select the video and audio stream by their index among the streams of
+ * the same type. decodebin3 only creates decoders for the selected streams. */
+static void select_streams(GstAutoAudioDecodeBin *filter, GstStreamCollection *collection)
+{
+  GList *selected = NULL;
+  gint video_index = 0, audio_index = 0;
+  guint i;
+  
+  filter->video_selected = FALSE;
+  filter->audio_selected = FALSE;
+  
+  for (i = 0; i < gst_stream_collection_get_size(collection); i++)
+  {
+    GstStream *stream = gst_stream_collection_get_stream(collection, i);
+    GstStreamType type = gst_stream_get_stream_type(stream);
+    const gchar *id = gst_stream_get_stream_id(stream);
+    
+    if ((type & GST_STREAM_TYPE_VIDEO) && video_index++ == filter->video_track)
+    {
+      GST_DEBUG("Selecting video stream %s", id);
+      selected = g_list_append(selected, (gpointer)id);
+      filter->video_selected = TRUE;
+    }
+    else if ((type & GST_STREAM_TYPE_AUDIO) && audio_index++ == filter->audio_track)
+    {
+      GST_DEBUG("Selecting audio stream %s", id);
+      selected = g_list_append(selected, (gpointer)id);
+      filter->audio_selected = TRUE;
+    }
+    else
+    {
+      GST_DEBUG("Dropping %s stream %s", gst_stream_type_get_name(type), id);
+    }
+  }
+  
+  if (selected != NULL)
+  {
+    gst_element_send_event(filter->decodebin, gst_event_new_select_streams(selected));
+    g_list_free(selected);
+  }
+  
+  /* The pads of the missing streams are never added, so the dummy
+   * sources cannot wait for no-more-pads */
+  if (!filter->audio_selected && filter->dummy_audio)
+    add_dummy_audio(filter);
+  if (!filter->video_selected)
+    add_dummy_video(filter);
+}
+#endif
+
+static void gst_autoaudio_decodebin_handle_message(GstBin *bin, GstMessage *message)
+{
+#if GST_CHECK_VERSION(1,10,0)
+  GstAutoAudioDecodeBin *filter = GST_AUTOAUDIO_DECODEBIN(bin);
+  
+  /* Handled synchronously, so the selection is in place before
+   * decodebin3 exposes any pads */
+  if (filter->stream_selection &&
+      GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_COLLECTION)
+  {
+    GstStreamCollection *collection = NULL;
+    gst_message_parse_stream_collection(message, &collection);
+    if (collection != NULL)
+    {
+      select_streams(filter, collection);
+      gst_object_unref(collection);
+    }
+  }
+#endif
+  
+  GST_BIN_CLASS(gst_autoaudio_decodebin_parent_class)->handle_message(bin, message);
+}
+
 static void decodebin_pad_added(GstElement *decodebin, GstPad *pad, gpointer data)
 {
   GstAutoAudioDecodeBin *filter = (GstAutoAudioDecodeBin*)data;
@@ -141,6 +467,26 @@ static void decodebin_pad_added(GstElement *decodebin, GstPad *pad, gpointer dat
     gst_caps_unref(caps);
   }
   
+  /* Without stream selection in the decodebin, skip the pads of the
+   * other streams. They stay unlinked. */
+  if (is_audio && !filter->stream_selection)
+  {
+    is_audio = (filter->audio_pads++ == filter->audio_track);
+  }
+  else if (is_audio)
+  {
+    is_audio = filter->audio_selected;
+  }
+  
+  if (is_video && !filter->stream_selection)
+  {
+    is_video = (filter->video_pads++ == filter->video_track);
+  }
+  else if (is_video)
+  {
+    is_video = filter->video_selected;
+  }
+  
   /* Handle audio pads */
   if (is_audio)
   {
@@ -184,57 +530,61 @@ static void decodebin_no_more_pads(GstElement *decodebin, gpointer data)
 {
   GstAutoAudioDecodeBin *filter = (GstAutoAudioDecodeBin*)data;
   
-  /* Add dummy audio if needed */
+  if (filter->dummy_audio)
+    add_dummy_audio(filter);
+  add_dummy_video(filter);
+}
+
+static void add_dummy_audio(GstAutoAudioDecodeBin *filter)
+{
+  GstPad *audiopad = gst_element_get_static_pad(GST_ELEMENT(filter), "audio");
+  if (filter->dummyaudio == NULL && !gst_ghost_pad_get_target(GST_GHOST_PAD(audiopad)))
   {
-    GstPad *audiopad = gst_element_get_static_pad(GST_ELEMENT(filter), "audio");
-    if (!gst_ghost_pad_get_target(GST_GHOST_PAD(audiopad)))
+    GST_DEBUG("Inserting dummy audio source");
+    filter->dummyaudio = gst_element_factory_make("audiotestsrc", "dummyaudio");
+    gst_bin_add(GST_BIN(filter), filter->dummyaudio);
+    
+    g_object_set(G_OBJECT(filter->dummyaudio), "wave", 4, NULL); /* 4 = silence */
+    
     {
-      GST_DEBUG("Inserting dummy audio source");
-      filter->dummyaudio = gst_element_factory_make("audiotestsrc", "dummyaudio");
-      gst_bin_add(GST_BIN(filter), filter->dummyaudio);
-      
-      g_object_set(G_OBJECT(filter->dummyaudio), "wave", 4, NULL); /* 4 = silence */
-      
+      GstPad *dummypad = gst_element_get_static_pad(filter->dummyaudio, "src");
+      if (!gst_ghost_pad_set_target(GST_GHOST_PAD(audiopad), dummypad))
       {
-        GstPad *dummypad = gst_element_get_static_pad(filter->dummyaudio, "src");
-        if (!gst_ghost_pad_set_target(GST_GHOST_PAD(audiopad), dummypad))
-        {
-          GST_ELEMENT_ERROR(filter, STREAM, WRONG_TYPE, (NULL),
-                            ("Could not link dummy audio source"));
-        }
-        gst_object_unref(dummypad);
+        GST_ELEMENT_ERROR(filter, STREAM, WRONG_TYPE, (NULL),
+                          ("Could not link dummy audio source"));
       }
-      
-      gst_element_set_state(filter->dummyaudio, GST_STATE_NEXT(GST_ELEMENT(filter)));
+      gst_object_unref(dummypad);
     }
-    g_object_unref(audiopad);
+    
+    gst_element_set_state(filter->dummyaudio, GST_STATE_NEXT(GST_ELEMENT(filter)));
   }
-  
-  /* Add dummy video if needed */
+  g_object_unref(audiopad);
+}
+
+static void add_dummy_video(GstAutoAudioDecodeBin *filter)
+{
+  GstPad *videopad = gst_element_get_static_pad(GST_ELEMENT(filter), "video");
+  if (filter->dummyvideo == NULL && !gst_ghost_pad_get_target(GST_GHOST_PAD(videopad)))
   {
-    GstPad *videopad = gst_element_get_static_pad(GST_ELEMENT(filter), "video");
-    if (!gst_ghost_pad_get_target(GST_GHOST_PAD(videopad)))
+    GST_DEBUG("Inserting dummy video source");
+    filter->dummyvideo = gst_element_factory_make("videotestsrc", "dummyvideo");
+    gst_bin_add(GST_BIN(filter), filter->dummyvideo);
+    
+    g_object_set(G_OBJECT(filter->dummyvideo), "pattern", 18, NULL); /* 18 = moving ball */
+    
     {
-      GST_DEBUG("Inserting dummy video source");
-      filter->dummyvideo = gst_element_factory_make("videotestsrc", "dummyvideo");
-      gst_bin_add(GST_BIN(filter), filter->dummyvideo);
-      
-      g_object_set(G_OBJECT(filter->dummyvideo), "pattern", 18, NULL); /* 18 = moving ball */
-      
+      GstPad *dummypad = gst_element_get_static_pad(filter->dummyvideo, "src");
+      if (!gst_ghost_pad_set_target(GST_GHOST_PAD(videopad), dummypad))
       {
-        GstPad *dummypad = gst_element_get_static_pad(filter->dummyvideo, "src");
-        if (!gst_ghost_pad_set_target(GST_GHOST_PAD(videopad), dummypad))
-        {
-          GST_ELEMENT_ERROR(filter, STREAM, WRONG_TYPE, (NULL),
-                            ("Could not link dummy audio source"));
-        }
-        gst_object_unref(dummypad);
+        GST_ELEMENT_ERROR(filter, STREAM, WRONG_TYPE, (NULL),
+                          ("Could not link dummy video source"));
       }
-      
-      gst_element_set_state(filter->dummyvideo, GST_STATE_NEXT(GST_ELEMENT(filter)));
+      gst_object_unref(dummypad);
     }
-    g_object_unref(videopad);
+    
+    gst_element_set_state(filter->dummyvideo, GST_STATE_NEXT(GST_ELEMENT(filter)));
   }
+  g_object_unref(videopad);
 }
 
 static GstPadProbeReturn sink_pad_probe_callback(GstPad *pad, GstPadProbeInfo *info, gpointer data)
@@ -258,4 +608,156 @@ static GstPadProbeReturn sink_pad_probe_callback(GstPad *pad, GstPadProbeInfo *i
   }
   
   return GST_PAD_PROBE_OK;
-}
\ No newline at end of file
+}
+
+/* Thread count properties used by the common decoders:
+ * libav max-threads, vpx threads, dav1d n-threads */
+static const gchar *thread_properties[] = {"max-threads", "threads", "n-threads"};
+
+static bool element_is_video_decoder(GstElement *element)
+{
+  GstElementFactory *factory = gst_element_get_factory(element);
+  const gchar *klass;
+  
+  if (factory == NULL)
+    return false;
+  
+  klass = gst_element_factory_get_metadata(factory, GST_ELEMENT_METADATA_KLASS);
+  return klass != NULL && strstr(klass, "Decoder") != NULL && strstr(klass, "Video") != NULL;
+}
+
+/* Configure the video decoders when decodebin creates them, and report
+ * the result on the bus. */
+static void decodebin_element_added(GstBin *decodebin, GstElement *element, gpointer data)
+{
+  GstAutoAudioDecodeBin *filter = (GstAutoAudioDecodeBin*)data;
+  GObjectClass *klass = G_OBJECT_GET_CLASS(element);
+  const gchar *thread_property = NULL;
+  gint threads = -1;
+  gchar *thread_type = NULL;
+  size_t i;
+  
+  if (!element_is_video_decoder(element))
+    return;
+  
+  for (i = 0; i < G_N_ELEMENTS(thread_properties); i++)
+  {
+    if (g_object_class_find_property(klass, thread_properties[i]) != NULL)
+    {
+      thread_property = thread_properties[i];
+      break;
+    }
+  }
+  
+  if (thread_property != NULL && filter->decoder_threads >= 0)
+  {
+    gchar *value = g_strdup_printf("%d", filter->decoder_threads > 0 ?
+                                         filter->decoder_threads : (int)g_get_num_processors());
+    GST_INFO("Setting %s %s=%s", GST_ELEMENT_NAME(element), thread_property, value);
+    gst_util_set_object_arg(G_OBJECT(element), thread_property, value);
+    g_free(value);
+  }
+  
+  if (filter->thread_type[0] != '\0' && g_object_class_find_property(klass, "thread-type") != NULL)
+  {
+    GST_INFO("Setting %s thread-type=%s", GST_ELEMENT_NAME(element), filter->thread_type);
+    gst_util_set_object_arg(G_OBJECT(element), "thread-type", filter->thread_type);
+  }
+  
+  if (filter->output_buffers > 0)
+  {
+    GstPad *pad = gst_element_get_static_pad(element, "src");
+    if (pad != NULL)
+    {
+      gst_pad_add_probe(pad, GST_PAD_PROBE_TYPE_QUERY_DOWNSTREAM,
+                        decoder_query_probe_callback, filter, NULL);
+      gst_object_unref(pad);
+    }
+  }
+  
+  /* Read back the values that are actually in use */
+  if (thread_property != NULL)
+  {
+    GValue value = G_VALUE_INIT;
+    g_value_init(&value, G_TYPE_INT);
+    g_object_get_property(G_OBJECT(element), thread_property, &value);
+    threads = g_value_get_int(&value);
+    g_value_unset(&value);
+  }
+  
+  if (g_object_class_find_property(klass, "thread-type") != NULL)
+  {
+    GValue value = G_VALUE_INIT;
+    g_value_init(&value, g_object_class_find_property(klass, "thread-type")->value_type);
+    g_object_get_property(G_OBJECT(element), "thread-type", &value);
+    thread_type = g_strdup_value_contents(&value);
+    g_value_unset(&value);
+  }
+  
+  {
+    GstStructure *s = gst_structure_new("oftvg-decoder",
+      "element", G_TYPE_STRING, GST_ELEMENT_NAME(element),
+      "factory", G_TYPE_STRING, GST_OBJECT_NAME(gst_element_get_factory(element)),
+      "threads", G_TYPE_INT, threads,
+      "thread-type", G_TYPE_STRING, thread_type ? thread_type : "",
+      "output-buffers", G_TYPE_INT, filter->output_buffers,
+      NULL);
+    
+    GST_DEBUG("Decoder: %" GST_PTR_FORMAT, s);
+    gst_element_post_message(GST_ELEMENT(filter),
+                             gst_message_new_element(GST_OBJECT(filter), s));
+  }
+  
+  g_free(thread_type);
+}
+
+/* Raise the minimum size of the decoder output pool after downstream has
+ * answered the allocation query. With frame threading, each thread holds
+ * on to an output buffer while the queues downstream hold the rest. */
+static GstPadProbeReturn decoder_query_probe_callback(GstPad *pad, GstPadProbeInfo *info, gpointer data)
+{
+  GstAutoAudioDecodeBin *filter = (GstAutoAudioDecodeBin*)data;
+  GstQuery *query = GST_PAD_PROBE_INFO_QUERY(info);
+  guint min = filter->output_buffers;
+  
+  if (!(GST_PAD_PROBE_INFO_TYPE(info) & GST_PAD_PROBE_TYPE_PULL) ||
+      GST_QUERY_TYPE(query) != GST_QUERY_ALLOCATION)
+    return GST_PAD_PROBE_OK;
+  
+  if (gst_query_get_n_allocation_pools(query) > 0)
+  {
+    guint i;
+    for (i = 0; i < gst_query_get_n_allocation_pools(query); i++)
+    {
+      GstBufferPool *pool;
+      guint size, pool_min, pool_max;
+      
+      gst_query_parse_nth_allocation_pool(query, i, &pool, &size, &pool_min, &pool_max);
+      if (pool_min < min)
+      {
+        pool_min = min;
+        if (pool_max != 0 && pool_max < pool_min)
+          pool_max = pool_min;
+        gst_query_set_nth_allocation_pool(query, i, pool, size, pool_min, pool_max);
+      }
+      
+      if (pool)
+        gst_object_unref(pool);
+    }
+  }
+  else
+  {
+    /* Let the decoder create its own pool, but with enough buffers */
+    GstCaps *caps;
+    GstVideoInfo vinfo;
+    
+    gst_query_parse_allocation(query, &caps, NULL);
+    if (caps != NULL && gst_video_info_from_caps(&vinfo, caps))
+    {
+      gst_query_add_allocation_pool(query, NULL, GST_VIDEO_INFO_SIZE(&vinfo), min, 0);
+    }
+  }
+  
+  GST_DEBUG("Decoder output pool: at least %u buffers", min);
+  return GST_PAD_PROBE_OK;
+}
@@ -1,6 +1,11 @@
 /* This is a wrapper around the GStreamer decodebin. It always provides one audio
  * source pad and one video source pad. If either stream is unavailable on input,
- * dummy data is generated.
+ * dummy data is generated. The dummy audio can be disabled with the dummy-audio
+ * property, when the audio pad is left unlinked.
+ *
+ * The video decoders created by decodebin are configured for multi-threaded
+ * decoding, and the chosen decoder is reported with an "oftvg-decoder"
+ * element message.
  */
 
 #ifndef __AUTOAUDIO_DECODEBIN_HH__
@@ -30,6 +35,31 @@ struct _GstAutoAudioDecodeBin {
   GstElement *decodebin;
   GstElement *dummyvideo;
   GstElement *dummyaudio;
+  
+  /* Property: generate silence if the input has no audio */
+  gboolean dummy_audio;
+  
+  /* Properties: decoder threads (0 for CPU cores, -1 to keep the decoder
+   * default), thread type flags and minimum output buffers (0 to keep) */
+  gint decoder_threads;
+  gchar *thread_type;
+  gint output_buffers;
+  
+  /* Properties: index of the video and audio stream to decode among the
+   * streams of the same type, -1 to decode none */
+  gint video_track;
+  gint audio_track;
+  
+  /* Property: use decodebin3 if it is available */
+  gboolean use_decodebin3;
+  
+  /* True if the decodebin drops the unselected streams before decoding
+   * (decodebin3). Otherwise the pads are counted as they appear. */
+  gboolean stream_selection;
+  gboolean video_selected;
+  gboolean audio_selected;
+  gint video_pads;
+  gint audio_pads;
 };
 
 struct _GstAutoAudioDecodeBinClass {
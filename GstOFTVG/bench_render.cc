@@ -0,0 +1,362 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Micro-benchmark for the marker rendering in OFTVG_Video_Process.
+ *
+ * Renders the layout on synthetic buffers for every format accepted by
+ * oftvg_video, at several resolutions and in every layout mode, without
+ * any decoding or encoding in the way. Each result is printed as one
+ * line of JSON (or CSV), so that the output of two releases can be diffed.
+ *
+ * Build and run with "make bench" in the GstOFTVG directory.
+ */
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "gstoftvg_video.hh"
+#include "gstoftvg_video_process.hh"
+#include "gstoftvg_stats.hh"
+#include "timemeasure.h"
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+GST_DEBUG_CATEGORY(gst_oftvg_debug);
+#define GST_CAT_DEFAULT gst_oftvg_debug
+
+/* Layout modes that are benchmarked */
+enum BenchMode
+{
+  MODE_NORMAL,
+  MODE_CALIBRATION_WHITE,
+  MODE_CALIBRATION_MARKS,
+  MODE_RGB6,
+  MODE_COUNT
+};
+
+static const char *mode_names[MODE_COUNT] = {
+  "normal", "calibration-white", "calibration-marks", "rgb6"
+};
+
+struct BenchSize
+{
+  const char *name;
+  int width;
+  int height;
+};
+
+static const BenchSize sizes[] = {
+  {"720p",  1280,  720},
+  {"1080p", 1920, 1080},
+  {"4k",    3840, 2160},
+  {"8k",    7680, 4320}
+};
+
+struct BenchResult
+{
+  guint64 frames;
+  double ns_per_frame;
+  timemeasure_t p50;
+  timemeasure_t p99;
+  double bytes_per_frame;
+  gint64 cache_misses; /* -1 if not available */
+};
+
+/* Command line options */
+static gchar *opt_layout = NULL;
+static gint opt_frames = 100;
+static gchar *opt_formats = NULL;
+static gchar *opt_sizes = NULL;
+static gboolean opt_csv = FALSE;
+static gboolean opt_perf = FALSE;
+
+static GOptionEntry option_entries[] = {
+  {"layout", 'l', 0, G_OPTION_ARG_FILENAME, &opt_layout, "Layout bitmap (default layout.bmp)", "FILE"},
+  {"frames", 'n', 0, G_OPTION_ARG_INT, &opt_frames, "Frames to render per test (default 100)", "N"},
+  {"formats", 'f', 0, G_OPTION_ARG_STRING, &opt_formats, "Comma-separated formats (default all)", "LIST"},
+  {"sizes", 's', 0, G_OPTION_ARG_STRING, &opt_sizes, "Comma-separated sizes: 720p,1080p,4k,8k", "LIST"},
+  {"csv", 0, 0, G_OPTION_ARG_NONE, &opt_csv, "Output CSV instead of JSON lines", NULL},
+  {"perf", 0, 0, G_OPTION_ARG_NONE, &opt_perf, "Count cache misses with perf_event_open", NULL},
+  {NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
+};
+
+/* Check if a name is included in a comma-separated list; NULL means all */
+static bool in_list(const gchar *list, const gchar *name)
+{
+  if (list == NULL)
+    return true;
+
+  gchar **items = g_strsplit(list, ",", -1);
+  bool found = false;
+  for (int i = 0; items[i] != NULL; i++)
+  {
+    if (g_ascii_strcasecmp(g_strstrip(items[i]), name) == 0)
+      found = true;
+  }
+  g_strfreev(items);
+  return found;
+}
+
+/* Cache miss counter for the calling thread, or -1 if not supported */
+static int open_cache_miss_counter()
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+static void start_counter(int fd)
+{
+#ifdef __linux__
+  if (fd >= 0)
+  {
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+static gint64 stop_counter(int fd)
+{
+#ifdef __linux__
+  long long count;
+  if (fd >= 0)
+  {
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(fd, &count, sizeof(count)) == sizeof(count))
+      return count;
+  }
+#endif
+  return -1;
+}
+
+/* Render one frame in the given mode */
+static void render(OFTVG_Video_Process *process, GstBuffer *buf, BenchMode mode, int frame)
+{
+  switch (mode)
+  {
+    case MODE_NORMAL:
+    {
+      /* Lipsync frames once a second, as with lipsync=1000 */
+      OFTVG::FrameFlags flags = (frame % 30 == 0) ? OFTVG::FRAMEFLAGS_LIPSYNC : OFTVG::FRAMEFLAGS_NONE;
+      process->process_frame(buf, frame, flags);
+      break;
+    }
+    case MODE_CALIBRATION_WHITE:
+    case MODE_RGB6:
+      process->process_calibration_white(buf);
+      break;
+    case MODE_CALIBRATION_MARKS:
+      process->process_calibration_marks(buf);
+      break;
+    default:
+      break;
+  }
+}
+
+static bool run_test(GstVideoFormat format, const BenchSize &size, BenchMode mode,
+                     int perf_fd, BenchResult *result)
+{
+  GstVideoInfo info;
+  OFTVG_Video_Process process;
+  OFTVG_Histogram histogram;
+  guint64 bytes = 0;
+  bool ok;
+
+  gst_video_info_set_format(&info, format, size.width, size.height);
+  GST_VIDEO_INFO_FPS_N(&info) = 30;
+  GST_VIDEO_INFO_FPS_D(&info) = 1;
+
+  {
+    GstCaps *caps = gst_video_info_to_caps(&info);
+    ok = process.init_caps(caps)
+      && process.init_custom_sequence("")
+      && process.init_layout(opt_layout, mode == MODE_RGB6);
+    gst_caps_unref(caps);
+  }
+
+  if (!ok)
+    return false;
+
+  /* Mid-gray frame, allocated once and reused for every iteration */
+  GstBuffer *buf = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&info), NULL);
+  gst_buffer_memset(buf, 0, 128, GST_VIDEO_INFO_SIZE(&info));
+
+  /* Warm up the caches and the allocator */
+  for (int i = 0; i < 5; i++)
+  {
+    render(&process, buf, mode, i);
+  }
+
+  start_counter(perf_fd);
+  timemeasure_t start = begin_timing();
+
+  for (int i = 0; i < opt_frames; i++)
+  {
+    timemeasure_t frame_start = begin_timing();
+    render(&process, buf, mode, i);
+    histogram.add(end_timing(frame_start));
+    bytes += process.get_last_bytes_written();
+  }
+
+  timemeasure_t total = end_timing(start);
+  gint64 misses = stop_counter(perf_fd);
+
+  gst_buffer_unref(buf);
+
+  result->frames = opt_frames;
+  result->ns_per_frame = (double)total / opt_frames;
+  result->p50 = histogram.percentile(0.50);
+  result->p99 = histogram.percentile(0.99);
+  result->bytes_per_frame = (double)bytes / opt_frames;
+  result->cache_misses = (misses >= 0) ? misses / opt_frames : -1;
+  return true;
+}
+
+static void print_result(const char *format, const BenchSize &size, BenchMode mode,
+                         const BenchResult &r)
+{
+  if (opt_csv)
+  {
+    printf("%s,%s,%d,%d,%s,%" G_GUINT64_FORMAT ",%.0f,%" G_GUINT64_FORMAT ",%" G_GUINT64_FORMAT ",%.0f,",
+           format, size.name, size.width, size.height, mode_names[mode], r.frames,
+           r.ns_per_frame, r.p50, r.p99, r.bytes_per_frame);
+    if (r.cache_misses >= 0)
+      printf("%" G_GINT64_FORMAT "\n", r.cache_misses);
+    else
+      printf("\n");
+  }
+  else
+  {
+    printf("{\"format\": \"%s\", \"size\": \"%s\", \"width\": %d, \"height\": %d, "
+           "\"mode\": \"%s\", \"frames\": %" G_GUINT64_FORMAT ", \"ns_per_frame\": %.0f, "
+           "\"p50_ns\": %" G_GUINT64_FORMAT ", \"p99_ns\": %" G_GUINT64_FORMAT ", "
+           "\"bytes_per_frame\": %.0f, \"cache_misses_per_frame\": ",
+           format, size.name, size.width, size.height, mode_names[mode], r.frames,
+           r.ns_per_frame, r.p50, r.p99, r.bytes_per_frame);
+    if (r.cache_misses >= 0)
+      printf("%" G_GINT64_FORMAT "}\n", r.cache_misses);
+    else
+      printf("null}\n");
+  }
+  fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+  GError *error = NULL;
+  GOptionContext *context;
+  int perf_fd = -1;
+
+  context = g_option_context_new("- benchmark the oftvg marker rendering");
+  g_option_context_add_main_entries(context, option_entries, NULL);
+  g_option_context_add_group(context, gst_init_get_option_group());
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    fprintf(stderr, "%s\n", error->message);
+    g_error_free(error);
+    return 1;
+  }
+  g_option_context_free(context);
+
+  GST_DEBUG_CATEGORY_INIT(gst_oftvg_debug, "oftvg", 0, "");
+
+  if (opt_layout == NULL)
+    opt_layout = g_strdup("layout.bmp");
+
+  if (opt_frames <= 0)
+  {
+    fprintf(stderr, "--frames must be positive\n");
+    return 1;
+  }
+
+  if (opt_perf)
+  {
+    perf_fd = open_cache_miss_counter();
+    if (perf_fd < 0)
+      fprintf(stderr, "Warning: cache miss counters are not available\n");
+  }
+
+  if (opt_csv)
+  {
+    printf("format,size,width,height,mode,frames,ns_per_frame,p50_ns,p99_ns,"
+           "bytes_per_frame,cache_misses_per_frame\n");
+  }
+
+  /* Same formats as on the sink pad of oftvg_video */
+  GstCaps *caps = gst_caps_from_string(GSTOFTVG_VIDEO_SINK_CAPS);
+  int status = 0;
+
+  for (guint c = 0; c < gst_caps_get_size(caps); c++)
+  {
+    const gchar *format_name = gst_structure_get_string(gst_caps_get_structure(caps, c), "format");
+    GstVideoFormat format = gst_video_format_from_string(format_name);
+
+    if (format == GST_VIDEO_FORMAT_UNKNOWN || !in_list(opt_formats, format_name))
+      continue;
+
+    for (size_t s = 0; s < G_N_ELEMENTS(sizes); s++)
+    {
+      if (!in_list(opt_sizes, sizes[s].name))
+        continue;
+
+      for (int m = 0; m < MODE_COUNT; m++)
+      {
+        BenchResult result;
+        if (!run_test(format, sizes[s], (BenchMode)m, perf_fd, &result))
+        {
+          fprintf(stderr, "Failed: %s %s %s\n", format_name, sizes[s].name, mode_names[m]);
+          status = 1;
+          continue;
+        }
+        print_result(format_name, sizes[s], (BenchMode)m, result);
+      }
+    }
+  }
+
+  gst_caps_unref(caps);
+
+#ifdef __linux__
+  if (perf_fd >= 0)
+    close(perf_fd);
+#endif
+
+  g_free(opt_layout);
+  return status;
+}
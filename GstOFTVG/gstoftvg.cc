@@ -49,6 +49,10 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_STR
 #undef PROP_INT
 #undef PROP_BOOL
+  PROP_STATS,
+  PROP_BEEP_CHANNELS,
+  PROP_CODED_BEEPS,
+  PROP_GENERATE_AUDIO
 };
 
 /* Definition of the GObject subtype. We inherit from GstBin. */
@@ -60,12 +64,6 @@ G_DEFINE_TYPE (GstOFTVG, gst_oftvg, GST_TYPE_BIN);
 static void gst_oftvg_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
 static void gst_oftvg_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
 
-/* Callbacks for passing lipsync data between video and audio elements */
-static void lipsync_generated_cb(GstElement *video_element, GstClockTime start,
-                                 GstClockTime end, GstOFTVG *filter);
-static void video_processed_upto_cb(GstElement *video_element, GstClockTime start,
-                                    GstOFTVG *filter);
-static void video_end_of_stream_cb(GstElement *video_element, GstOFTVG *filter);
 
 /* Initializer for the class type */
 static void gst_oftvg_class_init (GstOFTVGClass* klass)
@@ -141,6 +139,38 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_STR
 #undef PROP_INT
 #undef PROP_BOOL
+    
+    g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "stats", "Render-time statistics of the video element",
+                         GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE))
+    );
+  }
+  
+  /* Pass through the properties from the audio element */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    GObjectClass *audio_class = G_OBJECT_CLASS(g_type_class_ref(GST_TYPE_OFTVG_AUDIO));
+    GParamSpec *spec = g_object_class_find_property(audio_class, "beep-channels");
+    
+    g_object_class_install_property(gobject_class, PROP_BEEP_CHANNELS,
+      g_param_spec_uint64("beep-channels", "beep-channels", g_param_spec_get_blurb(spec),
+                          0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    spec = g_object_class_find_property(audio_class, "coded-beeps");
+    g_object_class_install_property(gobject_class, PROP_CODED_BEEPS,
+      g_param_spec_boolean("coded-beeps", "coded-beeps", g_param_spec_get_blurb(spec),
+                           FALSE, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_GENERATE_AUDIO,
+      g_param_spec_boolean("generate-audio", "generate-audio",
+                           "Generate the audio (silence and beeps) instead of taking it "
+                           "from the asink pad. Used for inputs without audio.",
+                           FALSE, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_type_class_unref(audio_class);
   }
 }
 
@@ -169,13 +199,61 @@ static void gst_oftvg_init (GstOFTVG* filter)
   gst_element_add_pad(GST_ELEMENT(filter), gst_ghost_pad_new ("asink", pad));
   gst_object_unref(GST_OBJECT(pad));
   
-  /* Connect the signals from the video element */
-  g_signal_connect(filter->video_element, "lipsync-generated",
-                   G_CALLBACK(lipsync_generated_cb), filter);
-  g_signal_connect(filter->video_element, "video-processed-upto",
-                   G_CALLBACK(video_processed_upto_cb), filter);
-  g_signal_connect(filter->video_element, "video-end-of-stream",
-                   G_CALLBACK(video_end_of_stream_cb), filter);
+  /* The audio element places the beeps according to the video timeline */
+  gst_oftvg_audio_set_timeline(filter->audio_element,
+                               gst_oftvg_video_get_timeline(filter->video_element));
+  filter->audio_source = NULL;
+}
+
+void gst_oftvg_set_timeline (GstOFTVG *filter, OFTVG_Timeline *timeline)
+{
+  gst_oftvg_video_set_timeline(filter->video_element, timeline);
+  timeline = gst_oftvg_video_get_timeline(filter->video_element);
+  
+  gst_oftvg_audio_set_timeline(filter->audio_element, timeline);
+  if (filter->audio_source)
+    gst_oftvg_audiosrc_set_timeline(filter->audio_source, timeline);
+}
+
+/* Switch the asrc pad between the audio filter and the audio source.
+ * Without input audio, the source produces silence with the beeps, so
+ * no dummy audio has to be decoded, converted and mixed. */
+static void gst_oftvg_set_generate_audio(GstOFTVG* filter, bool enable)
+{
+  GstPad *ghost = gst_element_get_static_pad(GST_ELEMENT(filter), "asrc");
+  GstPad *pad;
+  
+  if (enable && filter->audio_source == NULL)
+  {
+    guint64 beep_channels;
+    gboolean coded_beeps;
+    
+    filter->audio_source = GST_OFTVG_AUDIOSRC(gst_element_factory_make("oftvg_audiosrc", "audiosrc"));
+    gst_bin_add(GST_BIN(filter), GST_ELEMENT(filter->audio_source));
+    gst_oftvg_audiosrc_set_timeline(filter->audio_source,
+                                    gst_oftvg_video_get_timeline(filter->video_element));
+    
+    g_object_get(filter->audio_element, "beep-channels", &beep_channels,
+                 "coded-beeps", &coded_beeps, NULL);
+    g_object_set(filter->audio_source, "beep-channels", beep_channels,
+                 "coded-beeps", coded_beeps, NULL);
+    
+    pad = gst_element_get_static_pad(GST_ELEMENT(filter->audio_source), "src");
+    gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), pad);
+    gst_object_unref(GST_OBJECT(pad));
+  }
+  else if (!enable && filter->audio_source != NULL)
+  {
+    pad = gst_element_get_static_pad(GST_ELEMENT(filter->audio_element), "src");
+    gst_ghost_pad_set_target(GST_GHOST_PAD(ghost), pad);
+    gst_object_unref(GST_OBJECT(pad));
+    
+    gst_element_set_state(GST_ELEMENT(filter->audio_source), GST_STATE_NULL);
+    gst_bin_remove(GST_BIN(filter), GST_ELEMENT(filter->audio_source));
+    filter->audio_source = NULL;
+  }
+  
+  gst_object_unref(GST_OBJECT(ghost));
 }
 
 /* Property setting */
@@ -202,6 +280,22 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_INT
 #undef PROP_BOOL
 
+    case PROP_BEEP_CHANNELS:
+      g_object_set(filter->audio_element, "beep-channels", g_value_get_uint64(value), NULL);
+      if (filter->audio_source)
+        g_object_set(filter->audio_source, "beep-channels", g_value_get_uint64(value), NULL);
+      break;
+
+    case PROP_CODED_BEEPS:
+      g_object_set(filter->audio_element, "coded-beeps", g_value_get_boolean(value), NULL);
+      if (filter->audio_source)
+        g_object_set(filter->audio_source, "coded-beeps", g_value_get_boolean(value), NULL);
+      break;
+
+    case PROP_GENERATE_AUDIO:
+      gst_oftvg_set_generate_audio(filter, g_value_get_boolean(value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -245,27 +339,36 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_INT
 #undef PROP_BOOL
 
-    default:
-      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+    case PROP_STATS:
+    {
+      GstStructure *stats;
+      g_object_get(filter->video_element, "stats", &stats, NULL);
+      g_value_take_boxed(value, stats);
       break;
-  }
-}
+    }
 
-/* Pass signals from the video element to the audio side */
-static void lipsync_generated_cb(GstElement *video_element, GstClockTime start,
-                                 GstClockTime end, GstOFTVG *filter)
-{
-  gst_oftvg_audio_generate_beep(filter->audio_element, start, end);
-}
+    case PROP_BEEP_CHANNELS:
+    {
+      guint64 mask;
+      g_object_get(filter->audio_element, "beep-channels", &mask, NULL);
+      g_value_set_uint64(value, mask);
+      break;
+    }
 
-static void video_processed_upto_cb(GstElement *video_element, GstClockTime start,
-                                    GstOFTVG *filter)
-{
-  gst_oftvg_audio_generate_silence(filter->audio_element, start);
-}
+    case PROP_CODED_BEEPS:
+    {
+      gboolean coded;
+      g_object_get(filter->audio_element, "coded-beeps", &coded, NULL);
+      g_value_set_boolean(value, coded);
+      break;
+    }
 
-static void video_end_of_stream_cb(GstElement *video_element, GstOFTVG *filter)
-{
-  gst_oftvg_audio_end_stream(filter->audio_element);
-}
+    case PROP_GENERATE_AUDIO:
+      g_value_set_boolean(value, filter->audio_source != NULL);
+      break;
 
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
@@ -25,6 +25,7 @@
 #include <gst/gstbin.h>
 #include "gstoftvg_video.hh"
 #include "gstoftvg_audio.hh"
+#include "gstoftvg_audiosrc.hh"
 
 G_BEGIN_DECLS
 
@@ -46,6 +47,7 @@ struct _GstOFTVG {
   GstBin bin;
   GstOFTVG_Video *video_element;
   GstOFTVG_Audio *audio_element;
+  GstOFTVG_AudioSrc *audio_source; /* Replaces audio_element with generate-audio */
 };
 
 struct _GstOFTVGClass {
@@ -54,6 +56,11 @@ struct _GstOFTVGClass {
 
 GType gst_oftvg_get_type (void);
 
+/* Use a timeline shared with other oftvg elements that process the same
+ * input, so that their markers and beeps are placed on the same frames.
+ * The caller keeps the ownership. */
+void gst_oftvg_set_timeline (GstOFTVG *filter, OFTVG_Timeline *timeline);
+
 G_END_DECLS
 
 #endif /* __GST_OFTVG_HH__ */
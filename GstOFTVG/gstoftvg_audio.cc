@@ -23,6 +23,21 @@
  *
  * A source element that generates beeps as instructed. Cannot be used
  * stand-alone.
+ *
+ * The beeps are mixed into interleaved S16, S32 or F32 audio with any number
+ * of channels, so no conversion is needed for most decoders. The
+ * beep-channels property selects which channels get the beep.
+ *
+ * The beeps are placed on the lipsync frames of the timeline computed by
+ * the video element, so the audio does not have to wait for the video
+ * to be processed. When the end of the stream depends on where the input
+ * video ends, the audio is cut once the video element publishes the end.
+ * Without a timeline the audio is passed through.
+ *
+ * With coded-beeps enabled, each beep is followed by the number of the
+ * lipsync frame, counted from the first video frame like the frame ID
+ * markers. The number is sent as 4-FSK symbols, so that the analyzer can
+ * pair every beep with its frame even if some beeps or frames are lost.
  */
 
 
@@ -33,60 +48,86 @@
 #include <gst/gst.h>
 #include <gst/audio/audio.h>
 #include "gstoftvg_audio.hh"
-#include <math.h>
+#include "gstoftvg_timeline.hh"
+#include "gstoftvg_beeps.hh"
 
 /* Debug category to use */
 GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
 #define GST_CAT_DEFAULT gst_oftvg_debug
 
-/* Template for the source pin.
- * We only support a single format, audioconvert shall convert the data
- * from any other format that is needed.
- */
+/* Template for the pins */
 static GstStaticPadTemplate sink_template =
 GST_STATIC_PAD_TEMPLATE (
   "sink",
   GST_PAD_SINK,
   GST_PAD_ALWAYS,
-  GST_STATIC_CAPS (
-    "audio/x-raw, "
-    "format = (string) \"" GST_AUDIO_NE(S16) "\", "
-    "rate = (int) [ 1, max ], "
-    "layout = (string) interleaved, "
-    "channels = (int) 2;"
-  )
+  GST_STATIC_CAPS (GSTOFTVG_AUDIO_CAPS)
 );
 static GstStaticPadTemplate src_template =
 GST_STATIC_PAD_TEMPLATE (
   "src",
   GST_PAD_SRC,
   GST_PAD_ALWAYS,
-  GST_STATIC_CAPS (
-    "audio/x-raw, "
-    "format = (string) \"" GST_AUDIO_NE(S16) "\", "
-    "rate = (int) [ 1, max ], "
-    "layout = (string) interleaved, "
-    "channels = (int) 2;"
-  )
+  GST_STATIC_CAPS (GSTOFTVG_AUDIO_CAPS)
 );
 
+/* Identifier numbers for properties */
+enum
+{
+  PROP_0,
+  PROP_BEEP_CHANNELS,
+  PROP_CODED_BEEPS
+};
+
 /* Definition of the GObject subtype. */
 static void gst_oftvg_audio_class_init(GstOFTVG_AudioClass* klass);
 static void gst_oftvg_audio_init(GstOFTVG_Audio* filter);
 G_DEFINE_TYPE (GstOFTVG_Audio, gst_oftvg_audio, GST_TYPE_BASE_TRANSFORM);
 
 /* Prototypes for the overridden methods */
+static void gst_oftvg_audio_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_oftvg_audio_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_oftvg_audio_finalize(GObject *object);
+static GstStateChangeReturn gst_oftvg_audio_change_state(GstElement *element, GstStateChange transition);
 static gboolean gst_oftvg_audio_start(GstBaseTransform* object);
+static gboolean gst_oftvg_audio_set_caps(GstBaseTransform* object, GstCaps* incaps, GstCaps* outcaps);
+static gboolean gst_oftvg_audio_sink_event(GstBaseTransform *object, GstEvent *event);
 static GstFlowReturn gst_oftvg_audio_transform_ip (GstBaseTransform *base, GstBuffer *buf);
 
 /* Initializer for the class type */
 static void gst_oftvg_audio_class_init(GstOFTVG_AudioClass* klass)
 {
+  /* GObject method overrides */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    
+    gobject_class->set_property = gst_oftvg_audio_set_property;
+    gobject_class->get_property = gst_oftvg_audio_get_property;
+    gobject_class->finalize     = gst_oftvg_audio_finalize;
+    
+    g_object_class_install_property(gobject_class, PROP_BEEP_CHANNELS,
+      g_param_spec_uint64("beep-channels", "beep-channels",
+                          "Channel positions that get the lipsync beep, as a "
+                          "GST_AUDIO_CHANNEL_POSITION_MASK() bitmask. For unpositioned "
+                          "audio bit N selects channel N. 0 means all channels.",
+                          0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_CODED_BEEPS,
+      g_param_spec_boolean("coded-beeps", "coded-beeps",
+                           "Follow each lipsync beep with the frame number of the "
+                           "lipsync frame. Needs a lipsync interval of over one frame plus 140 ms.",
+                           FALSE, (GParamFlags)(G_PARAM_READWRITE))
+    );
+  }
+  
   /* GstBaseTransform method overrides */
   {
     GstBaseTransformClass* btrans = GST_BASE_TRANSFORM_CLASS(klass);
     
     btrans->start        = GST_DEBUG_FUNCPTR(gst_oftvg_audio_start);
+    btrans->set_caps     = GST_DEBUG_FUNCPTR(gst_oftvg_audio_set_caps);
+    btrans->sink_event   = GST_DEBUG_FUNCPTR(gst_oftvg_audio_sink_event);
     btrans->transform_ip = GST_DEBUG_FUNCPTR(gst_oftvg_audio_transform_ip);
   }
   
@@ -94,6 +135,8 @@ static void gst_oftvg_audio_class_init(GstOFTVG_AudioClass* klass)
   {
     GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
     
+    element_class->change_state = GST_DEBUG_FUNCPTR(gst_oftvg_audio_change_state);
+    
     gst_element_class_set_metadata (element_class,
       "OptoFidelity audio marker generator",
       "Source/Audio",
@@ -111,114 +154,143 @@ static void gst_oftvg_audio_class_init(GstOFTVG_AudioClass* klass)
 /* Initializer for class instances */
 static void gst_oftvg_audio_init(GstOFTVG_Audio* filter)
 {
-  filter->queue = g_async_queue_new();
+  filter->timeline = NULL;
+  filter->beep_channels = 0;
+  filter->coded_beeps = false;
+  filter->beeps = new OFTVG_Beeps();
+  gst_audio_info_init(&filter->info);
 }
 
-static gboolean gst_oftvg_audio_start(GstBaseTransform* object)
+static void gst_oftvg_audio_finalize(GObject *object)
 {
   GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(object);
-  filter->current = NULL;
-  filter->phase = 0;
-  filter->end_of_stream = false;
-  filter->first = true;
-  return TRUE;
+  
+  delete filter->beeps;
+  filter->beeps = NULL;
+  
+  G_OBJECT_CLASS(gst_oftvg_audio_parent_class)->finalize(object);
 }
 
-/* Type of the structures passed through the queue */
-typedef struct _beep_t {
-  GstClockTime start; /* Start of the beep */
-  GstClockTime end;   /* End of the beep. If end == start, generate just silence. */
-} beep_t;
+static void gst_oftvg_audio_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(object);
+  
+  switch (prop_id)
+  {
+    case PROP_BEEP_CHANNELS:
+      filter->beep_channels = g_value_get_uint64(value);
+      break;
+    
+    case PROP_CODED_BEEPS:
+      filter->coded_beeps = g_value_get_boolean(value);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
 
-/* Generate a beep with specified start and end time. Add silence between previous time and start. */
-void gst_oftvg_audio_generate_beep(GstOFTVG_Audio* element, GstClockTime start, GstClockTime end)
+static void gst_oftvg_audio_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
 {
-  beep_t *entry = (beep_t*)g_malloc(sizeof(beep_t));
-  entry->start = start;
-  entry->end = end;
-  g_async_queue_push(element->queue, entry);
+  GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(object);
+  
+  switch (prop_id)
+  {
+    case PROP_BEEP_CHANNELS:
+      g_value_set_uint64(value, filter->beep_channels);
+      break;
+    
+    case PROP_CODED_BEEPS:
+      g_value_set_boolean(value, filter->coded_beeps);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
-/* Generate silence up to the end time */
-void gst_oftvg_audio_generate_silence(GstOFTVG_Audio* element, GstClockTime end)
+static gboolean gst_oftvg_audio_start(GstBaseTransform* object)
 {
-  beep_t *entry = (beep_t*)g_malloc(sizeof(beep_t));
-  entry->start = end;
-  entry->end = end;
-  g_async_queue_push(element->queue, entry);
+  GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(object);
+  filter->started = false;
+  filter->first = true;
+  return TRUE;
 }
 
-/* Generate EOS event on the audio source */
-void gst_oftvg_audio_end_stream(GstOFTVG_Audio* element)
+/* Store the audio format, so that it needn't be parsed for every buffer,
+ * and resolve which channels get the beep. */
+static gboolean gst_oftvg_audio_set_caps(GstBaseTransform* object, GstCaps* incaps, GstCaps* outcaps)
 {
-  beep_t *entry = (beep_t*)g_malloc(sizeof(beep_t));
-  entry->start = G_MAXINT64;
-  entry->end = G_MAXINT64;
-  g_async_queue_push(element->queue, entry);
+  GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(object);
+  GstAudioInfo *info = &filter->info;
+
+  if (!gst_audio_info_from_caps(info, incaps))
+  {
+    GST_ERROR("Could not parse audio caps");
+    return FALSE;
+  }
+
+  filter->beeps->set_format(info, filter->beep_channels);
+
+  GST_DEBUG("Audio: %s, %d Hz, %d channels",
+            GST_AUDIO_INFO_NAME(info), GST_AUDIO_INFO_RATE(info),
+            GST_AUDIO_INFO_CHANNELS(info));
+  return TRUE;
 }
 
-/* Add the beep sound on top of existing audio in the buffer
- * start: index of first sample to modify
- * end:   index of last sample to modify
- * phase: keeps track of the sine wave phase between buffers
- */
-static void add_beep(GstBuffer *buffer, int start, int end, int *phase, int num_channels, int samplerate)
+/* Wake up the streaming thread if it is waiting for the video */
+static GstStateChangeReturn gst_oftvg_audio_change_state(GstElement *element, GstStateChange transition)
 {
-  /* Map the buffer data to memory */
-  GstMapInfo mapinfo;
-  if (!gst_buffer_map(buffer, &mapinfo, GST_MAP_WRITE))
+  GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(element);
+  
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY && filter->timeline != NULL)
   {
-    GST_ERROR("Could not map buffer");
-    return;
+    filter->timeline->cancel();
   }
   
-  gint16 *data = (gint16*)mapinfo.data;
+  return GST_ELEMENT_CLASS(gst_oftvg_audio_parent_class)->change_state(element, transition);
+}
+
+/* Wake up the streaming thread if it is waiting for the video when the
+ * pipeline is flushed, e.g. by a seek */
+static gboolean gst_oftvg_audio_sink_event(GstBaseTransform *object, GstEvent *event)
+{
+  GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(object);
   
-  for (int i = start; i < end; i++)
+  if (filter->timeline != NULL)
   {
-    float s = 0;
-    int p = *phase;
-    *phase += 1;
-    s += sin(2 * M_PI * 547 * p / samplerate);
-    s += sin(2 * M_PI * 1823 * p / samplerate);
-    
-    /* Add to existing data at about 75% volume */
-    for (int j = 0; j < num_channels; j++)
-    {
-      int index = i * num_channels + j;
-      float v = 16384 * s + data[index];
-      if (v > 32767) v = 32767;
-      if (v < -32767) v = -32767;
-      data[index] = (gint16)v;
-    }
+    if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_START)
+      filter->timeline->cancel();
+    else if (GST_EVENT_TYPE(event) == GST_EVENT_FLUSH_STOP)
+      filter->timeline->resume();
   }
   
-  gst_buffer_unmap(buffer, &mapinfo);
+  return GST_BASE_TRANSFORM_CLASS(gst_oftvg_audio_parent_class)->sink_event(object, event);
+}
+
+/* Use the timeline of the video element to place the beeps */
+void gst_oftvg_audio_set_timeline(GstOFTVG_Audio* element, OFTVG_Timeline *timeline)
+{
+  element->timeline = timeline;
 }
 
 /* Modify the audio buffer (called by the GstBaseTransform base class) */
 GstFlowReturn gst_oftvg_audio_transform_ip(GstBaseTransform *src, GstBuffer *buf)
 {
   GstOFTVG_Audio *filter = GST_OFTVG_AUDIO(src);
-  int offset = 0;
-  int num_channels = 2;
-  int samplerate = 0;
-  int buflen = gst_buffer_get_size(buf) / sizeof(gint16) / num_channels;
-  
-  {
-    GstCaps *caps = gst_pad_get_current_caps(GST_BASE_TRANSFORM_SINK_PAD(src));
-    GstAudioInfo info;
-    gst_audio_info_init(&info);
-    gst_audio_info_from_caps(&info, caps); 
-    samplerate = GST_AUDIO_INFO_RATE(&info);
-    gst_caps_unref(caps);
-  }
+  OFTVG_Timeline *timeline = filter->timeline;
+  int samplerate = GST_AUDIO_INFO_RATE(&filter->info);
+  int bpf = GST_AUDIO_INFO_BPF(&filter->info);
+  int buflen = gst_buffer_get_size(buf) / bpf;
   
   GstClockTime running_time = gst_segment_to_running_time(&src->segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buf));
+  GstClockTime buffer_end = running_time + gst_util_uint64_scale(buflen, GST_SECOND, samplerate);
   
   GST_DEBUG("Incoming buffer: %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT " (%d samples)",
             GST_TIME_ARGS(running_time),
-            GST_TIME_ARGS(running_time + GST_BUFFER_DURATION(buf)),
+            GST_TIME_ARGS(buffer_end),
             buflen);
   
   if (filter->first && running_time > GST_MSECOND)
@@ -229,96 +301,56 @@ GstFlowReturn gst_oftvg_audio_transform_ip(GstBaseTransform *src, GstBuffer *buf
   }
   filter->first = false;
   
-  /* Repeat until the whole buffer has been processed */
-  while (offset < buflen && !filter->end_of_stream)
+  if (timeline == NULL)
+    return GST_FLOW_OK;
+  
+  /* The timeline is laid out when the first video frame arrives */
+  if (!filter->started)
   {
-    /* Calculate timestamp at this offset */
-    GstClockTime start_time = running_time + GST_SECOND * offset / samplerate;
+    if (!timeline->wait_started())
+      return GST_FLOW_FLUSHING;
+    filter->started = true;
+    filter->beeps->start(timeline, GST_ELEMENT(filter), filter->coded_beeps);
+  }
+  
+  /* End the audio at the same time as the video. If the end depends on
+   * the length of the input, it is known once the video has ended. */
+  {
+    GstClockTime end_time = timeline->end_time();
     
-    /* Fetch a new beep entry if needed */
-    int min_len = GST_SECOND / samplerate;
-    if (filter->current == NULL || filter->current->end <= start_time + min_len)
+    if (GST_CLOCK_TIME_IS_VALID(end_time))
     {
-      if (filter->current != NULL)
+      if (running_time >= end_time)
       {
-        GST_DEBUG("Releasing struct that ends at %" GST_TIME_FORMAT ", "
-                  "waiting for one at %" GST_TIME_FORMAT,
-                  GST_TIME_ARGS(filter->current->end),
-                  GST_TIME_ARGS(start_time + min_len));
-        g_free(filter->current);
-      }
-        
-      filter->current = (beep_t*) g_async_queue_pop(filter->queue);
-      filter->phase = 0;
-      
-      if (filter->current->start >= G_MAXINT64)
-      {
-        /* G_MAXINT64 tells us that the video stream has ended */
         GST_DEBUG("End of audio stream");
-        filter->end_of_stream = true;
-        break;
-      }
-      else if (filter->current->start == filter->current->end)
-      {
-        GST_DEBUG("Silence up to %" GST_TIME_FORMAT, GST_TIME_ARGS(filter->current->start));
-      }
-      else
-      {
-        GST_DEBUG("Beep: %" GST_TIME_FORMAT " to %" GST_TIME_FORMAT,
-                  GST_TIME_ARGS(filter->current->start),
-                  GST_TIME_ARGS(filter->current->end));
-      }
-    }
-    
-    /* Figure out at which offset the beep starts */
-    GstClockTimeDiff delta = (filter->current->start - start_time);
-    int start_offset = offset + delta * samplerate / GST_SECOND;
-    
-    /* Figure out how many samples long the beep is */
-    GstClockTimeDiff length = (filter->current->end - filter->current->start);
-    int num_samples = length * samplerate / GST_SECOND;
-    
-    /* Check if the beep overlaps this buffer */
-    if (start_offset < buflen)
-    {
-      /* Check if it started in previous buffer */
-      if (start_offset < 0)
-      {
-        num_samples += start_offset;
-        start_offset = 0;
+        return GST_FLOW_EOS;
       }
       
-      /* Check if it extends beyond current buffer */
-      if (start_offset + num_samples > buflen)
-      {
-        num_samples = buflen - start_offset;
-      }
-        
-      /* Process the part of the beep that is inside current buffer */
-      if (num_samples != 0)
+      if (buffer_end > end_time)
       {
-        GST_DEBUG("Processing beep at offset %d, length %d, phase %d",
-                  start_offset, num_samples, filter->phase);
-        add_beep(buf, start_offset, start_offset + num_samples, &filter->phase, num_channels, samplerate);
+        buflen = gst_util_uint64_scale(end_time - running_time, samplerate, GST_SECOND);
+        gst_buffer_resize(buf, 0, (gssize)buflen * bpf);
+        GST_BUFFER_DURATION(buf) = end_time - running_time;
+        buffer_end = end_time;
       }
     }
-    
-    /* Update the offset for while loop condition */
-    offset = start_offset + num_samples;
   }
   
-  if (filter->end_of_stream)
+  /* Mix in the beeps of the lipsync frames that overlap this buffer */
   {
-    if (filter->current)
+    GstMapInfo mapinfo;
+    if (!gst_buffer_map(buf, &mapinfo, GST_MAP_WRITE))
     {
-      g_free(filter->current);
-      filter->current = NULL;
+      GST_ERROR("Could not map buffer");
+      return GST_FLOW_ERROR;
     }
-    return GST_FLOW_EOS;
-  }
-  else
-  {
-    GST_DEBUG("Buffer done");
-    return GST_FLOW_OK;
+    
+    filter->beeps->mix(timeline, mapinfo.data,
+                       gst_util_uint64_scale(running_time, samplerate, GST_SECOND), buflen);
+    
+    gst_buffer_unmap(buf, &mapinfo);
   }
+  
+  GST_DEBUG("Buffer done");
+  return GST_FLOW_OK;
 }
@@ -23,6 +23,7 @@
 
 #include <gst/gst.h>
 #include <gst/base/gstpushsrc.h>
+#include <gst/audio/audio.h>
 #include <stdbool.h>
 
 /* Declaration of the GObject subtype */
@@ -41,20 +42,48 @@ G_BEGIN_DECLS
 
 typedef struct _GstOFTVG_Audio      GstOFTVG_Audio;
 typedef struct _GstOFTVG_AudioClass GstOFTVG_AudioClass;
-typedef struct _beep_t beep_t;
+
+#ifdef __cplusplus
+class OFTVG_Timeline;
+class OFTVG_Beeps;
+#else
+typedef struct OFTVG_Timeline OFTVG_Timeline;
+typedef struct OFTVG_Beeps OFTVG_Beeps;
+#endif
+
+/* Template for the pins. The beeps are mixed in the native format of the
+ * stream, audioconvert is only needed for planar or less common formats. */
+#define GSTOFTVG_AUDIO_CAPS \
+    "audio/x-raw, " \
+    "format = (string) { " GST_AUDIO_NE(S16) ", " GST_AUDIO_NE(S32) ", " GST_AUDIO_NE(F32) " }, " \
+    "rate = (int) [ 1, max ], " \
+    "layout = (string) interleaved, " \
+    "channels = (int) [ 1, 64 ];"
 
 /* Structure to contain the internal data of gstoftvg_audio elements */
 struct _GstOFTVG_Audio
 {
   GstBaseTransform element;
   
-  /* Queue used to pass information about the beeps to the processing thread */
-  GAsyncQueue *queue;
+  /* Timeline of the video element, which gives the beep positions */
+  OFTVG_Timeline *timeline;
+  
+  /* Has the timeline been started by the video element? */
+  bool started;
+  
+  /* Format of the audio stream, set in set_caps */
+  GstAudioInfo info;
+  
+  /* Property: bitmask of channel positions that get the beep, 0 for all */
+  guint64 beep_channels;
+  
+  /* Property: follow each beep with the frame number of the lipsync frame */
+  bool coded_beeps;
+  
+  /* Synthesizes the beeps in the format of the stream */
+  OFTVG_Beeps *beeps;
   
-  /* Currently active event */
-  beep_t *current;
-  int phase;
-  bool end_of_stream;
+  /* Is the next buffer the first in the audio stream? */
   bool first;
 };
 
@@ -65,10 +94,9 @@ struct _GstOFTVG_AudioClass
 
 GType gst_oftvg_audio_get_type (void);
 
-/* Use these functions to instruct the element in generation of the beeps */
-void gst_oftvg_audio_generate_beep(GstOFTVG_Audio* element, GstClockTime start, GstClockTime end);
-void gst_oftvg_audio_generate_silence(GstOFTVG_Audio* element, GstClockTime end);
-void gst_oftvg_audio_end_stream(GstOFTVG_Audio* element);
+/* Take the beep positions and the end of the stream from the timeline of
+ * an oftvg_video element. Must be set before the element is started. */
+void gst_oftvg_audio_set_timeline(GstOFTVG_Audio* element, OFTVG_Timeline *timeline);
 
 G_END_DECLS
 
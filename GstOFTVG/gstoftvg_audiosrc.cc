@@ -0,0 +1,363 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-oftvg_audiosrc
+ *
+ * A source element that generates the audio track for inputs that have
+ * no audio: silence with the lipsync beeps. Cannot be used stand-alone,
+ * the oftvg element creates it when its generate-audio property is set.
+ *
+ * The audio is produced directly in the negotiated format, starting from
+ * running time 0 like the video, and it ends at exactly the same time as
+ * the video, as given by the timeline of the video element.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "gstoftvg_audiosrc.hh"
+#include "gstoftvg_timeline.hh"
+#include "gstoftvg_beeps.hh"
+
+/* Debug category to use */
+GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
+#define GST_CAT_DEFAULT gst_oftvg_debug
+
+/* Format used if downstream accepts anything */
+#define DEFAULT_RATE 48000
+#define DEFAULT_CHANNELS 2
+
+/* Template for the pins */
+static GstStaticPadTemplate src_template =
+GST_STATIC_PAD_TEMPLATE (
+  "src",
+  GST_PAD_SRC,
+  GST_PAD_ALWAYS,
+  GST_STATIC_CAPS (GSTOFTVG_AUDIO_CAPS)
+);
+
+/* Identifier numbers for properties */
+enum
+{
+  PROP_0,
+  PROP_BEEP_CHANNELS,
+  PROP_CODED_BEEPS,
+  PROP_SAMPLES_PER_BUFFER
+};
+
+/* Definition of the GObject subtype. */
+static void gst_oftvg_audiosrc_class_init(GstOFTVG_AudioSrcClass* klass);
+static void gst_oftvg_audiosrc_init(GstOFTVG_AudioSrc* filter);
+G_DEFINE_TYPE (GstOFTVG_AudioSrc, gst_oftvg_audiosrc, GST_TYPE_PUSH_SRC);
+
+/* Prototypes for the overridden methods */
+static void gst_oftvg_audiosrc_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_oftvg_audiosrc_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_oftvg_audiosrc_finalize(GObject *object);
+static GstCaps *gst_oftvg_audiosrc_fixate(GstBaseSrc *object, GstCaps *caps);
+static gboolean gst_oftvg_audiosrc_set_caps(GstBaseSrc *object, GstCaps *caps);
+static gboolean gst_oftvg_audiosrc_start(GstBaseSrc *object);
+static gboolean gst_oftvg_audiosrc_unlock(GstBaseSrc *object);
+static gboolean gst_oftvg_audiosrc_unlock_stop(GstBaseSrc *object);
+static gboolean gst_oftvg_audiosrc_is_seekable(GstBaseSrc *object);
+static GstFlowReturn gst_oftvg_audiosrc_create(GstPushSrc *object, GstBuffer **buf);
+
+/* Initializer for the class type */
+static void gst_oftvg_audiosrc_class_init(GstOFTVG_AudioSrcClass* klass)
+{
+  /* GObject method overrides */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    GObjectClass *audio_class = G_OBJECT_CLASS(g_type_class_ref(GST_TYPE_OFTVG_AUDIO));
+    
+    gobject_class->set_property = gst_oftvg_audiosrc_set_property;
+    gobject_class->get_property = gst_oftvg_audiosrc_get_property;
+    gobject_class->finalize     = gst_oftvg_audiosrc_finalize;
+    
+    /* Same beep settings as on the filter */
+    g_object_class_install_property(gobject_class, PROP_BEEP_CHANNELS,
+      g_param_spec_uint64("beep-channels", "beep-channels",
+                          g_param_spec_get_blurb(g_object_class_find_property(audio_class, "beep-channels")),
+                          0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_CODED_BEEPS,
+      g_param_spec_boolean("coded-beeps", "coded-beeps",
+                           g_param_spec_get_blurb(g_object_class_find_property(audio_class, "coded-beeps")),
+                           FALSE, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_SAMPLES_PER_BUFFER,
+      g_param_spec_int("samples-per-buffer", "samples-per-buffer",
+                       "Number of samples in each outgoing buffer",
+                       1, G_MAXINT, 1024, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_type_class_unref(audio_class);
+  }
+  
+  /* GstBaseSrc method overrides */
+  {
+    GstBaseSrcClass *basesrc = GST_BASE_SRC_CLASS(klass);
+    GstPushSrcClass *pushsrc = GST_PUSH_SRC_CLASS(klass);
+    
+    basesrc->fixate       = GST_DEBUG_FUNCPTR(gst_oftvg_audiosrc_fixate);
+    basesrc->set_caps     = GST_DEBUG_FUNCPTR(gst_oftvg_audiosrc_set_caps);
+    basesrc->start        = GST_DEBUG_FUNCPTR(gst_oftvg_audiosrc_start);
+    basesrc->unlock       = GST_DEBUG_FUNCPTR(gst_oftvg_audiosrc_unlock);
+    basesrc->unlock_stop  = GST_DEBUG_FUNCPTR(gst_oftvg_audiosrc_unlock_stop);
+    basesrc->is_seekable  = GST_DEBUG_FUNCPTR(gst_oftvg_audiosrc_is_seekable);
+    pushsrc->create       = GST_DEBUG_FUNCPTR(gst_oftvg_audiosrc_create);
+  }
+  
+  /* Element metadata */
+  {
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    
+    gst_element_class_set_metadata (element_class,
+      "OptoFidelity audio marker source",
+      "Source/Audio",
+      "Generates silence with lipsync marker beeps",
+      "OptoFidelity <info@optofidelity.com>");
+    
+    gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  }
+}
+
+/* Initializer for class instances */
+static void gst_oftvg_audiosrc_init(GstOFTVG_AudioSrc* filter)
+{
+  filter->timeline = NULL;
+  filter->beep_channels = 0;
+  filter->coded_beeps = false;
+  filter->samples_per_buffer = 1024;
+  filter->beeps = new OFTVG_Beeps();
+  gst_audio_info_init(&filter->info);
+  
+  gst_base_src_set_format(GST_BASE_SRC(filter), GST_FORMAT_TIME);
+  gst_base_src_set_live(GST_BASE_SRC(filter), FALSE);
+}
+
+static void gst_oftvg_audiosrc_finalize(GObject *object)
+{
+  GstOFTVG_AudioSrc *filter = GST_OFTVG_AUDIOSRC(object);
+  
+  delete filter->beeps;
+  filter->beeps = NULL;
+  
+  G_OBJECT_CLASS(gst_oftvg_audiosrc_parent_class)->finalize(object);
+}
+
+static void gst_oftvg_audiosrc_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_AudioSrc *filter = GST_OFTVG_AUDIOSRC(object);
+  
+  switch (prop_id)
+  {
+    case PROP_BEEP_CHANNELS:
+      filter->beep_channels = g_value_get_uint64(value);
+      break;
+    
+    case PROP_CODED_BEEPS:
+      filter->coded_beeps = g_value_get_boolean(value);
+      break;
+    
+    case PROP_SAMPLES_PER_BUFFER:
+      filter->samples_per_buffer = g_value_get_int(value);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gst_oftvg_audiosrc_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_AudioSrc *filter = GST_OFTVG_AUDIOSRC(object);
+  
+  switch (prop_id)
+  {
+    case PROP_BEEP_CHANNELS:
+      g_value_set_uint64(value, filter->beep_channels);
+      break;
+    
+    case PROP_CODED_BEEPS:
+      g_value_set_boolean(value, filter->coded_beeps);
+      break;
+    
+    case PROP_SAMPLES_PER_BUFFER:
+      g_value_set_int(value, filter->samples_per_buffer);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Use the timeline of the video element to place the beeps */
+void gst_oftvg_audiosrc_set_timeline(GstOFTVG_AudioSrc* element, OFTVG_Timeline *timeline)
+{
+  element->timeline = timeline;
+}
+
+/* Pick a common format if the encoder leaves the choice to us */
+static GstCaps *gst_oftvg_audiosrc_fixate(GstBaseSrc *object, GstCaps *caps)
+{
+  GstStructure *structure;
+  
+  caps = gst_caps_make_writable(caps);
+  structure = gst_caps_get_structure(caps, 0);
+  gst_structure_fixate_field_nearest_int(structure, "rate", DEFAULT_RATE);
+  gst_structure_fixate_field_nearest_int(structure, "channels", DEFAULT_CHANNELS);
+  
+  return GST_BASE_SRC_CLASS(gst_oftvg_audiosrc_parent_class)->fixate(object, caps);
+}
+
+static gboolean gst_oftvg_audiosrc_set_caps(GstBaseSrc *object, GstCaps *caps)
+{
+  GstOFTVG_AudioSrc *filter = GST_OFTVG_AUDIOSRC(object);
+  GstAudioInfo *info = &filter->info;
+  
+  if (!gst_audio_info_from_caps(info, caps))
+  {
+    GST_ERROR("Could not parse audio caps");
+    return FALSE;
+  }
+  
+  filter->beeps->set_format(info, filter->beep_channels);
+  
+  GST_DEBUG("Audio: %s, %d Hz, %d channels",
+            GST_AUDIO_INFO_NAME(info), GST_AUDIO_INFO_RATE(info),
+            GST_AUDIO_INFO_CHANNELS(info));
+  return TRUE;
+}
+
+static gboolean gst_oftvg_audiosrc_start(GstBaseSrc *object)
+{
+  GstOFTVG_AudioSrc *filter = GST_OFTVG_AUDIOSRC(object);
+  
+  if (filter->timeline == NULL)
+  {
+    GST_ELEMENT_ERROR(filter, CORE, FAILED, (NULL),
+                      ("oftvg_audiosrc needs the timeline of an oftvg_video element"));
+    return FALSE;
+  }
+  
+  filter->started = false;
+  filter->next_sample = 0;
+  return TRUE;
+}
+
+/* Wake up the streaming thread if it is waiting for the video */
+static gboolean gst_oftvg_audiosrc_unlock(GstBaseSrc *object)
+{
+  GST_OFTVG_AUDIOSRC(object)->timeline->cancel();
+  return TRUE;
+}
+
+static gboolean gst_oftvg_audiosrc_unlock_stop(GstBaseSrc *object)
+{
+  GST_OFTVG_AUDIOSRC(object)->timeline->resume();
+  return TRUE;
+}
+
+/* The audio follows the video, which is not seekable either */
+static gboolean gst_oftvg_audiosrc_is_seekable(GstBaseSrc *object)
+{
+  return FALSE;
+}
+
+/* Produce the next buffer of silence and beeps */
+static GstFlowReturn gst_oftvg_audiosrc_create(GstPushSrc *object, GstBuffer **buf)
+{
+  GstOFTVG_AudioSrc *filter = GST_OFTVG_AUDIOSRC(object);
+  OFTVG_Timeline *timeline = filter->timeline;
+  int samplerate = GST_AUDIO_INFO_RATE(&filter->info);
+  int bpf = GST_AUDIO_INFO_BPF(&filter->info);
+  gint64 count = filter->samples_per_buffer;
+  GstClockTime running_time, buffer_end;
+  GstBuffer *buffer;
+  
+  /* The timeline is laid out when the first video frame arrives */
+  if (!filter->started)
+  {
+    if (!timeline->wait_started())
+      return GST_FLOW_FLUSHING;
+    filter->started = true;
+    filter->beeps->start(timeline, GST_ELEMENT(filter), filter->coded_beeps);
+  }
+  
+  running_time = gst_util_uint64_scale(filter->next_sample, GST_SECOND, samplerate);
+  buffer_end = gst_util_uint64_scale(filter->next_sample + count, GST_SECOND, samplerate);
+  
+  /* Returns immediately unless the end depends on the length of the input */
+  if (!timeline->wait_position(buffer_end))
+    return GST_FLOW_FLUSHING;
+  
+  /* End the audio at the same sample as the video */
+  {
+    GstClockTime end_time = timeline->end_time();
+    
+    if (GST_CLOCK_TIME_IS_VALID(end_time) && buffer_end > end_time)
+    {
+      count = (gint64)gst_util_uint64_scale(end_time, samplerate, GST_SECOND) - filter->next_sample;
+      
+      if (count <= 0)
+      {
+        GST_DEBUG("End of audio stream");
+        return GST_FLOW_EOS;
+      }
+      
+      buffer_end = gst_util_uint64_scale(filter->next_sample + count, GST_SECOND, samplerate);
+    }
+  }
+  
+  buffer = gst_buffer_new_allocate(NULL, count * bpf, NULL);
+  if (buffer == NULL)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, NO_SPACE_LEFT, (NULL),
+                      ("Could not allocate audio buffer"));
+    return GST_FLOW_ERROR;
+  }
+  
+  {
+    GstMapInfo mapinfo;
+    gst_buffer_map(buffer, &mapinfo, GST_MAP_WRITE);
+    gst_audio_format_fill_silence(filter->info.finfo, mapinfo.data, mapinfo.size);
+    filter->beeps->mix(timeline, mapinfo.data, filter->next_sample, count);
+    gst_buffer_unmap(buffer, &mapinfo);
+  }
+  
+  GST_BUFFER_PTS(buffer) = running_time;
+  GST_BUFFER_DURATION(buffer) = buffer_end - running_time;
+  GST_BUFFER_OFFSET(buffer) = filter->next_sample;
+  GST_BUFFER_OFFSET_END(buffer) = filter->next_sample + count;
+  filter->next_sample += count;
+  
+  *buf = buffer;
+  return GST_FLOW_OK;
+}
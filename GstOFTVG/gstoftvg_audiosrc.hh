@@ -0,0 +1,86 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_OFTVG_AUDIOSRC_H__
+#define __GST_OFTVG_AUDIOSRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/audio/audio.h>
+#include <stdbool.h>
+#include "gstoftvg_audio.hh"
+
+/* Declaration of the GObject subtype */
+G_BEGIN_DECLS
+
+#define GST_TYPE_OFTVG_AUDIOSRC \
+  (gst_oftvg_audiosrc_get_type())
+#define GST_OFTVG_AUDIOSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OFTVG_AUDIOSRC,GstOFTVG_AudioSrc))
+#define GST_OFTVG_AUDIOSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OFTVG_AUDIOSRC,GstOFTVG_AudioSrcClass))
+#define GST_IS_OFTVG_AUDIOSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OFTVG_AUDIOSRC))
+#define GST_IS_OFTVG_AUDIOSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OFTVG_AUDIOSRC))
+
+typedef struct _GstOFTVG_AudioSrc      GstOFTVG_AudioSrc;
+typedef struct _GstOFTVG_AudioSrcClass GstOFTVG_AudioSrcClass;
+
+/* Structure to contain the internal data of gstoftvg_audiosrc elements */
+struct _GstOFTVG_AudioSrc
+{
+  GstPushSrc element;
+  
+  /* Timeline of the video element, which gives the beep positions */
+  OFTVG_Timeline *timeline;
+  
+  /* Has the timeline been started by the video element? */
+  bool started;
+  
+  /* Format of the audio stream, set in set_caps */
+  GstAudioInfo info;
+  
+  /* Synthesizes the beeps in the format of the stream */
+  OFTVG_Beeps *beeps;
+  
+  /* Properties, see gst_oftvg_audio for beep_channels and coded_beeps */
+  guint64 beep_channels;
+  bool coded_beeps;
+  int samples_per_buffer;
+  
+  /* Position of the next buffer in samples from running time 0 */
+  gint64 next_sample;
+};
+
+struct _GstOFTVG_AudioSrcClass 
+{
+  GstPushSrcClass parent_class;
+};
+
+GType gst_oftvg_audiosrc_get_type (void);
+
+/* Take the beep positions and the end of the stream from the timeline of
+ * an oftvg_video element. Must be set before the element is started. */
+void gst_oftvg_audiosrc_set_timeline(GstOFTVG_AudioSrc* element, OFTVG_Timeline *timeline);
+
+G_END_DECLS
+
+#endif /* __GST_OFTVG_AUDIOSRC_H__ */
@@ -0,0 +1,354 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Synthesis of the lipsync beeps, shared by the oftvg_audio filter that
+ * mixes them into the input audio and the oftvg_audiosrc source that
+ * generates the audio for inputs without it.
+ */
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "gstoftvg_beeps.hh"
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* Debug category to use */
+GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
+#define GST_CAT_DEFAULT gst_oftvg_debug
+
+/* The beep is the sum of two sine waves at these frequencies (Hz) */
+#define BEEP_FREQ1 547
+#define BEEP_FREQ2 1823
+
+/* Amplitude of each sine wave relative to full scale. The sum is mixed
+ * on top of the existing audio at about 75% volume. */
+#define BEEP_AMPLITUDE 0.5
+
+/* Coded beeps: after the beep, the frame number is sent as CODE_SYMBOLS
+ * tones of CODE_SYMBOL_MS each, most significant bits first. Each symbol
+ * carries 2 bits by selecting one of four frequencies. The last two
+ * symbols are a checksum of the others. The frequencies are far enough
+ * from the beep frequencies not to trigger the beep detection.
+ * The analyzer has a copy of these in lipsync.h. */
+#define CODE_BITS 24
+#define CODE_DATA_SYMBOLS (CODE_BITS / 2)
+#define CODE_SYMBOLS (CODE_DATA_SYMBOLS + 2)
+#define CODE_SYMBOL_MS 10
+#define CODE_MIN_SAMPLERATE 16000
+static const int code_freqs[4] = {2400, 3000, 3600, 4200};
+
+/* Split the frame number into symbols and append the checksum */
+static void code_symbols(gint64 value, int symbols[CODE_SYMBOLS])
+{
+  int checksum = 0;
+  
+  for (int i = 0; i < CODE_DATA_SYMBOLS; i++)
+  {
+    symbols[i] = (value >> (2 * (CODE_DATA_SYMBOLS - 1 - i))) & 3;
+    checksum += symbols[i];
+  }
+  
+  symbols[CODE_DATA_SYMBOLS] = (checksum >> 2) & 3;
+  symbols[CODE_DATA_SYMBOLS + 1] = checksum & 3;
+}
+
+/* Size in bytes of the block of interleaved samples that is synthesized at
+ * a time. The oscillators are restarted from the exact sample phase for each
+ * block, so the rounding errors of the recurrence do not accumulate. */
+#define BEEP_BLOCK_BYTES 2048
+
+/* Sine oscillator that rotates a unit vector by a fixed angle each sample,
+ * which costs a few multiplications instead of a call to sin(). */
+typedef struct {
+  double re, im;
+  double step_re, step_im;
+} oscillator_t;
+
+static void oscillator_init(oscillator_t *osc, int frequency, gint64 phase, int samplerate)
+{
+  /* Reduce the phase in integers so that the angle stays accurate */
+  double angle = 2 * M_PI * (double)((frequency * phase) % samplerate) / samplerate;
+  double step = 2 * M_PI * frequency / samplerate;
+
+  osc->re = cos(angle);
+  osc->im = sin(angle);
+  osc->step_re = cos(step);
+  osc->step_im = sin(step);
+}
+
+static inline double oscillator_next(oscillator_t *osc)
+{
+  double value = osc->im;
+  double re = osc->re * osc->step_re - osc->im * osc->step_im;
+  osc->im = osc->re * osc->step_im + osc->im * osc->step_re;
+  osc->re = re;
+  return value;
+}
+
+/* dest[i] = saturate(dest[i] + src[i]) for each sample format.
+ * Float audio has headroom above 1.0, so it is not clipped. */
+static void mix_s16(gint16 *dest, const gint16 *src, int count)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  for (; i + 8 <= count; i += 8)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(dest + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dest + i), _mm_adds_epi16(a, b));
+  }
+#endif
+
+  for (; i < count; i++)
+  {
+    int v = dest[i] + src[i];
+    dest[i] = (gint16)CLAMP(v, G_MININT16, G_MAXINT16);
+  }
+}
+
+static void mix_s32(gint32 *dest, const gint32 *src, int count)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  /* There is no saturating 32-bit add, so detect the overflow from the
+   * signs: it happened if the sum differs in sign from both inputs. */
+  const __m128i max = _mm_set1_epi32(G_MAXINT32);
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)(dest + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+    __m128i sum = _mm_add_epi32(a, b);
+    __m128i overflow = _mm_srai_epi32(_mm_and_si128(_mm_xor_si128(a, sum),
+                                                    _mm_xor_si128(b, sum)), 31);
+    __m128i saturated = _mm_xor_si128(_mm_srai_epi32(a, 31), max);
+    sum = _mm_or_si128(_mm_and_si128(overflow, saturated),
+                       _mm_andnot_si128(overflow, sum));
+    _mm_storeu_si128((__m128i*)(dest + i), sum);
+  }
+#endif
+
+  for (; i < count; i++)
+  {
+    gint64 v = (gint64)dest[i] + src[i];
+    dest[i] = (gint32)CLAMP(v, G_MININT32, G_MAXINT32);
+  }
+}
+
+static void mix_f32(gfloat *dest, const gfloat *src, int count)
+{
+  int i = 0;
+
+#ifdef __SSE2__
+  for (; i + 4 <= count; i += 4)
+  {
+    __m128 a = _mm_loadu_ps(dest + i);
+    __m128 b = _mm_loadu_ps(src + i);
+    _mm_storeu_ps(dest + i, _mm_add_ps(a, b));
+  }
+#endif
+
+  for (; i < count; i++)
+  {
+    dest[i] += src[i];
+  }
+}
+
+/* Write the beep sample to the selected channels of one frame in the block */
+#define FILL_FRAME(type, block, k, value) \
+  for (int j = 0; j < num_channels; j++) \
+    ((type*)(block))[(k) * num_channels + j] = beep_channel_[j] ? (value) : 0;
+
+/* Add the beep sound on top of existing audio
+ * start: index of first sample to modify
+ * end:   index of last sample to modify
+ * phase: samples since the start of the beep, for continuity between buffers
+ * freq1, freq2: frequencies of the two sine waves, 0 to leave one out
+ */
+void OFTVG_Beeps::add_beep(guint8 *data, int start, int end, gint64 phase, int freq1, int freq2)
+{
+  const GstAudioInfo *info = &info_;
+  GstAudioFormat format = GST_AUDIO_INFO_FORMAT(info);
+  int num_channels = GST_AUDIO_INFO_CHANNELS(info);
+  int samplerate = GST_AUDIO_INFO_RATE(info);
+  int bpf = GST_AUDIO_INFO_BPF(info);
+  
+  union {
+    guint8 bytes[BEEP_BLOCK_BYTES];
+    gint16 s16[BEEP_BLOCK_BYTES / sizeof(gint16)];
+    gint32 s32[BEEP_BLOCK_BYTES / sizeof(gint32)];
+    gfloat f32[BEEP_BLOCK_BYTES / sizeof(gfloat)];
+  } block;
+  int block_len = BEEP_BLOCK_BYTES / bpf;
+  
+  for (int i = start; i < end; i += block_len)
+  {
+    int count = MIN(block_len, end - i);
+    guint8 *dest = data + (gsize)i * bpf;
+    oscillator_t osc1, osc2;
+    
+    oscillator_init(&osc1, freq1, phase, samplerate);
+    oscillator_init(&osc2, freq2, phase, samplerate);
+    phase += count;
+    
+    /* Synthesize the beep for the selected channels, then mix it in */
+    for (int k = 0; k < count; k++)
+    {
+      double v = BEEP_AMPLITUDE * (oscillator_next(&osc1) + oscillator_next(&osc2));
+      
+      switch (format)
+      {
+        case GST_AUDIO_FORMAT_S16:
+          FILL_FRAME(gint16, block.s16, k, (gint16)CLAMP(v * 32768.0, -32767.0, 32767.0));
+          break;
+        case GST_AUDIO_FORMAT_S32:
+          FILL_FRAME(gint32, block.s32, k, (gint32)CLAMP(v * 2147483648.0, -2147483647.0, 2147483647.0));
+          break;
+        default:
+          FILL_FRAME(gfloat, block.f32, k, (gfloat)v);
+          break;
+      }
+    }
+    
+    switch (format)
+    {
+      case GST_AUDIO_FORMAT_S16:
+        mix_s16((gint16*)dest, block.s16, count * num_channels);
+        break;
+      case GST_AUDIO_FORMAT_S32:
+        mix_s32((gint32*)dest, block.s32, count * num_channels);
+        break;
+      default:
+        mix_f32((gfloat*)dest, block.f32, count * num_channels);
+        break;
+    }
+  }
+}
+
+OFTVG_Beeps::OFTVG_Beeps()
+{
+  gst_audio_info_init(&info_);
+  coded_ = false;
+  for (int i = 0; i < 64; i++)
+  {
+    beep_channel_[i] = true;
+  }
+}
+
+void OFTVG_Beeps::set_format(const GstAudioInfo *info, guint64 beep_channels)
+{
+  int channels = GST_AUDIO_INFO_CHANNELS(info);
+  
+  info_ = *info;
+  for (int i = 0; i < channels; i++)
+  {
+    guint64 bit;
+    
+    if (GST_AUDIO_INFO_IS_UNPOSITIONED(info) || info->position[i] < 0)
+      bit = G_GUINT64_CONSTANT(1) << i;
+    else
+      bit = GST_AUDIO_CHANNEL_POSITION_MASK(info->position[i]);
+    
+    beep_channel_[i] = (beep_channels == 0) || (beep_channels & bit);
+  }
+}
+
+void OFTVG_Beeps::start(OFTVG_Timeline *timeline, GstElement *element, bool coded)
+{
+  coded_ = false;
+  
+  if (coded && timeline->next_lipsync_frame(0) >= 0)
+  {
+    /* The symbols must end before the next beep, and the highest
+     * frequency must be representable at the samplerate. */
+    gint64 first = timeline->video_start_frame();
+    GstClockTime interval = timeline->frame_time(first + timeline->lipsync_step())
+                            - timeline->frame_time(first);
+    GstClockTime length = timeline->frame_time(first + 1) - timeline->frame_time(first)
+                          + CODE_SYMBOLS * CODE_SYMBOL_MS * GST_MSECOND;
+    
+    coded_ = (interval > length && GST_AUDIO_INFO_RATE(&info_) >= CODE_MIN_SAMPLERATE);
+    if (!coded_)
+    {
+      GST_ELEMENT_WARNING(element, STREAM, FORMAT, ("Coded beeps disabled"),
+                          ("Coded beeps need a lipsync interval over %d ms and a "
+                           "samplerate of at least %d Hz",
+                           (int)(length / GST_MSECOND), CODE_MIN_SAMPLERATE));
+    }
+  }
+}
+
+/* Mix in the beeps of the lipsync frames that overlap the samples.
+ * Sample positions are counted from running time 0 so that the beep
+ * phase continues across buffers. */
+void OFTVG_Beeps::mix(OFTVG_Timeline *timeline, guint8 *data, gint64 first_sample, int num_samples)
+{
+  int samplerate = GST_AUDIO_INFO_RATE(&info_);
+  gint64 end_sample = first_sample + num_samples;
+  GstClockTime start_time = gst_util_uint64_scale(first_sample, GST_SECOND, samplerate);
+  GstClockTime end_time = gst_util_uint64_scale(end_sample, GST_SECOND, samplerate);
+  gint64 symbol_len = samplerate * CODE_SYMBOL_MS / 1000;
+  GstClockTime tail = coded_ ? CODE_SYMBOLS * CODE_SYMBOL_MS * GST_MSECOND : 0;
+  gint64 frame = timeline->next_lipsync_frame(
+                   timeline->frame_at(start_time > tail ? start_time - tail : 0));
+  
+  while (frame >= 0 && timeline->frame_time(frame) < end_time)
+  {
+    gint64 beep_start = gst_util_uint64_scale(timeline->frame_time(frame), samplerate, GST_SECOND);
+    gint64 beep_end = gst_util_uint64_scale(timeline->frame_time(frame + 1), samplerate, GST_SECOND);
+    gint64 start = MAX(beep_start, first_sample);
+    gint64 end = MIN(beep_end, end_sample);
+    
+    if (end > start)
+    {
+      GST_DEBUG("Beep for frame %" G_GINT64_FORMAT " at offset %d, length %d",
+                frame, (int)(start - first_sample), (int)(end - start));
+      add_beep(data, start - first_sample, end - first_sample, start - beep_start,
+               BEEP_FREQ1, BEEP_FREQ2);
+    }
+    
+    /* The frame number follows the beep, one tone per symbol */
+    if (coded_ && beep_end + CODE_SYMBOLS * symbol_len > first_sample)
+    {
+      int symbols[CODE_SYMBOLS];
+      code_symbols(frame - timeline->video_start_frame(), symbols);
+      
+      for (int i = 0; i < CODE_SYMBOLS; i++)
+      {
+        gint64 symbol_start = beep_end + i * symbol_len;
+        start = MAX(symbol_start, first_sample);
+        end = MIN(symbol_start + symbol_len, end_sample);
+        
+        if (end > start)
+        {
+          add_beep(data, start - first_sample, end - first_sample, start - symbol_start,
+                   code_freqs[symbols[i]], 0);
+        }
+      }
+    }
+    
+    frame = timeline->next_lipsync_frame(frame + 1);
+  }
+}
@@ -0,0 +1,64 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Lipsync beeps placed on the timeline of the video element.
+ *
+ * The beep is two sine waves during the lipsync frame. With coded beeps,
+ * the number of the frame follows as 4-FSK symbols, see the format in
+ * gstoftvg_beeps.cc. The beeps are mixed in the native format of the
+ * stream: interleaved S16, S32 or F32 with up to 64 channels.
+ */
+
+#ifndef __GSTOFTVG_BEEPS_HH__
+#define __GSTOFTVG_BEEPS_HH__
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include "gstoftvg_timeline.hh"
+
+class OFTVG_Beeps
+{
+public:
+  OFTVG_Beeps();
+
+  /// Set the audio format and resolve which channels get the beep.
+  /// beep_channels: GST_AUDIO_CHANNEL_POSITION_MASK() bitmask, or channel
+  ///                indices for unpositioned audio. 0 means all channels.
+  void set_format(const GstAudioInfo *info, guint64 beep_channels);
+
+  /// Called when the timeline has started. Coded beeps are used if
+  /// requested and the lipsync interval leaves room for the code, otherwise
+  /// a warning is posted on the element.
+  void start(OFTVG_Timeline *timeline, GstElement *element, bool coded);
+
+  /// Mix the beeps that overlap the samples on top of the data.
+  /// first_sample: position of data[0] counted from running time 0
+  void mix(OFTVG_Timeline *timeline, guint8 *data, gint64 first_sample, int num_samples);
+
+private:
+  GstAudioInfo info_;
+  bool beep_channel_[64];
+  bool coded_;
+
+  void add_beep(guint8 *data, int start, int end, gint64 phase, int freq1, int freq2);
+};
+
+#endif /* __GSTOFTVG_BEEPS_HH__ */
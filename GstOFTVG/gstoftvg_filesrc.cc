@@ -0,0 +1,674 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-oftvg_filesrc
+ *
+ * A file source for inputs on network shares and other slow storage.
+ * A background thread reads the file in large blocks ahead of the
+ * position that downstream is reading, up to the readahead budget, so
+ * that the decoder does not wait for each small read in turn. Random
+ * access is supported for demuxers that operate in pull mode: the
+ * read-ahead simply restarts from the new position, and a quarter of
+ * the budget is kept behind the position for demuxers that jump back
+ * and forth between interleaved streams.
+ *
+ * The amount of data read, the time spent in reads and the time that
+ * downstream had to wait for data are available in the read-only "stats"
+ * property. The max-rate property limits the read rate, to test the
+ * behaviour on slow storage with a local file.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch oftvg_filesrc location=input.mp4 readahead=67108864 ! decodebin ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include "gstoftvg_filesrc.hh"
+
+#ifdef G_OS_WIN32
+#  include <io.h>
+#  define lseek _lseeki64
+#else
+#  include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#  define O_BINARY 0
+#endif
+
+/* Debug category to use */
+GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
+#define GST_CAT_DEFAULT gst_oftvg_debug
+
+#define DEFAULT_READAHEAD (32 * 1024 * 1024)
+#define DEFAULT_READ_SIZE (1024 * 1024)
+
+/* Template for the pins */
+static GstStaticPadTemplate src_template =
+GST_STATIC_PAD_TEMPLATE (
+  "src",
+  GST_PAD_SRC,
+  GST_PAD_ALWAYS,
+  GST_STATIC_CAPS_ANY
+);
+
+/* Identifier numbers for properties */
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_READAHEAD,
+  PROP_READ_SIZE,
+  PROP_MAX_RATE,
+  PROP_STATS
+};
+
+/* Definition of the GObject subtype. */
+static void gst_oftvg_filesrc_class_init(GstOFTVG_FileSrcClass* klass);
+static void gst_oftvg_filesrc_init(GstOFTVG_FileSrc* filter);
+G_DEFINE_TYPE (GstOFTVG_FileSrc, gst_oftvg_filesrc, GST_TYPE_BASE_SRC);
+
+/* Prototypes for the overridden methods */
+static void gst_oftvg_filesrc_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_oftvg_filesrc_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_oftvg_filesrc_finalize(GObject *object);
+static gboolean gst_oftvg_filesrc_start(GstBaseSrc *object);
+static gboolean gst_oftvg_filesrc_stop(GstBaseSrc *object);
+static gboolean gst_oftvg_filesrc_get_size(GstBaseSrc *object, guint64 *size);
+static gboolean gst_oftvg_filesrc_is_seekable(GstBaseSrc *object);
+static gboolean gst_oftvg_filesrc_unlock(GstBaseSrc *object);
+static gboolean gst_oftvg_filesrc_unlock_stop(GstBaseSrc *object);
+static GstFlowReturn gst_oftvg_filesrc_create(GstBaseSrc *object, guint64 offset,
+                                              guint length, GstBuffer **buf);
+
+/* Reads the blocks ahead of the cursor */
+static gpointer gst_oftvg_filesrc_reader(gpointer data);
+
+/* Build the structure for the "stats" property */
+static GstStructure *gst_oftvg_filesrc_get_stats(GstOFTVG_FileSrc *filter);
+
+/* Initializer for the class type */
+static void gst_oftvg_filesrc_class_init(GstOFTVG_FileSrcClass* klass)
+{
+  /* GObject method overrides */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    
+    gobject_class->set_property = gst_oftvg_filesrc_set_property;
+    gobject_class->get_property = gst_oftvg_filesrc_get_property;
+    gobject_class->finalize     = gst_oftvg_filesrc_finalize;
+    
+    g_object_class_install_property(gobject_class, PROP_LOCATION,
+      g_param_spec_string("location", "location", "Name of the file to read",
+                          NULL, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_READAHEAD,
+      g_param_spec_uint64("readahead", "readahead",
+                          "Bytes to read ahead of the current position",
+                          0, G_MAXUINT64, DEFAULT_READAHEAD, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_READ_SIZE,
+      g_param_spec_uint("read-size", "read-size",
+                        "Bytes to read with each system call",
+                        4096, 256 * 1024 * 1024, DEFAULT_READ_SIZE, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_MAX_RATE,
+      g_param_spec_uint64("max-rate", "max-rate",
+                          "Limit the read rate to this many bytes per second, "
+                          "to simulate slow storage. 0 for unlimited.",
+                          0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "stats", "I/O throughput and stall time statistics",
+                         GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE))
+    );
+  }
+  
+  /* GstBaseSrc method overrides */
+  {
+    GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS(klass);
+    
+    basesrc_class->start       = GST_DEBUG_FUNCPTR(gst_oftvg_filesrc_start);
+    basesrc_class->stop        = GST_DEBUG_FUNCPTR(gst_oftvg_filesrc_stop);
+    basesrc_class->get_size    = GST_DEBUG_FUNCPTR(gst_oftvg_filesrc_get_size);
+    basesrc_class->is_seekable = GST_DEBUG_FUNCPTR(gst_oftvg_filesrc_is_seekable);
+    basesrc_class->unlock      = GST_DEBUG_FUNCPTR(gst_oftvg_filesrc_unlock);
+    basesrc_class->unlock_stop = GST_DEBUG_FUNCPTR(gst_oftvg_filesrc_unlock_stop);
+    basesrc_class->create      = GST_DEBUG_FUNCPTR(gst_oftvg_filesrc_create);
+  }
+  
+  /* Element metadata */
+  {
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    
+    gst_element_class_set_metadata (element_class,
+      "File source with read-ahead",
+      "Source/File",
+      "Reads a file in large blocks in a background thread",
+      "OptoFidelity <info@optofidelity.com>");
+    
+    gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  }
+}
+
+/* Initializer for class instances */
+static void gst_oftvg_filesrc_init(GstOFTVG_FileSrc* filter)
+{
+  filter->location = NULL;
+  filter->readahead = DEFAULT_READAHEAD;
+  filter->read_size = DEFAULT_READ_SIZE;
+  filter->max_rate = 0;
+  
+  filter->fd = -1;
+  filter->size = 0;
+  filter->thread = NULL;
+  filter->running = false;
+  filter->flushing = false;
+  filter->read_errno = 0;
+  filter->blocks = NULL;
+  filter->num_blocks = 0;
+  filter->cursor = 0;
+  
+  filter->bytes_read = 0;
+  filter->read_time = 0;
+  filter->requests = 0;
+  filter->stalls = 0;
+  filter->stall_time = 0;
+  
+  g_mutex_init(&filter->lock);
+  g_cond_init(&filter->cond);
+}
+
+static void gst_oftvg_filesrc_finalize(GObject *object)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  
+  g_free(filter->location);
+  g_cond_clear(&filter->cond);
+  g_mutex_clear(&filter->lock);
+  
+  G_OBJECT_CLASS(gst_oftvg_filesrc_parent_class)->finalize(object);
+}
+
+static void gst_oftvg_filesrc_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  
+  switch (prop_id)
+  {
+    case PROP_LOCATION:
+      g_free(filter->location);
+      filter->location = g_value_dup_string(value);
+      break;
+    
+    case PROP_READAHEAD:
+      filter->readahead = g_value_get_uint64(value);
+      break;
+    
+    case PROP_READ_SIZE:
+      filter->read_size = g_value_get_uint(value);
+      break;
+    
+    case PROP_MAX_RATE:
+      filter->max_rate = g_value_get_uint64(value);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gst_oftvg_filesrc_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  
+  switch (prop_id)
+  {
+    case PROP_LOCATION:
+      g_value_set_string(value, filter->location);
+      break;
+    
+    case PROP_READAHEAD:
+      g_value_set_uint64(value, filter->readahead);
+      break;
+    
+    case PROP_READ_SIZE:
+      g_value_set_uint(value, filter->read_size);
+      break;
+    
+    case PROP_MAX_RATE:
+      g_value_set_uint64(value, filter->max_rate);
+      break;
+    
+    case PROP_STATS:
+      g_value_take_boxed(value, gst_oftvg_filesrc_get_stats(filter));
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static GstStructure *gst_oftvg_filesrc_get_stats(GstOFTVG_FileSrc *filter)
+{
+  GstStructure *s;
+  
+  g_mutex_lock(&filter->lock);
+  s = gst_structure_new("oftvg-filesrc-stats",
+    "bytes-read",  G_TYPE_UINT64, filter->bytes_read,
+    "read-time",   G_TYPE_UINT64, (guint64)filter->read_time,
+    "throughput",  G_TYPE_DOUBLE, filter->read_time > 0 ?
+                                  (double)filter->bytes_read * GST_SECOND / filter->read_time : 0.0,
+    "requests",    G_TYPE_UINT64, filter->requests,
+    "stalls",      G_TYPE_UINT64, filter->stalls,
+    "stall-time",  G_TYPE_UINT64, (guint64)filter->stall_time,
+    "readahead",   G_TYPE_UINT64, (guint64)filter->num_blocks * filter->read_size,
+    NULL);
+  g_mutex_unlock(&filter->lock);
+  
+  return s;
+}
+
+static gboolean gst_oftvg_filesrc_start(GstBaseSrc *object)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  gint64 size;
+  guint i;
+  
+  if (filter->location == NULL || filter->location[0] == '\0')
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, NOT_FOUND,
+                      ("No file name specified for reading."), (NULL));
+    return FALSE;
+  }
+  
+  filter->fd = g_open(filter->location, O_RDONLY | O_BINARY, 0);
+  if (filter->fd < 0)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, OPEN_READ,
+                      ("Could not open file \"%s\" for reading.", filter->location),
+                      GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+  
+  size = lseek(filter->fd, 0, SEEK_END);
+  if (size < 0)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, OPEN_READ,
+                      ("Could not get the size of \"%s\".", filter->location),
+                      GST_ERROR_SYSTEM);
+    close(filter->fd);
+    filter->fd = -1;
+    return FALSE;
+  }
+  filter->size = size;
+  
+#ifdef POSIX_FADV_SEQUENTIAL
+  /* Lets the kernel read ahead further on its own, too */
+  posix_fadvise(filter->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  
+  /* Two blocks at least, so that reading continues while one is used */
+  filter->num_blocks = MAX(2, filter->readahead / filter->read_size);
+  filter->blocks = g_new0(OFTVG_ReadBlock, filter->num_blocks);
+  for (i = 0; i < filter->num_blocks; i++)
+  {
+    filter->blocks[i].index = -1;
+    filter->blocks[i].data = (guint8*)g_malloc(filter->read_size);
+  }
+  
+  GST_DEBUG("Reading %s, %" G_GUINT64_FORMAT " bytes, %u blocks of %u bytes ahead",
+            filter->location, filter->size, filter->num_blocks, filter->read_size);
+  
+  filter->cursor = 0;
+  filter->running = true;
+  filter->flushing = false;
+  filter->read_errno = 0;
+  filter->bytes_read = 0;
+  filter->read_time = 0;
+  filter->requests = 0;
+  filter->stalls = 0;
+  filter->stall_time = 0;
+  filter->thread = g_thread_new("oftvg_filesrc", gst_oftvg_filesrc_reader, filter);
+  
+  return TRUE;
+}
+
+static gboolean gst_oftvg_filesrc_stop(GstBaseSrc *object)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  guint i;
+  
+  if (filter->thread != NULL)
+  {
+    g_mutex_lock(&filter->lock);
+    filter->running = false;
+    g_cond_broadcast(&filter->cond);
+    g_mutex_unlock(&filter->lock);
+    
+    g_thread_join(filter->thread);
+    filter->thread = NULL;
+  }
+  
+  for (i = 0; i < filter->num_blocks; i++)
+  {
+    g_free(filter->blocks[i].data);
+  }
+  g_free(filter->blocks);
+  filter->blocks = NULL;
+  
+  /* num_blocks is kept for the statistics */
+  
+  if (filter->fd >= 0)
+  {
+    close(filter->fd);
+    filter->fd = -1;
+  }
+  
+  return TRUE;
+}
+
+static gboolean gst_oftvg_filesrc_get_size(GstBaseSrc *object, guint64 *size)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  
+  if (filter->fd < 0)
+    return FALSE;
+  
+  *size = filter->size;
+  return TRUE;
+}
+
+static gboolean gst_oftvg_filesrc_is_seekable(GstBaseSrc *object)
+{
+  return TRUE;
+}
+
+static gboolean gst_oftvg_filesrc_unlock(GstBaseSrc *object)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  
+  g_mutex_lock(&filter->lock);
+  filter->flushing = true;
+  g_cond_broadcast(&filter->cond);
+  g_mutex_unlock(&filter->lock);
+  
+  return TRUE;
+}
+
+static gboolean gst_oftvg_filesrc_unlock_stop(GstBaseSrc *object)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  
+  g_mutex_lock(&filter->lock);
+  filter->flushing = false;
+  g_mutex_unlock(&filter->lock);
+  
+  return TRUE;
+}
+
+/* Block in the cache, or NULL. Called with the lock held. */
+static OFTVG_ReadBlock *find_block(GstOFTVG_FileSrc *filter, gint64 index)
+{
+  guint i;
+  
+  for (i = 0; i < filter->num_blocks; i++)
+  {
+    if (filter->blocks[i].index == index)
+      return &filter->blocks[i];
+  }
+  
+  return NULL;
+}
+
+/* Pick the next block to read and a slot for it, or NULL if the budget
+ * is filled. Called with the lock held. */
+static OFTVG_ReadBlock *next_block(GstOFTVG_FileSrc *filter)
+{
+  gint64 behind = filter->num_blocks / 4;
+  gint64 first = MAX(filter->cursor - behind, 0);
+  gint64 last = first + filter->num_blocks; /* exclusive */
+  gint64 end = (filter->size + filter->read_size - 1) / filter->read_size;
+  gint64 index;
+  guint i;
+  
+  for (index = filter->cursor; index < last && index < end; index++)
+  {
+    if (find_block(filter, index) != NULL)
+      continue;
+    
+    /* The window has one slot per block, so a slot outside of it is free.
+     * Unused slots have index -1. */
+    for (i = 0; i < filter->num_blocks; i++)
+    {
+      OFTVG_ReadBlock *block = &filter->blocks[i];
+      if (block->index < 0 || block->index < first || block->index >= last)
+      {
+        block->index = index;
+        block->ready = false;
+        return block;
+      }
+    }
+    break;
+  }
+  
+  return NULL;
+}
+
+/* Read the whole range, or fail with errno set */
+static bool read_fully(int fd, guint64 offset, guint8 *data, gsize length)
+{
+  if (lseek(fd, offset, SEEK_SET) < 0)
+    return false;
+  
+  while (length > 0)
+  {
+    gssize result = read(fd, data, length);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result < 0)
+      return false;
+    if (result == 0)
+    {
+      /* The file was truncated while we were reading it */
+      errno = EIO;
+      return false;
+    }
+    
+    data += result;
+    length -= result;
+  }
+  
+  return true;
+}
+
+static gpointer gst_oftvg_filesrc_reader(gpointer data)
+{
+  GstOFTVG_FileSrc *filter = (GstOFTVG_FileSrc*)data;
+  GstClockTime thread_start = gst_util_get_timestamp();
+  guint64 total = 0;
+  
+  g_mutex_lock(&filter->lock);
+  while (filter->running)
+  {
+    OFTVG_ReadBlock *block = next_block(filter);
+    guint64 offset;
+    gsize length;
+    GstClockTime start;
+    bool ok;
+    int error;
+    
+    if (block == NULL)
+    {
+      g_cond_wait(&filter->cond, &filter->lock);
+      continue;
+    }
+    
+    offset = (guint64)block->index * filter->read_size;
+    length = MIN(filter->read_size, filter->size - offset);
+    g_mutex_unlock(&filter->lock);
+    
+    /* Only this thread touches the file and the data of the blocks
+     * that are not ready */
+    start = gst_util_get_timestamp();
+    ok = read_fully(filter->fd, offset, block->data, length);
+    error = errno;
+    total += length;
+    
+    if (ok && filter->max_rate > 0)
+    {
+      GstClockTime due = thread_start + gst_util_uint64_scale(total, GST_SECOND, filter->max_rate);
+      GstClockTime now = gst_util_get_timestamp();
+      if (due > now)
+        g_usleep((due - now) / GST_USECOND);
+    }
+    
+    g_mutex_lock(&filter->lock);
+    if (!ok)
+    {
+      GST_DEBUG("Read of %" G_GSIZE_FORMAT " bytes at %" G_GUINT64_FORMAT " failed: %s",
+                length, offset, g_strerror(error));
+      block->index = -1;
+      filter->read_errno = error;
+      g_cond_broadcast(&filter->cond);
+      break;
+    }
+    
+    block->length = length;
+    block->ready = true;
+    filter->bytes_read += length;
+    filter->read_time += gst_util_get_timestamp() - start;
+    g_cond_broadcast(&filter->cond);
+  }
+  g_mutex_unlock(&filter->lock);
+  
+  return NULL;
+}
+
+static GstFlowReturn gst_oftvg_filesrc_create(GstBaseSrc *object, guint64 offset,
+                                              guint length, GstBuffer **buf)
+{
+  GstOFTVG_FileSrc *filter = GST_OFTVG_FILESRC(object);
+  GstFlowReturn result = GST_FLOW_OK;
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gsize done = 0;
+  int error = 0;
+  bool stalled = false;
+  GstClockTime stall_start = 0;
+  
+  if (offset >= filter->size)
+    return GST_FLOW_EOS;
+  
+  length = MIN(length, filter->size - offset);
+  buffer = gst_buffer_new_allocate(NULL, length, NULL);
+  gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+  
+  g_mutex_lock(&filter->lock);
+  filter->requests++;
+  
+  while (done < length)
+  {
+    guint64 pos = offset + done;
+    gint64 index = pos / filter->read_size;
+    OFTVG_ReadBlock *block = NULL;
+    gsize skip, count;
+    
+    if (filter->cursor != index)
+    {
+      filter->cursor = index;
+      g_cond_broadcast(&filter->cond);
+    }
+    
+    while (!filter->flushing && filter->read_errno == 0 &&
+           ((block = find_block(filter, index)) == NULL || !block->ready))
+    {
+      if (!stalled)
+      {
+        stalled = true;
+        stall_start = gst_util_get_timestamp();
+      }
+      g_cond_wait(&filter->cond, &filter->lock);
+    }
+    
+    if (filter->flushing)
+    {
+      result = GST_FLOW_FLUSHING;
+      break;
+    }
+    
+    if (filter->read_errno != 0)
+    {
+      error = filter->read_errno;
+      result = GST_FLOW_ERROR;
+      break;
+    }
+    
+    skip = pos - (guint64)index * filter->read_size;
+    count = MIN(length - done, block->length - skip);
+    memcpy(map.data + done, block->data + skip, count);
+    done += count;
+  }
+  
+  if (stalled)
+  {
+    filter->stalls++;
+    filter->stall_time += gst_util_get_timestamp() - stall_start;
+  }
+  g_mutex_unlock(&filter->lock);
+  
+  gst_buffer_unmap(buffer, &map);
+  
+  if (error != 0)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, READ, (NULL),
+                      ("Could not read \"%s\": %s", filter->location, g_strerror(error)));
+  }
+  
+  if (result != GST_FLOW_OK)
+  {
+    gst_buffer_unref(buffer);
+    return result;
+  }
+  
+  GST_BUFFER_OFFSET(buffer) = offset;
+  GST_BUFFER_OFFSET_END(buffer) = offset + length;
+  *buf = buffer;
+  return GST_FLOW_OK;
+}
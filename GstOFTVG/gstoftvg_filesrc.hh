@@ -0,0 +1,100 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_OFTVG_FILESRC_H__
+#define __GST_OFTVG_FILESRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstbasesrc.h>
+#include <stdbool.h>
+
+/* Declaration of the GObject subtype */
+G_BEGIN_DECLS
+
+#define GST_TYPE_OFTVG_FILESRC \
+  (gst_oftvg_filesrc_get_type())
+#define GST_OFTVG_FILESRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OFTVG_FILESRC,GstOFTVG_FileSrc))
+#define GST_OFTVG_FILESRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OFTVG_FILESRC,GstOFTVG_FileSrcClass))
+#define GST_IS_OFTVG_FILESRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OFTVG_FILESRC))
+#define GST_IS_OFTVG_FILESRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OFTVG_FILESRC))
+
+typedef struct _GstOFTVG_FileSrc      GstOFTVG_FileSrc;
+typedef struct _GstOFTVG_FileSrcClass GstOFTVG_FileSrcClass;
+
+/* One block of the file in the read-ahead cache */
+typedef struct
+{
+  gint64 index;  /* Block number in the file, -1 if unused */
+  bool ready;    /* Data has been read */
+  gsize length;  /* Shorter than read_size only at the end of the file */
+  guint8 *data;
+} OFTVG_ReadBlock;
+
+/* Structure to contain the internal data of gstoftvg_filesrc elements */
+struct _GstOFTVG_FileSrc
+{
+  GstBaseSrc element;
+  
+  /* Properties */
+  gchar *location;
+  guint64 readahead;  /* Bytes of cache, split into read_size blocks */
+  guint read_size;    /* Bytes per read() call */
+  guint64 max_rate;   /* Bytes per second, 0 for unlimited */
+  
+  int fd;
+  guint64 size;
+  
+  /* Reader thread and the cache that it fills, protected by lock */
+  GThread *thread;
+  GMutex lock;
+  GCond cond;
+  bool running;
+  bool flushing;
+  int read_errno;
+  
+  OFTVG_ReadBlock *blocks;
+  guint num_blocks;
+  
+  /* Block of the latest request. The reader keeps the blocks from
+   * a little behind it up to the end of the budget filled. */
+  gint64 cursor;
+  
+  /* Statistics for the "stats" property */
+  guint64 bytes_read;
+  GstClockTime read_time;
+  guint64 requests;
+  guint64 stalls;
+  GstClockTime stall_time;
+};
+
+struct _GstOFTVG_FileSrcClass 
+{
+  GstBaseSrcClass parent_class;
+};
+
+GType gst_oftvg_filesrc_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_OFTVG_FILESRC_H__ */
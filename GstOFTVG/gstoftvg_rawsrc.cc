@@ -0,0 +1,850 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-oftvg_rawsrc
+ *
+ * A source for uncompressed input files: YUV4MPEG2 (.y4m) files, and
+ * headerless raw video dumps when the raw-caps property gives their
+ * format. The caps, the timestamps and the duration come from the Y4M
+ * header, so no typefinding, parser or decoder is needed.
+ *
+ * Each frame is memory mapped privately and passed on without copying.
+ * The mapping is writable, so the oftvg element draws its markers in
+ * place and the operating system copies only the pages that it touches.
+ * The rest of the frame is read straight from the page cache by the
+ * encoder. The mapping is released together with the buffer. On Windows
+ * the frames are read into normal buffers instead.
+ *
+ * The frames in Y4M and raw files have no padding between the lines. If
+ * this differs from the default layout of the format, the layout is
+ * described with GstVideoMeta, or the frame is copied if downstream does
+ * not support it.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch oftvg_rawsrc location=input.y4m ! oftvg location=layout.bmp ! autovideosink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <glib/gstdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "gstoftvg_rawsrc.hh"
+
+#ifdef G_OS_WIN32
+#  include <io.h>
+#  define lseek _lseeki64
+#else
+#  include <unistd.h>
+#  include <sys/mman.h>
+#endif
+
+#ifndef O_BINARY
+#  define O_BINARY 0
+#endif
+
+/* Debug category to use */
+GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
+#define GST_CAT_DEFAULT gst_oftvg_debug
+
+/* Y4M header lines are short, "FRAME" usually has no parameters at all */
+#define Y4M_MAGIC "YUV4MPEG2 "
+#define Y4M_HEADER_MAX 1024
+#define Y4M_FRAME_HEADER_MAX 256
+
+/* Template for the pins */
+static GstStaticPadTemplate src_template =
+GST_STATIC_PAD_TEMPLATE (
+  "src",
+  GST_PAD_SRC,
+  GST_PAD_ALWAYS,
+  GST_STATIC_CAPS ("video/x-raw")
+);
+
+/* Identifier numbers for properties */
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_RAW_CAPS
+};
+
+/* Definition of the GObject subtype. */
+static void gst_oftvg_rawsrc_class_init(GstOFTVG_RawSrcClass* klass);
+static void gst_oftvg_rawsrc_init(GstOFTVG_RawSrc* filter);
+G_DEFINE_TYPE (GstOFTVG_RawSrc, gst_oftvg_rawsrc, GST_TYPE_PUSH_SRC);
+
+/* Prototypes for the overridden methods */
+static void gst_oftvg_rawsrc_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void gst_oftvg_rawsrc_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static void gst_oftvg_rawsrc_finalize(GObject *object);
+static gboolean gst_oftvg_rawsrc_start(GstBaseSrc *object);
+static gboolean gst_oftvg_rawsrc_stop(GstBaseSrc *object);
+static GstCaps *gst_oftvg_rawsrc_get_caps(GstBaseSrc *object, GstCaps *filter_caps);
+static gboolean gst_oftvg_rawsrc_decide_allocation(GstBaseSrc *object, GstQuery *query);
+static gboolean gst_oftvg_rawsrc_query(GstBaseSrc *object, GstQuery *query);
+static gboolean gst_oftvg_rawsrc_is_seekable(GstBaseSrc *object);
+static GstFlowReturn gst_oftvg_rawsrc_create(GstPushSrc *object, GstBuffer **buf);
+
+/* Initializer for the class type */
+static void gst_oftvg_rawsrc_class_init(GstOFTVG_RawSrcClass* klass)
+{
+  /* GObject method overrides */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+    
+    gobject_class->set_property = gst_oftvg_rawsrc_set_property;
+    gobject_class->get_property = gst_oftvg_rawsrc_get_property;
+    gobject_class->finalize     = gst_oftvg_rawsrc_finalize;
+    
+    g_object_class_install_property(gobject_class, PROP_LOCATION,
+      g_param_spec_string("location", "location", "Name of the file to read",
+                          NULL, (GParamFlags)(G_PARAM_READWRITE))
+    );
+    
+    g_object_class_install_property(gobject_class, PROP_RAW_CAPS,
+      g_param_spec_boxed("raw-caps", "raw-caps",
+                         "Format of a headerless raw video file, including the size and "
+                         "the framerate. Not needed for Y4M files.",
+                         GST_TYPE_CAPS, (GParamFlags)(G_PARAM_READWRITE))
+    );
+  }
+  
+  /* GstBaseSrc method overrides */
+  {
+    GstBaseSrcClass *basesrc_class = GST_BASE_SRC_CLASS(klass);
+    GstPushSrcClass *pushsrc_class = GST_PUSH_SRC_CLASS(klass);
+    
+    basesrc_class->start             = GST_DEBUG_FUNCPTR(gst_oftvg_rawsrc_start);
+    basesrc_class->stop              = GST_DEBUG_FUNCPTR(gst_oftvg_rawsrc_stop);
+    basesrc_class->get_caps          = GST_DEBUG_FUNCPTR(gst_oftvg_rawsrc_get_caps);
+    basesrc_class->decide_allocation = GST_DEBUG_FUNCPTR(gst_oftvg_rawsrc_decide_allocation);
+    basesrc_class->query             = GST_DEBUG_FUNCPTR(gst_oftvg_rawsrc_query);
+    basesrc_class->is_seekable       = GST_DEBUG_FUNCPTR(gst_oftvg_rawsrc_is_seekable);
+    pushsrc_class->create            = GST_DEBUG_FUNCPTR(gst_oftvg_rawsrc_create);
+  }
+  
+  /* Element metadata */
+  {
+    GstElementClass *element_class = GST_ELEMENT_CLASS(klass);
+    
+    gst_element_class_set_metadata (element_class,
+      "Raw video file source",
+      "Source/File/Video",
+      "Reads Y4M and raw video files without copying the frames",
+      "OptoFidelity <info@optofidelity.com>");
+    
+    gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+  }
+}
+
+/* Initializer for class instances */
+static void gst_oftvg_rawsrc_init(GstOFTVG_RawSrc* filter)
+{
+  filter->location = NULL;
+  filter->raw_caps = NULL;
+  filter->fd = -1;
+  filter->size = 0;
+  filter->y4m = false;
+  filter->first_frame = 0;
+  filter->caps = NULL;
+  filter->use_meta = false;
+  filter->top_field_first = true;
+  filter->position = 0;
+  filter->frame = 0;
+  
+  gst_video_info_init(&filter->info);
+  gst_video_info_init(&filter->file_info);
+  
+  gst_base_src_set_format(GST_BASE_SRC(filter), GST_FORMAT_TIME);
+}
+
+static void gst_oftvg_rawsrc_finalize(GObject *object)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  
+  g_free(filter->location);
+  if (filter->raw_caps)
+    gst_caps_unref(filter->raw_caps);
+  
+  G_OBJECT_CLASS(gst_oftvg_rawsrc_parent_class)->finalize(object);
+}
+
+static void gst_oftvg_rawsrc_set_property(GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  
+  switch (prop_id)
+  {
+    case PROP_LOCATION:
+      g_free(filter->location);
+      filter->location = g_value_dup_string(value);
+      break;
+    
+    case PROP_RAW_CAPS:
+      if (filter->raw_caps)
+        gst_caps_unref(filter->raw_caps);
+      filter->raw_caps = (GstCaps*)g_value_dup_boxed(value);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void gst_oftvg_rawsrc_get_property(GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  
+  switch (prop_id)
+  {
+    case PROP_LOCATION:
+      g_value_set_string(value, filter->location);
+      break;
+    
+    case PROP_RAW_CAPS:
+      g_value_set_boxed(value, filter->raw_caps);
+      break;
+    
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Read the whole range, or fail with errno set */
+static bool read_at(int fd, guint64 offset, guint8 *data, gsize length)
+{
+  if (lseek(fd, offset, SEEK_SET) < 0)
+    return false;
+  
+  while (length > 0)
+  {
+    gssize result = read(fd, data, length);
+    if (result < 0 && errno == EINTR)
+      continue;
+    if (result < 0)
+      return false;
+    if (result == 0)
+    {
+      errno = EIO;
+      return false;
+    }
+    
+    data += result;
+    length -= result;
+  }
+  
+  return true;
+}
+
+/* Y4M colorspace tags and the matching formats. The high bit depth
+ * samples are stored as little-endian 16-bit words. */
+static const struct
+{
+  const gchar *tag;
+  GstVideoFormat format;
+  const gchar *chroma_site;
+} y4m_formats[] = {
+  {"420jpeg",  GST_VIDEO_FORMAT_I420,       "jpeg"},
+  {"420paldv", GST_VIDEO_FORMAT_I420,       "dv"},
+  {"420mpeg2", GST_VIDEO_FORMAT_I420,       "mpeg2"},
+  {"420",      GST_VIDEO_FORMAT_I420,       "jpeg"},
+  {"411",      GST_VIDEO_FORMAT_Y41B,       NULL},
+  {"422",      GST_VIDEO_FORMAT_Y42B,       NULL},
+  {"444",      GST_VIDEO_FORMAT_Y444,       NULL},
+  {"mono",     GST_VIDEO_FORMAT_GRAY8,      NULL},
+  {"420p10",   GST_VIDEO_FORMAT_I420_10LE,  NULL},
+  {"422p10",   GST_VIDEO_FORMAT_I422_10LE,  NULL},
+  {"444p10",   GST_VIDEO_FORMAT_Y444_10LE,  NULL},
+};
+
+/* Parse the stream header line, without the magic and the newline */
+static bool parse_y4m_header(GstOFTVG_RawSrc *filter, const gchar *line)
+{
+  gchar **tokens = g_strsplit(line, " ", -1);
+  gint width = 0, height = 0, fps_n = 0, fps_d = 1, par_n = 1, par_d = 1;
+  GstVideoFormat format = GST_VIDEO_FORMAT_I420;
+  GstVideoInterlaceMode interlace = GST_VIDEO_INTERLACE_MODE_PROGRESSIVE;
+  bool top_field_first = true;
+  const gchar *chroma_site = "jpeg";
+  bool ok = true;
+  int i;
+  
+  for (i = 0; tokens[i] != NULL; i++)
+  {
+    const gchar *value = tokens[i] + 1;
+    
+    switch (tokens[i][0])
+    {
+      case 'W':
+        width = atoi(value);
+        break;
+      
+      case 'H':
+        height = atoi(value);
+        break;
+      
+      case 'F':
+        if (sscanf(value, "%d:%d", &fps_n, &fps_d) != 2)
+          ok = false;
+        break;
+      
+      case 'A':
+        /* 0:0 means unknown */
+        if (sscanf(value, "%d:%d", &par_n, &par_d) != 2 || par_n <= 0 || par_d <= 0)
+          par_n = par_d = 1;
+        break;
+      
+      case 'I':
+        /* Mixed means that the frame headers tell which frames are
+         * interlaced, see parse_y4m_frame_header() */
+        if (value[0] == 't' || value[0] == 'b')
+          interlace = GST_VIDEO_INTERLACE_MODE_INTERLEAVED;
+        else if (value[0] == 'm')
+          interlace = GST_VIDEO_INTERLACE_MODE_MIXED;
+        top_field_first = (value[0] != 'b');
+        break;
+      
+      case 'C':
+      {
+        size_t j;
+        for (j = 0; j < G_N_ELEMENTS(y4m_formats); j++)
+        {
+          if (strcmp(value, y4m_formats[j].tag) == 0)
+            break;
+        }
+        
+        if (j == G_N_ELEMENTS(y4m_formats))
+        {
+          GST_ELEMENT_ERROR(filter, STREAM, FORMAT, (NULL),
+                            ("Unsupported Y4M colorspace C%s", value));
+          g_strfreev(tokens);
+          return false;
+        }
+        
+        format = y4m_formats[j].format;
+        chroma_site = y4m_formats[j].chroma_site;
+        break;
+      }
+      
+      default:
+        /* X comments and unknown tags */
+        break;
+    }
+  }
+  g_strfreev(tokens);
+  
+  if (!ok || width <= 0 || height <= 0 || fps_n <= 0 || fps_d <= 0)
+  {
+    GST_ELEMENT_ERROR(filter, STREAM, FORMAT, (NULL),
+                      ("Invalid Y4M header: %s", line));
+    return false;
+  }
+  
+  gst_video_info_set_format(&filter->info, format, width, height);
+  GST_VIDEO_INFO_FPS_N(&filter->info) = fps_n;
+  GST_VIDEO_INFO_FPS_D(&filter->info) = fps_d;
+  GST_VIDEO_INFO_PAR_N(&filter->info) = par_n;
+  GST_VIDEO_INFO_PAR_D(&filter->info) = par_d;
+  GST_VIDEO_INFO_INTERLACE_MODE(&filter->info) = interlace;
+  filter->top_field_first = top_field_first;
+#if GST_CHECK_VERSION(1,12,0)
+  if (interlace == GST_VIDEO_INTERLACE_MODE_INTERLEAVED)
+    GST_VIDEO_INFO_FIELD_ORDER(&filter->info) = top_field_first ?
+      GST_VIDEO_FIELD_ORDER_TOP_FIELD_FIRST : GST_VIDEO_FIELD_ORDER_BOTTOM_FIELD_FIRST;
+#endif
+  if (chroma_site != NULL)
+    filter->info.chroma_site = gst_video_chroma_from_string(chroma_site);
+  
+  return true;
+}
+
+/* Layout of the frames in the file: the planes one after another,
+ * without padding between the lines */
+static void set_file_layout(GstVideoInfo *file_info, const GstVideoInfo *info)
+{
+  const GstVideoFormatInfo *finfo = info->finfo;
+  gsize offset = 0;
+  guint plane, comp;
+  
+  *file_info = *info;
+  
+  for (plane = 0; plane < GST_VIDEO_INFO_N_PLANES(info); plane++)
+  {
+    /* The first component of the plane gives its size */
+    for (comp = 0; comp < GST_VIDEO_INFO_N_COMPONENTS(info); comp++)
+    {
+      if (GST_VIDEO_FORMAT_INFO_PLANE(finfo, comp) == plane)
+        break;
+    }
+    
+    file_info->stride[plane] =
+      GST_VIDEO_FORMAT_INFO_SCALE_WIDTH(finfo, comp, GST_VIDEO_INFO_WIDTH(info)) *
+      GST_VIDEO_FORMAT_INFO_PSTRIDE(finfo, comp);
+    file_info->offset[plane] = offset;
+    offset += file_info->stride[plane] *
+              GST_VIDEO_FORMAT_INFO_SCALE_HEIGHT(finfo, comp, GST_VIDEO_INFO_HEIGHT(info));
+  }
+  
+  file_info->size = offset;
+}
+
+static bool layout_is_default(const GstVideoInfo *file_info, const GstVideoInfo *info)
+{
+  guint plane;
+  
+  for (plane = 0; plane < GST_VIDEO_INFO_N_PLANES(info); plane++)
+  {
+    if (file_info->stride[plane] != info->stride[plane] ||
+        file_info->offset[plane] != info->offset[plane])
+      return false;
+  }
+  
+  return true;
+}
+
+static gboolean gst_oftvg_rawsrc_start(GstBaseSrc *object)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  gchar header[Y4M_HEADER_MAX + 1];
+  gsize header_length;
+  gint64 size;
+  
+  if (filter->location == NULL || filter->location[0] == '\0')
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, NOT_FOUND,
+                      ("No file name specified for reading."), (NULL));
+    return FALSE;
+  }
+  
+  filter->fd = g_open(filter->location, O_RDONLY | O_BINARY, 0);
+  if (filter->fd < 0)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, OPEN_READ,
+                      ("Could not open file \"%s\" for reading.", filter->location),
+                      GST_ERROR_SYSTEM);
+    return FALSE;
+  }
+  
+  size = lseek(filter->fd, 0, SEEK_END);
+  if (size < 0)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, OPEN_READ,
+                      ("Could not get the size of \"%s\".", filter->location),
+                      GST_ERROR_SYSTEM);
+    goto fail;
+  }
+  filter->size = size;
+  
+  /* Y4M files are recognized from the magic, raw files need raw-caps */
+  header_length = MIN(filter->size, Y4M_HEADER_MAX);
+  if (!read_at(filter->fd, 0, (guint8*)header, header_length))
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, READ, (NULL),
+                      ("Could not read \"%s\": %s", filter->location, g_strerror(errno)));
+    goto fail;
+  }
+  header[header_length] = '\0';
+  
+  filter->y4m = g_str_has_prefix(header, Y4M_MAGIC);
+  if (filter->y4m)
+  {
+    gchar *end = (gchar*)memchr(header, '\n', header_length);
+    if (end == NULL)
+    {
+      GST_ELEMENT_ERROR(filter, STREAM, FORMAT, (NULL),
+                        ("Y4M header of \"%s\" is too long", filter->location));
+      goto fail;
+    }
+    
+    *end = '\0';
+    if (!parse_y4m_header(filter, header + strlen(Y4M_MAGIC)))
+      goto fail;
+    
+    filter->first_frame = end + 1 - header;
+  }
+  else if (filter->raw_caps != NULL)
+  {
+    if (!gst_video_info_from_caps(&filter->info, filter->raw_caps) ||
+        GST_VIDEO_INFO_FPS_N(&filter->info) <= 0)
+    {
+      GST_ELEMENT_ERROR(filter, STREAM, FORMAT, (NULL),
+                        ("raw-caps must give the format, size and framerate: %" GST_PTR_FORMAT,
+                         filter->raw_caps));
+      goto fail;
+    }
+    
+    filter->first_frame = 0;
+  }
+  else
+  {
+    GST_ELEMENT_ERROR(filter, STREAM, WRONG_TYPE, (NULL),
+                      ("\"%s\" is not a Y4M file, set raw-caps for raw video", filter->location));
+    goto fail;
+  }
+  
+  set_file_layout(&filter->file_info, &filter->info);
+  filter->caps = gst_video_info_to_caps(&filter->info);
+  filter->position = filter->first_frame;
+  filter->frame = 0;
+  
+  GST_DEBUG("Reading %s: %" GST_PTR_FORMAT ", %" G_GSIZE_FORMAT " bytes per frame",
+            filter->location, filter->caps, GST_VIDEO_INFO_SIZE(&filter->file_info));
+  return TRUE;
+  
+fail:
+  close(filter->fd);
+  filter->fd = -1;
+  return FALSE;
+}
+
+static gboolean gst_oftvg_rawsrc_stop(GstBaseSrc *object)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  
+  if (filter->fd >= 0)
+  {
+    close(filter->fd);
+    filter->fd = -1;
+  }
+  
+  if (filter->caps != NULL)
+  {
+    gst_caps_unref(filter->caps);
+    filter->caps = NULL;
+  }
+  
+  return TRUE;
+}
+
+static GstCaps *gst_oftvg_rawsrc_get_caps(GstBaseSrc *object, GstCaps *filter_caps)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  GstCaps *caps;
+  
+  if (filter->caps != NULL)
+    caps = gst_caps_ref(filter->caps);
+  else
+    caps = gst_pad_get_pad_template_caps(GST_BASE_SRC_PAD(object));
+  
+  if (filter_caps != NULL)
+  {
+    GstCaps *result = gst_caps_intersect_full(filter_caps, caps, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref(caps);
+    caps = result;
+  }
+  
+  return caps;
+}
+
+static gboolean gst_oftvg_rawsrc_decide_allocation(GstBaseSrc *object, GstQuery *query)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  
+  filter->use_meta = gst_query_find_allocation_meta(query, GST_VIDEO_META_API_TYPE, NULL);
+  
+  if (!layout_is_default(&filter->file_info, &filter->info))
+  {
+    GST_INFO("Frame layout differs from the default, %s",
+             filter->use_meta ? "using video meta" : "copying the frames");
+  }
+  
+  return GST_BASE_SRC_CLASS(gst_oftvg_rawsrc_parent_class)->decide_allocation(object, query);
+}
+
+/* Number of frames, assuming that all Y4M frame headers are plain "FRAME".
+ * Frame parameters make the estimate a few bytes per frame too large. */
+static gint64 get_num_frames(GstOFTVG_RawSrc *filter)
+{
+  gsize frame_size = GST_VIDEO_INFO_SIZE(&filter->file_info) + (filter->y4m ? 6 : 0);
+  return (filter->size - filter->first_frame) / frame_size;
+}
+
+static gboolean gst_oftvg_rawsrc_query(GstBaseSrc *object, GstQuery *query)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  
+  if (GST_QUERY_TYPE(query) == GST_QUERY_DURATION && filter->caps != NULL)
+  {
+    GstFormat format;
+    gst_query_parse_duration(query, &format, NULL);
+    
+    if (format == GST_FORMAT_TIME)
+    {
+      gst_query_set_duration(query, format,
+        gst_util_uint64_scale(get_num_frames(filter),
+                              GST_VIDEO_INFO_FPS_D(&filter->info) * GST_SECOND,
+                              GST_VIDEO_INFO_FPS_N(&filter->info)));
+      return TRUE;
+    }
+    else if (format == GST_FORMAT_DEFAULT)
+    {
+      gst_query_set_duration(query, format, get_num_frames(filter));
+      return TRUE;
+    }
+  }
+  
+  return GST_BASE_SRC_CLASS(gst_oftvg_rawsrc_parent_class)->query(object, query);
+}
+
+static gboolean gst_oftvg_rawsrc_is_seekable(GstBaseSrc *object)
+{
+  /* Frames are read once, in order */
+  return FALSE;
+}
+
+/* A privately mapped range of the file, released with the memory */
+typedef struct
+{
+  guint8 *base;
+  gsize length;
+} OFTVG_RawMapping;
+
+static void release_mapping(gpointer data)
+{
+  OFTVG_RawMapping *mapping = (OFTVG_RawMapping*)data;
+  
+#ifdef G_OS_WIN32
+  g_free(mapping->base);
+#else
+  munmap(mapping->base, mapping->length);
+#endif
+  
+  g_free(mapping);
+}
+
+/* Map 'length' bytes starting at 'offset'. The data starts at
+ * mapping->base + *skip. Changes to the data are private to us. */
+static OFTVG_RawMapping *map_range(GstOFTVG_RawSrc *filter, guint64 offset, gsize length,
+                                   gsize *skip)
+{
+  OFTVG_RawMapping *mapping = g_new0(OFTVG_RawMapping, 1);
+  
+#ifdef G_OS_WIN32
+  mapping->base = (guint8*)g_malloc(length);
+  mapping->length = length;
+  *skip = 0;
+  if (!read_at(filter->fd, offset, mapping->base, length))
+  {
+    g_free(mapping->base);
+    g_free(mapping);
+    return NULL;
+  }
+#else
+  {
+    static gsize page_size = 0;
+    void *base;
+    
+    if (page_size == 0)
+      page_size = sysconf(_SC_PAGESIZE);
+    
+    *skip = offset % page_size;
+    mapping->length = length + *skip;
+    base = mmap(NULL, mapping->length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                filter->fd, offset - *skip);
+    if (base == MAP_FAILED)
+    {
+      g_free(mapping);
+      return NULL;
+    }
+    mapping->base = (guint8*)base;
+    
+#ifdef MADV_SEQUENTIAL
+    madvise(base, mapping->length, MADV_SEQUENTIAL);
+#endif
+  }
+#endif
+  
+  return mapping;
+}
+
+/* Parse the parameters of a Y4M frame header, without "FRAME" and the
+ * newline. In mixed mode, "Ixyz" tells the field order of the frame in x:
+ * t or T for top field first, b or B for bottom field first and 1, 2 or 3
+ * for progressive. Returns the buffer flags for the frame. */
+static guint parse_y4m_frame_header(GstOFTVG_RawSrc *filter, const gchar *line)
+{
+  gchar **tokens;
+  guint flags = 0;
+  int i;
+  
+  if (GST_VIDEO_INFO_INTERLACE_MODE(&filter->info) != GST_VIDEO_INTERLACE_MODE_MIXED)
+    return 0;
+  
+  tokens = g_strsplit(line, " ", -1);
+  for (i = 0; tokens[i] != NULL; i++)
+  {
+    if (tokens[i][0] != 'I')
+      continue;
+    
+    switch (tokens[i][1])
+    {
+      case 't':
+      case 'T':
+        flags |= GST_VIDEO_BUFFER_FLAG_INTERLACED | GST_VIDEO_BUFFER_FLAG_TFF;
+        break;
+      
+      case 'b':
+      case 'B':
+        flags |= GST_VIDEO_BUFFER_FLAG_INTERLACED;
+        break;
+    }
+  }
+  g_strfreev(tokens);
+  
+  return flags;
+}
+
+static GstFlowReturn gst_oftvg_rawsrc_create(GstPushSrc *object, GstBuffer **buf)
+{
+  GstOFTVG_RawSrc *filter = GST_OFTVG_RAWSRC(object);
+  gsize frame_size = GST_VIDEO_INFO_SIZE(&filter->file_info);
+  gsize header_length = 0, length, skip;
+  guint frame_flags = 0;
+  OFTVG_RawMapping *mapping;
+  GstBuffer *buffer;
+  
+  if (filter->position >= filter->size)
+    return GST_FLOW_EOS;
+  
+  /* Y4M frames start with "FRAME" and optional parameters on one line,
+   * so map a little extra to cover it */
+  length = MIN(frame_size + (filter->y4m ? Y4M_FRAME_HEADER_MAX : 0),
+               filter->size - filter->position);
+  if (length < frame_size)
+  {
+    GST_ELEMENT_WARNING(filter, STREAM, DECODE, (NULL),
+                        ("Ignoring incomplete frame at the end of \"%s\"", filter->location));
+    return GST_FLOW_EOS;
+  }
+  
+  mapping = map_range(filter, filter->position, length, &skip);
+  if (mapping == NULL)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, READ, (NULL),
+                      ("Could not read \"%s\": %s", filter->location, g_strerror(errno)));
+    return GST_FLOW_ERROR;
+  }
+  
+  if (filter->y4m)
+  {
+    const guint8 *data = mapping->base + skip;
+    const guint8 *end = (const guint8*)memchr(data, '\n', MIN(length, Y4M_FRAME_HEADER_MAX));
+    
+    if (length < 5 || memcmp(data, "FRAME", 5) != 0 || end == NULL)
+    {
+      GST_ELEMENT_ERROR(filter, STREAM, DECODE, (NULL),
+                        ("Invalid Y4M frame header at offset %" G_GUINT64_FORMAT,
+                         filter->position));
+      release_mapping(mapping);
+      return GST_FLOW_ERROR;
+    }
+    
+    header_length = end + 1 - data;
+    if (header_length + frame_size > length)
+    {
+      GST_ELEMENT_WARNING(filter, STREAM, DECODE, (NULL),
+                          ("Ignoring incomplete frame at the end of \"%s\"", filter->location));
+      release_mapping(mapping);
+      return GST_FLOW_EOS;
+    }
+    
+    if (header_length > 6)
+    {
+      gchar *params = g_strndup((const gchar*)data + 6, header_length - 7);
+      frame_flags = parse_y4m_frame_header(filter, params);
+      g_free(params);
+    }
+  }
+  
+  buffer = gst_buffer_new();
+  gst_buffer_append_memory(buffer,
+    gst_memory_new_wrapped((GstMemoryFlags)0, mapping->base, mapping->length,
+                           skip + header_length, frame_size, mapping, release_mapping));
+  
+  filter->position += header_length + frame_size;
+  
+#ifdef POSIX_FADV_WILLNEED
+  /* Start reading the next frame while this one is processed */
+  posix_fadvise(filter->fd, filter->position, frame_size + header_length, POSIX_FADV_WILLNEED);
+#endif
+  
+  if (!layout_is_default(&filter->file_info, &filter->info))
+  {
+    if (filter->use_meta)
+    {
+      gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE,
+                                     GST_VIDEO_INFO_FORMAT(&filter->info),
+                                     GST_VIDEO_INFO_WIDTH(&filter->info),
+                                     GST_VIDEO_INFO_HEIGHT(&filter->info),
+                                     GST_VIDEO_INFO_N_PLANES(&filter->info),
+                                     filter->file_info.offset, filter->file_info.stride);
+    }
+    else
+    {
+      GstBuffer *copy = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&filter->info), NULL);
+      GstVideoFrame src, dest;
+      
+      gst_video_frame_map(&src, &filter->file_info, buffer, GST_MAP_READ);
+      gst_video_frame_map(&dest, &filter->info, copy, GST_MAP_WRITE);
+      gst_video_frame_copy(&dest, &src);
+      gst_video_frame_unmap(&dest);
+      gst_video_frame_unmap(&src);
+      
+      gst_buffer_unref(buffer);
+      buffer = copy;
+    }
+  }
+  
+  GST_BUFFER_PTS(buffer) = gst_util_uint64_scale(filter->frame,
+                                                 GST_VIDEO_INFO_FPS_D(&filter->info) * GST_SECOND,
+                                                 GST_VIDEO_INFO_FPS_N(&filter->info));
+  GST_BUFFER_DURATION(buffer) = gst_util_uint64_scale(filter->frame + 1,
+                                                      GST_VIDEO_INFO_FPS_D(&filter->info) * GST_SECOND,
+                                                      GST_VIDEO_INFO_FPS_N(&filter->info))
+                                - GST_BUFFER_PTS(buffer);
+  GST_BUFFER_OFFSET(buffer) = filter->frame;
+  GST_BUFFER_OFFSET_END(buffer) = filter->frame + 1;
+  if (filter->frame == 0)
+    GST_BUFFER_FLAG_SET(buffer, GST_BUFFER_FLAG_DISCONT);
+  if (filter->y4m && filter->top_field_first &&
+      GST_VIDEO_INFO_INTERLACE_MODE(&filter->info) == GST_VIDEO_INTERLACE_MODE_INTERLEAVED)
+    GST_BUFFER_FLAG_SET(buffer, GST_VIDEO_BUFFER_FLAG_TFF);
+  GST_BUFFER_FLAG_SET(buffer, frame_flags);
+  
+  filter->frame++;
+  *buf = buffer;
+  return GST_FLOW_OK;
+}
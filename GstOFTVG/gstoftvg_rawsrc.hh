@@ -0,0 +1,87 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __GST_OFTVG_RAWSRC_H__
+#define __GST_OFTVG_RAWSRC_H__
+
+#include <gst/gst.h>
+#include <gst/base/gstpushsrc.h>
+#include <gst/video/video.h>
+#include <stdbool.h>
+
+/* Declaration of the GObject subtype */
+G_BEGIN_DECLS
+
+#define GST_TYPE_OFTVG_RAWSRC \
+  (gst_oftvg_rawsrc_get_type())
+#define GST_OFTVG_RAWSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OFTVG_RAWSRC,GstOFTVG_RawSrc))
+#define GST_OFTVG_RAWSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OFTVG_RAWSRC,GstOFTVG_RawSrcClass))
+#define GST_IS_OFTVG_RAWSRC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OFTVG_RAWSRC))
+#define GST_IS_OFTVG_RAWSRC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OFTVG_RAWSRC))
+
+typedef struct _GstOFTVG_RawSrc      GstOFTVG_RawSrc;
+typedef struct _GstOFTVG_RawSrcClass GstOFTVG_RawSrcClass;
+
+/* Structure to contain the internal data of gstoftvg_rawsrc elements */
+struct _GstOFTVG_RawSrc
+{
+  GstPushSrc element;
+  
+  /* Properties */
+  gchar *location;
+  GstCaps *raw_caps;  /* Format of headerless files, NULL for Y4M */
+  
+  int fd;
+  guint64 size;
+  
+  /* Y4M files have a header for each frame, raw files have none */
+  bool y4m;
+  guint64 first_frame; /* File offset of the first frame */
+  
+  /* Format of the stream, and the layout of the frames in the file.
+   * Y4M and raw dumps have no padding between the lines. */
+  GstVideoInfo info;
+  GstVideoInfo file_info;
+  GstCaps *caps;
+  bool top_field_first; /* Field order of interlaced streams */
+  
+  /* Downstream supports GstVideoMeta, so the frames can be passed on
+   * even if the file layout differs from the default one */
+  bool use_meta;
+  
+  /* Position of the next frame */
+  guint64 position;
+  guint64 frame;
+};
+
+struct _GstOFTVG_RawSrcClass 
+{
+  GstPushSrcClass parent_class;
+};
+
+GType gst_oftvg_rawsrc_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_OFTVG_RAWSRC_H__ */
@@ -0,0 +1,181 @@
+#include "gstoftvg_stats.hh"
+#include <cstring>
+
+/* Name of the phases in the stats structure */
+static const gchar *phase_names[OFTVG::PHASE_COUNT] = {
+  "map", "resolve", "fill", "unmap", "total"
+};
+
+OFTVG_Histogram::OFTVG_Histogram()
+{
+  clear();
+}
+
+void OFTVG_Histogram::clear()
+{
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  max_ = 0;
+}
+
+// Values below SUB_BUCKETS get a bucket each, after that every power of
+// two is divided into SUB_BUCKETS buckets by the bits following the msb.
+int OFTVG_Histogram::bucket_index(timemeasure_t value)
+{
+  if (value < (timemeasure_t)SUB_BUCKETS)
+    return (int)value;
+
+#ifdef __GNUC__
+  int msb = 63 - __builtin_clzll(value);
+#else
+  int msb = 63;
+  while (!(value >> msb)) msb--;
+#endif
+
+  int sub = (int)(value >> (msb - 3)) & (SUB_BUCKETS - 1);
+  return (msb - 2) * SUB_BUCKETS + sub;
+}
+
+timemeasure_t OFTVG_Histogram::bucket_upper_bound(int index)
+{
+  if (index < SUB_BUCKETS)
+    return index;
+
+  int shift = index / SUB_BUCKETS - 1;
+  timemeasure_t sub = index % SUB_BUCKETS;
+
+  if (shift >= 60)
+    return G_MAXUINT64;
+
+  return ((SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void OFTVG_Histogram::add(timemeasure_t value)
+{
+  buckets_[bucket_index(value)]++;
+  count_++;
+
+  if (value > max_)
+    max_ = value;
+}
+
+timemeasure_t OFTVG_Histogram::percentile(double fraction) const
+{
+  if (count_ == 0)
+    return 0;
+
+  guint64 target = (guint64)(fraction * count_ + 0.999999);
+  guint64 cumulative = 0;
+
+  if (target < 1)
+    target = 1;
+
+  for (int i = 0; i < BUCKETS; i++)
+  {
+    cumulative += buckets_[i];
+    if (cumulative >= target)
+    {
+      timemeasure_t bound = bucket_upper_bound(i);
+      return (bound < max_) ? bound : max_;
+    }
+  }
+
+  return max_;
+}
+
+OFTVG_Stats::OFTVG_Stats()
+{
+  g_mutex_init(&lock_);
+  frames_ = 0;
+  layout_time_ = 0;
+}
+
+OFTVG_Stats::~OFTVG_Stats()
+{
+  g_mutex_clear(&lock_);
+}
+
+void OFTVG_Stats::clear()
+{
+  g_mutex_lock(&lock_);
+  frames_ = 0;
+  layout_time_ = 0;
+  for (int s = 0; s < SEGMENTS; s++)
+  {
+    for (int p = 0; p < OFTVG::PHASE_COUNT; p++)
+    {
+      histograms_[s][p].clear();
+    }
+  }
+  g_mutex_unlock(&lock_);
+}
+
+void OFTVG_Stats::add_layout_time(timemeasure_t time)
+{
+  g_mutex_lock(&lock_);
+  layout_time_ += time;
+  g_mutex_unlock(&lock_);
+}
+
+void OFTVG_Stats::add_frame(int segment, const OFTVG::FrameTiming &timing)
+{
+  if (segment < 0 || segment >= SEGMENTS)
+    return;
+
+  g_mutex_lock(&lock_);
+  frames_++;
+  for (int p = 0; p < OFTVG::PHASE_COUNT; p++)
+  {
+    histograms_[segment][p].add(timing.phase[p]);
+  }
+  g_mutex_unlock(&lock_);
+}
+
+GstStructure *OFTVG_Stats::to_structure(const gchar * const segment_names[SEGMENTS]) const
+{
+  GstStructure *result;
+
+  g_mutex_lock(&lock_);
+
+  result = gst_structure_new("oftvg-stats",
+                             "frames", G_TYPE_UINT64, frames_,
+                             "layout-compile", G_TYPE_UINT64, layout_time_,
+                             NULL);
+
+  /* Each segment with any frames gets a sub-structure with the
+   * count, p50, p99 and max times of each phase in nanoseconds. */
+  for (int s = 0; s < SEGMENTS; s++)
+  {
+    if (histograms_[s][OFTVG::PHASE_TOTAL].count() == 0)
+      continue;
+
+    GstStructure *segment = gst_structure_new_empty(segment_names[s]);
+    gst_structure_set(segment, "frames", G_TYPE_UINT64,
+                      histograms_[s][OFTVG::PHASE_TOTAL].count(), NULL);
+
+    for (int p = 0; p < OFTVG::PHASE_COUNT; p++)
+    {
+      const OFTVG_Histogram &h = histograms_[s][p];
+      gchar *p50 = g_strdup_printf("%s-p50", phase_names[p]);
+      gchar *p99 = g_strdup_printf("%s-p99", phase_names[p]);
+      gchar *max = g_strdup_printf("%s-max", phase_names[p]);
+
+      gst_structure_set(segment,
+                        p50, G_TYPE_UINT64, h.percentile(0.50),
+                        p99, G_TYPE_UINT64, h.percentile(0.99),
+                        max, G_TYPE_UINT64, h.max(),
+                        NULL);
+
+      g_free(p50);
+      g_free(p99);
+      g_free(max);
+    }
+
+    gst_structure_set(result, segment_names[s], GST_TYPE_STRUCTURE, segment, NULL);
+    gst_structure_free(segment);
+  }
+
+  g_mutex_unlock(&lock_);
+
+  return result;
+}
@@ -0,0 +1,120 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Render-time statistics for the oftvg_video element.
+ *
+ * Each processed frame is split into phases (map, color resolution, span
+ * fill, unmap) which are timed with timemeasure.h. The times are collected
+ * into latency histograms separately for each segment of the output video
+ * (precalibration, video, postcalibration), so that the cost of the marker
+ * rendering can be told apart from the rest of the pipeline.
+ */
+
+#ifndef __GSTOFTVG_STATS_HH__
+#define __GSTOFTVG_STATS_HH__
+
+#include <gst/gst.h>
+#include "timemeasure.h"
+
+namespace OFTVG
+{
+  /* Timed phases of processing a frame */
+  enum StatsPhase
+  {
+    PHASE_MAP,
+    PHASE_RESOLVE,
+    PHASE_FILL,
+    PHASE_UNMAP,
+    PHASE_TOTAL,
+    PHASE_COUNT
+  };
+
+  /* Times of each phase for a single frame, in nanoseconds */
+  struct FrameTiming
+  {
+    timemeasure_t phase[PHASE_COUNT];
+  };
+};
+
+/**
+ * Log-linear latency histogram. Each power of two is split into
+ * 8 buckets, which gives percentiles within 12.5 % of the real value.
+ */
+class OFTVG_Histogram
+{
+public:
+  OFTVG_Histogram();
+
+  void clear();
+  void add(timemeasure_t value);
+
+  inline guint64 count() const { return count_; }
+  inline timemeasure_t max() const { return max_; }
+
+  /// Value below which the given fraction (0..1) of samples fall.
+  timemeasure_t percentile(double fraction) const;
+
+private:
+  static const int SUB_BUCKETS = 8;
+  static const int BUCKETS = 64 * SUB_BUCKETS;
+
+  static int bucket_index(timemeasure_t value);
+  static timemeasure_t bucket_upper_bound(int index);
+
+  guint64 buckets_[BUCKETS];
+  guint64 count_;
+  timemeasure_t max_;
+};
+
+/**
+ * Statistics collected over one run of the element. All methods are
+ * thread safe, so the statistics can be read while streaming.
+ */
+class OFTVG_Stats
+{
+public:
+  /* Segments that are tracked separately. These match state_t in
+   * gstoftvg_video.hh, except that STATE_END is never recorded. */
+  static const int SEGMENTS = 4;
+
+  OFTVG_Stats();
+  ~OFTVG_Stats();
+
+  void clear();
+
+  /// Record the time it took to compile the layouts
+  void add_layout_time(timemeasure_t time);
+
+  /// Record the phase times of a frame in the given segment
+  void add_frame(int segment, const OFTVG::FrameTiming &timing);
+
+  /// Build a "oftvg-stats" structure with the current statistics.
+  /// Segment names are given in the same order as the segment numbers.
+  GstStructure *to_structure(const gchar * const segment_names[SEGMENTS]) const;
+
+private:
+  mutable GMutex lock_;
+  guint64 frames_;
+  timemeasure_t layout_time_;
+  OFTVG_Histogram histograms_[SEGMENTS][OFTVG::PHASE_COUNT];
+};
+
+#endif /* __GSTOFTVG_STATS_HH__ */
@@ -0,0 +1,239 @@
+#include "gstoftvg_timeline.hh"
+
+OFTVG_Timeline::OFTVG_Timeline()
+{
+  g_mutex_init(&lock_);
+  g_cond_init(&cond_);
+  waiting_ = 0;
+  reset();
+}
+
+OFTVG_Timeline::~OFTVG_Timeline()
+{
+  g_cond_clear(&cond_);
+  g_mutex_clear(&lock_);
+}
+
+void OFTVG_Timeline::reset()
+{
+  g_mutex_lock(&lock_);
+  started_ = false;
+  cancelled_ = false;
+  origin_ = 0;
+  frame_num_ = GST_SECOND / 30;
+  frame_den_ = 1;
+  marks_start_ = video_start_ = post_start_ = end_frame_ = -1;
+  lipsync_step_ = 1;
+  end_time_ = GST_CLOCK_TIME_NONE;
+  position_ = 0;
+  g_mutex_unlock(&lock_);
+}
+
+/* Number of frames needed to cover the duration */
+gint64 OFTVG_Timeline::frames_for(GstClockTime duration) const
+{
+  return gst_util_uint64_scale_ceil(duration, frame_den_, frame_num_);
+}
+
+/* The segment boundaries follow the rules that the video element has
+ * always used: a segment ends after the first frame that reaches its
+ * duration, so every enabled segment has at least one frame. */
+void OFTVG_Timeline::start(const OFTVG::TimelineParams &params, GstClockTime origin,
+                           guint64 frame_num, guint64 frame_den, GstClockTime end_of_video)
+{
+  GstClockTime pre_white = params.pre_white_duration * GST_MSECOND;
+  GstClockTime pre_marks = params.pre_marks_duration * GST_MSECOND;
+  GstClockTime post_white = params.post_white_duration * GST_MSECOND;
+
+  g_mutex_lock(&lock_);
+
+  /* Another video element sharing the timeline got its first frame first */
+  if (started_)
+  {
+    g_mutex_unlock(&lock_);
+    return;
+  }
+
+  params_ = params;
+  origin_ = origin;
+  frame_num_ = frame_num;
+  frame_den_ = frame_den;
+
+  marks_start_ = (pre_white > 0) ? MAX(1, frames_for(pre_white)) : 0;
+  video_start_ = (pre_marks > 0) ? MAX(marks_start_ + 1, frames_for(pre_white + pre_marks))
+                                 : marks_start_;
+
+  if (params.only_calibration)
+  {
+    post_start_ = video_start_;
+  }
+  else if (params.num_buffers > 0)
+  {
+    post_start_ = video_start_ + params.num_buffers;
+  }
+  else if (post_white > 0 && GST_CLOCK_TIME_IS_VALID(end_of_video))
+  {
+    /* The video is cut short to leave room for postcalibration */
+    GstClockTime cut = (end_of_video > post_white + GST_SECOND) ?
+                       end_of_video - post_white - GST_SECOND : 0;
+    post_start_ = MAX(video_start_ + 1, frames_for(cut));
+  }
+  else
+  {
+    /* Video continues until the input ends */
+    post_start_ = -1;
+  }
+
+  if (post_start_ < 0)
+    end_frame_ = -1;
+  else if (post_white > 0)
+    end_frame_ = post_start_ + MAX(1, frames_for(post_white));
+  else
+    end_frame_ = post_start_;
+
+  lipsync_step_ = MAX(1, frames_for(MAX(params.lipsync, 0) * GST_MSECOND));
+
+  if (end_frame_ >= 0)
+    end_time_ = frame_time(end_frame_);
+
+  GST_DEBUG("Timeline: marks at frame %" G_GINT64_FORMAT ", video at %" G_GINT64_FORMAT
+            ", postcalibration at %" G_GINT64_FORMAT ", end at %" G_GINT64_FORMAT
+            ", lipsync every %" G_GINT64_FORMAT " frames",
+            marks_start_, video_start_, post_start_, end_frame_, lipsync_step_);
+
+  started_ = true;
+  g_cond_broadcast(&cond_);
+  g_mutex_unlock(&lock_);
+}
+
+bool OFTVG_Timeline::wait_started()
+{
+  bool status;
+
+  g_mutex_lock(&lock_);
+  while (!started_ && !cancelled_)
+  {
+    g_cond_wait(&cond_, &lock_);
+  }
+  status = !cancelled_;
+  g_mutex_unlock(&lock_);
+
+  return status;
+}
+
+void OFTVG_Timeline::cancel()
+{
+  g_mutex_lock(&lock_);
+  cancelled_ = true;
+  g_cond_broadcast(&cond_);
+  g_mutex_unlock(&lock_);
+}
+
+void OFTVG_Timeline::resume()
+{
+  g_mutex_lock(&lock_);
+  cancelled_ = false;
+  g_mutex_unlock(&lock_);
+}
+
+GstClockTime OFTVG_Timeline::frame_time(gint64 frame) const
+{
+  return origin_ + gst_util_uint64_scale(frame, frame_num_, frame_den_);
+}
+
+gint64 OFTVG_Timeline::frame_at(GstClockTime time) const
+{
+  if (time <= origin_)
+    return 0;
+
+  return gst_util_uint64_scale(time - origin_, frame_den_, frame_num_);
+}
+
+enum state_t OFTVG_Timeline::state_at(gint64 frame) const
+{
+  if (frame < marks_start_)
+    return STATE_PRECALIBRATION_WHITE;
+  if (frame < video_start_)
+    return STATE_PRECALIBRATION_MARKS;
+  if (post_start_ < 0 || frame < post_start_)
+    return STATE_VIDEO;
+  if (end_frame_ < 0 || frame < end_frame_)
+    return STATE_POSTCALIBRATION;
+  return STATE_END;
+}
+
+gint64 OFTVG_Timeline::next_lipsync_frame(gint64 frame) const
+{
+  gint64 steps, result;
+
+  if (params_.lipsync <= 0)
+    return -1;
+
+  if (frame < video_start_)
+    frame = video_start_;
+
+  /* The first video frame has a marker, then every lipsync_step_ frames */
+  steps = (frame - video_start_ + lipsync_step_ - 1) / lipsync_step_;
+  result = video_start_ + steps * lipsync_step_;
+
+  if (post_start_ >= 0 && result >= post_start_)
+    return -1;
+
+  return result;
+}
+
+void OFTVG_Timeline::set_end(GstClockTime time)
+{
+  g_mutex_lock(&lock_);
+  if (!GST_CLOCK_TIME_IS_VALID(end_time_) || time < end_time_)
+  {
+    end_time_ = time;
+  }
+  g_cond_broadcast(&cond_);
+  g_mutex_unlock(&lock_);
+}
+
+GstClockTime OFTVG_Timeline::end_time() const
+{
+  GstClockTime result;
+
+  g_mutex_lock(&lock_);
+  result = end_time_;
+  g_mutex_unlock(&lock_);
+
+  return result;
+}
+
+void OFTVG_Timeline::set_position(GstClockTime time)
+{
+  g_mutex_lock(&lock_);
+
+  /* Nobody needs to wait for the video if the end is known in advance */
+  if (end_frame_ < 0)
+  {
+    position_ = time;
+    if (g_atomic_int_get(&waiting_))
+    {
+      g_cond_broadcast(&cond_);
+    }
+  }
+
+  g_mutex_unlock(&lock_);
+}
+
+bool OFTVG_Timeline::wait_position(GstClockTime time)
+{
+  bool status;
+
+  g_mutex_lock(&lock_);
+  while (!cancelled_ && !GST_CLOCK_TIME_IS_VALID(end_time_) && position_ < time)
+  {
+    g_atomic_int_inc(&waiting_);
+    g_cond_wait(&cond_, &lock_);
+    g_atomic_int_add(&waiting_, -1);
+  }
+  status = !cancelled_;
+  g_mutex_unlock(&lock_);
+
+  return status;
+}
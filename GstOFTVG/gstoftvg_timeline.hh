@@ -0,0 +1,141 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * Timeline of the output video, shared by the video and audio elements.
+ *
+ * The segments (calibration, video, postcalibration) and the lipsync
+ * frames are a function of the element properties and the frame rate
+ * only, so they are computed once when the first video frame arrives.
+ * After that, the audio element can place the beeps without waiting
+ * for the video thread. The only thing that has to be passed between
+ * the threads later is the end of the stream, and only when it depends
+ * on where the input video ends.
+ */
+
+#ifndef __GSTOFTVG_TIMELINE_HH__
+#define __GSTOFTVG_TIMELINE_HH__
+
+#include <gst/gst.h>
+#include "gstoftvg_video.hh"
+
+namespace OFTVG
+{
+  /* Element properties that affect the timeline */
+  struct TimelineParams
+  {
+    int pre_white_duration;  /* ms */
+    int pre_marks_duration;  /* ms */
+    int post_white_duration; /* ms */
+    int lipsync;             /* ms, <= 0 to disable */
+    int num_buffers;         /* video frames, <= 0 for whole input */
+    bool only_calibration;
+  };
+};
+
+class OFTVG_Timeline
+{
+public:
+  OFTVG_Timeline();
+  ~OFTVG_Timeline();
+
+  /// Forget the previous stream. Called when the video element starts.
+  void reset();
+
+  /// Compute the timeline. Called by the video element for its first frame.
+  /// When several video elements share the timeline, the first call wins.
+  /// origin:         running time of the first frame
+  /// frame_num/den:  duration of a frame in ns is frame_num / frame_den
+  /// end_of_video:   duration of the input video, or GST_CLOCK_TIME_NONE
+  void start(const OFTVG::TimelineParams &params, GstClockTime origin,
+             guint64 frame_num, guint64 frame_den, GstClockTime end_of_video);
+
+  /// Wait until start() has been called. Returns false if cancelled.
+  bool wait_started();
+
+  /// Wake up and fail all waits, used when the pipeline is stopping.
+  void cancel();
+
+  /// Allow waiting again after cancel(), used after a flush.
+  void resume();
+
+  /// Start time of a frame
+  GstClockTime frame_time(gint64 frame) const;
+
+  /// Frame that contains the given time
+  gint64 frame_at(GstClockTime time) const;
+
+  /// Segment that a frame belongs to
+  enum state_t state_at(gint64 frame) const;
+
+  /// First lipsync frame at or after 'frame', or -1 if there are none.
+  gint64 next_lipsync_frame(gint64 frame) const;
+
+  /// First frame of the video segment. Frame ID markers count from here.
+  gint64 video_start_frame() const { return video_start_; }
+
+  /// Frames between lipsync markers
+  gint64 lipsync_step() const { return lipsync_step_; }
+
+  /// Publish the end of the stream. Called by the video element when it
+  /// stops, needed if the end was not known in advance.
+  void set_end(GstClockTime time);
+
+  /// End time of the stream, or GST_CLOCK_TIME_NONE if not yet known.
+  GstClockTime end_time() const;
+
+  /// Publish how far the video has been processed. Only matters when
+  /// the end of the stream is not known in advance.
+  void set_position(GstClockTime time);
+
+  /// Wait until the video has been processed up to 'time' or the end
+  /// of the stream is known. Returns false if cancelled. Only used by
+  /// oftvg_audiosrc, which has no input to pace the generated audio;
+  /// input audio is passed on and cut at the end published by set_end().
+  bool wait_position(GstClockTime time);
+
+private:
+  mutable GMutex lock_;
+  GCond cond_;
+  bool started_;
+  bool cancelled_;
+  volatile gint waiting_;
+
+  OFTVG::TimelineParams params_;
+  GstClockTime origin_;
+  guint64 frame_num_;
+  guint64 frame_den_;
+
+  /* First frame of each segment, -1 if not known in advance */
+  gint64 marks_start_;
+  gint64 video_start_;
+  gint64 post_start_;
+  gint64 end_frame_;
+
+  /* Frames between lipsync markers */
+  gint64 lipsync_step_;
+
+  GstClockTime end_time_;
+  GstClockTime position_;
+
+  gint64 frames_for(GstClockTime duration) const;
+};
+
+#endif /* __GSTOFTVG_TIMELINE_HH__ */
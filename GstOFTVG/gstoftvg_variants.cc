@@ -0,0 +1,645 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * SECTION:element-oftvg_variants
+ *
+ * Produces several differently laid out test videos from a single decoded
+ * input. Each entry in the 'variants' property creates one branch with its
+ * own oftvg element. The entries are separated by ';' and have the form
+ * LAYOUT[@WIDTHxHEIGHT]. An empty LAYOUT uses the 'location' property, and
+ * if the resolution is omitted the video is not scaled. The other properties,
+ * including the audio ones, are the same as on oftvg and apply to every branch.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 filesrc location=in.mp4 ! autoaudio_decodebin name=d
+ *   d.video ! queue ! v.sink  d.audio ! audioconvert ! queue ! v.asink
+ *   oftvg_variants name=v variants="a.bmp@1280x720;b.bmp@3840x2160"
+ *   v.src_0 ! ... v.asrc_0 ! ...  v.src_1 ! ... v.asrc_1 ! ...
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include <config.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include "gstoftvg_variants.hh"
+#include "gstoftvg_audio.hh"
+#include "gstoftvg_timeline.hh"
+#include "gstoftvg.hh"
+
+/* Debug category to use */
+GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
+#define GST_CAT_DEFAULT gst_oftvg_debug
+
+/* Identifier numbers for properties */
+enum
+{
+  PROP_0,
+  PROP_VARIANTS,
+  PROP_BEEP_CHANNELS,
+  PROP_CODED_BEEPS,
+  PROP_GENERATE_AUDIO,
+#define PROP_STR(up,name,desc,def) PROP_ ## up,
+#define PROP_INT(up,name,desc,def) PROP_ ## up,
+#define PROP_BOOL(up,name,desc,def) PROP_ ## up,
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+};
+
+/* Elements that make up a single branch */
+typedef struct {
+  GstElement *video_queue;
+  GstElement *videoscale;  /* NULL if the video is not scaled */
+  GstElement *capsfilter;  /* NULL if the video is not scaled */
+  GstElement *audio_queue;
+  GstElement *oftvg;
+  GstPad *video_src;       /* Ghost pads on the bin */
+  GstPad *audio_src;
+  bool own_location;       /* Layout given in the variant entry */
+} variant_branch_t;
+
+/* Templates for the per-branch source pads */
+static GstStaticPadTemplate video_src_template =
+GST_STATIC_PAD_TEMPLATE (
+  "src_%u",
+  GST_PAD_SRC,
+  GST_PAD_SOMETIMES,
+  GST_STATIC_CAPS ("ANY")
+);
+
+static GstStaticPadTemplate audio_src_template =
+GST_STATIC_PAD_TEMPLATE (
+  "asrc_%u",
+  GST_PAD_SRC,
+  GST_PAD_SOMETIMES,
+  GST_STATIC_CAPS ("ANY")
+);
+
+/* Definition of the GObject subtype. We inherit from GstBin. */
+static void gst_oftvg_variants_class_init (GstOFTVG_VariantsClass* klass);
+static void gst_oftvg_variants_init (GstOFTVG_Variants* filter);
+G_DEFINE_TYPE (GstOFTVG_Variants, gst_oftvg_variants, GST_TYPE_BIN);
+
+/* Prototypes for the overridden methods */
+static void gst_oftvg_variants_finalize (GObject * object);
+static void gst_oftvg_variants_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_oftvg_variants_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn gst_oftvg_variants_change_state (GstElement *element, GstStateChange transition);
+
+/* Creation and removal of the branches */
+static bool build_branches (GstOFTVG_Variants *filter);
+static void clear_branches (GstOFTVG_Variants *filter);
+
+/* Initializer for the class type */
+static void gst_oftvg_variants_class_init (GstOFTVG_VariantsClass* klass)
+{
+  /* GObject method overrides */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+
+    gobject_class->set_property = gst_oftvg_variants_set_property;
+    gobject_class->get_property = gst_oftvg_variants_get_property;
+    gobject_class->finalize     = gst_oftvg_variants_finalize;
+  }
+
+  /* GstElement method overrides */
+  {
+    GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+    element_class->change_state = GST_DEBUG_FUNCPTR(gst_oftvg_variants_change_state);
+  }
+
+  /* Element metadata */
+  {
+    GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+    gst_element_class_set_metadata (element_class,
+      "OptoFidelity test video generator, multiple variants",
+      "Filter/Editor/Video",
+      "Generates several test video variants from a single decoded input",
+      "OptoFidelity <info@optofidelity.com>");
+  }
+
+  /* Sink pads are the same as on the video and audio elements */
+  {
+    GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+    GstElementClass *video_class = GST_ELEMENT_CLASS(g_type_class_ref(GST_TYPE_OFTVG_VIDEO));
+    GstElementClass *audio_class = GST_ELEMENT_CLASS(g_type_class_ref(GST_TYPE_OFTVG_AUDIO));
+    GstPadTemplate* pad;
+
+    gst_element_class_add_pad_template(element_class,
+      gst_element_class_get_pad_template(video_class, "sink"));
+
+    pad = gst_element_class_get_pad_template(audio_class, "sink");
+    gst_element_class_add_pad_template(element_class,
+      gst_pad_template_new("asink", pad->direction, pad->presence, pad->caps)
+    );
+
+    gst_element_class_add_pad_template(element_class,
+      gst_static_pad_template_get(&video_src_template));
+    gst_element_class_add_pad_template(element_class,
+      gst_static_pad_template_get(&audio_src_template));
+
+    g_type_class_unref(video_class);
+    g_type_class_unref(audio_class);
+  }
+
+  /* Element properties */
+  {
+    GObjectClass *gobject_class = (GObjectClass *) klass;
+
+    g_object_class_install_property(gobject_class, PROP_VARIANTS,
+      g_param_spec_string("variants", "variants",
+                          "List of variants to generate, in format LAYOUT[@WIDTHxHEIGHT];...",
+                          "", (GParamFlags)(G_PARAM_READWRITE))
+    );
+
+    /* The audio properties have the same descriptions as on oftvg */
+    {
+      GObjectClass *oftvg_class = G_OBJECT_CLASS(g_type_class_ref(GST_TYPE_OFTVG));
+
+      g_object_class_install_property(gobject_class, PROP_BEEP_CHANNELS,
+        g_param_spec_uint64("beep-channels", "beep-channels",
+                            g_param_spec_get_blurb(g_object_class_find_property(oftvg_class, "beep-channels")),
+                            0, G_MAXUINT64, 0, (GParamFlags)(G_PARAM_READWRITE))
+      );
+      g_object_class_install_property(gobject_class, PROP_CODED_BEEPS,
+        g_param_spec_boolean("coded-beeps", "coded-beeps",
+                             g_param_spec_get_blurb(g_object_class_find_property(oftvg_class, "coded-beeps")),
+                             FALSE, (GParamFlags)(G_PARAM_READWRITE))
+      );
+      g_object_class_install_property(gobject_class, PROP_GENERATE_AUDIO,
+        g_param_spec_boolean("generate-audio", "generate-audio",
+                             g_param_spec_get_blurb(g_object_class_find_property(oftvg_class, "generate-audio")),
+                             FALSE, (GParamFlags)(G_PARAM_READWRITE))
+      );
+
+      g_type_class_unref(oftvg_class);
+    }
+
+#define PROP_STR(up,name,desc,def) \
+  g_object_class_install_property(gobject_class, PROP_ ## up, \
+    g_param_spec_string(#name, #name, desc, def, (GParamFlags)(G_PARAM_READWRITE)) \
+  );
+#define PROP_INT(up,name,desc,def) \
+  g_object_class_install_property(gobject_class, PROP_ ## up, \
+    g_param_spec_int(#name, #name, desc, G_MININT, G_MAXINT, def, (GParamFlags)(G_PARAM_READWRITE)) \
+  );
+#define PROP_BOOL(up,name,desc,def) \
+  g_object_class_install_property(gobject_class, PROP_ ## up, \
+    g_param_spec_boolean(#name, #name, desc, def, (GParamFlags)(G_PARAM_READWRITE)) \
+  );
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+  }
+}
+
+/* Initializer for class instances */
+static void gst_oftvg_variants_init (GstOFTVG_Variants* filter)
+{
+  GstPad* pad;
+
+  /* Set all properties to default values */
+  filter->variants = g_strdup("");
+  filter->beep_channels = 0;
+  filter->coded_beeps = FALSE;
+  filter->generate_audio = FALSE;
+#define PROP_STR(up,name,desc,def) filter->name = g_strdup(def);
+#define PROP_INT(up,name,desc,def) filter->name = def;
+#define PROP_BOOL(up,name,desc,def) filter->name = def;
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+
+  filter->branches = g_ptr_array_new_with_free_func(g_free);
+  filter->timeline = new OFTVG_Timeline();
+
+  /* The tees are always present, branches are added when 'variants' is set */
+  filter->video_tee = gst_element_factory_make("tee", "videotee");
+  gst_bin_add(GST_BIN(filter), filter->video_tee);
+  filter->audio_tee = gst_element_factory_make("tee", "audiotee");
+  gst_bin_add(GST_BIN(filter), filter->audio_tee);
+
+  pad = gst_element_get_static_pad(filter->video_tee, "sink");
+  gst_element_add_pad(GST_ELEMENT(filter), gst_ghost_pad_new ("sink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+  pad = gst_element_get_static_pad(filter->audio_tee, "sink");
+  gst_element_add_pad(GST_ELEMENT(filter), gst_ghost_pad_new ("asink", pad));
+  gst_object_unref(GST_OBJECT(pad));
+}
+
+static void gst_oftvg_variants_finalize (GObject *object)
+{
+  GstOFTVG_Variants *filter = GST_OFTVG_VARIANTS(object);
+
+  g_ptr_array_unref(filter->branches);
+  filter->branches = NULL;
+  delete filter->timeline;
+  filter->timeline = NULL;
+  g_free(filter->variants);
+#define PROP_STR(up,name,desc,def) g_free(filter->name);
+#define PROP_INT(up,name,desc,def)
+#define PROP_BOOL(up,name,desc,def)
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+
+  G_OBJECT_CLASS(gst_oftvg_variants_parent_class)->finalize(object);
+}
+
+/* Property setting. The common properties are stored and passed on to the
+ * oftvg element of every branch. */
+static void gst_oftvg_variants_set_property (GObject *object, guint prop_id,
+                                             const GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_Variants *filter = GST_OFTVG_VARIANTS(object);
+  guint i;
+
+  switch (prop_id) {
+    case PROP_VARIANTS:
+      if (GST_STATE(filter) != GST_STATE_NULL)
+      {
+        GST_WARNING_OBJECT(filter, "Variants can only be changed in NULL state");
+        break;
+      }
+
+      g_free(filter->variants);
+      filter->variants = g_value_dup_string(value);
+      clear_branches(filter);
+      if (!build_branches(filter))
+      {
+        clear_branches(filter);
+      }
+      break;
+
+    case PROP_BEEP_CHANNELS:
+      filter->beep_channels = g_value_get_uint64(value);
+      for (i = 0; i < filter->branches->len; i++)
+      {
+        variant_branch_t *branch = (variant_branch_t*)g_ptr_array_index(filter->branches, i);
+        g_object_set(branch->oftvg, "beep-channels", filter->beep_channels, NULL);
+      }
+      break;
+
+    case PROP_CODED_BEEPS:
+      filter->coded_beeps = g_value_get_boolean(value);
+      for (i = 0; i < filter->branches->len; i++)
+      {
+        variant_branch_t *branch = (variant_branch_t*)g_ptr_array_index(filter->branches, i);
+        g_object_set(branch->oftvg, "coded-beeps", filter->coded_beeps, NULL);
+      }
+      break;
+
+    case PROP_GENERATE_AUDIO:
+      filter->generate_audio = g_value_get_boolean(value);
+      for (i = 0; i < filter->branches->len; i++)
+      {
+        variant_branch_t *branch = (variant_branch_t*)g_ptr_array_index(filter->branches, i);
+        g_object_set(branch->oftvg, "generate-audio", filter->generate_audio, NULL);
+      }
+      break;
+
+#define PROP_STR(up,name,desc,def) \
+    case PROP_ ## up: \
+      g_free(filter->name); \
+      filter->name = g_value_dup_string(value); \
+      for (i = 0; i < filter->branches->len; i++) \
+      { \
+        variant_branch_t *branch = (variant_branch_t*)g_ptr_array_index(filter->branches, i); \
+        if (prop_id != PROP_LOCATION || !branch->own_location) \
+          g_object_set(branch->oftvg, #name, filter->name, NULL); \
+      } \
+      break;
+#define PROP_INT(up,name,desc,def) \
+    case PROP_ ## up: \
+      filter->name = g_value_get_int(value); \
+      for (i = 0; i < filter->branches->len; i++) \
+      { \
+        variant_branch_t *branch = (variant_branch_t*)g_ptr_array_index(filter->branches, i); \
+        g_object_set(branch->oftvg, #name, filter->name, NULL); \
+      } \
+      break;
+#define PROP_BOOL(up,name,desc,def) \
+    case PROP_ ## up: \
+      filter->name = g_value_get_boolean(value); \
+      for (i = 0; i < filter->branches->len; i++) \
+      { \
+        variant_branch_t *branch = (variant_branch_t*)g_ptr_array_index(filter->branches, i); \
+        g_object_set(branch->oftvg, #name, filter->name, NULL); \
+      } \
+      break;
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Property getting */
+static void gst_oftvg_variants_get_property (GObject *object, guint prop_id,
+                                             GValue *value, GParamSpec *pspec)
+{
+  GstOFTVG_Variants *filter = GST_OFTVG_VARIANTS(object);
+
+  switch (prop_id) {
+    case PROP_VARIANTS: g_value_set_string(value, filter->variants); break;
+    case PROP_BEEP_CHANNELS: g_value_set_uint64(value, filter->beep_channels); break;
+    case PROP_CODED_BEEPS: g_value_set_boolean(value, filter->coded_beeps); break;
+    case PROP_GENERATE_AUDIO: g_value_set_boolean(value, filter->generate_audio); break;
+#define PROP_STR(up,name,desc,def)  case PROP_ ## up: g_value_set_string(value, filter->name); break;
+#define PROP_INT(up,name,desc,def)  case PROP_ ## up: g_value_set_int(value, filter->name); break;
+#define PROP_BOOL(up,name,desc,def) case PROP_ ## up: g_value_set_boolean(value, filter->name); break;
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Refuse to start without any branches, the tees would have nowhere to go */
+static GstStateChangeReturn gst_oftvg_variants_change_state (GstElement *element, GstStateChange transition)
+{
+  GstOFTVG_Variants *filter = GST_OFTVG_VARIANTS(element);
+
+  if (transition == GST_STATE_CHANGE_NULL_TO_READY && filter->branches->len == 0)
+  {
+    GST_ELEMENT_ERROR(filter, RESOURCE, SETTINGS,
+                      ("No valid variants given: '%s'", filter->variants), (NULL));
+    return GST_STATE_CHANGE_FAILURE;
+  }
+
+  return GST_ELEMENT_CLASS(gst_oftvg_variants_parent_class)->change_state(element, transition);
+}
+
+/* Parse one entry of the variants list: LAYOUT[@WIDTHxHEIGHT] */
+static bool parse_variant (const gchar *entry, gchar **location, int *width, int *height)
+{
+  const gchar *at = strrchr(entry, '@');
+  *width = 0;
+  *height = 0;
+
+  if (at != NULL)
+  {
+    char extra;
+    if (sscanf(at + 1, "%dx%d%c", width, height, &extra) != 2 || *width <= 0 || *height <= 0)
+    {
+      GST_ERROR("Invalid resolution in variant '%s'", entry);
+      return false;
+    }
+    *location = g_strndup(entry, at - entry);
+  }
+  else
+  {
+    *location = g_strdup(entry);
+  }
+
+  g_strstrip(*location);
+  return true;
+}
+
+/* Create the elements for one variant and link them to the tees */
+static bool add_branch (GstOFTVG_Variants *filter, guint index,
+                        const gchar *location, int width, int height)
+{
+  variant_branch_t *branch = (variant_branch_t*)g_malloc0(sizeof(variant_branch_t));
+  gchar *name;
+
+  name = g_strdup_printf("videoqueue%u", index);
+  branch->video_queue = gst_element_factory_make("queue", name);
+  g_free(name);
+  name = g_strdup_printf("audioqueue%u", index);
+  branch->audio_queue = gst_element_factory_make("queue", name);
+  g_free(name);
+  name = g_strdup_printf("oftvg%u", index);
+  branch->oftvg = gst_element_factory_make("oftvg", name);
+  g_free(name);
+
+  if (width > 0)
+  {
+    name = g_strdup_printf("videoscale%u", index);
+    branch->videoscale = gst_element_factory_make("videoscale", name);
+    g_free(name);
+    name = g_strdup_printf("capsfilter%u", index);
+    branch->capsfilter = gst_element_factory_make("capsfilter", name);
+    g_free(name);
+  }
+
+  if (!branch->video_queue || !branch->audio_queue || !branch->oftvg ||
+      (width > 0 && (!branch->videoscale || !branch->capsfilter)))
+  {
+    GST_ERROR("Could not create elements for variant %u", index);
+    if (branch->video_queue) gst_object_unref(branch->video_queue);
+    if (branch->audio_queue) gst_object_unref(branch->audio_queue);
+    if (branch->oftvg) gst_object_unref(branch->oftvg);
+    if (branch->videoscale) gst_object_unref(branch->videoscale);
+    if (branch->capsfilter) gst_object_unref(branch->capsfilter);
+    g_free(branch);
+    return false;
+  }
+
+  /* From here on the bin owns the elements and clear_branches() removes them */
+  g_ptr_array_add(filter->branches, branch);
+  gst_bin_add_many(GST_BIN(filter), branch->video_queue, branch->audio_queue,
+                   branch->oftvg, NULL);
+
+  /* The first branch to get a frame lays out the timeline for all */
+  gst_oftvg_set_timeline(GST_OFTVG(branch->oftvg), filter->timeline);
+
+  /* Apply the common properties, then the per-variant layout */
+#define PROP_STR(up,name,desc,def)  g_object_set(branch->oftvg, #name, filter->name, NULL);
+#define PROP_INT(up,name,desc,def)  g_object_set(branch->oftvg, #name, filter->name, NULL);
+#define PROP_BOOL(up,name,desc,def) g_object_set(branch->oftvg, #name, filter->name, NULL);
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+
+  g_object_set(branch->oftvg, "beep-channels", filter->beep_channels,
+               "coded-beeps", filter->coded_beeps,
+               "generate-audio", filter->generate_audio, NULL);
+
+  if (location != NULL && location[0] != '\0')
+  {
+    g_object_set(branch->oftvg, "location", location, NULL);
+    branch->own_location = true;
+  }
+
+  /* Video path: tee ! queue [! videoscale ! capsfilter] ! oftvg */
+  if (!gst_element_link(filter->video_tee, branch->video_queue))
+    return false;
+
+  if (width > 0)
+  {
+    GstCaps *caps = gst_caps_new_simple("video/x-raw",
+                                        "width", G_TYPE_INT, width,
+                                        "height", G_TYPE_INT, height,
+                                        NULL);
+    g_object_set(branch->capsfilter, "caps", caps, NULL);
+    gst_caps_unref(caps);
+
+    gst_bin_add_many(GST_BIN(filter), branch->videoscale, branch->capsfilter, NULL);
+    if (!gst_element_link_many(branch->video_queue, branch->videoscale, branch->capsfilter, NULL) ||
+        !gst_element_link_pads(branch->capsfilter, "src", branch->oftvg, "sink"))
+      return false;
+  }
+  else
+  {
+    if (!gst_element_link_pads(branch->video_queue, "src", branch->oftvg, "sink"))
+      return false;
+  }
+
+  /* Audio path: tee ! queue ! oftvg.asink */
+  if (!gst_element_link(filter->audio_tee, branch->audio_queue) ||
+      !gst_element_link_pads(branch->audio_queue, "src", branch->oftvg, "asink"))
+    return false;
+
+  /* Expose the outputs of the branch */
+  {
+    GstElementClass *klass = GST_ELEMENT_GET_CLASS(filter);
+    GstPad *pad;
+
+    pad = gst_element_get_static_pad(branch->oftvg, "src");
+    name = g_strdup_printf("src_%u", index);
+    branch->video_src = gst_ghost_pad_new_from_template(name, pad,
+                          gst_element_class_get_pad_template(klass, "src_%u"));
+    gst_element_add_pad(GST_ELEMENT(filter), branch->video_src);
+    gst_object_unref(GST_OBJECT(pad));
+    g_free(name);
+
+    pad = gst_element_get_static_pad(branch->oftvg, "asrc");
+    name = g_strdup_printf("asrc_%u", index);
+    branch->audio_src = gst_ghost_pad_new_from_template(name, pad,
+                          gst_element_class_get_pad_template(klass, "asrc_%u"));
+    gst_element_add_pad(GST_ELEMENT(filter), branch->audio_src);
+    gst_object_unref(GST_OBJECT(pad));
+    g_free(name);
+  }
+
+  GST_DEBUG("Added variant %u: layout '%s', size %dx%d", index,
+            branch->own_location ? location : filter->location, width, height);
+  return true;
+}
+
+/* Create a branch for each entry in the variants list */
+static bool build_branches (GstOFTVG_Variants *filter)
+{
+  gchar **entries = g_strsplit(filter->variants, ";", -1);
+  bool ok = true;
+  guint index = 0;
+
+  for (gchar **p = entries; *p != NULL && ok; p++)
+  {
+    gchar *location;
+    int width, height;
+
+    if (g_strstrip(*p)[0] == '\0')
+      continue;
+
+    if (!parse_variant(*p, &location, &width, &height))
+    {
+      ok = false;
+    }
+    else
+    {
+      ok = add_branch(filter, index++, location, width, height);
+      if (!ok)
+        GST_ERROR("Could not build the pipeline for variant '%s'", *p);
+      g_free(location);
+    }
+  }
+
+  g_strfreev(entries);
+  return ok;
+}
+
+/* Unlink a queue from the tee that feeds it and release the tee pad */
+static void release_tee_pad (GstElement *tee, GstElement *queue)
+{
+  GstPad *sinkpad = gst_element_get_static_pad(queue, "sink");
+  GstPad *teepad = gst_pad_get_peer(sinkpad);
+
+  if (teepad != NULL)
+  {
+    gst_pad_unlink(teepad, sinkpad);
+    gst_element_release_request_pad(tee, teepad);
+    gst_object_unref(teepad);
+  }
+
+  gst_object_unref(sinkpad);
+}
+
+/* Remove all branches from the bin */
+static void clear_branches (GstOFTVG_Variants *filter)
+{
+  guint i;
+
+  for (i = 0; i < filter->branches->len; i++)
+  {
+    variant_branch_t *branch = (variant_branch_t*)g_ptr_array_index(filter->branches, i);
+
+    if (branch->video_src)
+      gst_element_remove_pad(GST_ELEMENT(filter), branch->video_src);
+    if (branch->audio_src)
+      gst_element_remove_pad(GST_ELEMENT(filter), branch->audio_src);
+
+    release_tee_pad(filter->video_tee, branch->video_queue);
+    release_tee_pad(filter->audio_tee, branch->audio_queue);
+
+    gst_bin_remove(GST_BIN(filter), branch->video_queue);
+    gst_bin_remove(GST_BIN(filter), branch->audio_queue);
+    gst_bin_remove(GST_BIN(filter), branch->oftvg);
+    if (branch->videoscale)
+    {
+      /* Added to the bin only after the elements before it */
+      if (GST_OBJECT_PARENT(branch->videoscale) == GST_OBJECT(filter))
+      {
+        gst_bin_remove(GST_BIN(filter), branch->videoscale);
+        gst_bin_remove(GST_BIN(filter), branch->capsfilter);
+      }
+      else
+      {
+        gst_object_unref(branch->videoscale);
+        gst_object_unref(branch->capsfilter);
+      }
+    }
+  }
+
+  g_ptr_array_set_size(filter->branches, 0);
+}
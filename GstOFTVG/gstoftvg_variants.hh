@@ -0,0 +1,89 @@
+/*
+ * OptoFidelity Test Video Generator
+ * Copyright (C) 2011 OptoFidelity <info@optofidelity.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/* This bin takes one decoded video/audio stream and fans it out to several
+ * oftvg elements, each with its own layout and output resolution. All the
+ * branches share one timeline, so their calibration segments and lipsync
+ * markers line up.
+ */
+
+#ifndef __GST_OFTVG_VARIANTS_HH__
+#define __GST_OFTVG_VARIANTS_HH__
+
+#include <gst/gst.h>
+#include <gst/gstbin.h>
+#include "gstoftvg_video.hh"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_OFTVG_VARIANTS \
+  (gst_oftvg_variants_get_type())
+#define GST_OFTVG_VARIANTS(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OFTVG_VARIANTS,GstOFTVG_Variants))
+#define GST_OFTVG_VARIANTS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OFTVG_VARIANTS,GstOFTVG_VariantsClass))
+#define GST_IS_OFTVG_VARIANTS(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OFTVG_VARIANTS))
+#define GST_IS_OFTVG_VARIANTS_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OFTVG_VARIANTS))
+
+typedef struct _GstOFTVG_Variants      GstOFTVG_Variants;
+typedef struct _GstOFTVG_VariantsClass GstOFTVG_VariantsClass;
+
+struct _GstOFTVG_Variants {
+  GstBin bin;
+
+  /* Splits the incoming streams to the branches */
+  GstElement *video_tee;
+  GstElement *audio_tee;
+
+  /* The oftvg element of each branch, in the order given in 'variants' */
+  GPtrArray *branches;
+
+  /* Segments and lipsync frames, shared by all the branches */
+  OFTVG_Timeline *timeline;
+
+  /* Variant list, e.g. "a.bmp@1280x720;b.bmp@3840x2160" */
+  gchar *variants;
+
+  /* Audio properties of oftvg, also passed to every branch */
+  guint64 beep_channels;
+  gboolean coded_beeps;
+  gboolean generate_audio;
+
+  /* Properties that are passed to every branch */
+#define PROP_STR(up,name,desc,def) gchar *name;
+#define PROP_INT(up,name,desc,def) gint name;
+#define PROP_BOOL(up,name,desc,def) gboolean name;
+GSTOFTVG_VIDEO_PROPERTIES
+#undef PROP_STR
+#undef PROP_INT
+#undef PROP_BOOL
+};
+
+struct _GstOFTVG_VariantsClass {
+  GstBinClass parent_class;
+};
+
+GType gst_oftvg_variants_get_type (void);
+
+G_END_DECLS
+
+#endif /* __GST_OFTVG_VARIANTS_HH__ */
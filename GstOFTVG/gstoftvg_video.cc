@@ -25,6 +25,27 @@
  * frame id and synchronization markings to each frame. This element processes
  * the video stream.
  *
+ * Progress is reported with "oftvg-progress" element messages every
+ * progress_interval milliseconds and whenever the state changes. The
+ * message contains the fields state, frame, video-frame, running-time,
+ * fps, average-fps, eta, total-frames and percent. The last three are
+ * GST_CLOCK_TIME_NONE / -1 if the length of the input is not known.
+ *
+ * The time spent rendering each frame is collected per segment into the
+ * read-only "stats" property, and posted as an "oftvg-stats" element
+ * message at end of stream.
+ *
+ * The calibration segments and the lipsync frames are laid out on a
+ * timeline when the first frame arrives, based on the properties and the
+ * framerate. The oftvg bin gives the same timeline to the audio element,
+ * so it can place the beeps without waiting for the video.
+ *
+ * With the convert property, the element also scales and converts the
+ * video to the format and size that downstream asks for, which replaces
+ * separate videoscale and videoconvert elements. The markers are drawn
+ * after the conversion, with the layout rendered at the output size, so
+ * they stay pixel-exact in the output format.
+ *
  * <refsect2>
  * <title>Example launch line</title>
  * |[
@@ -40,6 +61,8 @@
 #include <gst/gst.h>
 #include "gstoftvg_video.hh"
 #include "gstoftvg_video_process.hh"
+#include "gstoftvg_stats.hh"
+#include "gstoftvg_timeline.hh"
 
 /* Debug category to use */
 GST_DEBUG_CATEGORY_EXTERN(gst_oftvg_debug);
@@ -66,35 +89,21 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_STR
 #undef PROP_INT
 #undef PROP_BOOL
+  PROP_STATS
 };
 
 /* Templates for the sink and source pins.
  *
  * The sink pin supports any most raw video formats.
- * The source pin will have the same format as the sink at runtime.
+ * The source pin will have the same format as the sink at runtime,
+ * unless the convert property is set.
  */
 static GstStaticPadTemplate sink_template =
 GST_STATIC_PAD_TEMPLATE (
   "sink",
   GST_PAD_SINK,
   GST_PAD_ALWAYS,
-  GST_STATIC_CAPS(
-    GST_VIDEO_CAPS_MAKE("AYUV") ";"
-    GST_VIDEO_CAPS_MAKE("Y444") ";"
-    GST_VIDEO_CAPS_MAKE("Y42B") ";"
-    GST_VIDEO_CAPS_MAKE("I420") ";"
-    GST_VIDEO_CAPS_MAKE("YV12") ";"
-    GST_VIDEO_CAPS_MAKE("Y41B") ";"
-    GST_VIDEO_CAPS_MAKE("YUY2") ";"
-    GST_VIDEO_CAPS_MAKE("YVYU") ";"
-    GST_VIDEO_CAPS_MAKE("UYVY") ";"
-    GST_VIDEO_CAPS_MAKE("RGB")  ";"
-    GST_VIDEO_CAPS_MAKE("RGBx") ";"
-    GST_VIDEO_CAPS_MAKE("xRGB") ";"
-    GST_VIDEO_CAPS_MAKE("BGR")  ";"
-    GST_VIDEO_CAPS_MAKE("BGRx") ";"
-    GST_VIDEO_CAPS_MAKE("xBGR") ";"
-  )
+  GST_STATIC_CAPS(GSTOFTVG_VIDEO_SINK_CAPS)
 );
 
 static GstStaticPadTemplate src_template =
@@ -105,6 +114,10 @@ GST_STATIC_PAD_TEMPLATE (
   GST_STATIC_CAPS ("ANY")
 );
 
+/* Formats that the markers can be drawn in, on either side of the
+ * conversion */
+static GstStaticCaps markable_caps = GST_STATIC_CAPS(GSTOFTVG_VIDEO_SINK_CAPS);
+
 /* Definition of the GObject subtype. We inherit from GstBaseTransform, which
  * does most of the events and caps negotiation for us. */
 static void gst_oftvg_video_class_init(GstOFTVG_VideoClass* klass);
@@ -114,11 +127,21 @@ G_DEFINE_TYPE (GstOFTVG_Video, gst_oftvg_video, GST_TYPE_BASE_TRANSFORM);
 /* Prototypes for the overridden methods */
 static void gst_oftvg_video_set_property (GObject * object, guint prop_id, const GValue * value, GParamSpec * pspec);
 static void gst_oftvg_video_get_property (GObject * object, guint prop_id, GValue * value, GParamSpec * pspec);
+static void gst_oftvg_video_finalize (GObject * object);
 static gboolean gst_oftvg_video_start(GstBaseTransform* btrans);
 static gboolean gst_oftvg_video_stop(GstBaseTransform* btrans);
 static gboolean gst_oftvg_video_sink_event(GstBaseTransform *object, GstEvent *event);
 static gboolean gst_oftvg_video_set_caps(GstBaseTransform* btrans, GstCaps* incaps, GstCaps* outcaps);
 static GstFlowReturn gst_oftvg_video_transform_ip (GstBaseTransform * base, GstBuffer * outbuf);
+static GstCaps *gst_oftvg_video_transform_caps(GstBaseTransform *btrans, GstPadDirection direction,
+                                               GstCaps *caps, GstCaps *filter_caps);
+static GstCaps *gst_oftvg_video_fixate_caps(GstBaseTransform *btrans, GstPadDirection direction,
+                                            GstCaps *caps, GstCaps *othercaps);
+static gboolean gst_oftvg_video_get_unit_size(GstBaseTransform *btrans, GstCaps *caps, gsize *size);
+static GstFlowReturn gst_oftvg_video_transform(GstBaseTransform *btrans, GstBuffer *inbuf, GstBuffer *outbuf);
+
+/* Build the structure for the "stats" property */
+static GstStructure *gst_oftvg_video_get_stats(GstOFTVG_Video *filter);
 
 /* Initializer for the class type */
 static void gst_oftvg_video_class_init (GstOFTVG_VideoClass * klass)
@@ -129,17 +152,22 @@ static void gst_oftvg_video_class_init (GstOFTVG_VideoClass * klass)
     
     gobject_class->set_property = gst_oftvg_video_set_property;
     gobject_class->get_property = gst_oftvg_video_get_property;
+    gobject_class->finalize     = gst_oftvg_video_finalize;
   }
   
   /* GstBaseTransform method overrides */
   {
     GstBaseTransformClass* btrans = GST_BASE_TRANSFORM_CLASS(klass);
     
-    btrans->transform_ip = GST_DEBUG_FUNCPTR(gst_oftvg_video_transform_ip);
-    btrans->set_caps     = GST_DEBUG_FUNCPTR(gst_oftvg_video_set_caps);
-    btrans->start        = GST_DEBUG_FUNCPTR(gst_oftvg_video_start);
-    btrans->stop         = GST_DEBUG_FUNCPTR(gst_oftvg_video_stop);
-    btrans->sink_event   = GST_DEBUG_FUNCPTR(gst_oftvg_video_sink_event);
+    btrans->transform_ip   = GST_DEBUG_FUNCPTR(gst_oftvg_video_transform_ip);
+    btrans->transform      = GST_DEBUG_FUNCPTR(gst_oftvg_video_transform);
+    btrans->transform_caps = GST_DEBUG_FUNCPTR(gst_oftvg_video_transform_caps);
+    btrans->fixate_caps    = GST_DEBUG_FUNCPTR(gst_oftvg_video_fixate_caps);
+    btrans->get_unit_size  = GST_DEBUG_FUNCPTR(gst_oftvg_video_get_unit_size);
+    btrans->set_caps       = GST_DEBUG_FUNCPTR(gst_oftvg_video_set_caps);
+    btrans->start          = GST_DEBUG_FUNCPTR(gst_oftvg_video_start);
+    btrans->stop           = GST_DEBUG_FUNCPTR(gst_oftvg_video_stop);
+    btrans->sink_event     = GST_DEBUG_FUNCPTR(gst_oftvg_video_sink_event);
   }
   
   /* Element metadata */
@@ -195,6 +223,11 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_STR
 #undef PROP_INT
 #undef PROP_BOOL
+    
+    g_object_class_install_property(gobject_class, PROP_STATS,
+      g_param_spec_boxed("stats", "stats", "Render-time statistics of the element",
+                         GST_TYPE_STRUCTURE, (GParamFlags)(G_PARAM_READABLE))
+    );
   }
 }
 
@@ -209,6 +242,26 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_STR
 #undef PROP_INT
 #undef PROP_BOOL
+  
+  filter->process = NULL;
+  filter->converter = NULL;
+  filter->stats = new OFTVG_Stats();
+  filter->own_timeline = new OFTVG_Timeline();
+  filter->timeline = filter->own_timeline;
+}
+
+/* Release the memory held by the instance */
+static void gst_oftvg_video_finalize (GObject *object)
+{
+  GstOFTVG_Video *filter = GST_OFTVG_VIDEO(object);
+  
+  delete filter->stats;
+  filter->stats = NULL;
+  delete filter->own_timeline;
+  filter->own_timeline = NULL;
+  filter->timeline = NULL;
+  
+  G_OBJECT_CLASS(gst_oftvg_video_parent_class)->finalize(object);
 }
 
 /* Property setting */
@@ -246,6 +299,10 @@ GSTOFTVG_VIDEO_PROPERTIES
 #undef PROP_STR
 #undef PROP_INT
 #undef PROP_BOOL
+    
+    case PROP_STATS:
+      g_value_take_boxed(value, gst_oftvg_video_get_stats(filter));
+      break;
 
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -262,32 +319,55 @@ static gboolean gst_oftvg_video_start(GstBaseTransform* object)
   filter->first = true;
   filter->last_state_change = 0;
   filter->end_of_video = G_MAXUINT64;
-  filter->progress_timestamp = 0;
-  filter->lipsync_timestamp = 0;
+  filter->total_frames = 0;
+  filter->frame_duration = GST_CLOCK_TIME_NONE;
+  filter->start_wallclock = 0;
+  filter->progress_wallclock = 0;
+  filter->progress_frames = 0;
+  filter->fps_n = 0;
+  filter->fps_d = 1;
   filter->process = new OFTVG_Video_Process();
- 
-  if (filter->pre_white_duration > 0)
-  {
-    filter->state = STATE_PRECALIBRATION_WHITE;
-  }
-  else if (filter->pre_marks_duration > 0)
-  {
-    filter->state = STATE_PRECALIBRATION_MARKS;
-  }
-  else if (!filter->only_calibration)
+  filter->stats->clear();
+  filter->timeline->reset();
+  
+  /* The actual state is taken from the timeline for each frame */
+  filter->state = STATE_PRECALIBRATION_WHITE;
+  
+  return true;
+}
+
+/* Lay out the segments and lipsync frames, starting from the first frame */
+static void start_timeline(GstOFTVG_Video *filter, GstClockTime origin, GstBuffer *buf)
+{
+  OFTVG::TimelineParams params;
+  guint64 frame_num, frame_den;
+  
+  params.pre_white_duration = filter->pre_white_duration;
+  params.pre_marks_duration = filter->pre_marks_duration;
+  params.post_white_duration = filter->post_white_duration;
+  params.lipsync = filter->lipsync;
+  params.num_buffers = filter->num_buffers;
+  params.only_calibration = filter->only_calibration;
+  
+  if (filter->fps_n > 0 && filter->fps_d > 0)
   {
-    filter->state = STATE_VIDEO;
+    frame_num = filter->fps_d * GST_SECOND;
+    frame_den = filter->fps_n;
   }
-  else if (filter->post_white_duration > 0)
+  else if (buf != NULL && GST_BUFFER_DURATION_IS_VALID(buf) && GST_BUFFER_DURATION(buf) > 0)
   {
-    filter->state = STATE_POSTCALIBRATION;
+    /* Variable framerate: use the duration of the first frame */
+    frame_num = GST_BUFFER_DURATION(buf);
+    frame_den = 1;
   }
   else
   {
-    filter->state = STATE_END;
+    GST_WARNING("Frame duration not known, assuming 30 fps");
+    frame_num = GST_SECOND;
+    frame_den = 30;
   }
   
-  return true;
+  filter->timeline->start(params, origin, frame_num, frame_den, filter->end_of_video);
 }
 
 /* Called when the pipeline is stopping */
@@ -297,6 +377,12 @@ static gboolean gst_oftvg_video_stop(GstBaseTransform* object)
   delete filter->process;
   filter->process = NULL;
   
+  if (filter->converter != NULL)
+  {
+    gst_video_converter_free(filter->converter);
+    filter->converter = NULL;
+  }
+  
   return true;
 }
 
@@ -304,11 +390,51 @@ static gboolean gst_oftvg_video_stop(GstBaseTransform* object)
 static gboolean gst_oftvg_video_set_caps(GstBaseTransform* object, GstCaps* incaps, GstCaps* outcaps)
 {
   GstOFTVG_Video *filter = GST_OFTVG_VIDEO(object);
-  (void)outcaps; /* unused */
   
   filter->have_caps = true;
   
-  if (!filter->process->init_caps(incaps))
+  if (!gst_video_info_from_caps(&filter->in_info, incaps) ||
+      !gst_video_info_from_caps(&filter->out_info, outcaps))
+  {
+    GST_ELEMENT_ERROR(filter, STREAM, FORMAT, ("Failed to apply caps"), (NULL));
+    return false;
+  }
+  
+  filter->fps_n = GST_VIDEO_INFO_FPS_N(&filter->in_info);
+  filter->fps_d = GST_VIDEO_INFO_FPS_D(&filter->in_info);
+  
+  if (filter->converter != NULL)
+  {
+    gst_video_converter_free(filter->converter);
+    filter->converter = NULL;
+  }
+  
+  if (!gst_video_info_is_equal(&filter->in_info, &filter->out_info))
+  {
+    GstStructure *config = gst_structure_new_empty("GstVideoConverter");
+    
+#if GST_CHECK_VERSION(1,12,0)
+    gst_structure_set(config, GST_VIDEO_CONVERTER_OPT_THREADS, G_TYPE_UINT,
+                      filter->convert_threads > 0 ? (guint)filter->convert_threads
+                                                  : g_get_num_processors(), NULL);
+#endif
+    
+    GST_DEBUG("Converting %" GST_PTR_FORMAT " to %" GST_PTR_FORMAT, incaps, outcaps);
+    filter->converter = gst_video_converter_new(&filter->in_info, &filter->out_info, config);
+    if (filter->converter == NULL)
+    {
+      GST_ELEMENT_ERROR(filter, STREAM, FORMAT, ("Conversion is not supported"),
+                        ("From %" GST_PTR_FORMAT " to %" GST_PTR_FORMAT, incaps, outcaps));
+      return false;
+    }
+  }
+  
+  /* Without conversion the markers are drawn directly on the input buffer */
+  gst_base_transform_set_in_place(object, filter->converter == NULL);
+  
+  /* The markers are drawn after the conversion, so the layout is
+   * rendered at the output size and format */
+  if (!filter->process->init_caps(outcaps))
   {
     GST_ELEMENT_ERROR(filter, STREAM, FORMAT, ("Failed to apply caps"), (NULL));
     return false;
@@ -328,6 +454,8 @@ static gboolean gst_oftvg_video_set_caps(GstBaseTransform* object, GstCaps* inca
     return false;
   }
   
+  filter->stats->add_layout_time(filter->process->get_layout_time());
+  
   return true;
 }
 
@@ -361,12 +489,176 @@ static gboolean gst_oftvg_video_sink_event(GstBaseTransform *object, GstEvent *e
                            filter->num_buffers, filter->frame_counter), (NULL));
     }
     
+    /* Let the audio know where the stream ended, in case it could not be
+     * known in advance. */
+    if (filter->first)
+    {
+      start_timeline(filter, 0, NULL);
+    }
+    filter->timeline->set_end(filter->timeline->frame_time(filter->total_frames));
     g_signal_emit(filter, gstoftvg_video_signals[SIGNAL_VIDEO_END_OF_STREAM], 0);
+    
+    /* Dump the render statistics */
+    {
+      GstStructure *stats = gst_oftvg_video_get_stats(filter);
+      GST_INFO_OBJECT(filter, "Render statistics: %" GST_PTR_FORMAT, stats);
+      gst_element_post_message(GST_ELEMENT(filter),
+                               gst_message_new_element(GST_OBJECT(filter), stats));
+    }
   }
   
   return GST_BASE_TRANSFORM_CLASS(gst_oftvg_video_parent_class)->sink_event(object, event);
 }
 
+/* Names of the states, as reported in the progress messages */
+static const gchar *state_name(enum state_t state)
+{
+  switch (state)
+  {
+    case STATE_PRECALIBRATION_WHITE: return "precalibration-white";
+    case STATE_PRECALIBRATION_MARKS: return "precalibration-marks";
+    case STATE_VIDEO:                return "video";
+    case STATE_POSTCALIBRATION:      return "postcalibration";
+    case STATE_END:                  return "end";
+  }
+  return "unknown";
+}
+
+static GstStructure *gst_oftvg_video_get_stats(GstOFTVG_Video *filter)
+{
+  static const gchar *segments[OFTVG_Stats::SEGMENTS] = {
+    state_name(STATE_PRECALIBRATION_WHITE), state_name(STATE_PRECALIBRATION_MARKS),
+    state_name(STATE_VIDEO), state_name(STATE_POSTCALIBRATION)
+  };
+  
+  return filter->stats->to_structure(segments);
+}
+
+OFTVG_Timeline *gst_oftvg_video_get_timeline(GstOFTVG_Video *element)
+{
+  return element->timeline;
+}
+
+void gst_oftvg_video_set_timeline(GstOFTVG_Video *element, OFTVG_Timeline *timeline)
+{
+  element->timeline = (timeline != NULL) ? timeline : element->own_timeline;
+}
+
+/* Estimate how many frames are still to be output after the frame ending
+ * at 'time'. Returns -1 if the length of the input video is not known. */
+static gint64 estimate_remaining_frames(GstOFTVG_Video *filter, GstClockTime time)
+{
+  GstClockTime fd = filter->frame_duration;
+  GstClockTime pre_end = (filter->pre_white_duration + filter->pre_marks_duration) * GST_MSECOND;
+  GstClockTime post = filter->post_white_duration * GST_MSECOND;
+  gint64 frames = 0;
+  
+  if (filter->state == STATE_END)
+    return 0;
+  
+  if (!GST_CLOCK_TIME_IS_VALID(fd) || fd == 0)
+    return -1;
+  
+  /* Remaining precalibration */
+  if (filter->state == STATE_PRECALIBRATION_WHITE || filter->state == STATE_PRECALIBRATION_MARKS)
+  {
+    if (pre_end > time)
+      frames += (pre_end - time + fd - 1) / fd;
+  }
+  
+  /* Remaining video */
+  if (filter->state != STATE_POSTCALIBRATION && !filter->only_calibration)
+  {
+    if (filter->num_buffers > 0)
+    {
+      frames += filter->num_buffers - filter->frame_counter;
+    }
+    else if (filter->end_of_video != G_MAXUINT64)
+    {
+      GstClockTime video_start = MAX(time, pre_end);
+      GstClockTime video_end = filter->end_of_video;
+      
+      /* The video is cut short to leave room for postcalibration */
+      if (post > 0)
+        video_end = (video_end > post + GST_SECOND) ? video_end - post - GST_SECOND : 0;
+      
+      if (video_end > video_start)
+        frames += (video_end - video_start + fd - 1) / fd;
+    }
+    else
+    {
+      return -1;
+    }
+  }
+  
+  /* Remaining postcalibration */
+  if (filter->state == STATE_POSTCALIBRATION)
+  {
+    GstClockTime elapsed = time - filter->last_state_change;
+    if (post > elapsed)
+      frames += (post - elapsed + fd - 1) / fd;
+  }
+  else
+  {
+    frames += (post + fd - 1) / fd;
+  }
+  
+  return frames;
+}
+
+/* Post an "oftvg-progress" element message if the progress interval has
+ * passed, or always if 'force' is set (on state changes). */
+static void post_progress(GstOFTVG_Video *filter, GstClockTime time, bool force)
+{
+  gint64 now = g_get_monotonic_time();
+  gint64 since_last = now - filter->progress_wallclock;
+  gint64 since_start = now - filter->start_wallclock;
+  gint64 remaining, total_frames = -1;
+  gdouble fps = 0, average_fps = 0, percent = -1;
+  GstClockTime eta = GST_CLOCK_TIME_NONE;
+  GstStructure *s;
+  
+  if (filter->silent || filter->progress_interval <= 0)
+    return;
+  
+  if (!force && since_last < (gint64)filter->progress_interval * 1000)
+    return;
+  
+  if (since_last > 0)
+    fps = (filter->total_frames - filter->progress_frames) * 1e6 / since_last;
+  
+  if (since_start > 0)
+    average_fps = filter->total_frames * 1e6 / since_start;
+  
+  remaining = estimate_remaining_frames(filter, time);
+  if (remaining >= 0)
+  {
+    total_frames = filter->total_frames + remaining;
+    percent = (total_frames > 0) ? 100.0 * filter->total_frames / total_frames : 100.0;
+    
+    if (average_fps > 0)
+      eta = (GstClockTime)(remaining / average_fps * GST_SECOND);
+  }
+  
+  s = gst_structure_new("oftvg-progress",
+                        "state", G_TYPE_STRING, state_name(filter->state),
+                        "frame", G_TYPE_UINT64, filter->total_frames,
+                        "video-frame", G_TYPE_INT, filter->frame_counter,
+                        "running-time", G_TYPE_UINT64, time,
+                        "fps", G_TYPE_DOUBLE, fps,
+                        "average-fps", G_TYPE_DOUBLE, average_fps,
+                        "eta", G_TYPE_UINT64, eta,
+                        "total-frames", G_TYPE_INT64, total_frames,
+                        "percent", G_TYPE_DOUBLE, percent,
+                        NULL);
+  
+  gst_element_post_message(GST_ELEMENT(filter),
+                           gst_message_new_element(GST_OBJECT(filter), s));
+  
+  filter->progress_wallclock = now;
+  filter->progress_frames = filter->total_frames;
+}
+
 /* Process a single video frame in-place */
 static GstFlowReturn gst_oftvg_video_transform_ip(GstBaseTransform* object, GstBuffer *buf)
 {
@@ -393,90 +685,45 @@ static GstFlowReturn gst_oftvg_video_transform_ip(GstBaseTransform* object, GstB
             "This can cause A/V sync issues with some video formats.\n",
             (float)running_time / GST_SECOND);
   }
+  
+  if (filter->first)
+  {
+    start_timeline(filter, running_time, buf);
+  }
   filter->first = false;
   
-  if (!filter->silent && filter->state == STATE_VIDEO)
+  if (GST_BUFFER_DURATION_IS_VALID(buf))
   {
-    /* Show progress once a second */
-    if (buffer_end_time / GST_SECOND - filter->progress_timestamp / GST_SECOND != 0)
-    {
-      float progress = 0;
-      if (filter->num_buffers > 0)
-      {
-        progress = 100.0f * filter->frame_counter / filter->num_buffers;
-      }
-      else
-      {
-        progress = 100.0f * buffer_end_time / filter->end_of_video;
-      }
-      
-      filter->progress_timestamp = buffer_end_time;
-      g_print("Progress: %4.1f%% (%d seconds) complete\n", progress,
-              (int)((buffer_end_time - filter->last_state_change) / GST_SECOND));
-    }
+    filter->frame_duration = GST_BUFFER_DURATION(buf);
+  }
+  
+  if (filter->start_wallclock == 0)
+  {
+    filter->start_wallclock = g_get_monotonic_time();
+    filter->progress_wallclock = filter->start_wallclock;
   }
   
-  /* State machine for the calibration/video parts */
+  /* The timeline decides the segment of each frame */
+  filter->state = filter->timeline->state_at(filter->total_frames);
+  prev_state = filter->state;
+  
   if (filter->state == STATE_PRECALIBRATION_WHITE)
   {
     filter->process->process_calibration_white(buf);
-    
-    if ((gint64)buffer_end_time >= filter->pre_white_duration * GST_MSECOND)
-    {
-      if (filter->pre_marks_duration > 0)
-      {
-        filter->state = STATE_PRECALIBRATION_MARKS;
-      }
-      else if (!filter->only_calibration)
-      {
-        filter->state = STATE_VIDEO;
-      }
-      else if (filter->post_white_duration > 0)
-      {
-	filter->state = STATE_POSTCALIBRATION;
-      }
-      else
-      {
-        filter->state = STATE_END;
-      } 
-    }
   }
   else if (filter->state == STATE_PRECALIBRATION_MARKS)
   {
     filter->process->process_calibration_marks(buf);
-    
-    if ((gint64)buffer_end_time >= (filter->pre_white_duration + filter->pre_marks_duration) * GST_MSECOND)
-    {
-      if (!filter->only_calibration)
-      {
-        GST_DEBUG("Precalibration is done");
-        filter->state = STATE_VIDEO;
-      }
-      else if(filter->post_white_duration > 0)
-      {
-	GST_DEBUG("Precalibration=only is done");
-        filter->state = STATE_POSTCALIBRATION;
-      }
-      else
-      {
-	GST_DEBUG("Precalibration=only is done");
-        filter->state = STATE_END;
-      }
-    }
   }
   else if (filter->state == STATE_VIDEO)
   {
     OFTVG::FrameFlags flags = OFTVG::FRAMEFLAGS_NONE;
     
     /* Generate lipsync frames at defined intervals */
-    if (filter->lipsync > 0
-        && (filter->lipsync_timestamp == 0
-            || buffer_end_time >= filter->lipsync_timestamp + GST_MSECOND * filter->lipsync)
-       )
+    if (filter->timeline->next_lipsync_frame(filter->total_frames) == (gint64)filter->total_frames)
     {
       GST_DEBUG("Generating lipsync at %" GST_TIME_FORMAT, GST_TIME_ARGS(running_time));
       flags = OFTVG::FRAMEFLAGS_LIPSYNC;
-      filter->lipsync_timestamp = buffer_end_time;
       
       g_signal_emit(filter, gstoftvg_video_signals[SIGNAL_LIPSYNC_GENERATED], 0,
                     running_time, buffer_end_time);
@@ -484,67 +731,197 @@ static GstFlowReturn gst_oftvg_video_transform_ip(GstBaseTransform* object, GstB
     
     filter->process->process_frame(buf, filter->frame_counter, flags);
     filter->frame_counter++;
-    
-    if (filter->num_buffers > 0)
-    {
-      /* Easy case: a fixed number of buffers */
-      if (filter->frame_counter >= filter->num_buffers)
-      {
-        if (filter->post_white_duration > 0)
-        {
-          GST_DEBUG("Given number of frames processed, going into postcalibration");
-          filter->state = STATE_POSTCALIBRATION;
-        }
-        else
-        {
-          GST_DEBUG("Given number of frames processed, video ends");
-          filter->state = STATE_END;
-        }
-      }
-    }
-    else
-    {
-      /* Otherwise try to stop earlier to leave enough time for postcalibration */
-      if (buffer_end_time + (filter->post_white_duration + 1000) * GST_MSECOND >= filter->end_of_video)
-      {
-        if (filter->post_white_duration > 0)
-        {
-          GST_DEBUG("Close to end of video, going into postcalibration");
-          filter->state = STATE_POSTCALIBRATION;
-        }
-      }
-    }
   }
   else if (filter->state == STATE_POSTCALIBRATION)
   {
     filter->process->process_calibration_white(buf);
-    
-    if ((gint64)(buffer_end_time - filter->last_state_change) >= filter->post_white_duration * GST_MSECOND)
-    {
-      filter->state = STATE_END;
-    }
   }
   else if (filter->state == STATE_END)
   {
     GST_DEBUG("End of video");
+    filter->timeline->set_end(filter->timeline->frame_time(filter->total_frames));
     g_signal_emit(filter, gstoftvg_video_signals[SIGNAL_VIDEO_END_OF_STREAM], 0);
     
     /* Note that the current buffer will not be passed forward when we return EOS */
     return GST_FLOW_EOS;
   }
   
+  filter->stats->add_frame(prev_state, filter->process->get_last_timing());
+  filter->total_frames++;
+  filter->state = filter->timeline->state_at(filter->total_frames);
+  
   if (filter->state != prev_state)
   {
     GST_DEBUG("Changing to state %d from state %d", filter->state, prev_state);
     filter->last_state_change = buffer_end_time;
   }
   
-  /* Report the timestamp of the frame that we just processed. */
-  g_signal_emit(filter, gstoftvg_video_signals[SIGNAL_VIDEO_PROCESSED_UPTO], 0, buffer_end_time);
+  post_progress(filter, buffer_end_time, filter->state != prev_state);
+  
+  /* Report the timestamp of the frame that we just processed. Only the
+   * generated audio needs this, when the end of the stream is not known
+   * in advance. */
+  filter->timeline->set_position(buffer_end_time);
+  
+  if (g_signal_has_handler_pending(filter, gstoftvg_video_signals[SIGNAL_VIDEO_PROCESSED_UPTO], 0, TRUE))
+  {
+    g_signal_emit(filter, gstoftvg_video_signals[SIGNAL_VIDEO_PROCESSED_UPTO], 0, buffer_end_time);
+  }
   
   return GST_FLOW_OK;
 }
 
+/* Convert the frame into the output buffer and then draw the markers on
+ * it. The converter works in slices in its own threads, so the frame is
+ * read and written only once; the markers only touch a few lines. */
+static GstFlowReturn gst_oftvg_video_transform(GstBaseTransform *object, GstBuffer *inbuf, GstBuffer *outbuf)
+{
+  GstOFTVG_Video *filter = GST_OFTVG_VIDEO(object);
+  GstVideoFrame in_frame, out_frame;
+  
+  if (filter->converter == NULL)
+  {
+    GST_ELEMENT_ERROR(filter, CORE, NEGOTIATION, (NULL), ("No conversion configured"));
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+  
+  if (!gst_video_frame_map(&in_frame, &filter->in_info, inbuf, GST_MAP_READ))
+  {
+    GST_ERROR("Could not map input buffer");
+    return GST_FLOW_ERROR;
+  }
+  
+  if (!gst_video_frame_map(&out_frame, &filter->out_info, outbuf, GST_MAP_WRITE))
+  {
+    GST_ERROR("Could not map output buffer");
+    gst_video_frame_unmap(&in_frame);
+    return GST_FLOW_ERROR;
+  }
+  
+  gst_video_converter_frame(filter->converter, &in_frame, &out_frame);
+  
+  gst_video_frame_unmap(&out_frame);
+  gst_video_frame_unmap(&in_frame);
+  
+  return gst_oftvg_video_transform_ip(object, outbuf);
+}
 
+/* Caps with the fields that the conversion can change removed */
+static GstCaps *convertible_caps(GstCaps *caps)
+{
+  GstCaps *result = gst_caps_new_empty();
+  guint i;
+  
+  for (i = 0; i < gst_caps_get_size(caps); i++)
+  {
+    GstStructure *s = gst_structure_copy(gst_caps_get_structure(caps, i));
+    gst_structure_remove_fields(s, "format", "width", "height", "pixel-aspect-ratio",
+                                "colorimetry", "chroma-site", NULL);
+    result = gst_caps_merge_structure(result, s);
+  }
+  
+  return result;
+}
 
+/* Without the convert property, the caps pass through unchanged. With it,
+ * any markable format and size is possible on the other side, but the
+ * unchanged caps are preferred so that no conversion is done needlessly. */
+static GstCaps *gst_oftvg_video_transform_caps(GstBaseTransform *object, GstPadDirection direction,
+                                               GstCaps *caps, GstCaps *filter_caps)
+{
+  GstOFTVG_Video *filter = GST_OFTVG_VIDEO(object);
+  GstCaps *result;
+  
+  if (filter->convert)
+  {
+    GstCaps *markable = gst_static_caps_get(&markable_caps);
+    GstCaps *open = convertible_caps(caps);
+    
+    result = gst_caps_intersect(caps, markable);
+    result = gst_caps_merge(result, gst_caps_intersect(open, markable));
+    
+    gst_caps_unref(open);
+    gst_caps_unref(markable);
+  }
+  else
+  {
+    result = gst_caps_ref(caps);
+  }
+  
+  if (filter_caps != NULL)
+  {
+    GstCaps *tmp = gst_caps_intersect_full(filter_caps, result, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref(result);
+    result = tmp;
+  }
+  
+  return result;
+}
 
+/* Set an integer field to the value nearest to the target */
+static void fixate_int(GstStructure *s, const gchar *field, gint target)
+{
+  if (gst_structure_has_field(s, field))
+    gst_structure_fixate_field_nearest_int(s, field, target);
+  else
+    gst_structure_set(s, field, G_TYPE_INT, target, NULL);
+}
+
+/* Keep the format and the size of the input where downstream allows it.
+ * If only one dimension is fixed downstream, the other one follows the
+ * aspect ratio of the input. */
+static GstCaps *gst_oftvg_video_fixate_caps(GstBaseTransform *object, GstPadDirection direction,
+                                            GstCaps *caps, GstCaps *othercaps)
+{
+  GstOFTVG_Video *filter = GST_OFTVG_VIDEO(object);
+  GstStructure *in, *out;
+  const gchar *format;
+  gint in_width = 0, in_height = 0, width, height;
+  
+  if (!filter->convert)
+  {
+    return GST_BASE_TRANSFORM_CLASS(gst_oftvg_video_parent_class)->fixate_caps(
+             object, direction, caps, othercaps);
+  }
+  
+  othercaps = gst_caps_make_writable(gst_caps_truncate(othercaps));
+  in = gst_caps_get_structure(caps, 0);
+  out = gst_caps_get_structure(othercaps, 0);
+  
+  format = gst_structure_get_string(in, "format");
+  if (format != NULL && gst_structure_has_field(out, "format"))
+    gst_structure_fixate_field_string(out, "format", format);
+  
+  gst_structure_get_int(in, "width", &in_width);
+  gst_structure_get_int(in, "height", &in_height);
+  
+  if (in_width > 0 && in_height > 0)
+  {
+    if (gst_structure_get_int(out, "height", &height) && !gst_structure_get_int(out, "width", &width))
+    {
+      fixate_int(out, "width", GST_ROUND_UP_2(gst_util_uint64_scale_int(in_width, height, in_height)));
+    }
+    else
+    {
+      fixate_int(out, "width", in_width);
+      gst_structure_get_int(out, "width", &width);
+      fixate_int(out, "height", GST_ROUND_UP_2(gst_util_uint64_scale_int(in_height, width, in_width)));
+    }
+  }
+  
+  if (gst_structure_has_field(out, "pixel-aspect-ratio"))
+    gst_structure_fixate_field_nearest_fraction(out, "pixel-aspect-ratio", 1, 1);
+  
+  return gst_caps_fixate(othercaps);
+}
+
+static gboolean gst_oftvg_video_get_unit_size(GstBaseTransform *object, GstCaps *caps, gsize *size)
+{
+  GstVideoInfo info;
+  
+  if (!gst_video_info_from_caps(&info, caps))
+    return FALSE;
+  
+  *size = GST_VIDEO_INFO_SIZE(&info);
+  return TRUE;
+}
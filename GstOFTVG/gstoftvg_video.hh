@@ -43,8 +43,31 @@
   PROP_STR(SEQUENCE,    sequence,    "Optional text file with custom color sequence data", "") \
   PROP_INT(NUM_BUFFERS, num_buffers, "Number of frames to include, -1 for all.", -1) \
   PROP_INT(LIPSYNC,     lipsync,     "Interval of lipsync markers in milliseconds.", -1) \
-  PROP_BOOL(SILENT,     silent,      "Suppress progress messages", false)
+  PROP_INT(PROGRESS_INTERVAL, progress_interval, "Interval of oftvg-progress messages in milliseconds, 0 to disable.", 1000) \
+  PROP_BOOL(SILENT,     silent,      "Suppress progress messages", false) \
+  PROP_BOOL(CONVERT,    convert,     "Scale and convert to the format requested downstream, in the same pass as the markers.", false) \
+  PROP_INT(CONVERT_THREADS, convert_threads, "Threads for the conversion, 0 for the number of CPU cores.", 0)
   
+/* Video formats accepted on the sink pad. The source pad will have the
+ * same format as the sink at runtime, or one of these formats if the
+ * convert property is set. */
+#define GSTOFTVG_VIDEO_SINK_CAPS \
+    GST_VIDEO_CAPS_MAKE("AYUV") ";" \
+    GST_VIDEO_CAPS_MAKE("Y444") ";" \
+    GST_VIDEO_CAPS_MAKE("Y42B") ";" \
+    GST_VIDEO_CAPS_MAKE("I420") ";" \
+    GST_VIDEO_CAPS_MAKE("YV12") ";" \
+    GST_VIDEO_CAPS_MAKE("Y41B") ";" \
+    GST_VIDEO_CAPS_MAKE("YUY2") ";" \
+    GST_VIDEO_CAPS_MAKE("YVYU") ";" \
+    GST_VIDEO_CAPS_MAKE("UYVY") ";" \
+    GST_VIDEO_CAPS_MAKE("RGB")  ";" \
+    GST_VIDEO_CAPS_MAKE("RGBx") ";" \
+    GST_VIDEO_CAPS_MAKE("xRGB") ";" \
+    GST_VIDEO_CAPS_MAKE("BGR")  ";" \
+    GST_VIDEO_CAPS_MAKE("BGRx") ";" \
+    GST_VIDEO_CAPS_MAKE("xBGR") ";"
+
 /* Declaration of the GObject subtype */
 G_BEGIN_DECLS
 
@@ -64,8 +87,12 @@ typedef struct _GstOFTVG_VideoClass GstOFTVG_VideoClass;
 
 #ifdef __cplusplus
 class OFTVG_Video_Process;
+class OFTVG_Stats;
+class OFTVG_Timeline;
 #else
 typedef struct OFTVG_Video_Process OFTVG_Video_Process;
+typedef struct OFTVG_Stats OFTVG_Stats;
+typedef struct OFTVG_Timeline OFTVG_Timeline;
 #endif
 
 enum state_t {STATE_PRECALIBRATION_WHITE, STATE_PRECALIBRATION_MARKS,
@@ -89,21 +116,45 @@ struct _GstOFTVG_Video
   /* Is the next buffer the first in the video stream? */
   bool first;
   
+  /* Framerate from the caps, fps_n is 0 for variable framerate */
+  gint fps_n;
+  gint fps_d;
+  
   /* Timestamp of last state change */
   GstClockTime last_state_change;
   
   /* End time of the video, if known */
   GstClockTime end_of_video;
   
-  /* Last time a progress report was printed. */
-  GstClockTime progress_timestamp;
+  /* Count of all frames output so far, including calibration */
+  guint64 total_frames;
+  
+  /* Duration of a single frame, or GST_CLOCK_TIME_NONE if not known */
+  GstClockTime frame_duration;
+  
+  /* Wall clock time (g_get_monotonic_time()) of the first frame and of
+   * the last progress message, and the frame count at that message. */
+  gint64 start_wallclock;
+  gint64 progress_wallclock;
+  guint64 progress_frames;
   
-  /* Last time a lipsync marker was generated. */
-  GstClockTime lipsync_timestamp;
+  /* Converts the input to the output format and size when they differ,
+   * NULL for in-place processing */
+  GstVideoConverter *converter;
+  GstVideoInfo in_info;
+  GstVideoInfo out_info;
   
   /* This is the actual class that does the processing */
   OFTVG_Video_Process* process;
   
+  /* Render-time statistics, readable through the "stats" property */
+  OFTVG_Stats* stats;
+  
+  /* Segments and lipsync frames, shared with the audio element. Points
+   * to own_timeline unless a shared one has been given. */
+  OFTVG_Timeline* timeline;
+  OFTVG_Timeline* own_timeline;
+  
   /* Storage for element properties */
 #define PROP_STR(up,name,desc,def) gchar *name;
 #define PROP_INT(up,name,desc,def) gint name;
@@ -130,6 +181,13 @@ struct _GstOFTVG_VideoClass
 
 GType gst_oftvg_video_get_type (void);
 
+/* Timeline of the element, for placing the lipsync beeps in the audio */
+OFTVG_Timeline *gst_oftvg_video_get_timeline(GstOFTVG_Video *element);
+
+/* Use a timeline shared with other video elements that process the same
+ * input, or NULL for the own timeline. The caller keeps the ownership. */
+void gst_oftvg_video_set_timeline(GstOFTVG_Video *element, OFTVG_Timeline *timeline);
+
 G_END_DECLS
 
 #endif /* __GST_OFTVG_VIDEO_H__ */
@@ -98,6 +98,7 @@ bool OFTVG_Video_Process::init_layout(const gchar* layout_file, bool calibration
 {
   GError* error = NULL;
   gboolean ret = TRUE;
+  timemeasure_t start = begin_timing();
   
   // Load the main layout
   {
@@ -136,6 +137,7 @@ bool OFTVG_Video_Process::init_layout(const gchar* layout_file, bool calibration
     GST_ERROR("Could not open layout file: %s. %s", layout_file, error->message);
   }
   
+  layout_time = end_timing(start);
   return ret;
 }
 
@@ -214,61 +216,63 @@ static guint8 color_array_rgb[20][4] = {
   { 255, 255, 255, 0}  /* White */
 };
 
-// Process a frame with the defined layout and frame index
-void OFTVG_Video_Process::process_with_layout(GstBuffer *buf, GstOFTVGLayout *layout,
-                                              int frame_index, OFTVG::FrameFlags flags)
+// Find the colors of the markers for this frame
+void OFTVG_Video_Process::resolve_colors(GstOFTVGLayout *layout, int frame_index,
+                                         OFTVG::FrameFlags flags)
 {
-  /* Map the buffer data to memory */
-  GstVideoFrame frame = {};
-  if (!gst_video_frame_map(&frame, &in_info, buf, GST_MAP_WRITE))
+  /* Find out the actual color components for this format */
+  guint8 (*color_array)[4] = GST_VIDEO_FORMAT_INFO_IS_YUV(in_format_info) ?
+                             color_array_yuv : color_array_rgb;
+  
+  resolved.clear();
+  
+  for (int i = 0; i < layout->size(); i++)
   {
-    GST_ERROR("Could not map buffer");
-    return;
+    const GstOFTVGElement& element = *layout->at(i);
+    
+    /* Get color of the marker for this frame */
+    OFTVG::MarkColor markcolor = element.getColor(frame_index, flags);
+    
+    if (markcolor == OFTVG::MARKCOLOR_TRANSPARENT)
+      continue;
+    
+    ResolvedElement r = {&element, color_array[markcolor]};
+    resolved.push_back(r);
   }
-  
+}
+
+// Draw the resolved markers in the mapped frame
+void OFTVG_Video_Process::fill_spans(GstVideoFrame *frame)
+{
   /* Compute pointers to color components in the buffer */
-  guint8* const bufY = GST_VIDEO_FRAME_COMP_DATA(&frame, 0);
-  guint8* const bufU = GST_VIDEO_FRAME_COMP_DATA(&frame, 1);
-  guint8* const bufV = GST_VIDEO_FRAME_COMP_DATA(&frame, 2);
+  guint8* const bufY = GST_VIDEO_FRAME_COMP_DATA(frame, 0);
+  guint8* const bufU = GST_VIDEO_FRAME_COMP_DATA(frame, 1);
+  guint8* const bufV = GST_VIDEO_FRAME_COMP_DATA(frame, 2);
   
   /* Length of lines in bytes */
-  int y_stride       = GST_VIDEO_FRAME_COMP_STRIDE(&frame, 0);
-  int uv_stride      = GST_VIDEO_FRAME_COMP_STRIDE(&frame, 1);
+  int y_stride       = GST_VIDEO_FRAME_COMP_STRIDE(frame, 0);
+  int uv_stride      = GST_VIDEO_FRAME_COMP_STRIDE(frame, 1);
   
   /* Increment between pixels in bytes */
-  int yoff           = GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, 0);
-  int uoff           = GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, 1);
-  int voff           = GST_VIDEO_FRAME_COMP_PSTRIDE(&frame, 2);
+  int yoff           = GST_VIDEO_FRAME_COMP_PSTRIDE(frame, 0);
+  int uoff           = GST_VIDEO_FRAME_COMP_PSTRIDE(frame, 1);
+  int voff           = GST_VIDEO_FRAME_COMP_PSTRIDE(frame, 2);
   
   /* Subsampling of color components */
   int h_subs         = gst_oftvg_get_subsampling_h_shift(&in_info, 1, width);
   int v_subs         = gst_oftvg_get_subsampling_v_shift(&in_info, 1, height);
+  
+  guint64 bytes = 0;
 
-  for (int i = 0; i < layout->size(); i++)
+  for (size_t i = 0; i < resolved.size(); i++)
   {
-    const GstOFTVGElement& element = *layout->at(i);
-
-    /* Get color of the marker for this frame */
-    OFTVG::MarkColor markcolor = element.getColor(frame_index, flags);
-    
-    if (markcolor == OFTVG::MARKCOLOR_TRANSPARENT)
-      continue;
+    const GstOFTVGElement& element = *resolved[i].element;
+    const guint8* color = resolved[i].color;
     
     /* Compute the start of the element in Y/U/V buffers */
     guint8* posY = bufY + element.y() * y_stride + element.x() * yoff;
     guint8* posU = bufU + (element.y() >> v_subs) * uv_stride + (element.x() >> h_subs) * uoff;
     guint8* posV = bufV + (element.y() >> v_subs) * uv_stride + (element.x() >> h_subs) * voff;
-
-    /* Find out the actual color components for this format */
-    const guint8* color = NULL;
-    if (GST_VIDEO_FORMAT_INFO_IS_YUV(in_format_info))
-    {
-      color = color_array_yuv[markcolor];
-    }
-    else
-    {
-      color = color_array_rgb[markcolor];
-    }
     
     /* Draw the marker in the frame */
     for (int dx = 0; dx < element.width(); dx++)
@@ -284,7 +288,48 @@ void OFTVG_Video_Process::process_with_layout(GstBuffer *buf, GstOFTVGLayout *la
       posU += uoff;
       posV += voff;
     }
+    
+    bytes += element.width() + 2 * ((element.width() + (1 << h_subs) - 1) >> h_subs);
   }
+  
+  last_bytes_written = bytes;
+}
 
+// Process a frame with the defined layout and frame index
+void OFTVG_Video_Process::process_with_layout(GstBuffer *buf, GstOFTVGLayout *layout,
+                                              int frame_index, OFTVG::FrameFlags flags)
+{
+  timemeasure_t start = begin_timing();
+  timemeasure_t t0, t1;
+  
+  memset(&last_timing, 0, sizeof(last_timing));
+  last_bytes_written = 0;
+  
+  /* Map the buffer data to memory */
+  GstVideoFrame frame = {};
+  t0 = begin_timing();
+  if (!gst_video_frame_map(&frame, &in_info, buf, GST_MAP_WRITE))
+  {
+    GST_ERROR("Could not map buffer");
+    return;
+  }
+  t1 = begin_timing();
+  last_timing.phase[OFTVG::PHASE_MAP] = t1 - t0;
+  
+  t0 = t1;
+  resolve_colors(layout, frame_index, flags);
+  t1 = begin_timing();
+  last_timing.phase[OFTVG::PHASE_RESOLVE] = t1 - t0;
+  
+  t0 = t1;
+  fill_spans(&frame);
+  t1 = begin_timing();
+  last_timing.phase[OFTVG::PHASE_FILL] = t1 - t0;
+  
+  t0 = t1;
   gst_video_frame_unmap(&frame);
+  t1 = begin_timing();
+  last_timing.phase[OFTVG::PHASE_UNMAP] = t1 - t0;
+  
+  last_timing.phase[OFTVG::PHASE_TOTAL] = t1 - start;
 }
@@ -5,6 +5,7 @@
 
 #include <vector>
 #include "gstoftvg_layout.hh"
+#include "gstoftvg_stats.hh"
 #include <gst/gst.h>
 #include <gst/base/gstbasetransform.h>
 #include <gst/video/video.h>
@@ -37,7 +38,34 @@ public:
   // Process a frame with the defined layout and frame index
   void process_with_layout(GstBuffer *buf, GstOFTVGLayout *layout, int frame_index, OFTVG::FrameFlags flags);
   
+  // Phase times of the most recently processed frame
+  inline const OFTVG::FrameTiming& get_last_timing() const { return last_timing; }
+  
+  // Number of bytes written into the most recently processed frame
+  inline guint64 get_last_bytes_written() const { return last_bytes_written; }
+  
+  // Time spent in the last init_layout() call
+  inline timemeasure_t get_layout_time() const { return layout_time; }
+  
 private:
+  // Marker that has a visible color in the current frame
+  struct ResolvedElement
+  {
+    const GstOFTVGElement *element;
+    const guint8 *color;
+  };
+  
+  // Find the colors of the markers for this frame
+  void resolve_colors(GstOFTVGLayout *layout, int frame_index, OFTVG::FrameFlags flags);
+  
+  // Draw the resolved markers in the mapped frame
+  void fill_spans(GstVideoFrame *frame);
+  
+  std::vector<ResolvedElement> resolved;
+  OFTVG::FrameTiming last_timing;
+  guint64 last_bytes_written;
+  timemeasure_t layout_time;
+  
   GstOFTVGLayout layout_calibration_white;
   GstOFTVGLayout layout_calibration_marks;
   GstOFTVGLayout layout_normal;
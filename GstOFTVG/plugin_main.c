@@ -1,7 +1,11 @@
 #include "gstoftvg.hh"
 #include "gstoftvg_video.hh"
 #include "gstoftvg_audio.hh"
+#include "gstoftvg_audiosrc.hh"
 #include "autoaudio_decodebin.hh"
+#include "gstoftvg_filesrc.hh"
+#include "gstoftvg_rawsrc.hh"
+#include "gstoftvg_variants.hh"
 
 GST_DEBUG_CATEGORY(gst_oftvg_debug);
 
@@ -16,7 +20,11 @@ gboolean oftvg_init (GstPlugin* plugin)
   return gst_element_register(plugin, "oftvg", GST_RANK_NONE, GST_TYPE_OFTVG)
       && gst_element_register(plugin, "oftvg_video", GST_RANK_NONE, GST_TYPE_OFTVG_VIDEO)
       && gst_element_register(plugin, "oftvg_audio", GST_RANK_NONE, GST_TYPE_OFTVG_AUDIO)
-      && gst_element_register(plugin, "autoaudio_decodebin", GST_RANK_NONE, GST_TYPE_AUTOAUDIO_DECODEBIN);
+      && gst_element_register(plugin, "oftvg_audiosrc", GST_RANK_NONE, GST_TYPE_OFTVG_AUDIOSRC)
+      && gst_element_register(plugin, "autoaudio_decodebin", GST_RANK_NONE, GST_TYPE_AUTOAUDIO_DECODEBIN)
+      && gst_element_register(plugin, "oftvg_filesrc", GST_RANK_NONE, GST_TYPE_OFTVG_FILESRC)
+      && gst_element_register(plugin, "oftvg_rawsrc", GST_RANK_NONE, GST_TYPE_OFTVG_RAWSRC)
+      && gst_element_register(plugin, "oftvg_variants", GST_RANK_NONE, GST_TYPE_OFTVG_VARIANTS);
 }
 
 #ifndef PACKAGE
@@ -20,88 +20,58 @@
 
 /**
  * Benchmarking the oftvg plugin can be done by using these utility methods.
+ * All times are in nanoseconds from a monotonic clock, so they are not
+ * affected by changes to the system time.
  */
 
 #ifndef _VL_TIMEMEASURE_H_
 #define _VL_TIMEMEASURE_H_
 
 #include <stdio.h>
+#include <glib.h>
 
 #ifdef _WIN32
 #pragma warning(push, 0)
 #include <windows.h>
 #pragma warning(pop)
 #else
-#include <sys/time.h>
+#include <time.h>
 #endif
 
-#ifdef DO_TIMING
-#ifdef _WIN32
-typedef LONGLONG timemeasure_t;
-#else
-typedef struct timeval timemeasure_t;
-#endif
-#else
-typedef int timemeasure_t;
-#endif
+typedef guint64 timemeasure_t;
 
+/// Current time of the monotonic clock in nanoseconds.
 static inline timemeasure_t begin_timing()
 {
-#ifdef DO_TIMING
 #ifdef _WIN32
-    LONGLONG result;
-    QueryPerformanceCounter((PLARGE_INTEGER)&result);
-    return result;
-#else
-    struct timeval result;
-    gettimeofday(&result, NULL);
-    return result;
-#endif
+    static LONGLONG ticks_per_sec = 0;
+    LONGLONG ticks;
+    if (ticks_per_sec == 0)
+    {
+      QueryPerformanceFrequency((PLARGE_INTEGER)&ticks_per_sec);
+    }
+    QueryPerformanceCounter((PLARGE_INTEGER)&ticks);
+    return (timemeasure_t)(ticks / ticks_per_sec) * 1000000000 +
+           (timemeasure_t)(ticks % ticks_per_sec) * 1000000000 / ticks_per_sec;
 #else
-    return 0;
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (timemeasure_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 #endif
 }
 
-static inline double end_timing(timemeasure_t timer, const char *name)
+/// Nanoseconds elapsed since begin_timing() returned 'timer'.
+static inline timemeasure_t end_timing(timemeasure_t timer)
 {
-    double result = 0.0;
-
-    (void)name;
-    (void)timer;
-    
-#ifdef DO_TIMING
-#ifdef _WIN32
-    LONGLONG start = timer;
-    LONGLONG end = begin_timing();
-    LONGLONG ticks_per_sec;
-    QueryPerformanceFrequency((PLARGE_INTEGER)&ticks_per_sec);
-    result = (double)(end - start) / ticks_per_sec;
-#else
-    timemeasure_t end = begin_timing();
-    end.tv_sec -= timer.tv_sec;
-    end.tv_usec -= timer.tv_usec;
-    
-    if (end.tv_usec < 0)
-    {
-        end.tv_usec += 1000000;
-        end.tv_sec -= 1;
-    }
-    
-    result = end.tv_sec + end.tv_usec / 1000000.0;
-#endif
-    
-    // fprintf(stderr, "Timer %15s: %0.6f\n", name, result);
-#endif
-
-    return result;
+    return begin_timing() - timer;
 }
 
 /// Show timing information.
-/// @param result Seconds
-static void show_timing(double result, const char* name)
+/// @param result Nanoseconds
+static inline void show_timing(timemeasure_t result, const char* name)
 {
   g_print("Timer %15s: %0.6f (%0.2f 1/s)\n",
-    name, result, result>0.000001?1.0/result:0.0);
+    name, result / 1e9, result > 1000 ? 1e9 / result : 0.0);
 }
 
 #endif
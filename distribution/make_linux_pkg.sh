@@ -40,6 +40,7 @@ function pick {
 BINFILES="
 gst-*-1.0
 tvg_analyzer
+tvg_generate
 "
 for f in $BINFILES
     do pick bin/$f gstreamer/bin
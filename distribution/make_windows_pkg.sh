@@ -40,6 +40,7 @@ function pick {
 BINFILES="
 gst-*-1.0.exe
 tvg_analyzer.exe
+tvg_generate.exe
 "
 for f in $BINFILES $(cat distribution/dlls_to_include.txt)
     do pick bin/$f gstreamer/bin
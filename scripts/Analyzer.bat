@@ -2,10 +2,11 @@
 
 :: Analyze a generated test video file.
 :: Usage: Analyzer.sh <videofile>
+:: Options for tvg_analyzer can be given in TVG_ANALYZER_OPTIONS.
 
 call %~dp0gstreamer\env.bat
 
-tvg_analyzer "%1"
+tvg_analyzer %TVG_ANALYZER_OPTIONS% "%1"
 
 if not [%2]==[nopause] (
 @echo Done! Press enter to exit.
@@ -2,8 +2,9 @@
 
 # Analyze a generated test video file.
 # Usage: Analyzer.sh <videofile>
+# Options for tvg_analyzer can be given in TVG_ANALYZER_OPTIONS.
 
 SCRIPTDIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
 source "$SCRIPTDIR/gstreamer/env.sh"
 
-tvg_analyzer $1
+tvg_analyzer $TVG_ANALYZER_OPTIONS "$1"
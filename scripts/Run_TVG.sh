@@ -84,15 +84,21 @@ PRE_WHITE_DURATION=4000
 PRE_MARKS_DURATION=1000
 POST_WHITE_DURATION=5000
 
+# Memory available for buffering video frames in megabytes.
+# The queues are sized based on the resolution and frame rate of the video.
+MEMORY_BUDGET=256
+
+# Number of encoder and decoder threads (0 for number of CPU cores)
+ENCODER_THREADS=0
+DECODER_THREADS=0
+
 # You can put just the settings you want to change in a file named something.tvg
 # and open it with Run_TVG.sh as the program.
+CONFIG=
 if [ -e "$1" ]
-then eval $(cat $1 | sed 's/^::/#/' | sed 's/SET \([^=]*\)=\(.*\)/\1="\2"/I')
-     echo Loaded parameters from $1
+then CONFIG="$1"
 fi
 
-echo Starting test video generator..
-
 SCRIPTDIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
 source "$SCRIPTDIR/gstreamer/env.sh"
 
@@ -102,16 +108,16 @@ rm -f $DEBUGDIR/*.dot $DEBUGDIR/*.txt $DEBUGDIR/*.png
 export GST_DEBUG_DUMP_DOT_DIR=$DEBUGDIR
 export GST_DEBUG_FILE=$DEBUGDIR/log.txt
 export GST_DEBUG=*:4
-QUEUE="queue max-size-bytes=100000000 max-size-time=10000000000"
-
-# Actual command that executes gst-launch
-gst-launch-1.0 -q \
-        filesrc location="$INPUT" ! autoaudio_decodebin name=decode $PREPROCESS ! $QUEUE \
-        ! oftvg location="$LAYOUT" num-buffers=$NUM_BUFFERS only_calibration=$ONLY_CALIBRATION \
-        rgb6_calibration=$RGB6_CALIBRATION pre_white_duration=$PRE_WHITE_DURATION pre_marks_duration=$PRE_MARKS_DURATION \
-	post_white_duration=$POST_WHITE_DURATION name=oftvg lipsync=$LIPSYNC \
-        ! queue ! videoconvert ! $COMPRESSION ! $QUEUE ! $CONTAINER name=mux ! filesink location="$OUTPUT" \
-        decode. ! audioconvert ! volume volume=0.5 ! $QUEUE ! oftvg. \
-        oftvg. ! queue ! audioconvert ! $AUDIOCOMPRESSION ! $QUEUE ! mux.
-
-echo Done!
+
+# Actual command that generates the video. Settings from the .tvg file
+# override the ones given above.
+tvg_generate \
+        INPUT="$INPUT" LAYOUT="$LAYOUT" OUTPUT="$OUTPUT" \
+        COMPRESSION="$COMPRESSION" CONTAINER="$CONTAINER" \
+        AUDIOCOMPRESSION="$AUDIOCOMPRESSION" PREPROCESS="$PREPROCESS" \
+        NUM_BUFFERS=$NUM_BUFFERS LIPSYNC=$LIPSYNC \
+        ONLY_CALIBRATION=$ONLY_CALIBRATION RGB6_CALIBRATION=$RGB6_CALIBRATION \
+        PRE_WHITE_DURATION=$PRE_WHITE_DURATION PRE_MARKS_DURATION=$PRE_MARKS_DURATION \
+        POST_WHITE_DURATION=$POST_WHITE_DURATION MEMORY_BUDGET=$MEMORY_BUDGET \
+        ENCODER_THREADS=$ENCODER_THREADS DECODER_THREADS=$DECODER_THREADS \
+        $CONFIG
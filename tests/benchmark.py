@@ -0,0 +1,161 @@
+'''Throughput benchmark for the test video generator.
+
+Runs tvg_generate on a synthetic input (videotestsrc and audiotestsrc)
+with the output discarded, so the numbers only depend on the decoding-free
+part of the pipeline: the oftvg element and the queues around it. Each
+case reports frames per second, the average processing time of the timed
+elements and the peak memory use.
+
+The results are compared to a stored baseline, and the script fails if
+the frame rate drops or the memory use grows more than the tolerance.
+The baseline depends on the machine, so it is not in the repository:
+the first run stores the results of the cases that have no baseline yet.
+Run with --update-baseline (or make benchmark-baseline) to replace the
+baseline with the current results.
+'''
+
+import json
+import subprocess
+import optparse
+import os.path
+import os
+import sys
+
+# Benchmark cases: name, resolution, framerate and the generator settings
+CASES = [
+  ('720p30',              '1280x720@30',  {}),
+  ('1080p30',             '1920x1080@30', {}),
+  ('1080p60',             '1920x1080@60', {}),
+  ('2160p30',             '3840x2160@30', {}),
+  ('1080p30-lipsync',     '1920x1080@30', {'LIPSYNC': '1000'}),
+  ('1080p30-nocal',       '1920x1080@30', {'PRE_WHITE_DURATION': '0',
+                                           'PRE_MARKS_DURATION': '0',
+                                           'POST_WHITE_DURATION': '0'}),
+  ('1080p30-longcal',     '1920x1080@30', {'PRE_WHITE_DURATION': '10000',
+                                           'PRE_MARKS_DURATION': '5000',
+                                           'POST_WHITE_DURATION': '10000'}),
+  ('1080p30-rgb6',        '1920x1080@30', {'RGB6_CALIBRATION': 'true'}),
+  ('2160p30-scale',       '3840x2160@30', {'OUTPUT_CAPS': 'video/x-raw,format=NV12,width=1920,height=1080'}),
+  ('2160p30-fused',       '3840x2160@30', {'OUTPUT_CAPS': 'video/x-raw,format=NV12,width=1920,height=1080',
+                                           'FUSED_CONVERT': 'true'}),
+]
+
+def run_case(options, name, size, params):
+  stats_file = 'benchmark_%s.json' % name
+
+  settings = {
+    'INPUT':             'testsrc:' + size,
+    'OUTPUT':            'null',
+    'LAYOUT':            options.layout,
+    'NUM_BUFFERS':       str(options.frames),
+    'PROGRESS_INTERVAL': '0',
+    'STATS_FILE':        stats_file,
+  }
+  settings.update(params)
+
+  if os.path.isfile(stats_file):
+    os.remove(stats_file)
+
+  cmd = [options.tvg_generate] + ['%s=%s' % kv for kv in sorted(settings.items())]
+  print "Running " + name + ": " + " ".join(cmd)
+  subprocess.check_call(cmd, stdout = open(os.devnull, 'w'))
+
+  result = json.load(open(stats_file))
+  os.remove(stats_file)
+  return result
+
+def summarize(result):
+  '''Pick the values that are compared against the baseline.'''
+  summary = {
+    'fps':         result['fps'],
+    'peak_memory': result['peak-memory'],
+    'elements':    result.get('elements', {}),
+  }
+
+  oftvg = result.get('oftvg', {})
+  if 'video' in oftvg:
+    summary['render_p50'] = oftvg['video']['total-p50']
+    summary['render_p99'] = oftvg['video']['total-p99']
+
+  return summary
+
+def compare(name, current, baseline, tolerance):
+  '''Returns a list of regressions compared to the baseline.'''
+  errors = []
+
+  if current['fps'] < baseline['fps'] * (1.0 - tolerance):
+    errors.append("%s: %.1f fps, baseline %.1f fps" %
+                  (name, current['fps'], baseline['fps']))
+
+  if current['peak_memory'] > baseline['peak_memory'] * (1.0 + tolerance):
+    errors.append("%s: peak memory %.1f MB, baseline %.1f MB" %
+                  (name, current['peak_memory'] / 1048576.0,
+                   baseline['peak_memory'] / 1048576.0))
+
+  return errors
+
+def main():
+  parser = optparse.OptionParser(usage = "%prog [options] path/to/tvg_generate")
+  parser.add_option("--layout", default = "layout.bmp",
+                    help = "layout bitmap [%default]")
+  parser.add_option("--frames", type = "int", default = 600,
+                    help = "video frames per case [%default]")
+  parser.add_option("--baseline", default = os.path.join(os.path.dirname(__file__),
+                                                         "benchmark_baseline.json"),
+                    help = "baseline results [%default]")
+  parser.add_option("--tolerance", type = "float", default = 0.15,
+                    help = "allowed relative regression [%default]")
+  parser.add_option("--cases", default = None,
+                    help = "comma-separated list of cases to run")
+  parser.add_option("--update-baseline", action = "store_true", default = False,
+                    help = "store the results as the new baseline")
+  (options, args) = parser.parse_args()
+
+  if len(args) != 1:
+    parser.print_usage()
+    sys.exit(1)
+  options.tvg_generate = args[0]
+
+  baseline = {}
+  if os.path.isfile(options.baseline):
+    baseline = json.load(open(options.baseline))
+
+  results = {}
+  recorded = []
+  errors = []
+  for name, size, params in CASES:
+    if options.cases and name not in options.cases.split(','):
+      continue
+
+    results[name] = summarize(run_case(options, name, size, params))
+    r = results[name]
+    print "   %.1f fps, peak memory %.1f MB, %s" % (
+      r['fps'], r['peak_memory'] / 1048576.0,
+      ", ".join("%s %.2f ms" % (k, v / 1e6) for k, v in sorted(r['elements'].items())))
+
+    if options.update_baseline:
+      recorded.append(name)
+    elif name in baseline:
+      errors += compare(name, r, baseline[name], options.tolerance)
+    else:
+      print "   no baseline, storing these results"
+      recorded.append(name)
+
+  print "==============="
+  if recorded:
+    for name in recorded:
+      baseline[name] = results[name]
+    json.dump(baseline, open(options.baseline, 'w'), indent = 2, sort_keys = True)
+    print "Baseline of " + ", ".join(recorded) + " written to " + options.baseline
+
+  if errors:
+    print "Performance regressions:"
+    for e in errors:
+      print "   " + e
+    sys.exit(1)
+  else:
+    print "All benchmarks ok"
+    sys.exit(0)
+
+if __name__ == '__main__':
+  main()
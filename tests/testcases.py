@@ -96,3 +96,324 @@ class TestLipsync(TestCase):
     self.assert_range(r['lipsync']['audio_delay_min_ms'], -1.0, 1.0)
     self.assert_range(r['lipsync']['audio_delay_max_ms'], -1.0, 1.0)
     self.assert_equals(r['warnings'], [])
+
+class TestCodedLipsync(TestCase):
+  def run(self, tr):
+    params = {
+      'COMPRESSION':       'x264enc speed-preset=2',
+      'CONTAINER':         'qtmux',
+      'AUDIOCOMPRESSION':  'identity',
+      'NUM_BUFFERS':       '240',
+      'LIPSYNC':           '2000',
+      'CODED_LIPSYNC':     'true',
+      'PRE_WHITE_DURATION':'5000',
+      'PRE_MARKS_DURATION':'0',
+      'POST_WHITE_DURATION':'5000',
+      'OUTPUT':            'output.mov',
+      'PREPROCESS':        '! videoscale ! video/x-raw,width=640,height=480',
+      'LAYOUT':            os.path.join(tr.tvg_path, "layout_fpsonly.bmp")
+    }
+    
+    r = tr.run_test(params)
+    
+    self.assert_equals(r['video_structure']['content_frames'], 240)
+    self.assert_equals(r['lipsync']['audio_markers'], 5)
+    self.assert_equals(r['lipsync']['coded_markers'], 5)
+    self.assert_equals(r['lipsync']['video_markers'], 5)
+    self.assert_equals(r['lipsync']['matched_markers'], 5)
+    self.assert_range(r['lipsync']['audio_delay_min_ms'], -1.0, 1.0)
+    self.assert_range(r['lipsync']['audio_delay_max_ms'], -1.0, 1.0)
+    self.assert_equals(r['warnings'], [])
+
+class TestSameCaps(TestCase):
+  '''oftvg with the same caps on both sides, with and without the
+  conversion enabled, marks the frames in place.'''
+  def run(self, tr):
+    for fused in ['false', 'true']:
+      params = {
+        'COMPRESSION':       'jpegenc',
+        'CONTAINER':         'avimux',
+        'AUDIOCOMPRESSION':  'identity',
+        'NUM_BUFFERS':       '64',
+        'LIPSYNC':           '-1',
+        'FUSED_CONVERT':     fused,
+        'PRE_WHITE_DURATION':'5000',
+        'PRE_MARKS_DURATION':'0',
+        'POST_WHITE_DURATION':'0',
+        'OUTPUT':            'output.avi'
+      }
+      
+      r = tr.run_test(params)
+      
+      self.assert_equals(r['resolution'],      [1920, 1080])
+      self.assert_equals(r['markers_found'],   27)
+      self.assert_equals(r['video_structure']['content_frames'], 64)
+      self.assert_equals(r['warnings'], [])
+
+class TestSegmentWorkers(TestCase):
+  '''The parallel second pass gives the same results as a sequential one.
+  The video is long enough to be split into several segments.'''
+  def run(self, tr):
+    params = {
+      'COMPRESSION':       'x264enc speed-preset=2',
+      'CONTAINER':         'qtmux',
+      'AUDIOCOMPRESSION':  'identity',
+      'NUM_BUFFERS':       '600',
+      'LIPSYNC':           '2000',
+      'CODED_LIPSYNC':     'true',
+      'PRE_WHITE_DURATION':'5000',
+      'PRE_MARKS_DURATION':'0',
+      'POST_WHITE_DURATION':'5000',
+      'OUTPUT':            'output.mov',
+      'PREPROCESS':        '! videoscale ! video/x-raw,width=640,height=480'
+    }
+    
+    tr.run_test(params)
+    
+    r1 = tr.analyze(params['OUTPUT'], ['--segment-workers=1'])
+    frames1 = open('frames.txt').read()
+    r2 = tr.analyze(params['OUTPUT'], ['--segment-workers=2'])
+    frames2 = open('frames.txt').read()
+    
+    self.assert_range(r1['video_length'], 20.0, 1000.0)
+    self.assert_equals(r1['lipsync']['matched_markers'], r1['lipsync']['audio_markers'])
+    self.assert_equals(r2, r1)
+    self.assert_equals(frames2 == frames1, True)
+    
+    # More workers than there are segments
+    r3 = tr.analyze(params['OUTPUT'], ['--segment-workers=64'])
+    self.assert_equals(r3, r1)
+    self.assert_equals(open('frames.txt').read() == frames1, True)
+
+class TestLayoutKernels(TestCase):
+  '''The SIMD layout kernels give the same results as the scalar kernel.
+  A kernel that the CPU does not support falls back to the next one.'''
+  def run(self, tr):
+    params = {
+      'COMPRESSION':       'jpegenc',
+      'CONTAINER':         'avimux',
+      'AUDIOCOMPRESSION':  'identity',
+      'NUM_BUFFERS':       '256',
+      'LIPSYNC':           '2000',
+      'PRE_WHITE_DURATION':'5000',
+      'PRE_MARKS_DURATION':'0',
+      'POST_WHITE_DURATION':'0',
+      'OUTPUT':            'output.avi'
+    }
+    
+    tr.run_test(params)
+    
+    results = []
+    for kernel in ['scalar', 'sse2', 'avx2']:
+      r = tr.analyze(params['OUTPUT'], env = {'TVG_LAYOUT_KERNEL': kernel})
+      results.append((r, open('frames.txt').read()))
+    
+    self.assert_equals(results[0][0]['markers_found'], 27)
+    for r, frames in results[1:]:
+      self.assert_equals(r, results[0][0])
+      self.assert_equals(frames == results[0][1], True)
+
+class TestLayoutThreads(TestCase):
+  '''Layout detection in row bands gives the same results with any
+  number of threads.'''
+  def run(self, tr):
+    params = {
+      'COMPRESSION':       'jpegenc',
+      'CONTAINER':         'avimux',
+      'AUDIOCOMPRESSION':  'identity',
+      'NUM_BUFFERS':       '256',
+      'LIPSYNC':           '2000',
+      'PRE_WHITE_DURATION':'5000',
+      'PRE_MARKS_DURATION':'0',
+      'POST_WHITE_DURATION':'0',
+      'OUTPUT':            'output.avi'
+    }
+    
+    tr.run_test(params)
+    
+    r1 = tr.analyze(params['OUTPUT'], ['--threads=1'])
+    frames1 = open('frames.txt').read()
+    
+    for threads in ['3', '0']:
+      r = tr.analyze(params['OUTPUT'], ['--threads=' + threads])
+      self.assert_equals(r, r1)
+      self.assert_equals(open('frames.txt').read() == frames1, True)
+
+class TestSinglePass(TestCase):
+  '''The single pass mode gives the same results as two passes. Only the
+  color of the frames before the layout converged is left out.'''
+  def run(self, tr):
+    params = {
+      'COMPRESSION':       'jpegenc',
+      'CONTAINER':         'avimux',
+      'AUDIOCOMPRESSION':  'identity',
+      'NUM_BUFFERS':       '256',
+      'LIPSYNC':           '2000',
+      'PRE_WHITE_DURATION':'5000',
+      'PRE_MARKS_DURATION':'0',
+      'POST_WHITE_DURATION':'0',
+      'OUTPUT':            'output.avi'
+    }
+    
+    tr.run_test(params)
+    
+    r1 = tr.analyze(params['OUTPUT'])
+    frames1 = open('frames.txt').read().splitlines()
+    r2 = tr.analyze(params['OUTPUT'], ['--single-pass'])
+    frames2 = open('frames.txt').read().splitlines()
+    
+    for key in ['total_frames', 'markers', 'video_structure', 'lipsync', 'warnings']:
+      self.assert_equals(r2[key], r1[key])
+    
+    self.assert_equals(len(frames2), len(frames1))
+    for line1, line2 in zip(frames1, frames2):
+      if line2.endswith(' #------'):
+        line1 = line1[:-len('#------')] + '#------'
+      self.assert_equals(line2, line1)
+
+class TestY4MInput(TestCase):
+  '''Y4M input is read by oftvg_rawsrc without a decoder. The mixed file
+  has interlacing parameters in its frame headers.'''
+  def run(self, tr):
+    width, height, frames = 640, 480, 96
+    
+    for interlace in ['p', 'm']:
+      f = open('input.y4m', 'wb')
+      f.write('YUV4MPEG2 W%d H%d F24:1 I%s A1:1 C420jpeg\n' % (width, height, interlace))
+      for i in range(frames):
+        if interlace == 'm':
+          f.write(['FRAME Itii\n', 'FRAME I1pp\n'][i % 2])
+        else:
+          f.write('FRAME\n')
+        f.write(chr(16 + i % 200) * (width * height))
+        f.write(chr(128) * (width * height / 2))
+      f.close()
+      
+      params = {
+        'INPUT':             'input.y4m',
+        'COMPRESSION':       'jpegenc',
+        'CONTAINER':         'avimux',
+        'AUDIOCOMPRESSION':  'identity',
+        'NUM_BUFFERS':       '-1',
+        'LIPSYNC':           '-1',
+        'PRE_WHITE_DURATION':'5000',
+        'PRE_MARKS_DURATION':'0',
+        'POST_WHITE_DURATION':'0',
+        'OUTPUT':            'output.avi',
+        'LAYOUT':            os.path.join(tr.tvg_path, "layout_fpsonly.bmp")
+      }
+      
+      r = tr.run_test(params)
+      
+      self.assert_equals(r['resolution'],      [width, height])
+      self.assert_equals(r['framerate'],       24.0)
+      self.assert_equals(r['markers_found'],   1)
+      self.assert_equals(r['video_structure']['content_frames'], frames)
+      self.assert_equals(r['warnings'], [])
+
+class TestAudioTrack(TestCase):
+  '''The second audio track of the input is used, with the unused tracks
+  dropped by pad or by decodebin3. The first track is a loud tone that
+  would hide the lipsync beeps.'''
+  def run(self, tr):
+    tr.run_pipeline([
+      'videotestsrc', 'num-buffers=240', '!',
+      'video/x-raw,width=640,height=480,framerate=24/1', '!', 'jpegenc', '!',
+      'matroskamux', 'name=m', '!', 'filesink', 'location=multitrack.mkv',
+      'audiotestsrc', 'num-buffers=100', 'samplesperbuffer=4800', 'volume=0.8', '!',
+      'audio/x-raw,rate=48000,channels=2', '!', 'm.',
+      'audiotestsrc', 'num-buffers=100', 'samplesperbuffer=4800', 'wave=silence', '!',
+      'audio/x-raw,rate=48000,channels=2', '!', 'm.'
+    ])
+    
+    for decodebin3 in ['false', 'true']:
+      params = {
+        'INPUT':             'multitrack.mkv',
+        'AUDIO_TRACK':       '1',
+        'USE_DECODEBIN3':    decodebin3,
+        'COMPRESSION':       'jpegenc',
+        'CONTAINER':         'avimux',
+        'AUDIOCOMPRESSION':  'identity',
+        'NUM_BUFFERS':       '-1',
+        'LIPSYNC':           '2000',
+        'PRE_WHITE_DURATION':'5000',
+        'PRE_MARKS_DURATION':'0',
+        'POST_WHITE_DURATION':'5000',
+        'OUTPUT':            'output.avi',
+        'LAYOUT':            os.path.join(tr.tvg_path, "layout_fpsonly.bmp")
+      }
+      
+      r = tr.run_test(params)
+      
+      self.assert_equals(r['video_structure']['content_frames'], 240)
+      self.assert_equals(r['lipsync']['audio_markers'], 5)
+      self.assert_equals(r['lipsync']['matched_markers'], 5)
+      self.assert_range(r['lipsync']['audio_delay_min_ms'], -1.0, 1.0)
+      self.assert_range(r['lipsync']['audio_delay_max_ms'], -1.0, 1.0)
+      self.assert_equals(r['warnings'], [])
+
+class TestInputReadahead(TestCase):
+  '''The input file is read through oftvg_filesrc with read-ahead, and
+  with a small budget that wraps the block slots several times.'''
+  def run(self, tr):
+    for readahead in ['32', '1']:
+      params = {
+        'COMPRESSION':       'jpegenc',
+        'CONTAINER':         'avimux',
+        'AUDIOCOMPRESSION':  'identity',
+        'NUM_BUFFERS':       '120',
+        'LIPSYNC':           '-1',
+        'INPUT_READAHEAD':   readahead,
+        'PRE_WHITE_DURATION':'5000',
+        'PRE_MARKS_DURATION':'0',
+        'POST_WHITE_DURATION':'0',
+        'OUTPUT':            'output.avi'
+      }
+      
+      r = tr.run_test(params)
+      
+      self.assert_equals(r['resolution'],      [1920, 1080])
+      self.assert_equals(r['markers_found'],   27)
+      self.assert_equals(r['video_structure']['content_frames'], 120)
+      self.assert_equals(r['warnings'], [])
+
+class TestVariants(TestCase):
+  '''oftvg_variants renders the same timeline in every variant, so the
+  markers and beeps are on the same frames at any resolution.'''
+  def run(self, tr):
+    layout = os.path.join(tr.tvg_path, "layout_fpsonly.bmp")
+    outputs = ['variant0.avi', 'variant1.avi']
+    
+    pipeline = [
+      'filesrc', 'location="%s"' % tr.video_in, '!', 'decodebin', 'name=d',
+      'oftvg_variants', 'name=v', 'variants="%s@640x480;%s@800x600"' % (layout, layout),
+      'num-buffers=240', 'lipsync=2000', 'coded-beeps=true', 'pre-white-duration=5000',
+      'pre-marks-duration=0', 'post-white-duration=5000',
+      'd.', '!', 'queue', '!', 'videoconvert', '!', 'v.sink',
+      'd.', '!', 'queue', '!', 'audioconvert', '!', 'audioresample', '!', 'v.asink'
+    ]
+    for i, output in enumerate(outputs):
+      if os.path.isfile(output):
+        os.remove(output)
+      pipeline += [
+        'v.src_%d' % i, '!', 'queue', '!', 'videoconvert', '!', 'jpegenc', '!',
+        'avimux', 'name=m%d' % i, '!', 'filesink', 'location=' + output,
+        'v.asrc_%d' % i, '!', 'queue', '!', 'audioconvert', '!', 'm%d.' % i
+      ]
+    
+    tr.run_pipeline(pipeline)
+    
+    times = []
+    for output, resolution in zip(outputs, [[640, 480], [800, 600]]):
+      r = tr.analyze(output)
+      self.assert_equals(r['resolution'], resolution)
+      self.assert_equals(r['video_structure']['content_frames'], 240)
+      self.assert_equals(r['lipsync']['audio_markers'], 5)
+      self.assert_equals(r['lipsync']['coded_markers'], 5)
+      self.assert_equals(r['lipsync']['matched_markers'], 5)
+      self.assert_equals(r['warnings'], [])
+      
+      # Frame times with their marker codes, and beep start times
+      times.append([line.split()[:3] for line in open('frames.txt')])
+    
+    self.assert_equals(times[1] == times[0], True)
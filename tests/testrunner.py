@@ -46,11 +46,38 @@ class TestRunner:
     print "Running command: " + self.run_tvg + " " + config
     subprocess.check_call([self.run_tvg, config, 'nopause'])
     
+    return self.analyze(params['OUTPUT'])
+  
+  def run_pipeline(self, pipeline):
+    '''Run gst-launch-1.0 in the GStreamer environment of the scripts.
+    pipeline is a list of gst-launch arguments.'''
+    env_sh = os.path.join(self.tvg_path, "gstreamer", "env.sh")
+    if os.path.isfile(env_sh):
+      command = ['bash', '-c', 'source "$0" && exec gst-launch-1.0 "$@"', env_sh]
+    else:
+      command = ['cmd', '/c', 'call', os.path.join(self.tvg_path, "gstreamer", "env.bat"),
+                 '&&', 'gst-launch-1.0']
+    
+    print
+    print "===================="
+    print "Running pipeline"
+    print "Running command: gst-launch-1.0 " + ' '.join(pipeline)
+    subprocess.check_call(command + ['-q'] + pipeline)
+  
+  def analyze(self, filename, options = [], env = {}):
+    '''Run the analyzer on filename. options are passed to tvg_analyzer
+    and env is added to its environment. The frame details are left in
+    frames.txt.'''
+    run_env = dict(os.environ)
+    run_env.update(env)
+    run_env['TVG_ANALYZER_OPTIONS'] = ' '.join(options)
+    
     print
     print "===================="
     print "Analyzing result file"
-    print "Running command: " + self.analyzer + " " + params['OUTPUT'] + " > analyzer_output.txt"
-    data = subprocess.check_output([self.analyzer, params['OUTPUT'], 'nopause'])
+    print "Running command: " + ' '.join(['%s=%s' % kv for kv in env.items()] +
+                                         [self.analyzer] + options + [filename]) + " > analyzer_output.txt"
+    data = subprocess.check_output([self.analyzer, filename, 'nopause'], env = run_env)
     open('analyzer_output.txt', 'w').write(data)
     
     return json.loads(data)